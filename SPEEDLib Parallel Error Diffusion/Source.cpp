@@ -1,112 +1,55 @@
-//#include "../dependencies/HalftoningSection.cpp"
+// Scratch driver for the band scaler: scales a small 8-bit ramp with each filter and prints the result
+// The scaler itself is dependencies/Resampler.cpp, the same code HalftoneRasterRow() runs
+#include <algorithm>
 #include <iostream>
+#include <string.h>
+#include <vector>
 using namespace std;
 
-//UINT8 nInputImageBuff;
+#include "../dependencies/Resampler.cpp"
 
+int HalftoneImageBand(UINT32 inPixWidth, UINT32 inPixHeight, const UINT8* inImageBuffer, UINT32 outPixWidth,
+	UINT32 outPixHeight, float* outImageBuffer, UINT8 nFilter) {
 
-int HalftoneImageBand(int inPixWidth, int inPixHeight, int*** inImageBuffer, int outPixWidth,int outPixHeight, int*** outImageBuffer,int inChan,int outChan,int bpc) {
+	vector<INT32> nColumnFirst(outPixWidth), nRowFirst(outPixHeight);
+	vector<float> dColumnWeight((size_t)_ResampleTaps(nFilter, inPixWidth, outPixWidth) * outPixWidth);
+	vector<float> dRowWeight((size_t)_ResampleTaps(nFilter, inPixHeight, outPixHeight) * outPixHeight);
+	vector<float> dColumns(inPixWidth);
+	ResamplePlan ColumnPlan, RowPlan;
+	ResampleSource Source;
 
-	//Loop through outImageBuffer, from row 0 - outPixHeight, column 0 to outPixWidth
+	ColumnPlan.pFirst = nColumnFirst.data();
+	ColumnPlan.pWeight = dColumnWeight.data();
+	RowPlan.pFirst = nRowFirst.data();
+	RowPlan.pWeight = dRowWeight.data();
+	_BuildResamplePlan(&ColumnPlan, nFilter, inPixWidth, outPixWidth, 0, outPixWidth, 0, inPixWidth);
+	_BuildResamplePlan(&RowPlan, nFilter, inPixHeight, outPixHeight, 0, outPixHeight, 0, inPixHeight);
 
-	// locate the four closest pixels that form a square surrounding
+	Source.pSamples = inImageBuffer;										// One channel, 8-bit, read as 0 - 255
+	Source.nRowPitch = inPixWidth;
 
-	/*
-	int height = inPixWidth;
-	int width = inPixWidth;
-
-	int scale_x = round(outPixWidth/ inPixWidth);
-	int scale_y = round(outPixHeight/ inPixWidth);
-
-
-	int** new_image = new int* [outPixHeight];		// Create array of zeros
-
-	for (int i = 0; i < outPixHeight; i++) {		// Fill array with 0s
-		
-		new_image[i] = new int[outPixWidth];
-
-		for (int j = 0; j < outPixWidth; j++) {
-			new_image[i][j]=0;
-
-		}
-
-	}
-
-
-
-	int** old_image = new int* [outPixHeight];		// Create array of zeros
-
-	for (int i = 0; i < outPixHeight; i++) {		// Fill array with 0s
-
-		new_image[i] = new int[outPixWidth];
-
-		for (int j = 0; j < outPixWidth; j++) {
-			new_image[i][j] = 1;
-
-		}
-
-	}
-
-	*/
-
-	for (int chan = 0; chan < 3; chan++) {
-
-
-
-		for (int row = 0; row < outPixHeight; row++) {
-
-
-			for (int col = 0; col < outPixWidth; col++) {
-
-				int x1 = floor((row / outPixWidth) * inPixWidth);
-				int y1 = floor((col / outPixHeight) * inPixHeight);
-
-				int x2 = x1 + 1;
-				int y2 = y1 + 1;
-
-
-				int x_diff = x1 - x2;
-				int y_diff = y1 - y2;
-
-				int a = inImageBuffer[y2][x2][chan];
-				int b = inImageBuffer[y2][x2 + 1][chan];
-				int c = inImageBuffer[y2 + 1][x2][chan];
-				int d = inImageBuffer[y2+1][x2+1][chan];
-
-
-				int pixel = a * (1 - x_diff) * (1 - y_diff) + b * (x_diff) * \
-					(1 - y_diff) + c * (1 - x_diff) * (y_diff)+d * x_diff * y_diff;
+	for (UINT32 row = 0; row < outPixHeight; row++)
+		_ResampleRow(&Source, &RowPlan, &ColumnPlan, row, inPixWidth, 255.F, dColumns.data(), outImageBuffer + (size_t)row * outPixWidth);
+	return 0;
+}
 
+int main() {
+	const UINT32 inSize = 5, outSize = 8;
+	UINT8 inImage[inSize * inSize];
+	float outImage[outSize * outSize];
 
+	for (UINT32 i = 0; i < inSize * inSize; i++)
+		inImage[i] = (UINT8)(((i % inSize) + (i / inSize)) * 255 / (2 * (inSize - 1)));
 
-				outImageBuffer[row][col][chan] = pixel;
+	for (UINT8 nFilter = RESAMPLE_BOX; nFilter <= RESAMPLE_LANCZOS3; nFilter++) {
+		HalftoneImageBand(inSize, inSize, inImage, outSize, outSize, outImage, nFilter);
+		cout << "Filter " << (int)nFilter << endl;
 
-			}
+		for (UINT32 row = 0; row < outSize; row++) {
+			for (UINT32 col = 0; col < outSize; col++)
+				cout << (int)(outImage[row * outSize + col] + 0.5F) << "\t";
 			cout << endl;
 		}
 	}
-
-
-
-
-
-	for (int i = 0; i < outPixHeight; i++) {
-		for (int j = 0; j < outPixWidth; j++) {
-
-			cout << new_image[i][j];
-
-
-		}
-		cout << endl;
-	}
-
 	return 0;
-
 }
-
-int main() {
-	HalftoneImageBand(5, 5, 5, 5, 5, 5, 5, 5, 5 );
-
-}
-
-
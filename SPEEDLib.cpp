@@ -1,91 +1,103 @@
-#define INT8 signed __int8
-#define INT16 signed __int16
-#define INT32 signed __int32
-#define UINT8 unsigned __int8
-#define UINT16 unsigned __int16
-#define UINT32 unsigned __int32
-
-#include "TIFF_Stuff.h"
-#include "HalftoningSection.h"
-#include <omp.h>
-#include <iostream>
-#include <string.h>
-//#include <stdio.h>
-using namespace std;
-
-int main(int argc, const char* argv[])
-{
-	TIFFHeader MyTIFFHeader;
-	EDParams MyEDParams;
-	//int maxThreads = omp_get_max_threads();
-	int maxCores = 0;
-	int pageScalingPer = 0;
-
-	for (int i = 0; i < argc; i++) {
-		if (string(argv[i]).substr(0,2) == "-v") {				// updates Verbose mode
-			MyTIFFHeader.bVerbose = true;
-		}
-		else if (string(argv[i]).substr(0, 2) == "-x") {		// check constraints and change Horizontal Resolution
-			int temp = stoi(string(argv[i]).substr(2));
-			if (temp <= 50) {
-				MyTIFFHeader.nHorizontalDPI = 50;
-			}
-			else if (temp >= 3200) {
-				MyTIFFHeader.nHorizontalDPI = 3200;
-			}
-			else {
-				MyTIFFHeader.nHorizontalDPI = temp;
-			}
-		}
-		else if (string(argv[i]).substr(0, 2) == "-y") {		// check constraints and change Vertical Resolution
-			int temp = stoi(string(argv[i]).substr(2));
-			if (temp <= 50) {
-				MyTIFFHeader.nVerticalDPI = 50;
-			}
-			else if (temp >= 3200) {
-				MyTIFFHeader.nVerticalDPI = 3200;
-			}
-			else {
-				MyTIFFHeader.nVerticalDPI = temp;
-			}
-		}
-		else if (string(argv[i]).substr(0, 2) == "-s") {		// check constraints and change Page Scaling Percentage
-			int temp = stoi(string(argv[i]).substr(2));
-			if (temp <= 25) {
-				pageScalingPer = 25;
-			}
-			else if (temp >= 400) {								// *NOT SURE WHAT UNIFORM PAGE SCALING PERCENTAGE ATTRIBUTES TO*
-				pageScalingPer = 400;							// *CHANGE LATER*
-			}
-			else {
-				pageScalingPer = temp;
-			}
-		}
-		else if (string(argv[i]).substr(0, 2) == "-p") {		// check constraints and change Max Cores
-			int temp = stoi(string(argv[i]).substr(2));
-			if (temp <= 1) {
-				maxCores = 1;
-			}
-			else if (temp >= 512) {
-				maxCores = 512;
-			}
-			else {
-				maxCores = temp;
-			}
-		}
-		else if (string(argv[i]).substr(0, 2) == "-i") {		// updates filepath for the TIFF file
-			MyTIFFHeader.strInputFile = string(argv[i]).substr(2);
-		}
-	}
-
-	INT16 getImageDimensions = _GetInputImageDimensions(&MyTIFFHeader);			// opens TIFF file and gets the dimensions?
-
-	//MyEDParams.bInputImageIsRGB = MyTIFFHeader.bInputImageIsRGB;
-
-	INT16 rasterRow = HalftoneRasterRow(&MyEDParams, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, maxCores, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
-	INT16 halftoneImageFlt = HalftoneImageFlt(&MyEDParams, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, maxCores);
-	INT16 generateRTLData = GenerateRTLData(MyEDParams, NULL, NULL, NULL);
-
-
-	return 0;
-}
\ No newline at end of file
+#define INT8 signed __int8
+#define INT16 signed __int16
+#define INT32 signed __int32
+#define UINT8 unsigned __int8
+#define UINT16 unsigned __int16
+#define UINT32 unsigned __int32
+
+#include "AsyncIO.h"
+#include "TIFF_Stuff.h"
+#include "Orientation.h"
+#include "RTL_Compression.h"
+#include "RTL_Output.h"
+#include "ColorDecode.h"
+#include "ColorSeparation.h"
+#include "ColorLUT.h"
+#include "TransferCurves.h"
+#include "Resampler.h"
+#include "HalftoningSection.h"
+#include "LUT_Cache.h"
+#include "LUT_Builder.h"
+#include "SPEEDJob.h"
+#include "SpoolDaemon.h"
+#include "BatchManifest.h"
+#include <omp.h>
+#include <iostream>
+#include <string.h>
+//#include <stdio.h>
+using namespace std;
+
+int main(int argc, const char* argv[])
+{
+	SPEEDJob* MyJob = new SPEEDJob;										// large (TIFF, ED and writer state), so not on the stack
+	std::vector<string> arguments(argv, argv + argc);
+	INT16 runResult;
+
+	if (_ParseJobArguments(MyJob, arguments) != 0) {
+		wcerr << MyJob->sRetErrDescription << endl;
+		runResult = MyJob->nErrorCode;
+	}
+	else if (!MyJob->strCalibrationPath.empty()) {						// -C, recalibrate: build the LUT cache file and stop
+		LUTCalibration* MyCalibration = new LUTCalibration;
+		double dStart = omp_get_wtime();
+
+		runResult = _ReadLUTCalibration(MyCalibration, MyJob->strCalibrationPath.c_str());
+		if (runResult == 0) {
+			runResult = _BuildLUTCache(&MyJob->MyEDParams, MyCalibration, MyJob->strLUTDirectory, NULL,
+				(MyJob->nMaxCores > 0) ? MyJob->nMaxCores : omp_get_max_threads());
+		}
+		if (runResult != 0) {
+			wcerr << MyCalibration->sRetErrDescription << endl;
+		}
+		else if (MyJob->MyTIFFHeader.bVerbose) {
+			wcerr << "LUT cache for " << MyCalibration->nInks << " inks built in " << (omp_get_wtime() - dStart) * 1000.
+				<< " ms" << endl;
+		}
+		delete MyCalibration;
+	}
+	else if (!MyJob->strSpoolDirectory.empty() || !MyJob->strSocketPath.empty()) {	// -D / -S, run as a spool daemon
+		SpoolDaemon* MyDaemon = new SpoolDaemon;
+
+		MyDaemon->strSpoolDirectory = MyJob->strSpoolDirectory;
+		MyDaemon->strSocketPath = MyJob->strSocketPath;
+		MyDaemon->nCoreBudget = (MyJob->nMaxCores > 0) ? MyJob->nMaxCores : omp_get_max_threads();
+		MyDaemon->nConcurrentJobs = (MyJob->nConcurrentJobs > 0) ? MyJob->nConcurrentJobs :
+			max(MyDaemon->nCoreBudget / 4, 1);							// 4 cores per job unless told otherwise
+		MyDaemon->bVerbose = MyJob->MyTIFFHeader.bVerbose;
+
+		runResult = _RunSpoolDaemon(MyDaemon);
+		if (runResult != 0) {
+			wcerr << MyDaemon->sRetErrDescription << endl;
+		}
+		delete MyDaemon;
+	}
+	else if (!MyJob->strManifestPath.empty()) {							// -B, many files in this process
+		BatchRun* MyBatch = new BatchRun;
+
+		MyBatch->strManifestPath = MyJob->strManifestPath;
+		for (int i = 1; i < argc; i++) {								// the rest of the command line is the default for every file
+			string strSwitch = string(argv[i]).substr(0, 2);
+			if (strSwitch != "-B" && strSwitch != "-p" && strSwitch != "-j" && strSwitch != "-D" && strSwitch != "-S") {
+				MyBatch->DefaultArguments.push_back(argv[i]);
+			}
+		}
+		MyBatch->nCoreBudget = (MyJob->nMaxCores > 0) ? MyJob->nMaxCores : omp_get_max_threads();
+		MyBatch->nConcurrentJobs = MyJob->nConcurrentJobs;
+		MyBatch->bVerbose = MyJob->MyTIFFHeader.bVerbose;
+
+		runResult = _RunBatchManifest(MyBatch);							// failed files were reported as they finished
+		if (runResult != 0 && MyBatch->nJobsFailed == 0) {
+			wcerr << MyBatch->sRetErrDescription << endl;
+		}
+		delete MyBatch;
+	}
+	else {																// one job, with a context of its own
+		runResult = _RunSPEEDJob(MyJob, NULL);
+		if (runResult != 0) {
+			wcerr << MyJob->sRetErrDescription << endl;
+		}
+	}
+	delete MyJob;
+
+	return runResult;
+}
@@ -0,0 +1,370 @@
+// SPEEDLib C API (see SPEEDLib_API.h): a thin wrapper around the halftoning context in HalftoningSection.cpp
+// Compiled with the embedding application (or into its own shared library); SPEEDLib.cpp is the command line front end
+//  over the same code
+
+#define INT8 signed __int8
+#define INT16 signed __int16
+#define INT32 signed __int32
+#define UINT8 unsigned __int8
+#define UINT16 unsigned __int16
+#define UINT32 unsigned __int32
+
+#define SPEEDLIB_EXPORTS
+#include "SPEEDLib_API.h"
+#include "AsyncIO.h"
+#include "TIFF_Stuff.h"
+#include "Orientation.h"
+#include "RTL_Compression.h"
+#include "RTL_Output.h"
+#include "ColorDecode.h"
+#include "ColorSeparation.h"
+#include "ColorLUT.h"
+#include "TransferCurves.h"
+#include "Resampler.h"
+#include "HalftoningSection.h"
+#include "LUT_Cache.h"
+#include "LUT_Builder.h"
+#include <omp.h>
+#include <new>
+#include <string.h>
+#include <stdio.h>
+
+struct speed_context {
+	HalftoneContext Context;											// ED parameters, LUTs and buffers
+	LUTCache LUTs;														// speed_map_lut_cache(), replaces the LUTs while mapped
+	ColorLUT InputColorLUT;												// speed_map_color_lut(), converts the input while mapped
+	TransferCurves InkCurves;											// speed_set_transfer_curves(), applied while set
+	bool bPageOpen					= false;							// Between speed_begin_page() and speed_end_page()
+	UINT32 nInputRowsSubmitted		= 0;								// Input rows halftoned so far on this page
+	char sLastError[160]			= "";								// speed_last_error(), narrowed from sRetErrDescription
+};
+
+static thread_local char sCreateError[160] = "";						// speed_last_error(NULL), why speed_create() failed
+
+// *********************************************************************************************************************************
+// _SpeedError() records an error on the context (or for speed_create() when there is none) and returns its code
+//
+static int _SpeedError(speed_context* pContext, INT16 nErrorCode, const TCHAR* sDescription) {
+	char* sLastError = (pContext != NULL) ? pContext->sLastError : sCreateError;
+
+	snprintf(sLastError, sizeof(sCreateError), "%ls", sDescription);
+	return nErrorCode;
+}
+
+// *********************************************************************************************************************************
+// _SpeedContextError() passes the halftoning context's own error code and description up
+//
+static int _SpeedContextError(speed_context* pContext) {
+	return _SpeedError(pContext, pContext->Context.Params.nErrorCode, pContext->Context.Params.sRetErrDescription);
+}
+
+int speed_api_version(void) {
+	return SPEEDLIB_API_VERSION;
+}
+
+// *********************************************************************************************************************************
+// speed_default_config() fills in the same defaults as EDParams (kernel 16, 16-bit diffusion, CMYK, variable dot)
+//
+void speed_default_config(speed_config* config) {
+	EDParams Defaults;
+
+	memset(config, 0, sizeof(speed_config));
+	config->struct_size = sizeof(speed_config);
+	config->kernel_type = Defaults.nEDKernelType;
+	config->diffusion_bit_depth = Defaults.nInputBitDepth;
+	config->color_channels = Defaults.nColorChannels;
+	config->bits_per_dot = Defaults.nBitsPerDot;
+	config->serpentine = Defaults.bSerpentineRaster;
+	config->rgb_input = Defaults.bInputImageIsRGB;
+	config->hysteresis = Defaults.dHysteresis;
+	config->threads = 0;
+	memcpy(config->ink_order, Defaults.nInkOrder, sizeof(config->ink_order));
+	config->huge_pages = ED_HUGE_PAGES_OFF;
+	config->gcr = Defaults.Separation.dGCR;
+	config->ucr = Defaults.Separation.dUCR;
+	config->ink_limit = Defaults.Separation.dInkLimit;
+	config->input_color_space = Defaults.Decode.nColorSpace;
+	config->resample_filter = Defaults.nResampleFilter;
+}
+
+// *********************************************************************************************************************************
+// speed_create() checks the config, then allocates the context with its LUTs (zeroed until speed_set_luts())
+// A config from an older header is read only as far as its struct_size; the fields it does not have keep their defaults
+//
+int speed_create(const speed_config* config, speed_context** context) {
+	TCHAR sErrDescription[128];
+	EDParams MyEDParams;
+	speed_config Config;
+
+	*context = NULL;
+	if (config == NULL || config->struct_size < SPEEDLIB_CONFIG_SIZE_V1) {
+		swprintf_s(sErrDescription, _countof(sErrDescription), _T("EC(-85) Invalid halftoning configuration size!"));
+		return _SpeedError(NULL, (-85), sErrDescription);
+	}
+	speed_default_config(&Config);
+	memcpy(&Config, config, min((size_t)config->struct_size, sizeof(speed_config)));
+
+	if (Config.kernel_type > 16 ||
+		(Config.diffusion_bit_depth != 8 && Config.diffusion_bit_depth != 16) ||
+		Config.color_channels < 1 || Config.color_channels > 16 ||
+		(Config.bits_per_dot != 1 && Config.bits_per_dot != 2) || Config.huge_pages > ED_HUGE_PAGES_HUGETLB ||
+		Config.input_color_space > COLOR_SPACE_YCBCR || Config.resample_filter > RESAMPLE_AUTO) {
+		swprintf_s(sErrDescription, _countof(sErrDescription), _T("EC(-85) Invalid halftoning configuration!"));
+		return _SpeedError(NULL, (-85), sErrDescription);
+	}
+	MyEDParams.nEDKernelType = Config.kernel_type;
+	MyEDParams.nInputBitDepth = Config.diffusion_bit_depth;
+	MyEDParams.nColorChannels = Config.color_channels;
+	MyEDParams.nBitsPerDot = Config.bits_per_dot;
+	MyEDParams.nDotLevels = (UINT8)(1 << Config.bits_per_dot);
+	MyEDParams.nDotsPerByteBlock = (UINT8)(8 / Config.bits_per_dot);
+	MyEDParams.bSerpentineRaster = (Config.serpentine != 0);
+	MyEDParams.bInputImageIsRGB = (Config.rgb_input != 0);
+	MyEDParams.dHysteresis = Config.hysteresis;
+	MyEDParams.Separation.dGCR = std::clamp(Config.gcr, 0.F, 1.F);
+	MyEDParams.Separation.dUCR = std::clamp(Config.ucr, 0.F, 1.F);
+	MyEDParams.Separation.dInkLimit = std::clamp(Config.ink_limit, 1.F, 4.F);
+	MyEDParams.Decode.nColorSpace = Config.input_color_space;				// YCbCr is full range with BT.601 luma
+	MyEDParams.nResampleFilter = Config.resample_filter;
+	memcpy(MyEDParams.nInkOrder, Config.ink_order, sizeof(MyEDParams.nInkOrder));
+	if (MyEDParams.bInputImageIsRGB && MyEDParams.nColorChannels < 4) {	// RGB is separated to 4 inks, CMYK
+		swprintf_s(sErrDescription, _countof(sErrDescription), _T("EC(-85) RGB input needs 4 or more inks!"));
+		return _SpeedError(NULL, (-85), sErrDescription);
+	}
+	if (!_ValidInkOrder(&MyEDParams)) {									// Every ink needs its own printer plane
+		swprintf_s(sErrDescription, _countof(sErrDescription),
+			_T("EC(-85) Ink order does not fit %u inks!"), Config.color_channels);
+		return _SpeedError(NULL, (-85), sErrDescription);
+	}
+
+	speed_context* pContext = new (std::nothrow) speed_context;
+	if (pContext == NULL) {
+		swprintf_s(sErrDescription, _countof(sErrDescription), _T("EC(-62) Failed to allocate halftoning context!"));
+		return _SpeedError(NULL, (-62), sErrDescription);
+	}
+	pContext->Context.Arena.nHugePageMode = Config.huge_pages;
+	if (_InitHalftoneContext(&pContext->Context, &MyEDParams,
+		(Config.threads > 0) ? Config.threads : omp_get_max_threads()) != 0) {
+		int nErrorCode = _SpeedError(NULL, pContext->Context.Params.nErrorCode, pContext->Context.Params.sRetErrDescription);
+		speed_destroy(pContext);
+		return nErrorCode;
+	}
+	*context = pContext;
+	return 0;
+}
+
+void speed_destroy(speed_context* context) {
+	if (context == NULL)
+		return;
+	_FreeHalftoneContext(&context->Context);
+	_UnmapLUTCache(&context->LUTs);
+	_UnmapColorLUT(&context->InputColorLUT);
+	delete context;
+}
+
+// *********************************************************************************************************************************
+// speed_lut_sizes() reports how big the two LUTs speed_set_luts() expects are
+//
+int speed_lut_sizes(const speed_context* context, size_t* dot_lut_bytes, size_t* error_lut_floats) {
+	size_t nLUTEntries = (size_t)1 << context->Context.Params.nInputBitDepth;
+
+	*dot_lut_bytes = nLUTEntries * 3;
+	*error_lut_floats = nLUTEntries * context->Context.Params.nEDKernelSize;
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// speed_set_luts() loads the dot and error LUTs; they are kept for every page until replaced (not while a page is open)
+//
+int speed_set_luts(speed_context* context, const uint8_t* dot_lut, const float* error_lut) {
+	TCHAR sErrDescription[128];
+	size_t nDotBytes, nErrorFloats;
+
+	if (context->bPageOpen) {
+		swprintf_s(sErrDescription, _countof(sErrDescription), _T("EC(-86) LUTs cannot be changed during a page!"));
+		return _SpeedError(context, (-86), sErrDescription);
+	}
+	speed_lut_sizes(context, &nDotBytes, &nErrorFloats);
+	memcpy(context->Context.Params.pDotLUT, dot_lut, nDotBytes);
+	memcpy(context->Context.Params.pFloatErrorLUT, error_lut, nErrorFloats * sizeof(float));
+	_DetachLUTCache(&context->Context.Params);
+	_UnmapLUTCache(&context->LUTs);
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// speed_map_lut_cache() uses the per-ink LUTs of a LUT cache file (see LUT_Cache.cpp) instead of speed_set_luts()
+//
+int speed_map_lut_cache(speed_context* context, const char* path) {
+	TCHAR sErrDescription[128];
+
+	if (context->bPageOpen) {
+		swprintf_s(sErrDescription, _countof(sErrDescription), _T("EC(-86) LUTs cannot be changed during a page!"));
+		return _SpeedError(context, (-86), sErrDescription);
+	}
+	_DetachLUTCache(&context->Context.Params);
+	if (_MapLUTCache(&context->LUTs, path, &context->Context.Params) != 0)
+		return _SpeedError(context, context->LUTs.nErrorCode, context->LUTs.sRetErrDescription);
+
+	_AttachLUTCache(&context->LUTs, &context->Context.Params);
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// speed_build_lut_cache() builds the per-ink LUTs for measured dot densities (inks x dot levels, level 0 first) with the
+//  context's kernel, diffusion bit depth and dot size, and writes them to a LUT cache file for speed_map_lut_cache()
+//
+int speed_build_lut_cache(speed_context* context, const float* dot_densities, uint32_t inks, const char* path) {
+	LUTCalibration* pCalibration = new (std::nothrow) LUTCalibration;
+	TCHAR sErrDescription[128];
+	int nErrorCode = 0;
+
+	if (pCalibration == NULL) {
+		swprintf_s(sErrDescription, _countof(sErrDescription), _T("EC(-62) Failed to allocate dot calibration!"));
+		return _SpeedError(context, (-62), sErrDescription);
+	}
+	for (uint32_t ilp = 0; ilp < inks && nErrorCode == 0; ilp++)
+		nErrorCode = _AddCalibrationInk(pCalibration, dot_densities + (size_t)ilp * context->Context.Params.nDotLevels,
+			context->Context.Params.nDotLevels, ilp + 1);
+	if (nErrorCode == 0 && inks == 0)
+		nErrorCode = _SetCalibrationError(pCalibration, "no inks", 0);
+	if (nErrorCode == 0)
+		nErrorCode = _BuildLUTCache(&context->Context.Params, pCalibration, string(), path, context->Context.nThreads);
+	if (nErrorCode != 0)
+		_SpeedError(context, (INT16)nErrorCode, pCalibration->sRetErrDescription);
+	delete pCalibration;
+	return nErrorCode;
+}
+
+// *********************************************************************************************************************************
+// speed_map_color_lut() converts every page's input through a color profile's LUT (see ColorLUT.cpp), compiled into cache_dir
+//  (NULL = beside the profile) the first time the profile is seen; a NULL profile goes back to unconverted input
+//
+int speed_map_color_lut(speed_context* context, const char* profile_path, const char* cache_dir) {
+	TCHAR sErrDescription[128];
+
+	if (context->bPageOpen) {
+		swprintf_s(sErrDescription, _countof(sErrDescription), _T("EC(-86) Color LUT cannot be changed during a page!"));
+		return _SpeedError(context, (-86), sErrDescription);
+	}
+	context->Context.Params.pColorLUT = NULL;
+	if (profile_path == NULL) {
+		_UnmapColorLUT(&context->InputColorLUT);
+		return 0;
+	}
+	if (_OpenColorLUT(&context->InputColorLUT, profile_path, (cache_dir != NULL) ? string(cache_dir) : string()) != 0)
+		return _SpeedError(context, context->InputColorLUT.nErrorCode, context->InputColorLUT.sRetErrDescription);
+
+	context->Context.Params.pColorLUT = &context->InputColorLUT;
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// speed_set_transfer_curves() applies a curve per ink (inks x points levels, 0. - 1., for evenly spaced input levels) as the
+//  input is scaled, see TransferCurves.cpp; NULL levels goes back to linear
+//
+int speed_set_transfer_curves(speed_context* context, const float* levels, uint32_t inks, uint32_t points) {
+	TCHAR sErrDescription[128];
+	int nErrorCode = 0;
+
+	if (context->bPageOpen) {
+		swprintf_s(sErrDescription, _countof(sErrDescription), _T("EC(-86) Transfer curves cannot be changed during a page!"));
+		return _SpeedError(context, (-86), sErrDescription);
+	}
+	context->Context.Params.pTransferCurves = NULL;
+	if (levels == NULL)
+		return 0;
+
+	context->InkCurves.nInks = 0;
+	context->InkCurves.nPoints = 0;
+	context->InkCurves.nErrorCode = 0;
+	for (uint32_t ilp = 0; ilp < inks && nErrorCode == 0; ilp++)
+		nErrorCode = _AddTransferCurve(&context->InkCurves, levels + (size_t)ilp * points,
+			(UINT16)min(points, (uint32_t)TRANSFER_CURVE_POINTS + 1), ilp + 1);
+	if (nErrorCode == 0 && inks == 0)
+		nErrorCode = _SetTransferCurveError(&context->InkCurves, "no inks", 0);
+	if (nErrorCode != 0)
+		return _SpeedError(context, (INT16)nErrorCode, context->InkCurves.sRetErrDescription);
+
+	context->Context.Params.pTransferCurves = &context->InkCurves;
+	return 0;
+}
+
+int speed_begin_page(speed_context* context, uint32_t input_width, uint32_t input_height, uint32_t band_rows,
+	uint32_t input_channels, uint32_t image_bit_depth, int planar_input, uint32_t output_width, uint32_t output_height) {
+	TCHAR sErrDescription[128];
+
+	if (input_width == 0 || input_width > 65535 || input_height == 0 || input_height > 65535 ||
+		band_rows == 0 || band_rows > 255 || input_channels == 0 || input_channels > 16 ||
+		(image_bit_depth != 8 && image_bit_depth != 16) || output_width == 0 || output_height == 0 ||
+		output_height > 65535 * input_height / band_rows) {
+		swprintf_s(sErrDescription, _countof(sErrDescription), _T("EC(-85) Invalid page geometry!"));
+		return _SpeedError(context, (-85), sErrDescription);
+	}
+	context->bPageOpen = false;
+	if (_BeginHalftonePage(&context->Context, (UINT16)input_width, (UINT16)input_height, (UINT8)band_rows,
+		(UINT8)input_channels, (UINT8)image_bit_depth, planar_input != 0, output_width, output_height) != 0)
+		return _SpeedContextError(context);
+
+	context->bPageOpen = true;
+	context->nInputRowsSubmitted = 0;
+	return 0;
+}
+
+void* speed_band_buffer(speed_context* context) {
+	return context->bPageOpen ? context->Context.pInputRasterBuffer : NULL;
+}
+
+// *********************************************************************************************************************************
+// speed_submit_band() halftones rows (up to band_rows) input rows, taken from pixels or, if that is NULL, the band buffer
+//
+int speed_submit_band(speed_context* context, const void* pixels, uint32_t rows, speed_rows* out) {
+	HalftoneContext* pHalftone = &context->Context;
+	TCHAR sErrDescription[128];
+	UINT8** pRTLData;
+	UINT16 nOutputRows;
+
+	if (!context->bPageOpen || rows == 0 || rows > pHalftone->nInputImageBufferRows ||
+		context->nInputRowsSubmitted + rows > pHalftone->nInputImagePixelHeight) {
+		swprintf_s(sErrDescription, _countof(sErrDescription),
+			_T("EC(-87) Band of %u rows does not fit the page!"), rows);
+		return _SpeedError(context, (-87), sErrDescription);
+	}
+	if (pixels != NULL && pixels != pHalftone->pInputRasterBuffer)
+		memcpy(pHalftone->pInputRasterBuffer, pixels, (size_t)rows * pHalftone->nInputImagePixelWidth *
+			pHalftone->nInputColorChannels * (pHalftone->nInputImageBitDepth / 8));
+
+	if (_HalftoneBand(pHalftone, (UINT8)rows, &pRTLData, &nOutputRows) != 0)
+		return _SpeedContextError(context);
+
+	context->nInputRowsSubmitted += rows;
+	memset(out, 0, sizeof(speed_rows));
+	out->rows = nOutputRows;
+	out->width = pHalftone->nRasterWidthPixels;
+	out->stride = pHalftone->nRasterWidthPixels;
+	for (UINT8 clp = 0; clp < pHalftone->Params.nColorChannels; clp++)
+		out->planes[clp] = pRTLData[clp];
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// speed_conversion_stats() reports the input conversion of the current (or last) page: pixels converted, and of those, how many
+//  repeated the pixel before and how many were found in the conversion cache
+//
+int speed_conversion_stats(const speed_context* context, uint64_t* pixels, uint64_t* run_hits, uint64_t* cache_hits) {
+	const SeparationStats* pStats = &context->Context.ConversionStats;
+
+	*pixels = pStats->nPixels;
+	*run_hits = pStats->nRunHits;
+	*cache_hits = pStats->nCacheHits;
+	return 0;
+}
+
+int speed_end_page(speed_context* context) {
+	context->bPageOpen = false;
+	return 0;
+}
+
+const char* speed_last_error(const speed_context* context) {
+	return (context != NULL) ? context->sLastError : sCreateError;
+}
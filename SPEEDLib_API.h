@@ -0,0 +1,117 @@
+// SPEEDLib C API, for embedding the halftoner in another process (RIP server, print driver, scripting bindings)
+// Compile SPEEDLib_API.cpp with the application (define SPEEDLIB_STATIC for both) and include this header, or build it
+//  into a DLL or shared object of your own; the project here only builds the command line tool
+//
+// A context is created once from a speed_config: the ED parameters, LUTs and every halftoning buffer are allocated then,
+//  and are kept (buffers only ever grow) for as many pages as the context is used for; the OpenMP worker pool stays warm
+//  for the life of the process. Per page:
+//
+//	speed_begin_page()		page geometry, clears the error buffers
+//	speed_submit_band()		one band of input rows in, halftoned (scaled) rows out, repeated until the page is done
+//	speed_end_page()
+//
+// A context is not thread safe; use one context per concurrent job. Functions return 0 or a negative EC() error code,
+//  described by speed_last_error()
+
+#ifndef SPEEDLIB_API_H
+#define SPEEDLIB_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(SPEEDLIB_STATIC)
+#define SPEEDLIB_EXPORT
+#elif defined(_WIN32)
+#ifdef SPEEDLIB_EXPORTS
+#define SPEEDLIB_EXPORT __declspec(dllexport)
+#else
+#define SPEEDLIB_EXPORT __declspec(dllimport)
+#endif
+#else
+#define SPEEDLIB_EXPORT __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SPEEDLIB_API_VERSION	2											// Bumped when the ABI changes (2: speed_config grew
+																			//  past ink_order, huge_pages on)
+
+typedef struct speed_context speed_context;								// Opaque, one per concurrent job
+
+typedef struct speed_config {
+	uint32_t struct_size;													// sizeof(speed_config), set by speed_default_config();
+																			//  older, shorter configs (version 1 ends at ink_order)
+																			//  are accepted, the fields past them take the defaults
+	uint8_t kernel_type;													// Diffusion kernel, 0 - 16 (see HalftoningSection.cpp)
+	uint8_t diffusion_bit_depth;											// 8 or 16, LUTs have 2 ^ diffusion_bit_depth entries
+	uint8_t color_channels;													// Inks, 1 - 16
+	uint8_t bits_per_dot;													// 1 = fixed dot size, 2 = variable dot (S, M, L)
+	uint8_t serpentine;														// Non-zero = serpentine raster
+	uint8_t rgb_input;														// Non-zero = input is RGB, converted to CMYK (4+ inks)
+	float hysteresis;														// White noise intensity, 0 - 1
+	int32_t threads;														// Worker threads, 0 = every core
+	uint8_t ink_order[16];													// Printer plane of each ink, e.g. C (1), M (2), Y (3), K (0);
+																			//  each ink its own plane, below color_channels
+	uint8_t huge_pages;														// 0 = off, 1 = THP, 2 = hugetlbfs (falls back to THP)
+	float gcr;																// RGB input: gray component replacement, 0 - 1
+	float ucr;																// RGB input: under color removal, 0 - 1
+	float ink_limit;														// RGB input: total ink, 1 (100%) - 4 (400%)
+	uint8_t input_color_space;												// RGB input: 0 = RGB, 1 = CIELab, 2 = ICC Lab, 3 = YCbCr
+	uint8_t resample_filter;												// Scaling: 0 = box, 1 = bilinear, 2 = Lanczos3, 3 = auto
+} speed_config;
+
+#define SPEEDLIB_CONFIG_SIZE_V1	offsetof(speed_config, huge_pages)			// struct_size of a version 1 speed_config
+
+typedef struct speed_rows {
+	uint32_t rows;															// Halftoned (scaled) rows out of this band
+	uint32_t width;															// Dots per row, padded to whole RTL byte blocks
+	size_t stride;															// Bytes from one row to the next
+	const uint8_t* planes[16];												// One per ink (printer order), one byte per dot (0 = no dot)
+} speed_rows;
+
+SPEEDLIB_EXPORT int speed_api_version(void);
+SPEEDLIB_EXPORT void speed_default_config(speed_config* config);
+
+// speed_create() sets *context, or NULL on failure (the reason is then speed_last_error(NULL))
+SPEEDLIB_EXPORT int speed_create(const speed_config* config, speed_context** context);
+SPEEDLIB_EXPORT void speed_destroy(speed_context* context);
+
+// Dot LUT: 3 bytes per input level; error LUT: kernel rows x 7 floats per input level
+SPEEDLIB_EXPORT int speed_lut_sizes(const speed_context* context, size_t* dot_lut_bytes, size_t* error_lut_floats);
+SPEEDLIB_EXPORT int speed_set_luts(speed_context* context, const uint8_t* dot_lut, const float* error_lut);
+// Maps a prebuilt LUT cache file (one dot and error LUT per ink, see LUT_Cache.cpp) read-only in place of speed_set_luts()
+SPEEDLIB_EXPORT int speed_map_lut_cache(speed_context* context, const char* path);
+// Builds that file from measured dot densities, inks x dot levels (level 0 = no dot first, 0 = paper .. 1 = solid)
+SPEEDLIB_EXPORT int speed_build_lut_cache(speed_context* context, const float* dot_densities, uint32_t inks,
+	const char* path);
+// Converts the input of every page through a color profile's 3D/4D LUT (see ColorLUT.cpp), compiled into cache_dir (NULL =
+//  beside the profile) once per profile; color_channels must match the profile's inks, NULL profile_path = no conversion
+SPEEDLIB_EXPORT int speed_map_color_lut(speed_context* context, const char* profile_path, const char* cache_dir);
+// Per ink transfer curves (see TransferCurves.cpp), inks x points levels (0 .. 1) for evenly spaced input levels, applied
+//  as the input is scaled; inks must match the inks printed, 2 - 256 points, NULL levels = linear
+SPEEDLIB_EXPORT int speed_set_transfer_curves(speed_context* context, const float* levels, uint32_t inks, uint32_t points);
+
+SPEEDLIB_EXPORT int speed_begin_page(speed_context* context, uint32_t input_width, uint32_t input_height,
+	uint32_t band_rows, uint32_t input_channels, uint32_t image_bit_depth, int planar_input,
+	uint32_t output_width, uint32_t output_height);
+
+// The band buffer holds band_rows input rows; filling it directly and passing pixels = NULL saves a copy
+SPEEDLIB_EXPORT void* speed_band_buffer(speed_context* context);
+
+// Rows handed back in *out stay valid until the band after next is submitted; a scaled row that needs input rows of the next
+//  band waits for it, so out->rows can lag (or be 0), and the last band of the page hands back every row left
+SPEEDLIB_EXPORT int speed_submit_band(speed_context* context, const void* pixels, uint32_t rows, speed_rows* out);
+SPEEDLIB_EXPORT int speed_end_page(speed_context* context);
+// Input conversion (RGB or color LUT) of the current or last page: pixels, and how many were runs or conversion cache hits
+SPEEDLIB_EXPORT int speed_conversion_stats(const speed_context* context, uint64_t* pixels, uint64_t* run_hits,
+	uint64_t* cache_hits);
+
+SPEEDLIB_EXPORT const char* speed_last_error(const speed_context* context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPEEDLIB_API_H
@@ -0,0 +1,405 @@
+// Optional Linux io_uring backend for the band reader and the RTL writer
+// Build with SPEEDLIB_IO_URING defined and link with liburing (-luring) to enable it; otherwise _AsyncIOInit() reports
+//  that the backend is unavailable, -u says so on stderr, and callers keep using the ordinary blocking reads and writes
+//
+// The band buffer pool is a small set of aligned, fixed-size buffers registered with the ring (IORING_REGISTER_BUFFERS),
+//  so reads and writes use the _fixed opcodes and the kernel does not have to map the pages for every request
+// Reads prefetch the strips of the next input band while the current band is halftoned; writes queue RTL data and
+//  only block when the pool runs out of free buffers, so many requests stay in flight without any extra I/O threads
+// A ring is not thread safe: the band reader (main thread) and the RTL writer (writer thread) each have their own
+
+#define INT8	signed __int8
+#define INT16	signed __int16
+#define INT32	signed __int32
+#define INT64	signed __int64
+#define UINT8 	unsigned __int8
+#define UINT16	unsigned __int16
+#define UINT32	unsigned __int32
+#define UINT64	unsigned __int64
+
+#include "../../LibTiff_Win32/source_4.1/tiff.h"							// Header files for LibTIFF
+#include "../../LibTiff_Win32/source_4.1/tiffio.h"
+
+#if defined(SPEEDLIB_IO_URING) && defined(__linux__)
+#include <liburing.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define ASYNC_IO_MAX_BUFFERS	32											// Max number of buffers in the band buffer pool
+#define ASYNC_IO_ALIGNMENT		4096										// Buffer alignment, one page (also suits O_DIRECT)
+
+#define ASYNC_IO_FREE			0											// Buffer states
+#define ASYNC_IO_IN_FLIGHT		1
+#define ASYNC_IO_COMPLETE		2
+
+typedef struct AsyncIOBuffer {
+	UINT8* pData					= NULL;									// Aligned buffer, registered with the ring
+	UINT64 nFileOffset				= 0;									// File offset the data came from, or goes to
+	UINT32 nLength					= 0;									// Bytes requested
+	INT32 nResult					= 0;									// Bytes transferred, or -errno (from the CQE)
+	UINT8 nState					= ASYNC_IO_FREE;						// Free, in flight, or complete
+	bool bWrite						= false;								// Write request (true) or read request
+	int nFileDescriptor				= -1;									// File the request was issued against
+} AsyncIOBuf;
+
+typedef struct AsyncIOContext {
+	bool bEnabled					= false;								// Ring is set up and the buffers are registered
+	UINT8 nBuffers					= 0;									// Number of buffers in the pool
+	UINT32 nBufferSize				= 0;									// Size of each buffer in bytes
+	UINT32 nInFlight				= 0;									// Requests submitted but not yet reaped
+	AsyncIOBuf Buffers[ASYNC_IO_MAX_BUFFERS];								// The band buffer pool
+#if defined(SPEEDLIB_IO_URING) && defined(__linux__)
+	struct io_uring Ring;													// Submission and completion queues
+#endif
+	INT16 nErrorCode				= 0;									// Return error code
+	TCHAR sRetErrDescription[128];											// Return error message
+} AsyncIO;
+
+typedef struct AsyncTIFFSource {											// LibTIFF client handle, see _AsyncIOOpenTIFF()
+	AsyncIO* pAsyncIO				= NULL;									// Ring and buffer pool holding prefetched strips
+	int nFileDescriptor				= -1;									// Input image file
+	UINT64 nFileSize				= 0;									// Size of the input image file
+	UINT64 nPosition				= 0;									// Current read position (LibTIFF seeks, then reads)
+} AsyncTIFFSrc;
+
+#if defined(SPEEDLIB_IO_URING) && defined(__linux__)
+
+// *********************************************************************************************************************************
+// _AsyncIOInit() creates the ring and the band buffer pool, and registers the pool with the kernel
+// nBuffers buffers of nBufferSize bytes; the queue depth matches the pool size, as every request owns one buffer
+//
+INT16 _AsyncIOInit(AsyncIO* pAsyncIO, UINT8 nBuffers, UINT32 nBufferSize) {
+	struct iovec ioVecs[ASYNC_IO_MAX_BUFFERS];
+
+	pAsyncIO->nBuffers = (UINT8)min((int)nBuffers, ASYNC_IO_MAX_BUFFERS);
+	pAsyncIO->nBufferSize =
+		(nBufferSize + ASYNC_IO_ALIGNMENT - 1) & ~(UINT32)(ASYNC_IO_ALIGNMENT - 1);
+
+	for (UINT8 blp = 0; blp < pAsyncIO->nBuffers; blp++) {
+		if (posix_memalign((void**)&pAsyncIO->Buffers[blp].pData, ASYNC_IO_ALIGNMENT, pAsyncIO->nBufferSize) != 0) {
+			pAsyncIO->Buffers[blp].pData = NULL;
+			pAsyncIO->nErrorCode = (-80);
+			swprintf_s(pAsyncIO->sRetErrDescription,
+				_countof(pAsyncIO->sRetErrDescription),
+				_T("EC(-80) Failed to allocate band buffer pool!"));
+			return pAsyncIO->nErrorCode;
+		}
+		pAsyncIO->Buffers[blp].nState = ASYNC_IO_FREE;
+		ioVecs[blp].iov_base = pAsyncIO->Buffers[blp].pData;
+		ioVecs[blp].iov_len = pAsyncIO->nBufferSize;
+	}
+	int nRet = io_uring_queue_init(pAsyncIO->nBuffers, &pAsyncIO->Ring, 0);
+
+	if (nRet < 0) {
+		pAsyncIO->nErrorCode = (-81);
+		swprintf_s(pAsyncIO->sRetErrDescription,
+			_countof(pAsyncIO->sRetErrDescription),
+			_T("EC(-81) Failed to create io_uring, error %d!"), -nRet);
+		return pAsyncIO->nErrorCode;
+	}
+	if ((nRet = io_uring_register_buffers(&pAsyncIO->Ring, ioVecs, pAsyncIO->nBuffers)) < 0) {
+		io_uring_queue_exit(&pAsyncIO->Ring);
+		pAsyncIO->nErrorCode = (-81);
+		swprintf_s(pAsyncIO->sRetErrDescription,
+			_countof(pAsyncIO->sRetErrDescription),
+			_T("EC(-81) Failed to register band buffer pool, error %d!"), -nRet);
+		return pAsyncIO->nErrorCode;
+	}
+	pAsyncIO->bEnabled = true;
+	pAsyncIO->nInFlight = 0;
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _AsyncIOReap() moves one completion (waiting for it if bWait) from the completion queue to its buffer
+// Returns 1 if a completion was reaped, 0 if none was ready, or an error code
+//
+INT16 _AsyncIOReap(AsyncIO* pAsyncIO, bool bWait) {
+	struct io_uring_cqe* pCQE;
+	int nRet = bWait ? io_uring_wait_cqe(&pAsyncIO->Ring, &pCQE) : io_uring_peek_cqe(&pAsyncIO->Ring, &pCQE);
+
+	if (nRet == -EAGAIN)													// Nothing ready yet
+		return 0;
+	if (nRet < 0) {
+		pAsyncIO->nErrorCode = (-82);
+		swprintf_s(pAsyncIO->sRetErrDescription,
+			_countof(pAsyncIO->sRetErrDescription),
+			_T("EC(-82) io_uring completion failed, error %d!"), -nRet);
+		return pAsyncIO->nErrorCode;
+	}
+	AsyncIOBuf* pBuf = &pAsyncIO->Buffers[(UINT8)io_uring_cqe_get_data64(pCQE)];
+	pBuf->nResult = pCQE->res;
+	io_uring_cqe_seen(&pAsyncIO->Ring, pCQE);
+	pAsyncIO->nInFlight--;
+
+	if (pBuf->bWrite && pBuf->nResult >= 0 && (UINT32)pBuf->nResult < pBuf->nLength) {
+		UINT32 nDone = (UINT32)pBuf->nResult;								// Short write (pipes, signals), finish it here
+
+		while (nDone < pBuf->nLength) {
+			ssize_t nWritten = (pBuf->nFileOffset == (UINT64)(-1)) ?
+				write(pBuf->nFileDescriptor, pBuf->pData + nDone, pBuf->nLength - nDone) :
+				pwrite(pBuf->nFileDescriptor, pBuf->pData + nDone, pBuf->nLength - nDone,
+					(off_t)(pBuf->nFileOffset + nDone));
+			if (nWritten <= 0)
+				break;
+			nDone += (UINT32)nWritten;
+		}
+		pBuf->nResult = (INT32)nDone;
+	}
+	if (pBuf->bWrite && pBuf->nResult == (INT32)pBuf->nLength)
+		pBuf->nState = ASYNC_IO_FREE;										// Written buffers go straight back to the pool
+	else
+		pBuf->nState = ASYNC_IO_COMPLETE;									// Reads (and failed writes) wait for the caller
+
+	return 1;
+}
+
+// *********************************************************************************************************************************
+// _AsyncIOGetBuffer() returns the index of a free pool buffer, reaping completed writes if the pool is exhausted
+// Returns -1 if every buffer holds read data the caller has not released
+//
+INT16 _AsyncIOGetBuffer(AsyncIO* pAsyncIO) {
+	for (;;) {
+		for (UINT8 blp = 0; blp < pAsyncIO->nBuffers; blp++) {
+			if (pAsyncIO->Buffers[blp].nState == ASYNC_IO_FREE)
+				return blp;
+		}
+		if (pAsyncIO->nInFlight == 0)										// Nothing will come back to the pool
+			return (-1);
+		if (_AsyncIOReap(pAsyncIO, true) < 0)
+			return (-1);
+	}
+}
+
+// *********************************************************************************************************************************
+// _AsyncIOSubmit() queues a fixed-buffer read or write; an offset of (UINT64)-1 means the current file position,
+//  which is what pipes and stdout need
+//
+INT16 _AsyncIOSubmit(AsyncIO* pAsyncIO, bool bWrite, int nFileDescriptor, UINT8 nBuf, UINT64 nFileOffset, UINT32 nLength) {
+	AsyncIOBuf* pBuf = &pAsyncIO->Buffers[nBuf];
+	struct io_uring_sqe* pSQE = io_uring_get_sqe(&pAsyncIO->Ring);
+
+	if (pSQE == NULL) {														// Ring is full, so flush it and try again
+		io_uring_submit(&pAsyncIO->Ring);
+		if ((pSQE = io_uring_get_sqe(&pAsyncIO->Ring)) == NULL) {
+			pAsyncIO->nErrorCode = (-83);
+			swprintf_s(pAsyncIO->sRetErrDescription,
+				_countof(pAsyncIO->sRetErrDescription),
+				_T("EC(-83) io_uring submission queue is full!"));
+			return pAsyncIO->nErrorCode;
+		}
+	}
+	nLength = min(nLength, pAsyncIO->nBufferSize);
+
+	if (bWrite)
+		io_uring_prep_write_fixed(pSQE, nFileDescriptor, pBuf->pData, nLength, nFileOffset, nBuf);
+	else
+		io_uring_prep_read_fixed(pSQE, nFileDescriptor, pBuf->pData, nLength, nFileOffset, nBuf);
+	io_uring_sqe_set_data64(pSQE, (unsigned long long)nBuf);
+
+	pBuf->bWrite = bWrite;
+	pBuf->nFileDescriptor = nFileDescriptor;
+	pBuf->nFileOffset = nFileOffset;
+	pBuf->nLength = nLength;
+	pBuf->nResult = 0;
+	pBuf->nState = ASYNC_IO_IN_FLIGHT;
+	pAsyncIO->nInFlight++;
+
+	io_uring_submit(&pAsyncIO->Ring);
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _AsyncIOWait() blocks until buffer nBuf has completed (or nBuf = -1, until nothing is in flight)
+//
+INT16 _AsyncIOWait(AsyncIO* pAsyncIO, INT16 nBuf) {
+	while (pAsyncIO->nInFlight > 0 &&
+		(nBuf < 0 || pAsyncIO->Buffers[nBuf].nState == ASYNC_IO_IN_FLIGHT)) {
+		INT16 nRet = _AsyncIOReap(pAsyncIO, true);
+		if (nRet < 0)
+			return nRet;
+	}
+	for (UINT8 blp = 0; blp < pAsyncIO->nBuffers; blp++) {					// Report any write that did not complete
+		AsyncIOBuf* pBuf = &pAsyncIO->Buffers[blp];
+
+		if ((nBuf < 0 || nBuf == blp) && pBuf->bWrite && pBuf->nState == ASYNC_IO_COMPLETE) {
+			pBuf->nState = ASYNC_IO_FREE;
+			pAsyncIO->nErrorCode = (-84);
+			swprintf_s(pAsyncIO->sRetErrDescription,
+				_countof(pAsyncIO->sRetErrDescription),
+				_T("EC(-84) Asynchronous write failed, error %d!"), pBuf->nResult < 0 ? -pBuf->nResult : 0);
+			return pAsyncIO->nErrorCode;
+		}
+	}
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _AsyncIOReleaseReads() returns every completed read buffer to the pool (once its band has been decoded)
+//
+void _AsyncIOReleaseReads(AsyncIO* pAsyncIO) {
+	for (UINT8 blp = 0; blp < pAsyncIO->nBuffers; blp++) {
+		if (!pAsyncIO->Buffers[blp].bWrite && pAsyncIO->Buffers[blp].nState == ASYNC_IO_COMPLETE)
+			pAsyncIO->Buffers[blp].nState = ASYNC_IO_FREE;
+	}
+}
+
+// *********************************************************************************************************************************
+// _AsyncIOClose() waits for outstanding requests, then tears down the ring and frees the pool
+//
+void _AsyncIOClose(AsyncIO* pAsyncIO) {
+	if (pAsyncIO->bEnabled) {
+		_AsyncIOWait(pAsyncIO, -1);
+		io_uring_unregister_buffers(&pAsyncIO->Ring);
+		io_uring_queue_exit(&pAsyncIO->Ring);
+	}
+	for (UINT8 blp = 0; blp < pAsyncIO->nBuffers; blp++) {
+		free(pAsyncIO->Buffers[blp].pData);
+		pAsyncIO->Buffers[blp].pData = NULL;
+	}
+	pAsyncIO->bEnabled = false;
+	pAsyncIO->nBuffers = 0;
+}
+
+// *********************************************************************************************************************************
+// LibTIFF client procedures, so LibTIFF reads the input image through the prefetched pool buffers
+// A read that falls entirely inside a prefetched (or in-flight) buffer is copied from it; anything else falls back to pread()
+//
+tmsize_t _AsyncTIFFRead(thandle_t hSource, void* pData, tmsize_t nSize) {
+	AsyncTIFFSrc* pSrc = (AsyncTIFFSrc*)hSource;
+	AsyncIO* pAsyncIO = pSrc->pAsyncIO;
+
+	for (UINT8 blp = 0; blp < pAsyncIO->nBuffers; blp++) {
+		AsyncIOBuf* pBuf = &pAsyncIO->Buffers[blp];
+
+		if (pBuf->bWrite || pBuf->nState == ASYNC_IO_FREE || pBuf->nFileDescriptor != pSrc->nFileDescriptor ||
+			pSrc->nPosition < pBuf->nFileOffset ||
+			pSrc->nPosition + (UINT64)nSize > pBuf->nFileOffset + pBuf->nLength)
+			continue;
+
+		if (pBuf->nState == ASYNC_IO_IN_FLIGHT && _AsyncIOWait(pAsyncIO, blp) < 0)
+			break;
+		if (pBuf->nResult < 0 || pSrc->nPosition + (UINT64)nSize > pBuf->nFileOffset + (UINT64)pBuf->nResult)
+			break;															// Short read, let pread() sort it out
+
+		memcpy(pData, pBuf->pData + (pSrc->nPosition - pBuf->nFileOffset), (size_t)nSize);
+		pSrc->nPosition += (UINT64)nSize;
+		return nSize;
+	}
+	ssize_t nRead = pread(pSrc->nFileDescriptor, pData, (size_t)nSize, (off_t)pSrc->nPosition);
+	if (nRead > 0)
+		pSrc->nPosition += (UINT64)nRead;
+	return (tmsize_t)nRead;
+}
+
+tmsize_t _AsyncTIFFWrite(thandle_t hSource, void* pData, tmsize_t nSize) {
+	return (tmsize_t)(-1);													// The input image is read only
+}
+
+toff_t _AsyncTIFFSeek(thandle_t hSource, toff_t nOffset, int nWhence) {
+	AsyncTIFFSrc* pSrc = (AsyncTIFFSrc*)hSource;
+
+	if (nWhence == SEEK_SET)
+		pSrc->nPosition = nOffset;
+	else if (nWhence == SEEK_CUR)
+		pSrc->nPosition += nOffset;
+	else
+		pSrc->nPosition = pSrc->nFileSize + nOffset;
+	return pSrc->nPosition;
+}
+
+int _AsyncTIFFClose(thandle_t hSource) {
+	AsyncTIFFSrc* pSrc = (AsyncTIFFSrc*)hSource;
+	int nRet = close(pSrc->nFileDescriptor);
+
+	delete pSrc;
+	return nRet;
+}
+
+toff_t _AsyncTIFFSize(thandle_t hSource) {
+	return ((AsyncTIFFSrc*)hSource)->nFileSize;
+}
+
+int _AsyncTIFFMap(thandle_t hSource, void** pBase, toff_t* nSize) {
+	return 0;																// No memory mapping, reads go through the ring
+}
+
+void _AsyncTIFFUnmap(thandle_t hSource, void* pBase, toff_t nSize) {
+}
+
+// *********************************************************************************************************************************
+// _AsyncIOOpenTIFF() opens sFileName for LibTIFF with reads served from the pool
+//
+TIFF* _AsyncIOOpenTIFF(AsyncIO* pAsyncIO, const char* sFileName) {
+	struct stat fileStat;
+	int nFileDescriptor = open(sFileName, O_RDONLY);
+
+	if (nFileDescriptor < 0)
+		return NULL;
+	if (fstat(nFileDescriptor, &fileStat) != 0) {
+		close(nFileDescriptor);
+		return NULL;
+	}
+	AsyncTIFFSrc* pSrc = new AsyncTIFFSrc;
+	pSrc->pAsyncIO = pAsyncIO;
+	pSrc->nFileDescriptor = nFileDescriptor;
+	pSrc->nFileSize = (UINT64)fileStat.st_size;
+
+	TIFF* inputTIFF = TIFFClientOpen(sFileName, "rm", (thandle_t)pSrc, _AsyncTIFFRead, _AsyncTIFFWrite,
+		_AsyncTIFFSeek, _AsyncTIFFClose, _AsyncTIFFSize, _AsyncTIFFMap, _AsyncTIFFUnmap);
+	if (inputTIFF == NULL)
+		_AsyncTIFFClose((thandle_t)pSrc);									// TIFFClientOpen() does not close on failure
+	return inputTIFF;
+}
+
+// *********************************************************************************************************************************
+// _AsyncIOPrefetch() queues reads for the byte range nFileOffset .. nFileOffset + nLength - 1 of the file behind inputTIFF,
+//  split across as many free pool buffers as it takes; whatever does not fit is read by pread() later
+//
+INT16 _AsyncIOPrefetch(AsyncIO* pAsyncIO, TIFF* inputTIFF, UINT64 nFileOffset, UINT64 nLength) {
+	int nFileDescriptor = ((AsyncTIFFSrc*)TIFFClientdata(inputTIFF))->nFileDescriptor;
+
+	while (nLength > 0) {
+		INT16 nBuf = -1;
+
+		for (UINT8 blp = 0; blp < pAsyncIO->nBuffers && nBuf < 0; blp++) {	// Don't reap writes to make room for a prefetch
+			if (pAsyncIO->Buffers[blp].nState == ASYNC_IO_FREE)
+				nBuf = blp;
+		}
+		if (nBuf < 0)
+			break;
+
+		UINT32 nChunk = (UINT32)min(nLength, (UINT64)pAsyncIO->nBufferSize);
+		INT16 nRet = _AsyncIOSubmit(pAsyncIO, false, nFileDescriptor, (UINT8)nBuf, nFileOffset, nChunk);
+		if (nRet != 0)
+			return nRet;
+
+		nFileOffset += nChunk;
+		nLength -= nChunk;
+	}
+	return 0;
+}
+
+#else // No io_uring in this build, so the band reader and RTL writer stay on blocking I/O (-u warns, see SPEEDJob)
+
+INT16 _AsyncIOInit(AsyncIO* pAsyncIO, UINT8 /* nBuffers */, UINT32 /* nBufferSize */) {
+	pAsyncIO->nErrorCode = (-81);
+	swprintf_s(pAsyncIO->sRetErrDescription,
+		_countof(pAsyncIO->sRetErrDescription),
+		_T("EC(-81) io_uring backend is not available in this build!"));
+	return pAsyncIO->nErrorCode;
+}
+
+INT16 _AsyncIOGetBuffer(AsyncIO* /* pAsyncIO */) { return (-1); }
+INT16 _AsyncIOSubmit(AsyncIO* /* pAsyncIO */, bool /* bWrite */, int /* nFileDescriptor */, UINT8 /* nBuf */,
+	UINT64 /* nFileOffset */, UINT32 /* nLength */) { return (-81); }
+INT16 _AsyncIOWait(AsyncIO* /* pAsyncIO */, INT16 /* nBuf */) { return 0; }
+void _AsyncIOReleaseReads(AsyncIO* /* pAsyncIO */) {}
+void _AsyncIOClose(AsyncIO* /* pAsyncIO */) {}
+TIFF* _AsyncIOOpenTIFF(AsyncIO* /* pAsyncIO */, const char* /* sFileName */) { return NULL; }
+INT16 _AsyncIOPrefetch(AsyncIO* /* pAsyncIO */, TIFF* /* inputTIFF */, UINT64 /* nFileOffset */, UINT64 /* nLength */) { return 0; }
+
+#endif
@@ -0,0 +1,175 @@
+// Batch mode (-B<manifest>): RIP every file listed in a manifest in one process
+// Each manifest line is a job descriptor, the same switches as the command line (e.g. -i/proofs/a.tif -o/proofs/a.prn -x720
+//  -y720 -s50 -k9); blank lines and lines starting with # are skipped. Switches given on the command line itself (other than
+//  -B, -p, -j, -D and -S) are defaults for every line, and the line's own switches override them
+// Every line names its own output (-o<path>): -o and -f are refused on the command line, and lines without -o, or that
+//  would read stdin or write stdout or an inherited descriptor (-f), fail like any other bad line
+// One file can keep at most 2 x inks cores busy (even/odd rows x channels, see HalftoneImageFlt()), so a large core budget is
+//  spent on several files at once: -j files run concurrently, each with -p / -j cores (by default 8 cores per file)
+// Files are started largest first, so one big file does not end up running alone at the end; they share one ContextPool,
+//  so files with the same kernel, inks and DPI reuse the LUTs and buffers of the files before them
+
+#define INT8	signed __int8
+#define INT16	signed __int16
+#define INT32	signed __int32
+#define UINT8 	unsigned __int8
+#define UINT16	unsigned __int16
+#define UINT32	unsigned __int32
+
+#include <atomic>
+#include <sys/stat.h>
+
+#define BATCH_CORES_PER_FILE	8											// 2 x 4 inks, what one CMYK file can use
+
+typedef struct BatchManifestRun {
+	string strManifestPath;													// -B, "-" = stdin
+	std::vector<string> DefaultArguments;									// Command line switches applied to every line
+	int nCoreBudget					= 1;									// Cores shared by all files (-p)
+	int nConcurrentJobs				= 0;									// Files run at once (-j), 0 = budget / 8
+	bool bVerbose					= false;								// Report every file to stderr
+	UINT32 nJobsDone				= 0;
+	UINT32 nJobsFailed				= 0;
+	INT16 nErrorCode				= 0;									// Return error code (first file that failed)
+	TCHAR sRetErrDescription[128];											// Return error message
+} BatchRun;
+
+typedef struct BatchManifestEntry {
+	string strJobLine;														// Switches from the manifest
+	UINT32 nLine					= 0;									// Manifest line number, for messages
+	UINT64 nInputBytes				= 0;									// Size of the -i file, for largest first
+	INT16 nErrorCode				= 0;
+	TCHAR sRetErrDescription[128];
+} BatchEntry;
+
+// *********************************************************************************************************************************
+// _ReadBatchManifest() reads the job lines of the manifest, and the size of each input file
+//
+INT16 _ReadBatchManifest(BatchRun* pBatch, std::vector<BatchEntry>& Entries) {
+	bool bStdin = (pBatch->strManifestPath == "-");
+	FILE* pManifest = bStdin ? stdin : fopen(pBatch->strManifestPath.c_str(), "r");
+	char sLine[4096];
+	UINT32 nLine = 0;
+
+	if (pManifest == NULL) {
+		pBatch->nErrorCode = (-88);
+		swprintf_s(pBatch->sRetErrDescription,
+			_countof(pBatch->sRetErrDescription),
+			_T("EC(-88) Failed to read batch manifest %hs!"), pBatch->strManifestPath.c_str());
+		return pBatch->nErrorCode;
+	}
+	while (fgets(sLine, sizeof(sLine), pManifest) != NULL) {
+		BatchEntry Entry;
+		std::vector<string> Arguments;
+
+		nLine++;
+		_SplitJobLine(sLine, Arguments);
+		if (Arguments.empty() || Arguments[0][0] == '#')
+			continue;
+
+		Entry.strJobLine = sLine;
+		while (!Entry.strJobLine.empty() && (Entry.strJobLine.back() == '\n' || Entry.strJobLine.back() == '\r'))
+			Entry.strJobLine.pop_back();
+		Entry.nLine = nLine;
+		for (const string& strArg : Arguments) {
+			struct stat InputStat;
+
+			if (strArg.compare(0, 2, "-i") == 0 && stat(strArg.c_str() + 2, &InputStat) == 0)
+				Entry.nInputBytes = (UINT64)InputStat.st_size;
+		}
+		Entries.push_back(Entry);
+	}
+	if (!bStdin)
+		fclose(pManifest);
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _RunBatchManifest() runs every file of the manifest; returns 0, or the error code of the first file (in manifest order)
+//  that failed, after all the others have run
+//
+INT16 _RunBatchManifest(BatchRun* pBatch) {
+	std::vector<BatchEntry> Entries;
+	std::vector<size_t> Order;
+	std::vector<std::thread> Workers;
+	std::atomic<size_t> nNext(0);
+	std::mutex ResultLock;
+	ContextPool Pool;
+
+	for (const string& strArg : pBatch->DefaultArguments) {
+		if (strArg.compare(0, 2, "-o") == 0 || strArg.compare(0, 2, "-f") == 0) {
+			pBatch->nErrorCode = (-89);
+			swprintf_s(pBatch->sRetErrDescription,
+				_countof(pBatch->sRetErrDescription),
+				_T("EC(-89) Batch output goes on each manifest line, not %hs!"), strArg.c_str());
+			return pBatch->nErrorCode;
+		}
+	}
+	if (_ReadBatchManifest(pBatch, Entries) != 0)
+		return pBatch->nErrorCode;
+
+	int nConcurrentJobs = (pBatch->nConcurrentJobs > 0) ? pBatch->nConcurrentJobs :
+		max(pBatch->nCoreBudget / BATCH_CORES_PER_FILE, 1);
+	nConcurrentJobs = max(min(nConcurrentJobs, (int)Entries.size()), 1);
+	int nJobCores = max(pBatch->nCoreBudget / nConcurrentJobs, 1);
+
+	for (size_t elp = 0; elp < Entries.size(); elp++)
+		Order.push_back(elp);
+	std::stable_sort(Order.begin(), Order.end(), [&Entries](size_t a, size_t b) {
+		return Entries[a].nInputBytes > Entries[b].nInputBytes; });			// Largest first
+
+	if (pBatch->bVerbose)
+		std::wcerr << "Batch: " << Entries.size() << " files, " << nConcurrentJobs << " at a time x " << nJobCores
+			<< " cores" << std::endl;
+
+	auto BatchWorker = [&]() {
+		for (size_t nIndex = nNext++; nIndex < Order.size(); nIndex = nNext++) {
+			BatchEntry* pEntry = &Entries[Order[nIndex]];
+			std::unique_ptr<SPEEDJob> pJob(new SPEEDJob);
+			std::vector<string> Arguments = pBatch->DefaultArguments;
+
+			_SplitJobLine(pEntry->strJobLine, Arguments);
+			if (_ParseJobArguments(pJob.get(), Arguments) == 0 && _CheckJobStreams(pJob.get(), "Batch") == 0) {
+				if (!pJob->bWriteOutput) {
+					pJob->nErrorCode = (-88);
+					swprintf_s(pJob->sRetErrDescription,
+						_countof(pJob->sRetErrDescription),
+						_T("EC(-88) Batch line has no -o<path>!"));
+				}
+			}
+			if (pJob->nErrorCode == 0) {
+				pJob->nMaxCores = (pJob->nMaxCores > 0) ? min(pJob->nMaxCores, nJobCores) : nJobCores;
+				_RunSPEEDJob(pJob.get(), &Pool);
+			}
+			pEntry->nErrorCode = pJob->nErrorCode;
+			swprintf_s(pEntry->sRetErrDescription, _countof(pEntry->sRetErrDescription), _T("%ls"),
+				pJob->nErrorCode != 0 ? pJob->sRetErrDescription : _T(""));
+
+			std::lock_guard<std::mutex> Lock(ResultLock);
+			if (pEntry->nErrorCode == 0)
+				pBatch->nJobsDone++;
+			else
+				pBatch->nJobsFailed++;
+			if (pEntry->nErrorCode != 0 || pBatch->bVerbose)
+				std::wcerr << "Line " << pEntry->nLine << ": " << (pEntry->nErrorCode == 0 ? _T("done") :
+					pEntry->sRetErrDescription) << std::endl;
+		}
+	};
+	for (int wlp = 1; wlp < nConcurrentJobs; wlp++)
+		Workers.emplace_back(BatchWorker);
+	BatchWorker();															// This thread is a worker too
+	for (std::thread& Worker : Workers)
+		Worker.join();
+
+	for (const BatchEntry& Entry : Entries) {								// First failure in manifest order
+		if (Entry.nErrorCode != 0 && pBatch->nErrorCode == 0) {
+			pBatch->nErrorCode = Entry.nErrorCode;
+			swprintf_s(pBatch->sRetErrDescription, _countof(pBatch->sRetErrDescription), _T("%ls"),
+				Entry.sRetErrDescription);
+		}
+	}
+	if (pBatch->bVerbose)
+		std::wcerr << "Batch: " << pBatch->nJobsDone << " done, " << pBatch->nJobsFailed << " failed, "
+			<< Pool.nWarmStarts << " warm starts, " << Pool.nColdStarts << " cold" << std::endl;
+	_FreeContextPool(&Pool);
+	return pBatch->nErrorCode;
+}
@@ -0,0 +1,264 @@
+// Input color decoding: CIELab and YCbCr images turned into RGB in registers, as the separation (or color LUT) stage loads them
+// LibTIFF's own converters (TIFFCIELabToRGB, TIFFYCbCrtoRGB in tif_color.c) work a pixel at a time through 8-bit RGBA; here the
+//  three samples of 4 pixels are loaded as floats (0. - 1. of full scale, see _LoadSamples4()) and decoded with SSE2 right before
+//  the CMYK sums, so no RGB band is ever written. The separation cache keys on the raw samples, so repeated colors skip the
+//  decode as well. The scalar tail goes through the same vector code one pixel at a time, so both give identical inks
+//	CIELab / ICCLab									L* a* b* (D50) to XYZ, Bradford adapted to linear sRGB, sRGB gamma
+//	YCbCr											TIFF luma coefficients and reference black / white, to RGB
+// The sRGB gamma is a polynomial log2 / exp2 pair (relative error about 1e-6, under a 16-bit step). JPEG compressed YCbCr,
+//  usually chroma subsampled, is decoded to RGB by the JPEG codec itself (TIFFTAG_JPEGCOLORMODE, see TIFF_Stuff)
+// A color LUT (ColorLUT) is indexed by the image's own samples instead; CIELab a* b* are signed, so they are re-centred
+//  (ICC Lab, 0 = a* b* of -128) first, see _ColorDecodeKeyFlip()
+
+#define INT8	signed __int8
+#define INT16	signed __int16
+#define INT32	signed __int32
+#define UINT8 	unsigned __int8
+#define UINT16	unsigned __int16
+#define UINT32	unsigned __int32
+#define UINT64	unsigned __int64
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ED_USE_SSE2
+#include <emmintrin.h>
+#endif
+#include <math.h>
+
+#define COLOR_SPACE_RGB			0											// Samples are R, G, B, nothing to decode
+#define COLOR_SPACE_CIELAB		1											// L*, a*, b*, a* and b* signed (PHOTOMETRIC_CIELAB)
+#define COLOR_SPACE_ICCLAB		2											// L*, a*, b*, a* and b* offset by 128 (PHOTOMETRIC_ICCLAB)
+#define COLOR_SPACE_YCBCR		3											// Y, Cb, Cr, one of each per pixel (PHOTOMETRIC_YCBCR)
+
+typedef struct ColorDecodeParameters {
+	UINT8 nColorSpace				= COLOR_SPACE_RGB;						// What the 3 input samples are
+	float dLuma[3]					= { 0.299F, 0.587F, 0.114F };			// YCbCr: share of R, G, B in Y (TIFFTAG_YCBCRCOEFFICIENTS)
+	float dReference[6]				= {};									// YCbCr: black, white codes of Y, Cb, Cr (all 0 = full range)
+} ColorDecode;
+
+typedef struct ColorDecoderConstants {
+	UINT8 nColorSpace				= COLOR_SPACE_RGB;
+	float dScale[3]					= {};									// Sample (0. - 1.) to L*, a*, b* or Y', Cb', Cr' ...
+	float dOffset[3]				= {};									//  ... = sample x dScale - dOffset
+	float dWrapAt					= 2.F;									// CIELab: a* b* at or over this sample are negative
+	float dRedCr					= 0.F;									// YCbCr: R = Y' + dRedCr x Cr'
+	float dBlueCb					= 0.F;									//  B = Y' + dBlueCb x Cb'
+	float dGreenCb					= 0.F;									//  G = Y' - dGreenCb x Cb' - dGreenCr x Cr'
+	float dGreenCr					= 0.F;
+} ColorDecoder;
+
+// *********************************************************************************************************************************
+// _SetColorDecode() sets the decode for a TIFF photometric model; returns false if the model has no RGB decode here
+//
+bool _SetColorDecode(ColorDecode* pDecode, UINT16 nPhotometric, const float* dLuma, const float* dReference) {
+	switch (nPhotometric) {
+	case PHOTOMETRIC_RGB:		pDecode->nColorSpace = COLOR_SPACE_RGB;		break;
+	case PHOTOMETRIC_CIELAB:	pDecode->nColorSpace = COLOR_SPACE_CIELAB;	break;
+	case PHOTOMETRIC_ICCLAB:	pDecode->nColorSpace = COLOR_SPACE_ICCLAB;	break;
+	case PHOTOMETRIC_YCBCR:		pDecode->nColorSpace = COLOR_SPACE_YCBCR;	break;
+	default:					return false;
+	}
+	for (UINT8 clp = 0; clp < 3 && dLuma != NULL; clp++)
+		pDecode->dLuma[clp] = dLuma[clp];
+	for (UINT8 rlp = 0; rlp < 6; rlp++)
+		pDecode->dReference[rlp] = (dReference != NULL) ? dReference[rlp] : 0.F;
+	return true;
+}
+
+// *********************************************************************************************************************************
+// _PrepareColorDecoder() works out the constants for nImageBitDepth samples; returns false for RGB (nothing to decode)
+//
+bool _PrepareColorDecoder(const ColorDecode* pDecode, UINT8 nImageBitDepth, ColorDecoder* pDecoder) {
+	float dFull = (nImageBitDepth == 8) ? 255.F : 65535.F;					// Full scale code, the samples are code / dFull
+
+	*pDecoder = ColorDecoder();
+	pDecoder->nColorSpace = (pDecode != NULL) ? pDecode->nColorSpace : COLOR_SPACE_RGB;
+	if (pDecoder->nColorSpace == COLOR_SPACE_RGB)
+		return false;
+
+	if (pDecoder->nColorSpace == COLOR_SPACE_YCBCR) {
+		float dChroma = (nImageBitDepth == 8) ? 127.F : 32767.F;			// Chroma coding range, Cb' and Cr' are -0.5 - 0.5
+		float dRef[6] = { 0.F, dFull, dFull / 2.F + 0.5F, dFull, dFull / 2.F + 0.5F, dFull };
+		float dKr = pDecode->dLuma[0], dKg = pDecode->dLuma[1], dKb = pDecode->dLuma[2];
+
+		if (pDecode->dReference[1] > pDecode->dReference[0])				// Reference black / white from the image
+			for (UINT8 rlp = 0; rlp < 6; rlp++)
+				dRef[rlp] = pDecode->dReference[rlp];
+		for (UINT8 clp = 0; clp < 3; clp++) {								// Code to Y' (0 - 1), Cb', Cr' (-0.5 - 0.5)
+			float dRange = fmaxf(dRef[2 * clp + 1] - dRef[2 * clp], 1.F) * ((clp == 0) ? 1.F : dFull / dChroma);
+			pDecoder->dScale[clp] = dFull / dRange;
+			pDecoder->dOffset[clp] = dRef[2 * clp] / dRange;
+		}
+		pDecoder->dRedCr = 2.F - 2.F * dKr;
+		pDecoder->dBlueCb = 2.F - 2.F * dKb;
+		pDecoder->dGreenCb = dKb * pDecoder->dBlueCb / dKg;
+		pDecoder->dGreenCr = dKr * pDecoder->dRedCr / dKg;
+		return true;
+	}
+	pDecoder->dScale[0] = 100.F;											// L*, 0 - 100 either way
+	for (UINT8 clp = 1; clp < 3; clp++) {									// a*, b*: 8-bit in units, 16-bit in 1/256 units
+		pDecoder->dScale[clp] = dFull / ((nImageBitDepth == 8) ? 1.F : 256.F);
+		pDecoder->dOffset[clp] = (pDecoder->nColorSpace == COLOR_SPACE_ICCLAB) ? 128.F : 0.F;
+	}
+	if (pDecoder->nColorSpace == COLOR_SPACE_CIELAB)						// Signed: codes from half scale up are negative
+		pDecoder->dWrapAt = 0.5F;
+	return true;
+}
+
+// *********************************************************************************************************************************
+// _ColorDecodeKeyFlip() is what to XOR the raw samples (packed 16 bits each, see _PixelKey()) with to index a color LUT: CIELab
+//  a* and b* get their sign bit flipped, which re-centres them like ICC Lab; every other input is used as it is
+//
+UINT64 _ColorDecodeKeyFlip(const ColorDecode* pDecode, UINT8 nImageBitDepth) {
+	UINT64 nSignBit = (nImageBitDepth == 8) ? 0x80 : 0x8000;
+
+	if (pDecode == NULL || pDecode->nColorSpace != COLOR_SPACE_CIELAB)
+		return 0;
+	return (nSignBit << 16) | (nSignBit << 32);
+}
+
+#ifdef ED_USE_SSE2
+// *********************************************************************************************************************************
+// _Log2Approx4() and _Exp2Approx4() are log2 and exp2 of 4 floats, polynomials on the mantissa and the fraction
+//
+static inline __m128 _Log2Approx4(__m128 vX) {
+	__m128i vBits = _mm_castps_si128(vX);
+	__m128 vExponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(vBits, 23), _mm_set1_epi32(127)));
+	__m128 vMantissa = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(vBits, _mm_set1_epi32(0x007FFFFF)),
+		_mm_set1_epi32(0x3F800000)));										// 1. - 2.
+	__m128 vPoly = _mm_set1_ps(-3.4436006e-2F);
+
+	vPoly = _mm_add_ps(_mm_mul_ps(vPoly, vMantissa), _mm_set1_ps(3.1821337e-1F));
+	vPoly = _mm_add_ps(_mm_mul_ps(vPoly, vMantissa), _mm_set1_ps(-1.2315303F));
+	vPoly = _mm_add_ps(_mm_mul_ps(vPoly, vMantissa), _mm_set1_ps(2.5988452F));
+	vPoly = _mm_add_ps(_mm_mul_ps(vPoly, vMantissa), _mm_set1_ps(-3.3241990F));
+	vPoly = _mm_add_ps(_mm_mul_ps(vPoly, vMantissa), _mm_set1_ps(3.1157899F));
+	return _mm_add_ps(_mm_mul_ps(vPoly, _mm_sub_ps(vMantissa, _mm_set1_ps(1.F))), vExponent);
+}
+
+static inline __m128 _Exp2Approx4(__m128 vX) {
+	vX = _mm_max_ps(_mm_min_ps(vX, _mm_set1_ps(127.F)), _mm_set1_ps(-126.F));
+	__m128i vWhole = _mm_cvtps_epi32(_mm_sub_ps(vX, _mm_set1_ps(0.5F)));	// Floor (a fraction of 1. is as good as 0.)
+	__m128 vFraction = _mm_sub_ps(vX, _mm_cvtepi32_ps(vWhole));
+	__m128 vPoly = _mm_set1_ps(1.8775767e-3F);
+
+	vPoly = _mm_add_ps(_mm_mul_ps(vPoly, vFraction), _mm_set1_ps(8.9893397e-3F));
+	vPoly = _mm_add_ps(_mm_mul_ps(vPoly, vFraction), _mm_set1_ps(5.5826318e-2F));
+	vPoly = _mm_add_ps(_mm_mul_ps(vPoly, vFraction), _mm_set1_ps(2.4015361e-1F));
+	vPoly = _mm_add_ps(_mm_mul_ps(vPoly, vFraction), _mm_set1_ps(6.9315308e-1F));
+	vPoly = _mm_add_ps(_mm_mul_ps(vPoly, vFraction), _mm_set1_ps(9.9999994e-1F));
+	return _mm_mul_ps(vPoly, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(vWhole, _mm_set1_epi32(127)), 23)));
+}
+
+// *********************************************************************************************************************************
+// _SRGBEncode4() clamps linear light to 0. - 1. and applies the sRGB gamma
+//
+static inline __m128 _SRGBEncode4(__m128 vLinear) {
+	vLinear = _mm_min_ps(_mm_max_ps(vLinear, _mm_setzero_ps()), _mm_set1_ps(1.F));
+	__m128 vToe = _mm_mul_ps(vLinear, _mm_set1_ps(12.92F));
+	__m128 vCurve = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(1.055F),
+		_Exp2Approx4(_mm_mul_ps(_Log2Approx4(vLinear), _mm_set1_ps(1.F / 2.4F)))), _mm_set1_ps(0.055F));
+	__m128 vIsToe = _mm_cmple_ps(vLinear, _mm_set1_ps(0.0031308F));
+
+	return _mm_or_ps(_mm_and_ps(vIsToe, vToe), _mm_andnot_ps(vIsToe, vCurve));
+}
+
+// *********************************************************************************************************************************
+// _LabInverse4() is the inverse of the CIELab companding, f^-1(t): t^3, or the linear segment below 6/29
+//
+static inline __m128 _LabInverse4(__m128 vT) {
+	__m128 vCube = _mm_mul_ps(_mm_mul_ps(vT, vT), vT);
+	__m128 vLinear = _mm_mul_ps(_mm_set1_ps(3.F * (6.F / 29.F) * (6.F / 29.F)), _mm_sub_ps(vT, _mm_set1_ps(4.F / 29.F)));
+	__m128 vIsCube = _mm_cmpgt_ps(vT, _mm_set1_ps(6.F / 29.F));
+
+	return _mm_or_ps(_mm_and_ps(vIsCube, vCube), _mm_andnot_ps(vIsCube, vLinear));
+}
+
+// *********************************************************************************************************************************
+// _DecodeColor4() decodes 4 pixels in place: *pv0 - *pv2 hold the 3 samples (0. - 1. of full scale) and get R, G, B (0. - 1.)
+//
+static inline void _DecodeColor4(const ColorDecoder* pDecoder, __m128* pv0, __m128* pv1, __m128* pv2) {
+	__m128 v0 = _mm_sub_ps(_mm_mul_ps(*pv0, _mm_set1_ps(pDecoder->dScale[0])), _mm_set1_ps(pDecoder->dOffset[0]));
+	__m128 v1 = _mm_sub_ps(_mm_mul_ps(*pv1, _mm_set1_ps(pDecoder->dScale[1])), _mm_set1_ps(pDecoder->dOffset[1]));
+	__m128 v2 = _mm_sub_ps(_mm_mul_ps(*pv2, _mm_set1_ps(pDecoder->dScale[2])), _mm_set1_ps(pDecoder->dOffset[2]));
+
+	if (pDecoder->nColorSpace == COLOR_SPACE_YCBCR) {						// Y', Cb', Cr' to R, G, B
+		__m128 vR = _mm_add_ps(v0, _mm_mul_ps(_mm_set1_ps(pDecoder->dRedCr), v2));
+		__m128 vB = _mm_add_ps(v0, _mm_mul_ps(_mm_set1_ps(pDecoder->dBlueCb), v1));
+		__m128 vG = _mm_sub_ps(_mm_sub_ps(v0, _mm_mul_ps(_mm_set1_ps(pDecoder->dGreenCb), v1)),
+			_mm_mul_ps(_mm_set1_ps(pDecoder->dGreenCr), v2));
+		__m128 vZero = _mm_setzero_ps(), vOne = _mm_set1_ps(1.F);
+
+		*pv0 = _mm_min_ps(_mm_max_ps(vR, vZero), vOne);
+		*pv1 = _mm_min_ps(_mm_max_ps(vG, vZero), vOne);
+		*pv2 = _mm_min_ps(_mm_max_ps(vB, vZero), vOne);
+		return;
+	}
+	__m128 vWrap = _mm_set1_ps(256.F), vWrapAt = _mm_set1_ps(pDecoder->dWrapAt);	// Signed a* b*: two's complement
+	v1 = _mm_sub_ps(v1, _mm_and_ps(_mm_cmpge_ps(*pv1, vWrapAt), vWrap));
+	v2 = _mm_sub_ps(v2, _mm_and_ps(_mm_cmpge_ps(*pv2, vWrapAt), vWrap));
+
+	__m128 vFy = _mm_mul_ps(_mm_add_ps(v0, _mm_set1_ps(16.F)), _mm_set1_ps(1.F / 116.F));
+	__m128 vX = _mm_mul_ps(_mm_set1_ps(0.9642F), _LabInverse4(_mm_add_ps(vFy, _mm_mul_ps(v1, _mm_set1_ps(1.F / 500.F)))));
+	__m128 vY = _LabInverse4(vFy);
+	__m128 vZ = _mm_mul_ps(_mm_set1_ps(0.8249F), _LabInverse4(_mm_sub_ps(vFy, _mm_mul_ps(v2, _mm_set1_ps(1.F / 200.F)))));
+
+	*pv0 = _SRGBEncode4(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(3.1338561F), vX),	// XYZ (D50) to linear sRGB
+		_mm_mul_ps(_mm_set1_ps(-1.6168667F), vY)), _mm_mul_ps(_mm_set1_ps(-0.4906146F), vZ)));
+	*pv1 = _SRGBEncode4(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(-0.9787684F), vX),
+		_mm_mul_ps(_mm_set1_ps(1.9161415F), vY)), _mm_mul_ps(_mm_set1_ps(0.0334540F), vZ)));
+	*pv2 = _SRGBEncode4(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.0719453F), vX),
+		_mm_mul_ps(_mm_set1_ps(-0.2289914F), vY)), _mm_mul_ps(_mm_set1_ps(1.4052427F), vZ)));
+}
+#else
+// *********************************************************************************************************************************
+// _LabInverse() is the inverse of the CIELab companding, f^-1(t): t^3, or the linear segment below 6/29
+//
+static inline float _LabInverse(float dT) {
+	return (dT > 6.F / 29.F) ? dT * dT * dT : 3.F * (6.F / 29.F) * (6.F / 29.F) * (dT - 4.F / 29.F);
+}
+
+// *********************************************************************************************************************************
+// _SRGBEncode() clamps linear light to 0. - 1. and applies the sRGB gamma
+//
+static inline float _SRGBEncode(float dLinear) {
+	dLinear = fminf(fmaxf(dLinear, 0.F), 1.F);
+	return (dLinear <= 0.0031308F) ? dLinear * 12.92F : 1.055F * powf(dLinear, 1.F / 2.4F) - 0.055F;
+}
+#endif
+
+// *********************************************************************************************************************************
+// _DecodeColorPixel() decodes one pixel in place, dSample[0 - 2] (0. - 1. of full scale) to R, G, B (0. - 1.); with SSE2 this
+//  is _DecodeColor4() on one lane, so a pixel decodes the same whether it is in a vector or not
+//
+static inline void _DecodeColorPixel(const ColorDecoder* pDecoder, float* dSample) {
+#ifdef ED_USE_SSE2
+	__m128 v0 = _mm_set1_ps(dSample[0]), v1 = _mm_set1_ps(dSample[1]), v2 = _mm_set1_ps(dSample[2]);
+
+	_DecodeColor4(pDecoder, &v0, &v1, &v2);
+	dSample[0] = _mm_cvtss_f32(v0);
+	dSample[1] = _mm_cvtss_f32(v1);
+	dSample[2] = _mm_cvtss_f32(v2);
+#else
+	float d0 = dSample[0] * pDecoder->dScale[0] - pDecoder->dOffset[0];
+	float d1 = dSample[1] * pDecoder->dScale[1] - pDecoder->dOffset[1];
+	float d2 = dSample[2] * pDecoder->dScale[2] - pDecoder->dOffset[2];
+
+	if (pDecoder->nColorSpace == COLOR_SPACE_YCBCR) {
+		dSample[0] = fminf(fmaxf(d0 + pDecoder->dRedCr * d2, 0.F), 1.F);
+		dSample[1] = fminf(fmaxf(d0 - pDecoder->dGreenCb * d1 - pDecoder->dGreenCr * d2, 0.F), 1.F);
+		dSample[2] = fminf(fmaxf(d0 + pDecoder->dBlueCb * d1, 0.F), 1.F);
+		return;
+	}
+	d1 -= (dSample[1] >= pDecoder->dWrapAt) ? 256.F : 0.F;
+	d2 -= (dSample[2] >= pDecoder->dWrapAt) ? 256.F : 0.F;
+
+	float dFy = (d0 + 16.F) * (1.F / 116.F);
+	float dX = 0.9642F * _LabInverse(dFy + d1 * (1.F / 500.F));
+	float dY = _LabInverse(dFy);
+	float dZ = 0.8249F * _LabInverse(dFy - d2 * (1.F / 200.F));
+
+	dSample[0] = _SRGBEncode(3.1338561F * dX - 1.6168667F * dY - 0.4906146F * dZ);
+	dSample[1] = _SRGBEncode(-0.9787684F * dX + 1.9161415F * dY + 0.0334540F * dZ);
+	dSample[2] = _SRGBEncode(0.0719453F * dX - 0.2289914F * dY + 1.4052427F * dZ);
+#endif
+}
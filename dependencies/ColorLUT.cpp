@@ -0,0 +1,461 @@
+// Profile driven color conversion: 3D (RGB) or 4D (CMYK) color LUTs, interpolated per pixel into 16-bit planar ink bands
+// A device profile is too slow to evaluate per pixel at print resolution, so it is sampled once onto a grid (17 or 33 points
+//  per input is usual) and every pixel is interpolated from the grid. Interpolation is simplex (tetrahedral in 3D): the
+//  fractions of the pixel inside its grid cell are sorted, which picks the nInputs + 1 corners of the one simplex holding
+//  the pixel, and their weights; every output ink is then the same weighted sum of those corners, done 8 inks at a time
+//  with SSE2, so 16 inks cost little more than 4. The band is converted once, on every core, before the scaler reads it,
+//  with repeated colors copied from a per-thread cache (see ColorSeparation)
+//
+// Profile file (text), sampled by whatever color management built it:
+//	GRID_POINTS 17										points per input, 2 - 65
+//	INPUT_CHANNELS 3									3 (RGB) or 4 (CMYK)
+//	OUTPUT_CHANNELS 6									inks, 1 - 16, in color channel order
+//	then one line per grid point, OUTPUT_CHANNELS values of 0. - 1. each; the first input varies slowest (ICC order)
+//	the inputs are the image's own samples, 0 - full scale: RGB, YCbCr, ICC Lab (CIELab images are re-centred, see ColorDecode)
+//	blank lines and # comments are skipped
+//
+// Parsing a profile is slow, so it is compiled once into a binary cache file named after a hash of the profile's bytes
+//  (speedclut_<hash>.clut), which jobs map read-only like the LUT cache (see LUT_Cache.cpp); an edited profile gets a new
+//  hash, so a stale compiled grid is never used. Cache file layout (native byte order, version COLOR_LUT_VERSION):
+//	ColorLUTHeader										64 bytes, padded to a 4 KB page
+//	grid												nGridEntries x nOutputStride UINT16, 0 - 65535
+
+#define INT8	signed __int8
+#define INT16	signed __int16
+#define INT32	signed __int32
+#define INT64	signed __int64
+#define UINT8 	unsigned __int8
+#define UINT16	unsigned __int16
+#define UINT32	unsigned __int32
+#define UINT64	unsigned __int64
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define COLOR_LUT_MAGIC			"SPEEDCLT"									// 8 bytes, no terminator in the file
+#define COLOR_LUT_VERSION		1											// Bumped when the layout changes
+#define COLOR_LUT_PAGE			4096										// The grid starts on a page
+#define COLOR_LUT_MAX_ENTRIES	((UINT32)1 << 22)							// Grid points, 65^3 or 45^4
+
+typedef struct ColorLUTFileHeader {
+	char sMagic[8];															// COLOR_LUT_MAGIC
+	UINT32 nVersion;														// COLOR_LUT_VERSION
+	UINT32 nHeaderBytes;													// sizeof(ColorLUTHeader)
+	UINT64 nProfileHash;													// Key: FNV-1a hash of the profile file
+	UINT8 nInputs;															// 3 or 4
+	UINT8 nGridPoints;														// Points per input
+	UINT8 nOutputs;															// Inks
+	UINT8 nOutputStride;													// UINT16 per grid point, nOutputs rounded up to 8
+	UINT32 nGridEntries;													// nGridPoints ^ nInputs
+	UINT64 nGridOffset;														// Grid, from the start of the file
+	UINT64 nGridBytes;														// nGridEntries x nOutputStride x 2
+	UINT8 nReserved[16];
+} ColorLUTHeader;
+
+typedef struct ColorLUTMapping {
+	const UINT8* pBase				= NULL;									// Start of the mapped file
+	UINT64 nSize					= 0;									// Bytes mapped
+#ifdef _WIN32
+	HANDLE hMapping					= NULL;
+#endif
+	const ColorLUTHeader* pHeader	= NULL;									// Same as pBase, once validated
+	const UINT16* pGrid				= NULL;									// Grid points, nOutputStride samples each
+	UINT8 nInputs					= 0;									// 3 (RGB) or 4 (CMYK) samples per input pixel
+	UINT8 nOutputs					= 0;									// Inks out
+	UINT32 nInputStride[4]			= {};									// UINT16 from one grid point to the next, per input
+	INT16 nErrorCode				= 0;									// Return error code
+	TCHAR sRetErrDescription[128];											// Return error message
+} ColorLUT;
+
+// *********************************************************************************************************************************
+// _SetColorLUTError() records a color LUT error and returns its code
+//
+static INT16 _SetColorLUTError(ColorLUT* pLUT, INT16 nErrorCode, const char* sReason, const char* sPath) {
+	pLUT->nErrorCode = nErrorCode;
+	swprintf_s(pLUT->sRetErrDescription,
+		_countof(pLUT->sRetErrDescription),
+		_T("EC(%d) Color profile %hs: %hs!"), nErrorCode, sPath, sReason);
+	return nErrorCode;
+}
+
+// *********************************************************************************************************************************
+// _HashColorProfile() is the FNV-1a hash of the profile file's bytes, the key of its compiled cache file
+//
+INT16 _HashColorProfile(const char* sPath, UINT64* pnHash) {
+	FILE* pFile = fopen(sPath, "rb");
+	UINT8 nBuffer[65536];
+	size_t nRead;
+
+	if (pFile == NULL)
+		return (-96);
+	*pnHash = 0xCBF29CE484222325ULL;
+	while ((nRead = fread(nBuffer, 1, sizeof(nBuffer), pFile)) > 0) {
+		for (size_t blp = 0; blp < nRead; blp++)
+			*pnHash = (*pnHash ^ nBuffer[blp]) * 0x100000001B3ULL;
+	}
+	fclose(pFile);
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _ColorLUTCachePath() is the compiled file for a profile hash, in strDirectory, or beside the profile if that is empty
+//
+string _ColorLUTCachePath(const string& strDirectory, const char* sProfilePath, UINT64 nHash) {
+	char sName[64];
+	string strProfile(sProfilePath);
+	size_t nSlash = strProfile.find_last_of("/\\");
+
+	snprintf(sName, sizeof(sName), "speedclut_%016llx.clut", (unsigned long long)nHash);
+	if (!strDirectory.empty())
+		return strDirectory + "/" + sName;
+	return (nSlash == string::npos) ? string(sName) : strProfile.substr(0, nSlash + 1) + sName;
+}
+
+// *********************************************************************************************************************************
+// _UnmapColorLUT() releases the mapping; ED parameters pointing at the LUT must not be used afterwards
+//
+void _UnmapColorLUT(ColorLUT* pLUT) {
+	if (pLUT->pBase != NULL) {
+#ifdef _WIN32
+		UnmapViewOfFile(pLUT->pBase);
+		CloseHandle(pLUT->hMapping);
+		pLUT->hMapping = NULL;
+#else
+		munmap((void*)pLUT->pBase, pLUT->nSize);
+#endif
+	}
+	pLUT->pBase = NULL;
+	pLUT->pHeader = NULL;
+	pLUT->pGrid = NULL;
+	pLUT->nSize = 0;
+}
+
+// *********************************************************************************************************************************
+// _MapColorLUT() maps a compiled color LUT read-only and checks it is complete and was compiled from the profile nHash
+//
+INT16 _MapColorLUT(ColorLUT* pLUT, const char* sPath, UINT64 nHash) {
+	_UnmapColorLUT(pLUT);
+	pLUT->nErrorCode = 0;
+#ifdef _WIN32
+	HANDLE hFile = CreateFileA(sPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	LARGE_INTEGER nFileSize;
+
+	if (hFile != INVALID_HANDLE_VALUE && GetFileSizeEx(hFile, &nFileSize) && nFileSize.QuadPart >= sizeof(ColorLUTHeader) &&
+		(pLUT->hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL)) != NULL) {
+		pLUT->pBase = (const UINT8*)MapViewOfFile(pLUT->hMapping, FILE_MAP_READ, 0, 0, 0);
+		pLUT->nSize = (UINT64)nFileSize.QuadPart;
+		if (pLUT->pBase == NULL) {
+			CloseHandle(pLUT->hMapping);
+			pLUT->hMapping = NULL;
+		}
+	}
+	if (hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(hFile);													// The mapping keeps the file open
+#else
+	int nFile = open(sPath, O_RDONLY | O_CLOEXEC);
+	struct stat FileStat;
+
+	if (nFile >= 0 && fstat(nFile, &FileStat) == 0 && (UINT64)FileStat.st_size >= sizeof(ColorLUTHeader)) {
+		void* pMap = mmap(NULL, (size_t)FileStat.st_size, PROT_READ, MAP_SHARED, nFile, 0);
+		if (pMap != MAP_FAILED) {
+			pLUT->pBase = (const UINT8*)pMap;
+			pLUT->nSize = (UINT64)FileStat.st_size;
+		}
+	}
+	if (nFile >= 0)
+		close(nFile);														// The mapping keeps the file open
+#endif
+	if (pLUT->pBase == NULL)
+		return _SetColorLUTError(pLUT, (-93), "failed to map the compiled LUT", sPath);
+
+	const ColorLUTHeader* pHeader = (const ColorLUTHeader*)pLUT->pBase;
+	UINT64 nEntries = 1;												// 255 ^ 4 at most, no overflow in 64 bits
+
+	for (UINT8 ilp = 0; ilp < pHeader->nInputs && ilp < 4; ilp++)
+		nEntries *= pHeader->nGridPoints;
+	if (memcmp(pHeader->sMagic, COLOR_LUT_MAGIC, 8) != 0 || pHeader->nVersion != COLOR_LUT_VERSION ||
+		pHeader->nHeaderBytes != sizeof(ColorLUTHeader) || pHeader->nProfileHash != nHash ||
+		(pHeader->nInputs != 3 && pHeader->nInputs != 4) || pHeader->nGridPoints < 2 ||
+		pHeader->nOutputs < 1 || pHeader->nOutputs > 16 || pHeader->nOutputStride != ((pHeader->nOutputs + 7) & ~7) ||
+		nEntries > COLOR_LUT_MAX_ENTRIES || pHeader->nGridEntries != nEntries ||
+		pHeader->nGridBytes != nEntries * pHeader->nOutputStride * sizeof(UINT16) ||
+		pHeader->nGridOffset < sizeof(ColorLUTHeader) || (pHeader->nGridOffset % 16) != 0 ||	// Grid points are read with
+		pHeader->nGridOffset > pLUT->nSize || pHeader->nGridBytes > pLUT->nSize - pHeader->nGridOffset) {	//  aligned loads
+		_UnmapColorLUT(pLUT);
+		return _SetColorLUTError(pLUT, (-93), "compiled LUT does not match the profile", sPath);
+	}
+	pLUT->pHeader = pHeader;
+	pLUT->pGrid = (const UINT16*)(pLUT->pBase + pHeader->nGridOffset);
+	pLUT->nInputs = pHeader->nInputs;
+	pLUT->nOutputs = pHeader->nOutputs;
+	UINT32 nStride = pHeader->nOutputStride;
+
+	for (INT8 ilp = pHeader->nInputs - 1; ilp >= 0; ilp--) {			// Last input varies fastest
+		pLUT->nInputStride[ilp] = nStride;
+		nStride *= pHeader->nGridPoints;
+	}
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _CompileColorLUT() reads a profile and writes its grid to the cache file sCachePath (temporary name, then renamed into place)
+//
+INT16 _CompileColorLUT(ColorLUT* pLUT, const char* sProfilePath, const char* sCachePath, UINT64 nHash) {
+	FILE* pFile = fopen(sProfilePath, "r");
+	ColorLUTHeader Header;
+	std::vector<UINT16> Grid;
+	char sLine[1024], sTempPath[1024];
+	UINT32 nEntry = 0;
+	unsigned nGridPoints = 0, nInputs = 0, nOutputs = 0;
+
+	if (pFile == NULL)
+		return _SetColorLUTError(pLUT, (-96), "file not found", sProfilePath);
+
+	memset(&Header, 0, sizeof(Header));
+	while (fgets(sLine, sizeof(sLine), pFile) != NULL) {
+		char* pNext = sLine;
+
+		while (*pNext == ' ' || *pNext == '\t')
+			pNext++;
+		if (*pNext == '#' || *pNext == '\n' || *pNext == '\r' || *pNext == 0)
+			continue;
+		if (sscanf(pNext, "GRID_POINTS %u", &nGridPoints) == 1 || sscanf(pNext, "INPUT_CHANNELS %u", &nInputs) == 1 ||
+			sscanf(pNext, "OUTPUT_CHANNELS %u", &nOutputs) == 1)
+			continue;
+		if (Grid.empty()) {													// First grid point, so the header is complete
+			if (nGridPoints < 2 || nGridPoints > 65 || (nInputs != 3 && nInputs != 4) || nOutputs < 1 || nOutputs > 16 ||
+				pow((double)nGridPoints, (double)nInputs) > COLOR_LUT_MAX_ENTRIES)
+				break;
+			memcpy(Header.sMagic, COLOR_LUT_MAGIC, 8);
+			Header.nVersion = COLOR_LUT_VERSION;
+			Header.nHeaderBytes = sizeof(ColorLUTHeader);
+			Header.nProfileHash = nHash;
+			Header.nInputs = (UINT8)nInputs;
+			Header.nGridPoints = (UINT8)nGridPoints;
+			Header.nOutputs = (UINT8)nOutputs;
+			Header.nOutputStride = (UINT8)((nOutputs + 7) & ~7);
+			Header.nGridEntries = (UINT32)pow((double)nGridPoints, (double)nInputs);
+			Header.nGridOffset = COLOR_LUT_PAGE;
+			Header.nGridBytes = (UINT64)Header.nGridEntries * Header.nOutputStride * sizeof(UINT16);
+			Grid.assign((size_t)Header.nGridEntries * Header.nOutputStride, 0);
+		}
+		if (nEntry == Header.nGridEntries)
+			break;
+
+		UINT16* pPoint = Grid.data() + (size_t)nEntry * Header.nOutputStride;
+		UINT8 nValues = 0;
+
+		for (char* pEnd; nValues < nOutputs; nValues++, pNext = pEnd) {
+			float dValue = strtof(pNext, &pEnd);
+			if (pEnd == pNext || !(dValue >= 0.F && dValue <= 1.F))
+				break;
+			pPoint[nValues] = (UINT16)lrintf(dValue * 65535.F);
+		}
+		if (nValues < nOutputs)
+			break;
+		nEntry++;
+	}
+	fclose(pFile);
+	if (Grid.empty() || nEntry != Header.nGridEntries)
+		return _SetColorLUTError(pLUT, (-96), "bad header or grid (see ColorLUT.cpp)", sProfilePath);
+
+	static const UINT8 nZeros[COLOR_LUT_PAGE] = {};
+	bool bWritten;
+
+	snprintf(sTempPath, sizeof(sTempPath), "%s.%u.tmp", sCachePath, (unsigned)time(NULL) ^ (unsigned)(size_t)&Header);
+	pFile = fopen(sTempPath, "wb");
+	if (pFile == NULL)
+		return _SetColorLUTError(pLUT, (-94), "failed to write the compiled LUT", sCachePath);
+
+	bWritten = fwrite(&Header, sizeof(Header), 1, pFile) == 1 &&
+		fwrite(nZeros, COLOR_LUT_PAGE - sizeof(Header), 1, pFile) == 1 &&
+		fwrite(Grid.data(), (size_t)Header.nGridBytes, 1, pFile) == 1;
+	bWritten = (fclose(pFile) == 0) && bWritten;
+#ifdef _WIN32
+	bWritten = bWritten && MoveFileExA(sTempPath, sCachePath, MOVEFILE_REPLACE_EXISTING);
+#else
+	bWritten = bWritten && rename(sTempPath, sCachePath) == 0;
+#endif
+	if (!bWritten) {
+		remove(sTempPath);
+		return _SetColorLUTError(pLUT, (-94), "failed to write the compiled LUT", sCachePath);
+	}
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _OpenColorLUT() maps the compiled grid of a profile, compiling it into strCacheDirectory first if it is not there yet
+//
+INT16 _OpenColorLUT(ColorLUT* pLUT, const char* sProfilePath, const string& strCacheDirectory) {
+	UINT64 nHash;
+
+	_UnmapColorLUT(pLUT);
+	if (_HashColorProfile(sProfilePath, &nHash) != 0)
+		return _SetColorLUTError(pLUT, (-96), "file not found", sProfilePath);
+
+	string strCachePath = _ColorLUTCachePath(strCacheDirectory, sProfilePath, nHash);
+
+	if (_MapColorLUT(pLUT, strCachePath.c_str(), nHash) == 0)				// Compiled before, by this or another job
+		return 0;
+	if (_CompileColorLUT(pLUT, sProfilePath, strCachePath.c_str(), nHash) != 0)
+		return pLUT->nErrorCode;
+	return _MapColorLUT(pLUT, strCachePath.c_str(), nHash);
+}
+
+// *********************************************************************************************************************************
+// _InterpolateColorLUT() interpolates one pixel (dPosition[] = grid coordinates, 0. - nGridPoints - 1) into nOutputStride samples
+//
+static inline void _InterpolateColorLUT(const ColorLUT* pLUT, const float* dPosition, UINT8 nGridPoints, UINT16* pInks) {
+	UINT8 nInputs = pLUT->nInputs, nOutputStride = pLUT->pHeader->nOutputStride;
+	float dFraction[4];
+	UINT32 nStep[4];
+	size_t nCorner = 0;
+
+	for (UINT8 ilp = 0; ilp < nInputs; ilp++) {							// Cell and the position inside it, per input
+		UINT32 nCell = min((UINT32)dPosition[ilp], (UINT32)nGridPoints - 2);
+		float dInCell = dPosition[ilp] - (float)nCell;
+		UINT8 nSlot = ilp;
+
+		nCorner += (size_t)nCell * pLUT->nInputStride[ilp];
+		for (; nSlot > 0 && dFraction[nSlot - 1] < dInCell; nSlot--) {		// Largest fraction first: the simplex's edges
+			dFraction[nSlot] = dFraction[nSlot - 1];
+			nStep[nSlot] = nStep[nSlot - 1];
+		}
+		dFraction[nSlot] = dInCell;
+		nStep[nSlot] = pLUT->nInputStride[ilp];
+	}
+
+	float dWeight[5];
+	size_t nVertex[5];
+
+	dWeight[0] = 1.F - dFraction[0];
+	nVertex[0] = nCorner;
+	for (UINT8 ilp = 0; ilp < nInputs; ilp++) {							// Walk from the low corner to the high one
+		dWeight[ilp + 1] = (ilp + 1 < nInputs) ? dFraction[ilp] - dFraction[ilp + 1] : dFraction[ilp];
+		nVertex[ilp + 1] = nVertex[ilp] + nStep[ilp];
+	}
+#ifdef ED_USE_SSE2
+	__m128i vZero = _mm_setzero_si128();
+
+	for (UINT8 olp = 0; olp < nOutputStride; olp += 8) {					// 8 inks per pass
+		__m128 vLow = _mm_setzero_ps(), vHigh = _mm_setzero_ps();
+
+		for (UINT8 vlp = 0; vlp <= nInputs; vlp++) {
+			__m128i vPoint = _mm_load_si128((const __m128i*)(pLUT->pGrid + nVertex[vlp] + olp));
+			__m128 vWeight = _mm_set1_ps(dWeight[vlp]);
+
+			vLow = _mm_add_ps(vLow, _mm_mul_ps(vWeight, _mm_cvtepi32_ps(_mm_unpacklo_epi16(vPoint, vZero))));
+			vHigh = _mm_add_ps(vHigh, _mm_mul_ps(vWeight, _mm_cvtepi32_ps(_mm_unpackhi_epi16(vPoint, vZero))));
+		}
+		_mm_store_si128((__m128i*)(pInks + olp), _PackSamples8(vLow, vHigh));
+	}
+#else
+	for (UINT8 olp = 0; olp < nOutputStride; olp++) {
+		float dInk = 0.F;
+
+		for (UINT8 vlp = 0; vlp <= nInputs; vlp++)
+			dInk += dWeight[vlp] * (float)pLUT->pGrid[nVertex[vlp] + olp];
+		pInks[olp] = (UINT16)min(lrintf(dInk), 65535L);					// Saturates like _PackSamples8()
+	}
+#endif
+}
+
+// *********************************************************************************************************************************
+// _ApplyColorLUTRow() converts one row; pInput[n] is input sample n of the row's first pixel, samples nStride apart, and ink n
+//  goes to pInkRow + n x nPlaneSamples; with a cache (pCache not NULL) repeated colors are copied instead of interpolated
+// nKeyFlip is XORed into the samples (packed like _PixelKey()) before they index the grid, see _ColorDecodeKeyFlip()
+//
+void _ApplyColorLUTRow(const ColorLUT* pLUT, const void* const* pInput, UINT8 nImageBitDepth, UINT8 nStride, UINT16 nWidth,
+	UINT64 nKeyFlip, UINT16* pInkRow, size_t nPlaneSamples, SeparationCache* pCache) {
+
+	UINT8 nGridPoints = pLUT->pHeader->nGridPoints;
+	float dScale = (float)(nGridPoints - 1) / ((nImageBitDepth == 8) ? 255.F : 65535.F);
+	alignas(16) UINT16 nInks[16];
+	float dPosition[4];
+	UINT16 nPixel = 0;
+
+	if (pCache != NULL)
+		pCache->Stats.nPixels += nWidth;
+	if (_UseSeparationCache(pCache)) {										// Run by run, until it stops paying
+		UINT32 nMisses = 0;
+
+		while (nPixel < nWidth) {
+			UINT64 nKey = _PixelKey(pInput, pLUT->nInputs, nImageBitDepth, (size_t)nPixel * nStride);
+			UINT16 nRunEnd = _PixelRunEnd(pInput, pLUT->nInputs, nImageBitDepth, nStride, nPixel + 1, nWidth, nKey);
+			bool bHit;
+			UINT16* pSlot = _SeparationCacheSlot(pCache, nKey, &bHit);
+
+			if (!bHit) {
+				for (UINT8 ilp = 0; ilp < pLUT->nInputs; ilp++)
+					dPosition[ilp] = dScale * (float)(((nKey ^ nKeyFlip) >> (16 * ilp)) & 0xFFFF);
+				_InterpolateColorLUT(pLUT, dPosition, nGridPoints, pSlot);
+				nMisses++;
+			}
+			pCache->Stats.nCacheHits += bHit;
+			pCache->Stats.nRunHits += nRunEnd - nPixel - 1;
+			for (UINT8 olp = 0; olp < pLUT->nOutputs; olp++) {				// Each ink plane, one fill per run
+				UINT16* pPlane = pInkRow + olp * nPlaneSamples;
+				std::fill(pPlane + nPixel, pPlane + nRunEnd, pSlot[olp]);
+			}
+			nPixel = nRunEnd;
+			if (!bHit && _SeparationCacheMissing(pCache, nMisses, nPixel))
+				break;
+		}
+	}
+	for (; nPixel < nWidth; nPixel++) {
+		size_t nOffset = (size_t)nPixel * nStride;
+
+		for (UINT8 ilp = 0; ilp < pLUT->nInputs; ilp++)
+			dPosition[ilp] = dScale * (float)(((nImageBitDepth == 8) ? ((const UINT8*)pInput[ilp])[nOffset] :
+				((const UINT16*)pInput[ilp])[nOffset]) ^ (UINT16)(nKeyFlip >> (16 * ilp)));
+		_InterpolateColorLUT(pLUT, dPosition, nGridPoints, nInks);
+		for (UINT8 olp = 0; olp < pLUT->nOutputs; olp++)
+			pInkRow[olp * nPlaneSamples + nPixel] = nInks[olp];
+	}
+}
+
+// *********************************************************************************************************************************
+// _ApplyColorLUTBand() converts a band (pixel order, or planar with nRows rows per plane) to a planar 16-bit ink band, one
+//  plane of nRows x nWidth per ink, one row per core, each core with its own cache; pDecode (NULL = RGB) is the input's color
+//  space, and pStats (if not NULL) gets the counts added
+//
+void _ApplyColorLUTBand(const ColorLUT* pLUT, const ColorDecode* pDecode, const void* pBand, UINT8 nImageBitDepth, bool bPlanar,
+	UINT16 nWidth, UINT8 nRows, UINT16* pInkBand, int nThreads, SeparationStats* pStats) {
+
+	size_t nSampleBytes = nImageBitDepth / 8, nPlaneSamples = (size_t)nRows * nWidth;
+	UINT8 nInputs = pLUT->nInputs;
+	UINT64 nKeyFlip = _ColorDecodeKeyFlip(pDecode, nImageBitDepth);
+
+#pragma omp parallel num_threads(max(min(nThreads, (int)nRows), 1))
+	{
+		SeparationCache Cache;
+
+		_ResetSeparationCache(&Cache);
+#pragma omp for schedule(static)
+		for (int rlp = 0; rlp < (int)nRows; rlp++) {
+			const void* pInput[4];
+
+			for (UINT8 ilp = 0; ilp < nInputs; ilp++)						// Planar: plane ilp; pixel order: sample ilp
+				pInput[ilp] = (const UINT8*)pBand + nSampleBytes * (bPlanar ?
+					((size_t)ilp * nRows + rlp) * nWidth : ((size_t)rlp * nWidth * nInputs + ilp));
+			_ApplyColorLUTRow(pLUT, pInput, nImageBitDepth, bPlanar ? 1 : nInputs, nWidth, nKeyFlip, pInkBand + (size_t)rlp * nWidth,
+				nPlaneSamples, &Cache);
+		}
+		if (pStats != NULL)
+			_AddSeparationStats(pStats, &Cache.Stats);
+	}
+}
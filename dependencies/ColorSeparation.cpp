@@ -0,0 +1,339 @@
+// RGB to CMYK separation, the stage between the band reader and the scaler for RGB input (bInputImageIsRGB)
+// Each band is converted once, on every core, into 16-bit CMYK (pixel order, nColorChannels samples per pixel, inks past K
+//  left at 0), so the scaler and the diffusion only ever see ink values:
+//	C, M, Y = 1 - R, G, B
+//	K = dGCR x min(C, M, Y)											gray component replacement
+//	C, M, Y -= dUCR x K												under color removal, 0 = K printed on top of CMY
+//	C, M, Y scaled so C + M + Y + K <= dInkLimit					total area coverage, K is kept
+// SSE2 does 4 pixels at a time (planar bands load straight into the vectors), the scalar tail does the same sums
+// CIELab and YCbCr input is decoded to RGB on the way in, in the same vectors (see ColorDecode)
+//
+// Labels, signage and CAD plots have a handful of colors over millions of pixels, so the conversion is memoized: each thread
+//  keeps a small direct mapped cache of input pixels it has converted, and a run of equal pixels is converted (or found) once
+//  and filled. A row that keeps missing goes back to the straight conversion, for itself and a few rows after it, so photos
+//  lose little.
+//  The profile LUT (ColorLUT) uses the same cache; SeparationStats counts the hits
+
+#define INT8	signed __int8
+#define INT16	signed __int16
+#define INT32	signed __int32
+#define UINT8 	unsigned __int8
+#define UINT16	unsigned __int16
+#define UINT32	unsigned __int32
+#define UINT64	unsigned __int64
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ED_USE_SSE2
+#include <emmintrin.h>
+#endif
+#include <math.h>
+#include <string.h>
+
+#define SEPARATION_CACHE_SLOTS		256										// Per thread, direct mapped on a hash of the pixel
+#define SEPARATION_CACHE_MISS_PCT	25										// A row missing more than this (after a few misses)...
+#define SEPARATION_CACHE_MIN_MISSES	32
+#define SEPARATION_CACHE_REST_ROWS	8										//  ...and this many rows after it go without the cache
+
+typedef struct SeparationParameters {
+	float dGCR						= 1.F;									// Gray component replaced by K, 0 - 1
+	float dUCR						= 1.F;									// CMY removed under that K, 0 - 1
+	float dInkLimit					= 4.F;									// Total ink, 1 (100%) - 4 (400%, no limit)
+} SeparationParams;
+
+typedef struct SeparationStatistics {
+	UINT64 nPixels					= 0;									// Pixels converted
+	UINT64 nRunHits					= 0;									// Same as the pixel before, copied
+	UINT64 nCacheHits				= 0;									// Found in the thread's cache
+} SeparationStats;
+
+typedef struct SeparationCacheData {
+	UINT64 nKey[SEPARATION_CACHE_SLOTS];									// Input pixel, samples packed 16 bits each
+	alignas(16) UINT16 nInks[SEPARATION_CACHE_SLOTS][16];					// Its converted inks
+	bool bValid[SEPARATION_CACHE_SLOTS];
+	UINT16 nRestRows				= 0;									// Rows left to convert without the cache
+	SeparationStats Stats;													// This thread's counts, added up per band
+} SeparationCache;
+
+// *********************************************************************************************************************************
+// _ResetSeparationCache() empties a thread's cache, at the start of each band (the conversion may have changed since)
+//
+static inline void _ResetSeparationCache(SeparationCache* pCache) {
+	memset(pCache->bValid, 0, sizeof(pCache->bValid));
+	pCache->nRestRows = 0;
+	pCache->Stats = SeparationStats();
+}
+
+// *********************************************************************************************************************************
+// _UseSeparationCache() is true if this row should go through the cache (false while resting after a row that missed)
+//
+static inline bool _UseSeparationCache(SeparationCache* pCache) {
+	if (pCache == NULL)
+		return false;
+	if (pCache->nRestRows == 0)
+		return true;
+	pCache->nRestRows--;
+	return false;
+}
+
+// *********************************************************************************************************************************
+// _SeparationCacheMissing() is true if the row so far (nPixels, nMisses of them missed) is missing too often to be worth the
+//  cache; the rest of the row, and the next few rows, then go without it
+//
+static inline bool _SeparationCacheMissing(SeparationCache* pCache, UINT32 nMisses, UINT32 nPixels) {
+	if (nMisses < SEPARATION_CACHE_MIN_MISSES || nMisses * 100 <= nPixels * SEPARATION_CACHE_MISS_PCT)
+		return false;
+	pCache->nRestRows = SEPARATION_CACHE_REST_ROWS;
+	return true;
+}
+
+// *********************************************************************************************************************************
+// _SeparationCacheSlot() returns the slot for a pixel; *pbHit false = the slot now belongs to nKey, and its inks must be filled in
+//
+static inline UINT16* _SeparationCacheSlot(SeparationCache* pCache, UINT64 nKey, bool* pbHit) {
+	UINT32 nSlot = (UINT32)((nKey * 0x9E3779B97F4A7C15ULL) >> 56);		// Fibonacci hash, top 8 bits
+
+	*pbHit = pCache->bValid[nSlot] && pCache->nKey[nSlot] == nKey;
+	pCache->nKey[nSlot] = nKey;
+	pCache->bValid[nSlot] = true;
+	return pCache->nInks[nSlot];
+}
+
+// *********************************************************************************************************************************
+// _PixelKey() packs the nSamples samples of one pixel (pSamples[n] + nOffset) into a cache key
+//
+static inline UINT64 _PixelKey(const void* const* pSamples, UINT8 nSamples, UINT8 nImageBitDepth, size_t nOffset) {
+	UINT64 nKey = 0;
+
+	for (UINT8 slp = 0; slp < nSamples; slp++)
+		nKey |= (UINT64)((nImageBitDepth == 8) ? ((const UINT8*)pSamples[slp])[nOffset] :
+			((const UINT16*)pSamples[slp])[nOffset]) << (16 * slp);
+	return nKey;
+}
+
+// *********************************************************************************************************************************
+// _PixelRunEnd() returns the first pixel from nPixel on (pixels nStride samples apart) that is not nKey, or nWidth
+//
+static inline UINT16 _PixelRunEnd(const void* const* pSamples, UINT8 nSamples, UINT8 nImageBitDepth, UINT8 nStride,
+	UINT16 nPixel, UINT16 nWidth, UINT64 nKey) {
+
+	if (nImageBitDepth == 8) {
+		while (nPixel < nWidth && _PixelKey(pSamples, nSamples, 8, (size_t)nPixel * nStride) == nKey)
+			nPixel++;
+	}
+	else {
+		while (nPixel < nWidth && _PixelKey(pSamples, nSamples, 16, (size_t)nPixel * nStride) == nKey)
+			nPixel++;
+	}
+	return nPixel;
+}
+
+// *********************************************************************************************************************************
+// _SeparatePixel() is the separation of one pixel (0. - 1. RGB in, 0 - 65535 CMYK out), for the pixels SSE2 does not cover
+//
+static inline void _SeparatePixel(const SeparationParams* pSeparation, float dR, float dG, float dB, UINT16* pCMYK) {
+	float dC = 1.F - dR, dM = 1.F - dG, dY = 1.F - dB;
+	float dK = pSeparation->dGCR * fminf(fminf(dC, dM), dY);
+	float dRemove = pSeparation->dUCR * dK;
+
+	dC -= dRemove;
+	dM -= dRemove;
+	dY -= dRemove;
+	float dCMY = dC + dM + dY;
+	if (dCMY + dK > pSeparation->dInkLimit) {								// Over the limit, so thin CMY (dCMY > 0 here)
+		float dScale = (pSeparation->dInkLimit - dK) / dCMY;
+		dC *= dScale;
+		dM *= dScale;
+		dY *= dScale;
+	}
+	pCMYK[0] = (UINT16)lrintf(dC * 65535.F);								// Round to nearest, like cvtps
+	pCMYK[1] = (UINT16)lrintf(dM * 65535.F);
+	pCMYK[2] = (UINT16)lrintf(dY * 65535.F);
+	pCMYK[3] = (UINT16)lrintf(dK * 65535.F);
+}
+
+#ifdef ED_USE_SSE2
+// *********************************************************************************************************************************
+// _LoadSamples4() loads 4 samples, nStride apart, as floats (planar bands have nStride 1, and are loaded as one vector)
+//
+static inline __m128 _LoadSamples4(const void* pSamples, UINT8 nImageBitDepth, UINT8 nStride) {
+	__m128i vZero = _mm_setzero_si128();
+
+	if (nImageBitDepth == 8) {
+		const UINT8* p = (const UINT8*)pSamples;
+		if (nStride == 1) {
+			INT32 nPacked;
+			memcpy(&nPacked, p, 4);
+			return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(nPacked), vZero), vZero));
+		}
+		return _mm_setr_ps(p[0], p[nStride], p[2 * nStride], p[3 * nStride]);
+	}
+	const UINT16* p = (const UINT16*)pSamples;
+	if (nStride == 1)
+		return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)p), vZero));
+	return _mm_setr_ps(p[0], p[nStride], p[2 * nStride], p[3 * nStride]);
+}
+
+// *********************************************************************************************************************************
+// _PackSamples8() rounds 8 values (0. - 65535.) to UINT16; SSE2 can only pack signed, so they are packed offset by 32768
+//
+static inline __m128i _PackSamples8(__m128 vLow, __m128 vHigh) {
+	__m128i vOffset = _mm_set1_epi32(32768);								// Offset after rounding, so it rounds like lrintf()
+	__m128i vLow32 = _mm_sub_epi32(_mm_cvtps_epi32(vLow), vOffset);
+	__m128i vHigh32 = _mm_sub_epi32(_mm_cvtps_epi32(vHigh), vOffset);
+
+	return _mm_xor_si128(_mm_packs_epi32(vLow32, vHigh32), _mm_set1_epi16((short)0x8000));
+}
+#endif
+
+// *********************************************************************************************************************************
+// _SeparateRGBRow() converts one row; pRGB[0 - 2] are the R, G and B samples of the row's first pixel, nStride apart
+// With a decoder (pDecoder not NULL) the samples are Lab or YCbCr, decoded to RGB first
+// With a cache (pCache not NULL) repeated colors are copied instead of converted, see above
+//
+void _SeparateRGBRow(const SeparationParams* pSeparation, const ColorDecoder* pDecoder, const void* const* pRGB,
+	UINT8 nImageBitDepth, UINT8 nStride, UINT16 nWidth, UINT8 nColorChannels, UINT16* pCMYK, SeparationCache* pCache) {
+
+	float dScale = (nImageBitDepth == 8) ? 1.F / 255.F : 1.F / 65535.F;
+	size_t nSampleBytes = nImageBitDepth / 8;
+	UINT16 nPixel = 0;
+
+	if (nColorChannels > 4)													// Only CMYK is printed from RGB
+		memset(pCMYK, 0, (size_t)nWidth * nColorChannels * sizeof(UINT16));
+	if (pCache != NULL)
+		pCache->Stats.nPixels += nWidth;
+	if (_UseSeparationCache(pCache)) {										// Run by run, until it stops paying
+		UINT32 nMisses = 0;
+
+		while (nPixel < nWidth) {
+			UINT64 nKey = _PixelKey(pRGB, 3, nImageBitDepth, (size_t)nPixel * nStride);
+			UINT16 nRunEnd = _PixelRunEnd(pRGB, 3, nImageBitDepth, nStride, nPixel + 1, nWidth, nKey);
+			bool bHit;
+			UINT16* pSlot = _SeparationCacheSlot(pCache, nKey, &bHit);
+
+			if (!bHit) {													// Same sums as the scalar tail below
+				float dRGB[3];
+				for (UINT8 clp = 0; clp < 3; clp++)
+					dRGB[clp] = dScale * (float)((nKey >> (16 * clp)) & 0xFFFF);
+				if (pDecoder != NULL)
+					_DecodeColorPixel(pDecoder, dRGB);
+				_SeparatePixel(pSeparation, dRGB[0], dRGB[1], dRGB[2], pSlot);
+				nMisses++;
+			}
+			pCache->Stats.nCacheHits += bHit;
+			pCache->Stats.nRunHits += nRunEnd - nPixel - 1;
+			for (; nPixel < nRunEnd; nPixel++)
+				memcpy(pCMYK + (size_t)nPixel * nColorChannels, pSlot, 4 * sizeof(UINT16));
+			if (!bHit && _SeparationCacheMissing(pCache, nMisses, nPixel))
+				break;
+		}
+	}
+#ifdef ED_USE_SSE2
+	__m128 vScale = _mm_set1_ps(dScale), vOne = _mm_set1_ps(1.F), vFull = _mm_set1_ps(65535.F);
+	__m128 vGCR = _mm_set1_ps(pSeparation->dGCR), vUCR = _mm_set1_ps(pSeparation->dUCR);
+	__m128 vInkLimit = _mm_set1_ps(pSeparation->dInkLimit);
+
+	for (; nPixel + 4 <= nWidth; nPixel += 4) {
+		size_t nOffset = (size_t)nPixel * nStride * nSampleBytes;
+		__m128 vC = _mm_mul_ps(_LoadSamples4((const UINT8*)pRGB[0] + nOffset, nImageBitDepth, nStride), vScale);
+		__m128 vM = _mm_mul_ps(_LoadSamples4((const UINT8*)pRGB[1] + nOffset, nImageBitDepth, nStride), vScale);
+		__m128 vY = _mm_mul_ps(_LoadSamples4((const UINT8*)pRGB[2] + nOffset, nImageBitDepth, nStride), vScale);
+
+		if (pDecoder != NULL)											// Lab or YCbCr to RGB, in the vectors
+			_DecodeColor4(pDecoder, &vC, &vM, &vY);
+		vC = _mm_sub_ps(vOne, vC);										// C, M, Y = 1 - R, G, B
+		vM = _mm_sub_ps(vOne, vM);
+		vY = _mm_sub_ps(vOne, vY);
+		__m128 vK = _mm_mul_ps(vGCR, _mm_min_ps(_mm_min_ps(vC, vM), vY));
+		__m128 vRemove = _mm_mul_ps(vUCR, vK);
+
+		vC = _mm_sub_ps(vC, vRemove);
+		vM = _mm_sub_ps(vM, vRemove);
+		vY = _mm_sub_ps(vY, vRemove);
+		__m128 vCMY = _mm_add_ps(_mm_add_ps(vC, vM), vY);
+		__m128 vOver = _mm_cmpgt_ps(_mm_add_ps(vCMY, vK), vInkLimit);		// Thin CMY only where over the limit
+		if (_mm_movemask_ps(vOver) != 0) {
+			__m128 vThin = _mm_div_ps(_mm_sub_ps(vInkLimit, vK), _mm_max_ps(vCMY, _mm_set1_ps(1e-6F)));
+			__m128 vFactor = _mm_or_ps(_mm_and_ps(vOver, vThin), _mm_andnot_ps(vOver, vOne));
+			vC = _mm_mul_ps(vC, vFactor);
+			vM = _mm_mul_ps(vM, vFactor);
+			vY = _mm_mul_ps(vY, vFactor);
+		}
+		vC = _mm_mul_ps(vC, vFull);
+		vM = _mm_mul_ps(vM, vFull);
+		vY = _mm_mul_ps(vY, vFull);
+		vK = _mm_mul_ps(vK, vFull);
+
+		if (nColorChannels == 4) {											// Pixel order: transpose, then 2 pixels per store
+			_MM_TRANSPOSE4_PS(vC, vM, vY, vK);
+			_mm_storeu_si128((__m128i*)(pCMYK + (size_t)nPixel * 4), _PackSamples8(vC, vM));
+			_mm_storeu_si128((__m128i*)(pCMYK + (size_t)nPixel * 4 + 8), _PackSamples8(vY, vK));
+		}
+		else {
+			alignas(16) UINT16 nPlanes[16];									// C C C C M M M M Y Y Y Y K K K K
+			_mm_store_si128((__m128i*)nPlanes, _PackSamples8(vC, vM));
+			_mm_store_si128((__m128i*)(nPlanes + 8), _PackSamples8(vY, vK));
+			for (UINT8 plp = 0; plp < 4; plp++) {
+				for (UINT8 clp = 0; clp < 4; clp++)
+					pCMYK[(size_t)(nPixel + plp) * nColorChannels + clp] = nPlanes[clp * 4 + plp];
+			}
+		}
+	}
+#endif
+	for (; nPixel < nWidth; nPixel++) {
+		size_t nOffset = (size_t)nPixel * nStride;
+		float dRGB[3];
+
+		for (UINT8 clp = 0; clp < 3; clp++)
+			dRGB[clp] = dScale * ((nImageBitDepth == 8) ? (float)((const UINT8*)pRGB[clp])[nOffset] :
+				(float)((const UINT16*)pRGB[clp])[nOffset]);
+		if (pDecoder != NULL)
+			_DecodeColorPixel(pDecoder, dRGB);
+		_SeparatePixel(pSeparation, dRGB[0], dRGB[1], dRGB[2], pCMYK + (size_t)nPixel * nColorChannels);
+	}
+}
+
+// *********************************************************************************************************************************
+// _AddSeparationStats() adds a thread's counts to the page's (called once per thread per band)
+//
+static inline void _AddSeparationStats(SeparationStats* pStats, const SeparationStats* pThreadStats) {
+#pragma omp atomic
+	pStats->nPixels += pThreadStats->nPixels;
+#pragma omp atomic
+	pStats->nRunHits += pThreadStats->nRunHits;
+#pragma omp atomic
+	pStats->nCacheHits += pThreadStats->nCacheHits;
+}
+
+// *********************************************************************************************************************************
+// _SeparateRGBBand() converts a band of RGB rows (pixel order, or planar with nRows rows per plane) to 16-bit CMYK in pCMYKBand,
+//  one row per core, each core with its own cache; pDecode (NULL = RGB) says if the rows are Lab or YCbCr instead, and
+//  pStats (if not NULL) gets the pixel and hit counts added
+//
+void _SeparateRGBBand(const SeparationParams* pSeparation, const ColorDecode* pDecode, const void* pRGBBand,
+	UINT8 nImageBitDepth, bool bPlanar, UINT16 nWidth, UINT8 nRows, UINT8 nColorChannels, UINT16* pCMYKBand, int nThreads,
+	SeparationStats* pStats) {
+
+	size_t nSampleBytes = nImageBitDepth / 8;
+	size_t nRowSamples = (size_t)nWidth * (bPlanar ? 1 : 3);
+	ColorDecoder Decoder;
+	const ColorDecoder* pDecoder = _PrepareColorDecoder(pDecode, nImageBitDepth, &Decoder) ? &Decoder : NULL;
+
+#pragma omp parallel num_threads(max(min(nThreads, (int)nRows), 1))
+	{
+		SeparationCache Cache;
+
+		_ResetSeparationCache(&Cache);
+#pragma omp for schedule(static)
+		for (int rlp = 0; rlp < (int)nRows; rlp++) {
+			const void* pRGB[3];
+
+			for (UINT8 clp = 0; clp < 3; clp++)							// Planar: plane clp; pixel order: sample clp
+				pRGB[clp] = (const UINT8*)pRGBBand + nSampleBytes * (bPlanar ?
+					((size_t)clp * nRows + rlp) * nWidth : rlp * nRowSamples + clp);
+			_SeparateRGBRow(pSeparation, pDecoder, pRGB, nImageBitDepth, bPlanar ? 1 : 3, nWidth, nColorChannels,
+				pCMYKBand + (size_t)rlp * nWidth * nColorChannels, &Cache);
+		}
+		if (pStats != NULL)
+			_AddSeparationStats(pStats, &Cache.Stats);
+	}
+}
@@ -8,6 +8,17 @@
 #define UINT16	unsigned __int16
 #define UINT32	unsigned __int32
 
+#include <thread>															// Writer stage runs beside the halftoning threads
+
+#ifdef __linux__
+#include <sys/mman.h>														// Huge page backed arena (hugetlbfs, THP)
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ED_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 // Error Diffusion Kernels:
 //  0 = dKernela_3x2 		 3 weights
 //  1 = dKernelb_3x2         4 weights
@@ -34,6 +45,12 @@ typedef struct EDParameters {
 	UINT8 nInputBitDepth 			= 16;								// Error diffusion bit depth, 8 or 16, >= nImageBitDepth
 	UINT8 nImageBitDepth 			= 8;								// Input raster image bit depth, 8 or 16 bits/color
 	bool bInputImageIsRGB 			= false;							// Input image is RGB, so must be converted to CMYK @ 16-bit
+	ColorDecode Decode;													// Lab or YCbCr input, decoded to RGB on the way (ColorDecode)
+	SeparationParams Separation;										// GCR, UCR and ink limit of that conversion (ColorSeparation)
+	const ColorLUT* pColorLUT		= NULL;								// Profile LUT converting the input instead, NULL = none (ColorLUT)
+	bool bPlanarInput				= false;							// Input band is planar (CC..MM..YY..KK..), one plane per channel
+	const TransferCurves* pTransferCurves = NULL;						// Per ink linearization / limit curves, NULL = linear (TransferCurves)
+	const UINT16* pTransferLUT[16]	= {};								// Per ink sample to scaled value, built per page, NULL = no curve
 	float dHysteresis 				= 0.15F;							// Value between 0 and 1 for white noise intensity
 	UINT8 nColorChannels			= 4;								// This will be 4 for now (CMYK) but could be up to 16 colors
 	UINT8 nBitsPerDot				= 2;								// 1 = fixed dot size, 2 = variable dot (S, M, L)
@@ -42,6 +59,21 @@ typedef struct EDParameters {
 	float*** pFloatErrorBuffer[2]	= { NULL, NULL };					// 3D floating point error buffer
 	UINT8* pDotLUT					= NULL;								// Pointer to the dot lookup table = (2 ^ nInputBitDepth)
 	float* pFloatErrorLUT			= NULL;								// Pointer to the error lookup table associated with pDotLUT
+	UINT8 nEDKernelSize				= 0;								// Entries per pixel value in pFloatErrorLUT, kernel rows x 7
+	const UINT8* pInkDotLUT[16]		= {};								// Per ink (color channel) dot LUT, NULL = pDotLUT, see LUT_Cache
+	const float* pInkErrorLUT[16]	= {};								// Per ink error LUT, NULL = pFloatErrorLUT
+	bool bZeroPixelIsBlank			= false;							// pDotLUT[0] is no dot and scatters no error, see blank rows
+	UINT8* pBlankRasterRows			= NULL;								// Per scaled row of the current band, 1 = no ink in any channel
+	float* pScaledRow[2][16]		= {};								// One scaled row per worker (even/odd, channel)
+	UINT8 nResampleFilter			= RESAMPLE_AUTO;					// Scaling filter, RESAMPLE_... (see Resampler)
+	ResamplePlan ColumnPlan;											// Input to printed columns, built per page
+	ResamplePlan RowPlan;												// Input to printed rows of the current band, in page rows
+	void* pRowHistory				= NULL;								// Last input rows of the bands before, ahead of the band
+	UINT16 nHistoryRows				= 0;								//  in RowPlan (band layout, planes nHistoryRowsMax tall)
+	UINT16 nHistoryRowsMax			= 0;								// Rows kept at most, the row plan's taps
+	UINT8* pBlankInputRows			= NULL;								// Per history and band input row, 1 = no ink
+	UINT32 nBandFirstRow			= 0;								// Page row of the band's first scaled row
+	float* pResampleRow[2][16]		= {};								// One vertical pass row per worker, input width
 	UINT8 nInkOrder[16]				= { 1, 2, 3, 0, 0, 0, 0, 0,			// Ink color order, C (1), M (2), Y (3), K (0)
 										 0, 0, 0, 0, 0, 0, 0, 0 };
 	INT16 nErrorCode 				= 0;								// Return error code (for allocation function)
@@ -52,120 +84,819 @@ static const UINT8
 	nKernelHeight[] = { 2, 2, 3, 3, 3, 2, 2, 2, 						// Kernel height = height of the error buffer
 						2, 3, 3, 3, 3, 3, 4, 4, 2 };
 
+INT16 HalftoneImageFlt(EDParams* CurrentParams, void* pInputRasterBuffer, UINT8* pOutputRasterBuffer,
+	UINT16 nInputImagePixelWidth, UINT8 nInputImageBufferRows, UINT32 nRasterWidthPixels,
+	UINT8* pRTLDataBuffer[16], float* dTIFFDotLevelPct, UINT32 nDotVol[16][16], UINT16 nNumberOfRasterRows, int nThreads);
+INT16 HalftoneRasterRow(EDParams* CurrentParams, void* pInputRasterBuffer, UINT8* pOutputRasterBuffer, UINT8 tlop,
+	INT8 nStepFN, UINT8* pRTLData[16], UINT16 nCurrentRasterRow, UINT8 nColorChannel, UINT32 nColMaxFN, float nscl,
+	int nThreads, float dMaxPixVal, float nrs, float nrf, UINT8 nWrkrThrd, float* dTIFFDotLevelPct, UINT32 nDotVol[16],
+	bool bDoSerpentineRaster, UINT8 nKernelRows, UINT32 dBufferWidth, float dOriginalHeight, float dColorChannels,
+	float dInputImageWidth);
+
 // *********************************************************************************************************************************
-// GenerateRTLData() is used to call HalftoneImageFlt() to halftone a band of image data; add your own code to open an image file
-// Image data must be CMYK, pixel order (i.e. CMYKCMYKCMYKCMYK.., not CCCCMMMMYYYYKKKK..) either 8 or 16 bits/channel (32/64 bits/pixel)
-// Image bands can be up to 255 rows tall; the halftone algorithm will scale to appropriate size for printing (up to 65,535 rows tall)
+// _BandRowIsBlank() returns true if nBytes of pData are all zero (SSE2, 64 bytes per test)
 //
-INT16 GenerateRTLData(													// This is a new function, for this example
-	EDParams CurrentParams,												// Pointer to structure holding ED parameters
-	UINT32 nRasterWidthPixels,											// RasterWidthByteBlocks * DotBlockBytes (zero padded)
-	UINT16 nRasterWidthByteBlocks,										// Width of output raster row in byte blocks
-	UINT16 nRasterBufferHeight) {										// Height of output raster buffer
-	
-	UINT8* nRTLDoubleBuffer[2][16]{};									// RTL data buffer (dot data, raster data is pixels)
-	UINT32 nicInt = nRasterWidthPixels;									// RTL data must fall on a byte boundary
-	
-	if ((nicInt % CurrentParams.nColorChannels) != 0)
-		nicInt += (CurrentParams.nColorChannels - (nicInt % CurrentParams.nColorChannels));
-	
-	for (int lop = 0; lop < CurrentParams.nColorChannels; lop++) {		// Allocate RTL data buffers
-		for (int lp = 0; lp < 2; lp++) {								// This needs to be a double buffer
-			if ((nRTLDoubleBuffer[lp][lop] = 							// Need to make sure we end on a byte boundary
-				(UINT8*)calloc((size_t)nicInt * 
-					(size_t)CurrentParams.nRasterBufferHeight, sizeof(UINT8))) == NULL) {
-
-				CurrentParams.nErrorCode = (-62);						// Buffer failed to allocate, so stop
-				swprintf_s(CurrentParams.sRetErrDescription,			// Report error back upstream
-					sizeof(CurrentParams.sRetErrDescription),
-					_T("EC(-62b) Failed to allocate PRN loop buffer!"));
-				return CurrentParams.nErrorCode;
+bool _BandRowIsBlank(const UINT8* pData, size_t nBytes) {
+	size_t nPos = 0;
+#ifdef ED_USE_SSE2
+	__m128i vZero = _mm_setzero_si128();
+
+	for (; nPos + 64 <= nBytes; nPos += 64) {								// OR four vectors together, then test once
+		__m128i vOr = _mm_or_si128(
+			_mm_or_si128(_mm_loadu_si128((const __m128i*)(pData + nPos)), _mm_loadu_si128((const __m128i*)(pData + nPos + 16))),
+			_mm_or_si128(_mm_loadu_si128((const __m128i*)(pData + nPos + 32)), _mm_loadu_si128((const __m128i*)(pData + nPos + 48))));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(vOr, vZero)) != 0xFFFF)
+			return false;
+	}
+#endif
+	for (; nPos < nBytes; nPos++) {
+		if (pData[nPos] != 0)
+			return false;
+	}
+	return true;
+}
+
+// *********************************************************************************************************************************
+// _FindBlankRasterRows() pre-scans an input band and flags the scaled rows that have no ink in any channel
+// A scaled row is blank when every input row the band's row plan weighs into it is blank (see Resampler); the plan's rows
+//  are the history rows kept from the bands before, then the band's
+// Returns the number of blank scaled rows (all of the plan's rows = the whole band is white)
+//
+UINT16 _FindBlankRasterRows(
+	EDParams* CurrentParams,											// Pointer to structure holding ED parameters
+	const void* pInputRasterBuffer,										// One input band, pixel order or planar
+	UINT16 nInputImagePixelWidth,										// Pixel width of the input band
+	UINT8 nInputRows,													// Rows in the input band
+	UINT8 nInputColorChannels,											// Samples per pixel in the input band
+	const ResamplePlan* pRowPlan) {										// History and band rows to scaled rows
+
+	UINT8* bBlankInputRow = CurrentParams->pBlankInputRows;				// Input rows with no ink in any channel
+	size_t nRowBytes = (size_t)nInputImagePixelWidth * nInputColorChannels * (CurrentParams->nImageBitDepth / 8);
+	UINT16 nBlankRows = 0;
+
+	for (UINT32 rlp = 0; rlp < (UINT32)CurrentParams->nHistoryRows + nInputRows; rlp++) {
+		bool bHistory = rlp < CurrentParams->nHistoryRows;
+		const UINT8* pRows = (const UINT8*)(bHistory ? CurrentParams->pRowHistory : pInputRasterBuffer);
+		size_t nRow = bHistory ? rlp : rlp - CurrentParams->nHistoryRows;
+		size_t nPlaneRows = bHistory ? CurrentParams->nHistoryRowsMax : nInputRows;
+
+		if (CurrentParams->bPlanarInput) {								// Planar: the row is blank in every plane
+			size_t nPlaneRowBytes = nRowBytes / nInputColorChannels;
+
+			bBlankInputRow[rlp] = 1;
+			for (UINT8 plp = 0; plp < nInputColorChannels && bBlankInputRow[rlp]; plp++)
+				bBlankInputRow[rlp] = _BandRowIsBlank(pRows + (plp * nPlaneRows + nRow) * nPlaneRowBytes, nPlaneRowBytes);
+		}
+		else
+			bBlankInputRow[rlp] = _BandRowIsBlank(pRows + nRow * nRowBytes, nRowBytes);
+	}
+	for (UINT32 cy = 0; cy < pRowPlan->nOutputs; cy++) {
+		CurrentParams->pBlankRasterRows[cy] = 1;
+		for (UINT16 tlp = 0; tlp < pRowPlan->nTaps; tlp++) {
+			if (pRowPlan->pWeight[(size_t)tlp * pRowPlan->nOutputs + cy] != 0.F &&
+				!bBlankInputRow[pRowPlan->pFirst[cy] + tlp]) {
+				CurrentParams->pBlankRasterRows[cy] = 0;
+				break;
 			}
 		}
+		nBlankRows += CurrentParams->pBlankRasterRows[cy];
 	}
-	
-	for (eblp = 0; eblp < 2; eblp++) {									// Allocate error buffers, double buffer even/odd
-		if ((CurrentParams.pFloatErrorBuffer[eblp] =					// Allocate and initialize the buffers to 0
-			(float ***)calloc((size_t)nKernelHeight[CurrentParams.nEDKernelType], 
-				sizeof(float **))) != NULL) {							// The buffer height = error kernel height
-	
-			for (x = 0; x < nKernelHeight[CurrentParams.nEDKernelType]; x++) {
-				if ((CurrentParams.pFloatErrorBuffer[eblp][x] =			// Each color channel is processed separate
-					(float **)calloc((size_t)CurrentParams.nColorChannels, 
-						sizeof(float *))) != NULL) {
-	
-					for (y = 0; y < CurrentParams.nColorChannels; y++) {
-						if ((CurrentParams.pFloatErrorBuffer[eblp][x][y] =
-							(float *)calloc((size_t)nRasterWidthPixels, 
-								sizeof(float))) != NULL) {				// The buffer width = width of the output pixel buffer
-							CurrentParams.nErrorCode = 0;
-						}
-						else {											// Buffer (width) could not be initialized
-							CurrentParams.nErrorCode = (-18);			// Report error
-							swprintf_s(CurrentParams.sRetErrDescription,
-								_countof(CurrentParams.sRetErrDescription),
-								_T("EC(-18) Failed to allocate float error buffer A!"));
-							return CurrentParams.nErrorCode;
-						}
-					}
+	return nBlankRows;
+}
+
+// *********************************************************************************************************************************
+// _ScaledWhiteRun() returns the number of zero pixels in pScaledRow from nCol on, scanning in the nStep direction (SSE2, 4 at a time)
+//
+#define ED_WHITE_RUN_MIN	8												// Shorter runs go through the diffusion loop
+
+UINT32 _ScaledWhiteRun(const float* pScaledRow, UINT32 nCol, INT8 nStep, UINT32 nWidth) {
+	UINT32 nRun = 0;
+
+	if (nStep > 0) {
+		UINT32 nLeft = nWidth - nCol;
+#ifdef ED_USE_SSE2
+		for (; nRun + 4 <= nLeft; nRun += 4) {
+			int nMask = _mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(pScaledRow + nCol + nRun), _mm_setzero_ps()));
+			if (nMask != 0) {												// First inked pixel in this group
+				while ((nMask & 1) == 0) {
+					nMask >>= 1;
+					nRun++;
 				}
-				else {
-					CurrentParams.nErrorCode = (-18);					// Buffer (channels) could not be initialized
-					swprintf_s(CurrentParams.sRetErrDescription,		// Report error
-						_countof(CurrentParams.sRetErrDescription),
-						_T("EC(-18) Failed to allocate float error buffer B!"));
-					return CurrentParams.nErrorCode;
+				return nRun;
+			}
+		}
+#endif
+		while (nRun < nLeft && pScaledRow[nCol + nRun] == 0.F)
+			nRun++;
+	}
+	else {
+		UINT32 nLeft = nCol + 1;
+#ifdef ED_USE_SSE2
+		for (; nRun + 4 <= nLeft; nRun += 4) {							// Columns nCol - nRun - 3 .. nCol - nRun
+			int nMask = _mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(pScaledRow + nCol - nRun - 3), _mm_setzero_ps()));
+			if (nMask != 0) {												// Last inked pixel in this group
+				while ((nMask & 8) == 0) {
+					nMask <<= 1;
+					nRun++;
 				}
+				return nRun;
 			}
 		}
-		else {
-			CurrentParams.nErrorCode = (-18);							// Buffer (height) could not be initialized
-			swprintf_s(CurrentParams.sRetErrDescription,				// Report error
-				_countof(CurrentParams.sRetErrDescription),
-				_T("EC(-18) Failed to allocate float error buffer C!"));
-			return CurrentParams.nErrorCode;
+#endif
+		while (nRun < nLeft && pScaledRow[nCol - nRun] == 0.F)
+			nRun++;
+	}
+	return nRun;
+}
+
+// *********************************************************************************************************************************
+// Halftoning arena: every buffer a halftoning context needs is carved from one aligned slab, sized up front
+// The slab outlives the job, so back-to-back jobs of the same (or smaller) size allocate and fault in nothing new
+// On Linux the slab can be backed by 2 MB pages, so the 16-bit error LUT and wide error rows need few DTLB entries:
+//  ED_HUGE_PAGES_THP asks for transparent huge pages (madvise), ED_HUGE_PAGES_HUGETLB maps reserved hugetlbfs pages
+//  and falls back to THP, then to normal pages; _HalftoneArenaHugePageBytes() reports what the kernel actually gave us
+//
+#define ED_ARENA_ALIGNMENT		64											// Each buffer starts on a cache line
+#define ED_ARENA_SLAB_ALIGNMENT	4096										// The slab starts on a page
+#define ED_HUGE_PAGE_SIZE		((size_t)2 << 20)							// x86-64 huge page, 2 MB
+
+#define ED_HUGE_PAGES_OFF		0											// Normal pages
+#define ED_HUGE_PAGES_THP		1											// Transparent huge pages, madvise(MADV_HUGEPAGE)
+#define ED_HUGE_PAGES_HUGETLB	2											// MAP_HUGETLB, falls back to THP
+
+typedef struct HalftoneArena {
+	UINT8* pSlab					= NULL;									// One allocation holding every halftoning buffer
+	size_t nSlabSize				= 0;									// Capacity of pSlab in bytes
+	size_t nSlabUsed				= 0;									// Bytes laid out for the current job
+	UINT32 nSlabAllocations			= 0;									// Times the slab was (re)allocated, the rest were reuses
+	UINT8 nHugePageMode				= ED_HUGE_PAGES_OFF;					// Requested backing, ED_HUGE_PAGES_...
+	UINT8 nHugePageBacking			= ED_HUGE_PAGES_OFF;					// Backing the slab actually got
+	void* pMapBase					= NULL;									// mmap() region holding the slab, NULL = heap
+	size_t nMapSize					= 0;									// Size of the mmap() region
+} HalftoneArena;
+
+// *********************************************************************************************************************************
+// _ReleaseHalftoneArena() frees the slab
+//
+void _ReleaseHalftoneArena(HalftoneArena* pArena) {
+#ifdef __linux__
+	if (pArena->pMapBase != NULL)
+		munmap(pArena->pMapBase, pArena->nMapSize);
+	else
+#endif
+#ifdef _WIN32
+	_aligned_free(pArena->pSlab);
+#else
+	free(pArena->pSlab);
+#endif
+	pArena->pSlab = NULL;
+	pArena->pMapBase = NULL;
+	pArena->nSlabSize = 0;
+	pArena->nMapSize = 0;
+	pArena->nHugePageBacking = ED_HUGE_PAGES_OFF;
+}
+
+// *********************************************************************************************************************************
+// _MapHugePageSlab() tries to put an nBytes slab (a whole number of huge pages) on 2 MB pages; false = use the heap instead
+//
+bool _MapHugePageSlab(HalftoneArena* pArena, size_t nBytes) {
+#ifdef __linux__
+#ifdef MAP_HUGETLB
+	if (pArena->nHugePageMode == ED_HUGE_PAGES_HUGETLB) {				// Reserved pages (vm.nr_hugepages), always 2 MB
+		void* pMap = mmap(NULL, nBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+		if (pMap != MAP_FAILED) {
+			pArena->pMapBase = pMap;
+			pArena->nMapSize = nBytes;
+			pArena->pSlab = (UINT8*)pMap;
+			pArena->nHugePageBacking = ED_HUGE_PAGES_HUGETLB;
+			return true;
 		}
 	}
-	UINT32 nLUTByteSize = (UINT32)powf(2., 								// Total size of pDotLUT lookup tables in bytes
-		(float)CurrentParams.nInputBitDepth);							// Either 256 (8-bit) or 65535 (16-bit) halftone
-	
-	if ((CurrentParams.pDotLUT = 
-		(UINT8*)calloc((size_t)nLUTByteSize * 3,						// Pointer to the dot lookup table = (2 ^ nInputBitDepth)
-			sizeof(UINT8))) == NULL) {									// This will be populated with values from the
-																		//  dot lookup table file
-		CurrentParams.nErrorCode = (-14);
-		swprintf_s(CurrentParams.sRetErrDescription,
-			sizeof(CurrentParams.sRetErrDescription),
-			_T("EC(-14) Failed to allocate dot density LUT!"));
-		return CurrentParams.nErrorCode;								// EC(-14) Failed to allocate dot density LUT
-	}
-	UINT8 nEDKernelSize = 												// pKernels[n] points to our kernel array
-		nKernelHeight[CurrentParams.nEDKernelType] * 7;					// First element of the array is the kernel size
-																		// All kernels are 7 wide
-	if ((CurrentParams.pFloatErrorLUT =									// Pointer to the error lookup table associated with pDotLUT
-		(float*)calloc((size_t)nLUTByteSize *							// This LUT holds the Q errors associated with each dot
-			nEDKernelSize, sizeof(float))) == NULL) {					// It is the difference between printed dot density and
-																		//  and the desired pixel value
-		CurrentParams.nErrorCode = (-19);								// Like pDotLUT, this will be populated with values from
-		swprintf_s(CurrentParams.sRetErrDescription,					//  the dot lookup table file
-			sizeof(CurrentParams.sRetErrDescription),
-			_T("EC(-19) Failed to allocate float error LUT!"));
-		return CurrentParams.nErrorCode;
+#endif
+#ifdef MADV_HUGEPAGE
+	size_t nMapSize = nBytes + ED_HUGE_PAGE_SIZE;						// Room to start the slab on a 2 MB boundary
+	void* pMap = mmap(NULL, nMapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (pMap != MAP_FAILED) {
+		UINT8* pSlab = (UINT8*)(((size_t)pMap + ED_HUGE_PAGE_SIZE - 1) & ~(ED_HUGE_PAGE_SIZE - 1));
+
+		if (madvise(pSlab, nBytes, MADV_HUGEPAGE) == 0) {				// THP disabled (or "never") fails here
+			pArena->pMapBase = pMap;
+			pArena->nMapSize = nMapSize;
+			pArena->pSlab = pSlab;
+			pArena->nHugePageBacking = ED_HUGE_PAGES_THP;
+			return true;
+		}
+		munmap(pMap, nMapSize);
+	}
+#endif
+#endif
+	return false;
+}
+
+// *********************************************************************************************************************************
+// _HalftoneArenaHugePageBytes() returns how much of the slab is on huge pages right now; hugetlbfs is all or nothing,
+//  THP is best effort, so it is read back from /proc/self/smaps (AnonHugePages of the slab's mapping)
+//
+size_t _HalftoneArenaHugePageBytes(HalftoneArena* pArena) {
+	size_t nHugeBytes = 0;
+
+	if (pArena->nHugePageBacking == ED_HUGE_PAGES_HUGETLB)
+		return pArena->nSlabSize;
+#ifdef __linux__
+	if (pArena->nHugePageBacking == ED_HUGE_PAGES_THP) {
+		FILE* pSmaps = fopen("/proc/self/smaps", "r");
+		char sLine[256];
+		bool bInSlab = false;
+		unsigned long long nStart, nEnd, nKB;
+
+		if (pSmaps == NULL)
+			return 0;
+		while (fgets(sLine, sizeof(sLine), pSmaps) != NULL) {
+			if (sscanf(sLine, "%llx-%llx ", &nStart, &nEnd) == 2)		// Mapping header, does it overlap the slab?
+				bInSlab = (nStart < (unsigned long long)(size_t)(pArena->pSlab + pArena->nSlabSize) &&
+					nEnd > (unsigned long long)(size_t)pArena->pSlab);
+			else if (bInSlab && sscanf(sLine, "AnonHugePages: %llu kB", &nKB) == 1)
+				nHugeBytes += (size_t)nKB * 1024;
+		}
+		fclose(pSmaps);
+	}
+#endif
+	return min(nHugeBytes, pArena->nSlabSize);
+}
+
+// *********************************************************************************************************************************
+// _ReserveHalftoneArena() makes sure the slab holds nBytes; a slab that is already big enough is kept as-is
+// When the slab has to grow, the first nPreserveBytes (pointer tables and LUTs) are carried over to the new slab;
+//  if the new slab cannot be had, the old one is left untouched
+//
+INT16 _ReserveHalftoneArena(HalftoneArena* pArena, size_t nBytes, size_t nPreserveBytes) {
+	if (pArena->pSlab != NULL && pArena->nSlabSize >= nBytes)
+		return 0;
+
+	HalftoneArena OldArena = *pArena;									// Released once the new slab is filled in
+
+	pArena->pSlab = NULL;
+	pArena->pMapBase = NULL;
+	pArena->nMapSize = 0;
+	pArena->nHugePageBacking = ED_HUGE_PAGES_OFF;
+	if (pArena->nHugePageMode != ED_HUGE_PAGES_OFF) {					// Whole huge pages, or the heap if none are to be had
+		size_t nHugeBytes = (nBytes + ED_HUGE_PAGE_SIZE - 1) & ~(ED_HUGE_PAGE_SIZE - 1);
+		if (_MapHugePageSlab(pArena, nHugeBytes))
+			nBytes = nHugeBytes;
+	}
+	if (pArena->pSlab == NULL) {
+		nBytes = (nBytes + ED_ARENA_SLAB_ALIGNMENT - 1) & ~(size_t)(ED_ARENA_SLAB_ALIGNMENT - 1);
+#ifdef _WIN32
+		pArena->pSlab = (UINT8*)_aligned_malloc(nBytes, ED_ARENA_SLAB_ALIGNMENT);
+#else
+		if (posix_memalign((void**)&pArena->pSlab, ED_ARENA_SLAB_ALIGNMENT, nBytes) != 0)
+			pArena->pSlab = NULL;
+#endif
+	}
+	if (pArena->pSlab == NULL) {
+		*pArena = OldArena;
+		return -1;
+	}
+	if (OldArena.pSlab != NULL && nPreserveBytes > 0)
+		memcpy(pArena->pSlab, OldArena.pSlab, min(nPreserveBytes, OldArena.nSlabSize));
+	_ReleaseHalftoneArena(&OldArena);
+
+	pArena->nSlabSize = nBytes;
+	pArena->nSlabAllocations++;
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// Halftoning context: everything needed to halftone pages with one set of ED parameters, set up once and kept warm
+//  _InitHalftoneContext()		copy the ED parameters, allocate the pointer tables and LUTs (zeroed, ready to be loaded)
+//  _BeginHalftonePage()		size the band buffers for a page (the slab only grows), clear the error buffers
+//  _HalftoneBand()				scale and halftone the band in pInputRasterBuffer, hand back one dot buffer per ink
+//  _FreeHalftoneContext()		release the arena
+// LUTs survive from page to page; bPlanarInput and nImageBitDepth are page attributes and are given to _BeginHalftonePage()
+//
+typedef struct HalftoneContext {
+	EDParams Params;													// ED parameters, LUT and buffer pointers point into Arena
+	HalftoneArena Arena;												// Every buffer, kept for the life of the context
+	int nThreads						= 1;							// Number of cores we have available
+	UINT8* pRTLDoubleBuffer[2][16]		= {};							// RTL data buffer (dot data), one per ink, double buffered
+	void* pInputRasterBuffer			= NULL;							// One input band, filled by the caller before _HalftoneBand()
+	UINT16* pSeparatedBuffer			= NULL;							// Input band converted to 16-bit inks (RGB separation:
+																		//  pixel order, color LUT: planar)
+	bool bConvertInput					= false;						// The band is converted before it is scaled, see above
+	bool bInputPlanar					= false;						// The caller's band is planar
+	UINT8 nInputImageBitDepth			= 8;							// The caller's band bit depth
+	SeparationStats ConversionStats;									// Pixels converted this page, and how many were repeats
+	UINT16* pTransferLUTs				= NULL;							// This page's transfer LUTs, see _TransferLUTCount()
+	UINT8* pOutputRasterBuffer			= NULL;							// Preview (8-bit) of the scaled, halftoned band
+	UINT16 nInputImagePixelWidth		= 0;							// Page geometry, from _BeginHalftonePage()
+	UINT16 nInputImagePixelHeight		= 0;
+	UINT8 nInputImageBufferRows			= 0;							// Tallest band the caller will hand us
+	UINT8 nInputColorChannels			= 4;							// Samples per input pixel
+	UINT32 nRasterWidthPixels			= 0;							// RasterWidthByteBlocks * DotBlockBytes (zero padded)
+	UINT32 nOutputPixelWidth			= 0;							// Printed dots per row, before the padding
+	UINT32 nOutputPixelHeight			= 0;							// Printed rows on the page
+	UINT16 nRasterBufferHeight			= 0;							// Tallest scaled band
+	UINT32 nInputRowsDone				= 0;							// Input rows halftoned so far on this page
+	UINT32 nOutputRowsDone				= 0;							// Scaled rows halftoned so far on this page
+	UINT8 nDblBuf						= 0;							// Half of the RTL double buffer the next band goes to
+	size_t nPageStateFirst				= 0;							// Slab offset of the per-page state (error rows, flags)
+	size_t nPageStateBytes				= 0;							// Size of the per-page state, zeroed for each page
+	float dTIFFDotLevelPct[16]			= {};							// Preview density of each dot size, 0 = no dot
+	UINT32 nDotVol[16][16]				= {};							// Ink usage, by color channel and dot size (this page)
+	UINT32 nPagesHalftoned				= 0;							// Pages begun with this context
+} HalftoneContext;
+
+// *********************************************************************************************************************************
+// _ArenaCarve() hands out the next nBytes of the slab (cache line aligned); when only sizing (bCarve false) it returns NULL
+//
+void* _ArenaCarve(HalftoneArena* pArena, bool bCarve, size_t nBytes) {
+	size_t nOffset = (pArena->nSlabUsed + ED_ARENA_ALIGNMENT - 1) & ~(size_t)(ED_ARENA_ALIGNMENT - 1);
+
+	pArena->nSlabUsed = nOffset + nBytes;
+	return bCarve ? pArena->pSlab + nOffset : NULL;
+}
+
+// *********************************************************************************************************************************
+// _TransferLUTCount() is how many transfer LUTs the page needs: one per ink with curves, none without (the resampler
+//  promotes 8-bit samples with a multiply)
+//
+UINT8 _TransferLUTCount(const HalftoneContext* pContext) {
+	const EDParams* CurrentParams = &pContext->Params;
+
+	return (CurrentParams->pTransferCurves != NULL) ? CurrentParams->nColorChannels : 0;
+}
+
+// *********************************************************************************************************************************
+// _LayoutHalftoneArena() is the one place the arena layout is defined; run with bCarve false it only adds up the footprint
+//  (in a scratch arena, leaving the context alone), run with bCarve true it points the context's buffers into the slab
+// The layout is: error buffer pointer tables and LUTs (fixed for the context, so they keep their place as the slab grows),
+//  then the per-page state that is zeroed for each page (error rows, scaled rows, row flags), then the band buffers,
+//  which are always written before they are read; with no page geometry yet, only the fixed part is laid out
+// *pnPageStateFirst gets the size of the fixed part, the bytes a growing slab carries over
+//
+size_t _LayoutHalftoneArena(HalftoneContext* pContext, bool bCarve, size_t nInputBandBytes, size_t* pnPageStateFirst) {
+	HalftoneArena Sizing;												// The sizing pass counts here
+	HalftoneArena* pArena = bCarve ? &pContext->Arena : &Sizing;
+	EDParams* CurrentParams = &pContext->Params;
+	UINT8 nRows = nKernelHeight[CurrentParams->nEDKernelType], x, y;
+	size_t nLUTEntries = (size_t)1 << CurrentParams->nInputBitDepth;	// 256 (8-bit) or 65536 (16-bit) halftone
+	UINT32 nicInt = pContext->nRasterWidthPixels;						// RTL data must fall on a byte boundary
+	float*** pErrorTables[2];											// What is carved, handed to the context only
+	float* pFloatErrorLUT;												//  once it is carved (a failed grow leaves the
+	UINT8* pDotLUT;														//  context's buffers where they were)
+	float* pScaledRow[2][16] = {};
+	float* pResampleRow[2][16] = {};
+	UINT8* pRTLDoubleBuffer[2][16] = {};
+	UINT8* pBlankRasterRows = NULL, * pBlankInputRows = NULL, * pOutputRasterBuffer = NULL;
+	INT32* pColumnFirst = NULL, * pRowFirst = NULL;
+	float* pColumnWeight = NULL, * pRowWeight = NULL;
+	void* pRowHistory = NULL, * pInputRasterBuffer = NULL;
+	UINT16* pSeparatedBuffer = NULL, * pTransferLUTs = NULL;
+	UINT16 nRowTaps = 0;
+	size_t nPageStateFirst, nPageStateBytes = 0;
+
+	if ((nicInt % CurrentParams->nColorChannels) != 0)
+		nicInt += (CurrentParams->nColorChannels - (nicInt % CurrentParams->nColorChannels));
+
+	pArena->nSlabUsed = 0;
+	for (UINT8 eblp = 0; eblp < 2; eblp++) {							// Error buffer pointer tables, double buffer even/odd
+		pErrorTables[eblp] = (float***)_ArenaCarve(pArena, bCarve, nRows * sizeof(float**));
+
+		for (x = 0; x < nRows; x++) {									// The buffer height = error kernel height
+			float** pChannels = (float**)_ArenaCarve(pArena, bCarve, CurrentParams->nColorChannels * sizeof(float*));
+			if (bCarve)
+				pErrorTables[eblp][x] = pChannels;
+		}
+	}
+	pFloatErrorLUT = (float*)_ArenaCarve(pArena, bCarve,				// Q errors for each dot, random access
+		nLUTEntries * CurrentParams->nEDKernelSize * sizeof(float));
+	pDotLUT = (UINT8*)_ArenaCarve(pArena, bCarve, nLUTEntries * 3);
+	nPageStateFirst = pArena->nSlabUsed = 
+		(pArena->nSlabUsed + ED_ARENA_ALIGNMENT - 1) & ~(size_t)(ED_ARENA_ALIGNMENT - 1);
+
+	if (pContext->nRasterWidthPixels != 0) {							// With no page yet, LUTs only
+		for (UINT8 eblp = 0; eblp < 2; eblp++) {						// Error rows, the buffer width = width of the output
+			for (x = 0; x < nRows; x++) {								//  pixel buffer
+				for (y = 0; y < CurrentParams->nColorChannels; y++) {
+					float* pRow = (float*)_ArenaCarve(pArena, bCarve, pContext->nRasterWidthPixels * sizeof(float));
+					if (bCarve)
+						pErrorTables[eblp][x][y] = pRow;
+				}
+			}
+		}
+		for (UINT8 tlp = 0; tlp < 2; tlp++) {							// Scaled row buffers, one per worker
+			for (y = 0; y < CurrentParams->nColorChannels; y++)
+				pScaledRow[tlp][y] = (float*)_ArenaCarve(pArena, bCarve, pContext->nRasterWidthPixels * sizeof(float));
+		}
+		pBlankRasterRows = (UINT8*)_ArenaCarve(pArena, bCarve, pContext->nRasterBufferHeight);
+		nPageStateBytes = pArena->nSlabUsed - nPageStateFirst;
+
+		UINT16 nColumnTaps = _ResampleTaps(CurrentParams->nResampleFilter, pContext->nInputImagePixelWidth,
+			pContext->nOutputPixelWidth);
+
+		nRowTaps = _ResampleTaps(CurrentParams->nResampleFilter, pContext->nInputImagePixelHeight, pContext->nOutputPixelHeight);
+		pColumnFirst = (INT32*)_ArenaCarve(pArena, bCarve, pContext->nOutputPixelWidth * sizeof(INT32));
+		pColumnWeight = (float*)_ArenaCarve(pArena, bCarve, (size_t)nColumnTaps * pContext->nOutputPixelWidth * sizeof(float));
+		pRowFirst = (INT32*)_ArenaCarve(pArena, bCarve, pContext->nRasterBufferHeight * sizeof(INT32));
+		pRowWeight = (float*)_ArenaCarve(pArena, bCarve, (size_t)nRowTaps * pContext->nRasterBufferHeight * sizeof(float));
+		pRowHistory = _ArenaCarve(pArena, bCarve, (size_t)nRowTaps * pContext->nInputImagePixelWidth *
+			(pContext->bConvertInput ? CurrentParams->nColorChannels : pContext->nInputColorChannels) *
+			(CurrentParams->nImageBitDepth / 8));
+		pBlankInputRows = (UINT8*)_ArenaCarve(pArena, bCarve, (size_t)nRowTaps + pContext->nInputImageBufferRows);
+		for (UINT8 tlp = 0; tlp < 2; tlp++) {							// Vertical pass rows, one per worker
+			for (y = 0; y < CurrentParams->nColorChannels; y++)
+				pResampleRow[tlp][y] = (float*)_ArenaCarve(pArena, bCarve, pContext->nInputImagePixelWidth * sizeof(float));
+		}
+
+		pInputRasterBuffer = _ArenaCarve(pArena, bCarve, nInputBandBytes);
+		pSeparatedBuffer = (UINT16*)_ArenaCarve(pArena, bCarve, pContext->bConvertInput ?
+			(size_t)pContext->nInputImagePixelWidth * CurrentParams->nColorChannels * pContext->nInputImageBufferRows *
+			sizeof(UINT16) : 0);
+		pTransferLUTs = (UINT16*)_ArenaCarve(pArena, bCarve, ((size_t)_TransferLUTCount(pContext) <<
+			CurrentParams->nImageBitDepth) * sizeof(UINT16));
+		pOutputRasterBuffer = (UINT8*)_ArenaCarve(pArena, bCarve,
+			(size_t)pContext->nRasterWidthPixels * CurrentParams->nColorChannels * pContext->nRasterBufferHeight);
+		for (y = 0; y < CurrentParams->nColorChannels; y++) {			// RTL data, double buffered for the writer stage
+			pRTLDoubleBuffer[0][y] = (UINT8*)_ArenaCarve(pArena, bCarve, (size_t)nicInt * pContext->nRasterBufferHeight);
+			pRTLDoubleBuffer[1][y] = (UINT8*)_ArenaCarve(pArena, bCarve, (size_t)nicInt * pContext->nRasterBufferHeight);
+		}
+	}
+	*pnPageStateFirst = nPageStateFirst;
+	if (!bCarve)
+		return pArena->nSlabUsed;
+
+	pContext->nPageStateFirst = nPageStateFirst;						// Carved: the context's buffers move into the slab
+	pContext->nPageStateBytes = nPageStateBytes;
+	CurrentParams->pFloatErrorBuffer[0] = pErrorTables[0];
+	CurrentParams->pFloatErrorBuffer[1] = pErrorTables[1];
+	CurrentParams->pFloatErrorLUT = pFloatErrorLUT;
+	CurrentParams->pDotLUT = pDotLUT;
+	if (pContext->nRasterWidthPixels == 0)								// The page buffers are kept until a page lays them out
+		return pArena->nSlabUsed;
+
+	memcpy(CurrentParams->pScaledRow, pScaledRow, sizeof(pScaledRow));
+	memcpy(CurrentParams->pResampleRow, pResampleRow, sizeof(pResampleRow));
+	memcpy(pContext->pRTLDoubleBuffer, pRTLDoubleBuffer, sizeof(pRTLDoubleBuffer));
+	CurrentParams->pBlankRasterRows = pBlankRasterRows;
+	CurrentParams->ColumnPlan.pFirst = pColumnFirst;
+	CurrentParams->ColumnPlan.pWeight = pColumnWeight;
+	CurrentParams->RowPlan.pFirst = pRowFirst;
+	CurrentParams->RowPlan.pWeight = pRowWeight;
+	CurrentParams->nHistoryRowsMax = nRowTaps;							// Rows above the band the next band's taps can read
+	CurrentParams->pRowHistory = pRowHistory;
+	CurrentParams->pBlankInputRows = pBlankInputRows;
+	pContext->pInputRasterBuffer = pInputRasterBuffer;
+	pContext->pSeparatedBuffer = pSeparatedBuffer;
+	pContext->pTransferLUTs = pTransferLUTs;
+	pContext->pOutputRasterBuffer = pOutputRasterBuffer;
+	return pArena->nSlabUsed;
+}
+
+// *********************************************************************************************************************************
+// _ArrangeHalftoneArena() sizes the arena for the context's current geometry, grows it if needed and points everything into it
+// Nothing in the context changes until the slab is big enough, so a failed grow leaves a warm context as it was
+//
+INT16 _ArrangeHalftoneArena(HalftoneContext* pContext, size_t nInputBandBytes) {
+	size_t nFixedBytes;
+	size_t nFootprint = _LayoutHalftoneArena(pContext, false, nInputBandBytes, &nFixedBytes);
+
+	if (_ReserveHalftoneArena(&pContext->Arena, nFootprint, nFixedBytes) != 0) {
+		pContext->Params.nErrorCode = (-62);							// One allocation for everything, nothing to leak
+		swprintf_s(pContext->Params.sRetErrDescription,
+			_countof(pContext->Params.sRetErrDescription),
+			_T("EC(-62) Failed to allocate halftoning arena (%zu bytes)!"), nFootprint);
+		return pContext->Params.nErrorCode;
+	}
+	_LayoutHalftoneArena(pContext, true, nInputBandBytes, &nFixedBytes);
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _DefaultInkOrder() sets the printer ink order for nColorChannels inks: CMYK goes out K first (K, C, M, Y), inks past K keep
+//  their place, and fewer than 4 inks (gray is the K plane alone, CMY) go out in input order
+//
+void _DefaultInkOrder(EDParams* CurrentParams) {
+	for (UINT8 clp = 0; clp < 16; clp++)
+		CurrentParams->nInkOrder[clp] = (CurrentParams->nColorChannels >= 4 && clp < 4) ? (UINT8)((clp + 1) % 4) : clp;
+}
+
+// *********************************************************************************************************************************
+// _ValidInkOrder() returns true if the ink order sends each of the nColorChannels inks to its own printer plane
+//
+bool _ValidInkOrder(const EDParams* CurrentParams) {
+	UINT16 nPlanesUsed = 0;
+
+	for (UINT8 clp = 0; clp < CurrentParams->nColorChannels; clp++) {
+		if (CurrentParams->nInkOrder[clp] >= CurrentParams->nColorChannels || (nPlanesUsed >> CurrentParams->nInkOrder[clp]) & 1)
+			return false;
+		nPlanesUsed |= (UINT16)(1 << CurrentParams->nInkOrder[clp]);
+	}
+	return true;
+}
+
+// *********************************************************************************************************************************
+// _InitHalftoneContext() sets a context up from a set of ED parameters; the LUTs are allocated and zeroed, ready to be loaded
+// Arena.nHugePageMode can be set before this call
+//
+INT16 _InitHalftoneContext(HalftoneContext* pContext, const EDParams* pParams, int nThreads) {
+	EDParams* CurrentParams = &pContext->Params;
+
+	*CurrentParams = *pParams;
+	CurrentParams->nErrorCode = 0;
+	CurrentParams->nEDKernelSize = 										// pKernels[n] points to our kernel array
+		nKernelHeight[CurrentParams->nEDKernelType] * 7;				// First element of the array is the kernel size
+	pContext->nThreads = max(nThreads, 1);								// All kernels are 7 wide
+	pContext->nRasterWidthPixels = 0;
+
+	for (UINT8 dlp = 1; dlp < CurrentParams->nDotLevels; dlp++)
+		pContext->dTIFFDotLevelPct[dlp] = (float)dlp / (float)(CurrentParams->nDotLevels - 1);
+
+	if (_ArrangeHalftoneArena(pContext, 0) != 0)
+		return CurrentParams->nErrorCode;
+
+	memset(pContext->Arena.pSlab, 0, pContext->nPageStateFirst);		// LUTs start empty, until loaded
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _BeginHalftonePage() gets the context ready for a page: band buffers sized for the geometry (the slab only ever grows),
+//  error buffers cleared, and the blank row shortcut enabled if the loaded LUTs allow it
+//
+INT16 _BeginHalftonePage(
+	HalftoneContext* pContext,											// Halftoning context
+	UINT16 nInputImagePixelWidth,										// Input image width in pixels
+	UINT16 nInputImagePixelHeight,										// Input image height in pixels
+	UINT8 nInputImageBufferRows,										// Tallest band that will be handed in
+	UINT8 nInputColorChannels,											// Samples per input pixel (3 for RGB, converted to CMYK)
+	UINT8 nImageBitDepth,												// Input raster image bit depth, 8 or 16 bits/color
+	bool bPlanarInput,													// Bands are planar (CC..MM..YY..KK..)
+	UINT32 nOutputPixelWidth,											// Printed image width in dots
+	UINT32 nOutputPixelHeight) {										// Printed image height in rows
+
+	EDParams* CurrentParams = &pContext->Params;
+
+	if (nOutputPixelWidth == 0 || nOutputPixelHeight == 0) {			// No print resolution, nothing to lay out
+		CurrentParams->nErrorCode = (-85);
+		swprintf_s(CurrentParams->sRetErrDescription,
+			_countof(CurrentParams->sRetErrDescription),
+			_T("EC(-85) Invalid page geometry, %u x %u printed dots!"), nOutputPixelWidth, nOutputPixelHeight);
+		return CurrentParams->nErrorCode;
+	}
+	if (CurrentParams->bInputImageIsRGB && (nInputColorChannels != 3 || CurrentParams->nColorChannels < 4 ||
+		CurrentParams->nInputBitDepth != 16)) {							// Separated to 16-bit CMYK, see ColorSeparation
+		CurrentParams->nErrorCode = (-85);
+		swprintf_s(CurrentParams->sRetErrDescription,
+			_countof(CurrentParams->sRetErrDescription),
+			_T("EC(-85) RGB input needs 3 channels, 4 or more inks and 16-bit diffusion!"));
+		return CurrentParams->nErrorCode;
+	}
+	if (CurrentParams->pColorLUT != NULL && (nInputColorChannels != CurrentParams->pColorLUT->nInputs ||
+		CurrentParams->nColorChannels != CurrentParams->pColorLUT->nOutputs || CurrentParams->nInputBitDepth != 16)) {
+		CurrentParams->nErrorCode = (-85);
+		swprintf_s(CurrentParams->sRetErrDescription,
+			_countof(CurrentParams->sRetErrDescription),
+			_T("EC(-85) Color LUT needs %u input channels, %u inks and 16-bit diffusion!"),
+			CurrentParams->pColorLUT->nInputs, CurrentParams->pColorLUT->nOutputs);
+		return CurrentParams->nErrorCode;
+	}
+	if (CurrentParams->pTransferCurves != NULL && CurrentParams->pTransferCurves->nInks != CurrentParams->nColorChannels) {
+		CurrentParams->nErrorCode = (-85);
+		swprintf_s(CurrentParams->sRetErrDescription,
+			_countof(CurrentParams->sRetErrDescription),
+			_T("EC(-85) Transfer curves for %u inks, the page prints %u!"),
+			CurrentParams->pTransferCurves->nInks, CurrentParams->nColorChannels);
+		return CurrentParams->nErrorCode;
+	}
+	if (!CurrentParams->bInputImageIsRGB && CurrentParams->pColorLUT == NULL &&	// Unconverted input is read as inks
+		nInputColorChannels != CurrentParams->nColorChannels) {
+		CurrentParams->nErrorCode = (-85);
+		swprintf_s(CurrentParams->sRetErrDescription,
+			_countof(CurrentParams->sRetErrDescription),
+			_T("EC(-85) Input of %u channels, the page prints %u inks!"), nInputColorChannels, CurrentParams->nColorChannels);
+		return CurrentParams->nErrorCode;
+	}
+	if (!_ValidInkOrder(CurrentParams)) {								// Every ink needs its own RTL plane
+		CurrentParams->nErrorCode = (-85);
+		swprintf_s(CurrentParams->sRetErrDescription,
+			_countof(CurrentParams->sRetErrDescription),
+			_T("EC(-85) Ink order does not fit %u inks!"), CurrentParams->nColorChannels);
+		return CurrentParams->nErrorCode;
+	}
+	UINT16 nRasterWidthByteBlocks = (UINT16)((nOutputPixelWidth +		// Output rows are whole byte blocks, zero padded
+		CurrentParams->nDotsPerByteBlock - 1) / CurrentParams->nDotsPerByteBlock);
+
+	CurrentParams->nErrorCode = 0;
+	pContext->bConvertInput = CurrentParams->bInputImageIsRGB || CurrentParams->pColorLUT != NULL;
+	pContext->bInputPlanar = bPlanarInput;
+	pContext->nInputImageBitDepth = nImageBitDepth;
+	CurrentParams->nImageBitDepth = pContext->bConvertInput ? 16 : nImageBitDepth;	// What the scaler reads
+	CurrentParams->bPlanarInput = pContext->bConvertInput ? (CurrentParams->pColorLUT != NULL) : bPlanarInput;
+	pContext->nInputImagePixelWidth = nInputImagePixelWidth;
+	pContext->nInputImagePixelHeight = nInputImagePixelHeight;
+	pContext->nInputImageBufferRows = nInputImageBufferRows;
+	pContext->nInputColorChannels = nInputColorChannels;
+	pContext->nOutputPixelHeight = nOutputPixelHeight;
+	pContext->nOutputPixelWidth = nOutputPixelWidth;
+	pContext->nRasterWidthPixels = (UINT32)nRasterWidthByteBlocks * CurrentParams->nDotsPerByteBlock;
+	UINT32 nBandRowsMost = min((UINT32)nInputImageBufferRows, (UINT32)nInputImagePixelHeight) +	// A band, and the rows
+		_ResampleTaps(CurrentParams->nResampleFilter, nInputImagePixelHeight, nOutputPixelHeight);	//  left waiting for it
+
+	pContext->nRasterBufferHeight = (UINT16)min(ceil((double)nBandRowsMost * nOutputPixelHeight / nInputImagePixelHeight) + 1.,
+		(double)min(nOutputPixelHeight, (UINT32)65535));				// Tallest scaled band
+	pContext->nInputRowsDone = 0;
+	pContext->nOutputRowsDone = 0;
+	CurrentParams->nHistoryRows = 0;
+	pContext->nDblBuf = 0;
+	memset(pContext->nDotVol, 0, sizeof(pContext->nDotVol));
+	pContext->ConversionStats = SeparationStats();
+
+	if (_ArrangeHalftoneArena(pContext, (size_t)nInputImagePixelWidth * nInputColorChannels *
+		(nImageBitDepth / 8) * nInputImageBufferRows) != 0)
+		return CurrentParams->nErrorCode;
+
+	memset(pContext->Arena.pSlab + pContext->nPageStateFirst, 0,		// Error buffers start at zero, every page
+		pContext->nPageStateBytes);
+	_BuildResamplePlan(&CurrentParams->ColumnPlan, CurrentParams->nResampleFilter, nInputImagePixelWidth, nOutputPixelWidth,
+		0, nOutputPixelWidth, 0, nInputImagePixelWidth);				// The same columns for every band
+
+	size_t nTransferEntries = (size_t)1 << CurrentParams->nImageBitDepth;	// Sample to scaled value, one lookup per sample
+	UINT16 nMaxPixVal = (CurrentParams->nInputBitDepth == 16) ? 65535 : 255;	//  (promotion, curve and limit in one)
+
+	for (UINT8 clp = 0; clp < CurrentParams->nColorChannels; clp++) {
+		if (CurrentParams->pTransferCurves != NULL) {
+			_BuildTransferLUT(CurrentParams->pTransferCurves, clp, CurrentParams->nImageBitDepth, nMaxPixVal,
+				pContext->pTransferLUTs + clp * nTransferEntries);
+			CurrentParams->pTransferLUT[clp] = pContext->pTransferLUTs + clp * nTransferEntries;
+		}
+		else
+			CurrentParams->pTransferLUT[clp] = NULL;
+	}
+
+	CurrentParams->bZeroPixelIsBlank = true;								// Blank rows can only be skipped if a zero pixel
+	for (UINT8 clp = 0; clp < CurrentParams->nColorChannels; clp++) {		//  prints nothing and scatters no error in every
+		const UINT8* pDotLUT = CurrentParams->pInkDotLUT[clp] ?				//  ink (converted input is scanned once converted)
+			CurrentParams->pInkDotLUT[clp] : CurrentParams->pDotLUT;
+		const float* pErrorLUT = CurrentParams->pInkErrorLUT[clp] ?
+			CurrentParams->pInkErrorLUT[clp] : CurrentParams->pFloatErrorLUT;
+		
+		if (pDotLUT[0] != 0 || (CurrentParams->pTransferLUT[clp] != NULL && CurrentParams->pTransferLUT[clp][0] != 0))
+			CurrentParams->bZeroPixelIsBlank = false;					// (nor may a curve lift a zero sample)
+		for (UINT8 klp = 0; klp < CurrentParams->nEDKernelSize; klp++) {
+			if (pErrorLUT[klp] != 0.F)
+				CurrentParams->bZeroPixelIsBlank = false;
+		}
+	}
+	pContext->nPagesHalftoned++;
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _KeepRowHistory() keeps the last input rows (up to nHistoryRowsMax) of the history and the band just halftoned, as the scaler
+//  read them (converted, if the input is), for the taps of the next band's first rows; planar rows stay in their planes
+//
+void _KeepRowHistory(HalftoneContext* pContext, const void* pHalftoneInput, UINT8 nBandRows) {
+	EDParams* CurrentParams = &pContext->Params;
+	UINT8 nChannels = pContext->bConvertInput ? CurrentParams->nColorChannels : pContext->nInputColorChannels;
+	UINT8 nPlanes = CurrentParams->bPlanarInput ? nChannels : 1;
+	size_t nPlaneRowBytes = (size_t)pContext->nInputImagePixelWidth * (nChannels / nPlanes) * (CurrentParams->nImageBitDepth / 8);
+	UINT16 nFromBand = (UINT16)min((UINT16)nBandRows, CurrentParams->nHistoryRowsMax);	// Newest rows last
+	UINT16 nFromHistory = (UINT16)min(CurrentParams->nHistoryRows, (UINT16)(CurrentParams->nHistoryRowsMax - nFromBand));
+
+	for (UINT8 plp = 0; plp < nPlanes; plp++) {
+		UINT8* pHistory = (UINT8*)CurrentParams->pRowHistory + (size_t)plp * CurrentParams->nHistoryRowsMax * nPlaneRowBytes;
+		const UINT8* pBand = (const UINT8*)pHalftoneInput + (size_t)plp * nBandRows * nPlaneRowBytes;
+
+		memmove(pHistory, pHistory + (size_t)(CurrentParams->nHistoryRows - nFromHistory) * nPlaneRowBytes,
+			nFromHistory * nPlaneRowBytes);
+		memcpy(pHistory + nFromHistory * nPlaneRowBytes, pBand + (size_t)(nBandRows - nFromBand) * nPlaneRowBytes,
+			nFromBand * nPlaneRowBytes);
 	}
+	CurrentParams->nHistoryRows = nFromHistory + nFromBand;
+}
+
+// *********************************************************************************************************************************
+// _HalftoneBand() scales and halftones the nBandRows rows the caller put in pInputRasterBuffer
+// The row plan is in page rows, reading the history kept from the bands before; a scaled row whose taps reach past the band
+//  waits for the next one (so the rows out lag the rows in by a little, and the last band brings the page out), and no
+//  band boundary is ever folded the way the image edges are
+// *pppRTLData gets one dot buffer per ink (printer ink order, nRasterWidthPixels dots per row, *pnOutputRows rows, maybe 0);
+//  bands go to alternate halves of the double buffer, so the dots stay valid while the next band is halftoned
+//
+INT16 _HalftoneBand(HalftoneContext* pContext, UINT8 nBandRows, UINT8*** pppRTLData, UINT16* pnOutputRows) {
+	EDParams* CurrentParams = &pContext->Params;
+	UINT32 nOutputNextRow = min(_ResampleOutputsReady(CurrentParams->nResampleFilter, pContext->nInputImagePixelHeight,
+		pContext->nOutputPixelHeight, pContext->nInputRowsDone + nBandRows),	// Rows with every tap read by now
+		pContext->nOutputRowsDone + pContext->nRasterBufferHeight);
+	UINT16 nBandOutputRows = (UINT16)(max(nOutputNextRow, pContext->nOutputRowsDone) - pContext->nOutputRowsDone);
+	UINT8** pRTLData = pContext->pRTLDoubleBuffer[pContext->nDblBuf];
+
+	if (CurrentParams->nErrorCode != 0)
+		return CurrentParams->nErrorCode;
+
+	void* pHalftoneInput = pContext->pInputRasterBuffer;				// What the scaler reads, ink values
+
+	_BuildResamplePlan(&CurrentParams->RowPlan, CurrentParams->nResampleFilter, pContext->nInputImagePixelHeight,
+		pContext->nOutputPixelHeight, pContext->nOutputRowsDone, nBandOutputRows,
+		pContext->nInputRowsDone - CurrentParams->nHistoryRows, CurrentParams->nHistoryRows + nBandRows);
+	CurrentParams->nBandFirstRow = pContext->nOutputRowsDone;
+
+	if (CurrentParams->pColorLUT != NULL) {							// Profile conversion to planar 16-bit inks, on every core
+		_ApplyColorLUTBand(CurrentParams->pColorLUT, &CurrentParams->Decode, pContext->pInputRasterBuffer, pContext->nInputImageBitDepth,
+			pContext->bInputPlanar, pContext->nInputImagePixelWidth, nBandRows, pContext->pSeparatedBuffer, pContext->nThreads,
+			&pContext->ConversionStats);
+		pHalftoneInput = pContext->pSeparatedBuffer;
+	}
+	else if (CurrentParams->bInputImageIsRGB) {						// RGB to 16-bit CMYK first, on every core
+		_SeparateRGBBand(&CurrentParams->Separation, &CurrentParams->Decode, pContext->pInputRasterBuffer, pContext->nInputImageBitDepth,
+			pContext->bInputPlanar, pContext->nInputImagePixelWidth, nBandRows, CurrentParams->nColorChannels,
+			pContext->pSeparatedBuffer, pContext->nThreads, &pContext->ConversionStats);
+		pHalftoneInput = pContext->pSeparatedBuffer;
+	}
+	if (CurrentParams->bZeroPixelIsBlank)								// Flag white rows, so they skip the diffusion
+		_FindBlankRasterRows(CurrentParams, pHalftoneInput, pContext->nInputImagePixelWidth, nBandRows,
+			pContext->bConvertInput ? CurrentParams->nColorChannels : pContext->nInputColorChannels, &CurrentParams->RowPlan);
+
+	HalftoneImageFlt(CurrentParams, pHalftoneInput, pContext->pOutputRasterBuffer,
+		pContext->nInputImagePixelWidth, nBandRows, pContext->nRasterWidthPixels,
+		pRTLData, pContext->dTIFFDotLevelPct, pContext->nDotVol, nBandOutputRows, pContext->nThreads);
+	_KeepRowHistory(pContext, pHalftoneInput, nBandRows);
+
+	pContext->nInputRowsDone += nBandRows;
+	pContext->nOutputRowsDone += nBandOutputRows;
+	pContext->nDblBuf ^= 1;
+	*pppRTLData = pRTLData;
+	*pnOutputRows = nBandOutputRows;
+	return CurrentParams->nErrorCode;
+}
+
+// *********************************************************************************************************************************
+// _FreeHalftoneContext() releases the context's arena; the context can be set up again with _InitHalftoneContext()
+//
+void _FreeHalftoneContext(HalftoneContext* pContext) {
+	_ReleaseHalftoneArena(&pContext->Arena);
+	pContext->nRasterWidthPixels = 0;
+	pContext->pInputRasterBuffer = NULL;
+	pContext->pOutputRasterBuffer = NULL;
+}
+
+// *********************************************************************************************************************************
+// GenerateRTLData() is used to call HalftoneImageFlt() to halftone a band of image data; add your own code to open an image file
+// Image data must be CMYK, pixel order (i.e. CMYKCMYKCMYKCMYK.., not CCCCMMMMYYYYKKKK..) either 8 or 16 bits/channel (32/64 bits/pixel)
+// The exception is planar input (bPlanarInput), where each channel is one contiguous plane of band rows x width samples
+// Image bands can be up to 255 rows tall; the halftone algorithm will scale to appropriate size for printing (up to 65,535 rows tall)
+// The halftoning context (see _InitHalftoneContext()) holds the ED parameters, LUTs and buffers, and is kept for the next page
+//
+INT16 GenerateRTLData(													// This is a new function, for this example
+	HalftoneContext* pContext,											// Halftoning context, already set up
+	TIFFHeader* MyTIFFHeader,											// Input image, already opened (TIFF or raw stream)
+	RTLWriter* pRTLWriter) {											// Printer data output, NULL = halftone only
 	
-	/* Allocate your input and output raster buffers here */
+	EDParams* CurrentParams = &pContext->Params;
+	UINT8 nBandRows = 0;												// Rows read into this band
+	UINT8** pRTLData;													// Dot buffers of the band just halftoned
+	UINT16 nBandOutputRows;												// Scaled (printed) rows in the band
+	std::thread writerThread;											// Writes band N while band N + 1 is halftoned
 	
-	/* Open your image file and copy it into your input raster
-	   buffer; remember that the max input buffer height is 255
-	   rows, so if the image height is more than that, pass it
-	   as image bands <= 255 tall */
+	if (_BeginHalftonePage(pContext, MyTIFFHeader->nOrientedPixelWidth, MyTIFFHeader->nOrientedPixelHeight,
+		MyTIFFHeader->nOrientedBufferRows, MyTIFFHeader->nInputColorChannels, MyTIFFHeader->nImageBitDepth,
+		MyTIFFHeader->bInputPlanar, MyTIFFHeader->nOutputPixelWidth, MyTIFFHeader->nOutputPixelHeight) != 0)
+		return CurrentParams->nErrorCode;
 	
-	/* The input image for this example should be CMYK; and
-	   remember, the halftone algorithm scales for you */
+	if (pRTLWriter != NULL && 
+		_BeginRTLPage(pRTLWriter, pContext->nRasterWidthPixels, MyTIFFHeader->nOutputPixelHeight, MyTIFFHeader->nHorizontalDPI,
+			MyTIFFHeader->nVerticalDPI, CurrentParams->nColorChannels, CurrentParams->nBitsPerDot) != 0)
+		pRTLWriter = NULL;												// Error is reported from pRTLWriter below
 	
-	/* Call HalftoneImageFlt() here after allocating your
-	   input and output raster buffers */
-	   
+	for (UINT32 nBandFirstRow = 0; 										// Read (turned as printed), scale and halftone
+		nBandFirstRow < MyTIFFHeader->nOrientedPixelHeight && CurrentParams->nErrorCode == 0; 
+		nBandFirstRow += nBandRows) {
+		
+		if (_ReadOrientedImageBand(MyTIFFHeader, pContext->pInputRasterBuffer, nBandFirstRow, &nBandRows) != 0 || 
+			nBandRows == 0) {
+			CurrentParams->nErrorCode = MyTIFFHeader->nErrorCode;		// Pass the reader's error back upstream
+			swprintf_s(CurrentParams->sRetErrDescription,
+				_countof(CurrentParams->sRetErrDescription), _T("%ls"), MyTIFFHeader->sRetErrDescription);
+			break;
+		}
+		if (_HalftoneBand(pContext, nBandRows, &pRTLData, &nBandOutputRows) != 0)
+			break;
+		
+		if (writerThread.joinable())									// The previous band is out, so its half of the
+			writerThread.join();										//  double buffer can be reused next time round
+		
+		if (pRTLWriter != NULL && pRTLWriter->nErrorCode == 0)			// Writer stage runs alongside the next band
+			writerThread = std::thread(_WriteRTLBand, pRTLWriter, pRTLData, 
+				nBandOutputRows, pContext->nRasterWidthPixels);
+	}
+	if (writerThread.joinable())
+		writerThread.join();
+	
+	if (pRTLWriter != NULL)
+		_EndRTLPage(pRTLWriter);
+	
+	return CurrentParams->nErrorCode;
 }
 
 // *********************************************************************************************************************************
@@ -181,7 +912,6 @@ INT16 HalftoneImageFlt(
 	UINT16 nInputImagePixelWidth,										// Pixel wiodth of the input image buffer, max 65535 columns
 	UINT8 nInputImageBufferRows,										// Number of rows in the input image buffer, max 255 per band
 	UINT32 nRasterWidthPixels,											// RasterWidthByteBlocks * DotBlockBytes (zero padded)
-	UINT16 nRasterBufferHeight,											// Height of output raster buffer	
 	UINT8* pRTLDataBuffer[16],											// RTL data buffer (dot data, raster data is pixels)
 	float* dTIFFDotLevelPct,											// Used to calculate dot level for simulated (TIFF) image
 	UINT32 nDotVol[16][16],												// Used to report ink drop volume by dot size and color
@@ -222,7 +952,7 @@ INT16 HalftoneImageFlt(
 	if (CurrentParams->bEnableParallelExecution && nThreads >= 8) {		// Parallel execution is enabled, with 8 or more CPUs
 		nWrkrThrd = 2;													// Interlace raster rows, odd/even processed on different cores
 
-#pragma omp parallel for												// OpenMP patallel for ...
+#pragma omp parallel for num_threads(min(nThreads, 2 * (int)CurrentParams->nColorChannels))	// No more than our share of cores
 		for (int cclp = 0; 												// Using 8 threads: C, M, Y, K Even + C, M, Y, K Odd
 			cclp < (int)(CurrentParams->nColorChannels * 
 				nWrkrThrd); cclp++) {
@@ -262,7 +992,7 @@ INT16 HalftoneImageFlt(
 			HalftoneRasterRow(CurrentParams, pInputRasterBuffer, pOutputRasterBuffer, tlop, nStep,
 				pRTLDataBuffer, nNumberOfRasterRows, nColorChannel, nColMax, nscl, nThreads, dMaxPixVal, 
 				nrs, nrf, nWrkrThrd, dTIFFDotLevelPct, nThreadDotVol[tlop][nColorChannel], bSerpentine, 
-				nKernelHeight[CurrentParams->nEDKernelType], nRasterWidthPixels, (float)nRasterBufferHeight,
+				nKernelHeight[CurrentParams->nEDKernelType], nRasterWidthPixels,
 				(float)nInputImageBufferRows, (float)CurrentParams->nColorChannels, (float)nInputImagePixelWidth);
 		}
 	}
@@ -270,7 +1000,7 @@ INT16 HalftoneImageFlt(
 				nThreads >= 4) {										// Parallel execution is enabled, with 4 or more CPUs
 		nWrkrThrd = 1;													// No interlaced passes, process rows sequentially
 
-#pragma omp parallel for												// OpenMP patallel for ...
+#pragma omp parallel for num_threads(min(nThreads, (int)CurrentParams->nColorChannels))		// No more than our share of cores
 		for (int cclp = 0; 												// Only using 4 threads, C, M, Y, K
 			cclp < (int)(CurrentParams->nColorChannels); cclp++) {
 			
@@ -280,7 +1010,7 @@ INT16 HalftoneImageFlt(
 			HalftoneRasterRow(CurrentParams, pInputRasterBuffer, pOutputRasterBuffer, tlop, nStep,
 				pRTLDataBuffer, nNumberOfRasterRows, (UINT8)cclp, nColMax, nscl, nThreads, dMaxPixVal, nrs, 
 				nrf, nWrkrThrd, dTIFFDotLevelPct, nThreadDotVol[0][cclp], CurrentParams->bSerpentineRaster, 
-				nKernelHeight[CurrentParams->nEDKernelType], nRasterWidthPixels, (float)nRasterBufferHeight, 
+				nKernelHeight[CurrentParams->nEDKernelType], nRasterWidthPixels,
 				(float)nInputImageBufferRows, (float)CurrentParams->nColorChannels, (float)nInputImagePixelWidth);
 		}
 	}
@@ -288,7 +1018,7 @@ INT16 HalftoneImageFlt(
 				nThreads >= 2) {										// Parallel execution is enabled, with 2 or more CPUs
 		nWrkrThrd = 2;													// Interlaced passes, even on CPU 1, odd on CPU 2
 
-#pragma omp parallel for												// OpenMP patallel for ...
+#pragma omp parallel for num_threads(2)											// OpenMP patallel for ...
 		for (int tlop = 0; tlop < (int)nWrkrThrd; tlop++) {				// Only using 2 threads, so channels process sequentially
 			INT8 nStep, cclp;											// Step forward or back, for serpentine raster
 			UINT32 nColMax;												// Total number of columns
@@ -313,7 +1043,7 @@ INT16 HalftoneImageFlt(
 				HalftoneRasterRow(CurrentParams, pInputRasterBuffer, pOutputRasterBuffer, (UINT8)tlop, 
 					nStep, pRTLDataBuffer, nNumberOfRasterRows, cclp, nColMax, nscl, nThreads, dMaxPixVal, 
 					nrs, nrf, nWrkrThrd, dTIFFDotLevelPct, nThreadDotVol[tlop][cclp], bSerpentine,
-					nKernelHeight[CurrentParams->nEDKernelType], nRasterWidthPixels, (float)nRasterBufferHeight, 
+					nKernelHeight[CurrentParams->nEDKernelType], nRasterWidthPixels,
 					(float)nInputImageBufferRows, (float)CurrentParams->nColorChannels, (float)nInputImagePixelWidth);
 			}
 		}
@@ -327,7 +1057,7 @@ INT16 HalftoneImageFlt(
 			HalftoneRasterRow(CurrentParams, pInputRasterBuffer, pOutputRasterBuffer, (UINT8)tlop,
 				nStep, pRTLDataBuffer, nNumberOfRasterRows, cclp, nColMax, nscl, nThreads, dMaxPixVal, nrs, 
 				nrf, nWrkrThrd, dTIFFDotLevelPct, nThreadDotVol[0][cclp], CurrentParams->bSerpentineRaster,
-				nKernelHeight[CurrentParams->nEDKernelType], nRasterWidthPixels, (float)nRasterBufferHeight, 
+				nKernelHeight[CurrentParams->nEDKernelType], nRasterWidthPixels,
 				(float)nInputImageBufferRows, (float)CurrentParams->nColorChannels, (float)nInputImagePixelWidth);
 		}
 	}
@@ -372,36 +1102,60 @@ INT16 HalftoneRasterRow(
 	bool bDoSerpentineRaster,											// Apply serpentine raster
 	UINT8 nKernelRows,													// Height of the ED kernel = 2, 3, or 4 rows
 	UINT32 dBufferWidth,												// The width of the output raster buffer
-	float dNewHeight,													// The new (scaled) height of the output raster band
 	float dOriginalHeight,												// The height of the input image raster band
 	float dColorChannels,												// The total number of color channels
 	float dInputImageWidth) {											// The width of the input image raster band
 
 	INT8 nStep = nStepFN;												// nStep is used locally, initialized with nStepFN
 	UINT8 nDotOut, lpa, lpb, lpc;										// Halftoned dot, local loop counters
-	UINT16 nR1C1, nR1C2, nR2C1, nR2C2, nPixelValue, cy;					// Nearest neighbors for bilinear interpolation
+	UINT16 nPixelValue, cy;												// Diffused pixel value, row counter
 	UINT32 nRTLIndex, nPixelIndex, nDotLUTIndex;						// Local index variables
 	UINT32 nRTLWidth, nIndexWidth, nColMaxValT, nColMax = nColMaxFN;	// Input and output raster row width
 	INT32 nTempPixVal, nDotLUTCount, nDotCount;							// Local variables for storing dot counts
-	float dOrgPixVal, dQErr, dQAvg, dAvgPixValue = 0;					// Local variables used for bilinear interpolation
+	float dOrgPixVal, dQErr, dQAvg, dAvgPixValue = 0;					// Pixel value, Q error and rolling average
 	float dOutputWidth = (float)dBufferWidth * dColorChannels;			// Output buffer width in bytes
-	float dInputWidth = dInputImageWidth * dColorChannels;				// Input buffer width in bytes
 
 	omp_set_num_threads(nThreads);										// Number of threads to use when creating parallel region
 
-	float dY, dX, dX1, dX2, dY1, dY2;									// These are local intermediate variables used
-	float dPix, dFP, dC1, dC2, dR1, dX2X, dY2Y, dX2X1, dY2Y1;			//  for bilinear interpolation section
-	float dX1Y1, dX2Y1, dX1Y2, dX2Y2, dX2X2X1, dY2Y2Y1, dR2 = 0.;
-	UINT32 nQ11, nQ12, nQ21, nQ22;
+	ResampleSource Source;												// This channel's samples in the band, see Resampler
+	size_t nSampleBytes = CurrentParams->nImageBitDepth / 8;
+
+	Source.nBitDepth = CurrentParams->nImageBitDepth;					// Converted (RGB, color LUT) input is always 16-bit
+	if (CurrentParams->bPlanarInput) {									// Planar input: this channel's plane, read sequentially
+		Source.pSamples = (const UINT8*)pInputRasterBuffer +
+			(size_t)dOriginalHeight * (size_t)dInputImageWidth * nColorChannel * nSampleBytes;
+		Source.nStride = 1;
+		Source.nRowPitch = (size_t)dInputImageWidth;
+		Source.pHistory = (const UINT8*)CurrentParams->pRowHistory +
+			(size_t)CurrentParams->nHistoryRowsMax * (size_t)dInputImageWidth * nColorChannel * nSampleBytes;
+	}
+	else {																// Interleaved input: every nth sample, offset by channel
+		Source.pSamples = (const UINT8*)pInputRasterBuffer + (size_t)nColorChannel * nSampleBytes;
+		Source.nStride = (UINT8)dColorChannels;
+		Source.nRowPitch = (size_t)dInputImageWidth * (size_t)dColorChannels;
+		Source.pHistory = (const UINT8*)CurrentParams->pRowHistory + (size_t)nColorChannel * nSampleBytes;
+	}
+	Source.nHistoryRows = CurrentParams->nHistoryRows;					// Rows kept from the bands before, see _HalftoneBand()
+	if (CurrentParams->pTransferCurves != NULL)							// The transfer LUT applies the ink's curve, and
+		Source.pTransferLUT = CurrentParams->pTransferLUT[nColorChannel];	//  promotes 8-bit samples in the same lookup
+	else																// With no curve, promotion is just a scale
+		Source.dScale = (CurrentParams->nImageBitDepth == 8) ? nscl : 1.F;
     
 	UINT8 nPreviewTIFFColorChannelOrder[16] = { 0, 1, 2, 3,
 												0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+	UINT8 nSettledRows = 0;												// Blank rows in a row, error rows all zero at nKernelRows
+	UINT32 nCol, nRun;													// Scale pass column, white run length
+	float* pScaledRow = CurrentParams->pScaledRow[tlop][nColorChannel];	// This row, scaled, before diffusion
+	const UINT8* pDotLUT = CurrentParams->pInkDotLUT[nColorChannel] ?	// This ink's LUTs, or the shared ones
+		CurrentParams->pInkDotLUT[nColorChannel] : CurrentParams->pDotLUT;
+	const float* pErrorLUT = CurrentParams->pInkErrorLUT[nColorChannel] ?
+		CurrentParams->pInkErrorLUT[nColorChannel] : CurrentParams->pFloatErrorLUT;
     
-	for (cy = (UINT16)tlop; 
-		cy < nCurrentRasterRow; cy += (UINT16)nWrkrThrd) {				// Count through rows, from top to bottom
+	for (cy = (UINT16)((nWrkrThrd == 2) ? (tlop + CurrentParams->nBandFirstRow) % 2 : tlop);	// Interlaced: even or odd
+		cy < nCurrentRasterRow; cy += (UINT16)nWrkrThrd) {				//  page rows, bands need not start on an even one
 		
 		if (bDoSerpentineRaster) {										// If the rows are not interlaced, and serpentine is selected
-			if ((cy % 2) == 0) {										//  alternate here: even left-to-right, odd right-to-left
+			if (((CurrentParams->nBandFirstRow + cy) % 2) == 0) {		//  alternate on page rows: even left-to-right, odd right-to-left
 				nStep = 1;												// Scan forward
 				nColMax = 0;											// Start at column 0
 			}
@@ -420,69 +1174,60 @@ INT16 HalftoneRasterRow(
 		srand((unsigned)time(NULL));									// Seed RAND() with time stamp
 		nRTLWidth = dBufferWidth * cy;									// Store RTL data width
 		nIndexWidth = (UINT32)dOutputWidth * cy;						// Store the scaled index width
+		
+		if (CurrentParams->bZeroPixelIsBlank && CurrentParams->pBlankRasterRows[cy]) {	// No ink in this row, in any channel
+			UINT8 nBlankPreview = (UINT8)fminf(floorf(dTIFFDotLevelPct[0] * 255.F), 255.F);
+			
+			memset(pRTLData[CurrentParams->nInkOrder[nColorChannel]] + nRTLWidth, 0, dBufferWidth);
+			for (UINT32 nCol = 0; nCol < dBufferWidth; nCol++)			// Same result as diffusing a row of zero pixels
+				pOutputRasterBuffer[nIndexWidth + nCol * (UINT8)dColorChannels +
+					nPreviewTIFFColorChannelOrder[nColorChannel]] = nBlankPreview;
+			nDotVol[0] += dBufferWidth;
+			dAvgPixValue = ldexpf(dAvgPixValue, -(INT32)min(dBufferWidth, (UINT32)255));	// Halved once per pixel
+			
+			if (nSettledRows < nKernelRows) {							// Zero pixels drop their error, so the error rows
+				for (lpa = 1; lpa < nKernelRows; lpa++)					//  just move up; once all are zero, nothing moves
+					memcpy(CurrentParams->pFloatErrorBuffer[tlop][lpa - 1][nColorChannel],
+						CurrentParams->pFloatErrorBuffer[tlop][lpa][nColorChannel], dBufferWidth * sizeof(float));
+				memset(CurrentParams->pFloatErrorBuffer[tlop][nKernelRows - 1][nColorChannel], 0,
+					dBufferWidth * sizeof(float));
+				nSettledRows++;
+			}
+			continue;
+		}
+		nSettledRows = 0;
     
-		while (nColMax >= 0 && nColMax < dBufferWidth) {				// Scan between column 0 and last column, forward or reverse
-			nRTLIndex = nRTLWidth + nColMax;							// The RTL data width is not the same as the input raster width
-			nPixelIndex = 												// We need to start with the output pixel index
-				nIndexWidth + (nColMax * (UINT8)dColorChannels);		// Then figure out which pixels in the input buffer surround
-			dPix = 														//  the pixel we need to halftone
-				(float)(nPixelIndex + nColorChannel) / dOutputWidth;	// We will actually halftone the interpolated pixel
-    
-			dFP = modff((modff(dPix, &dY) * dOutputWidth), &dX);		// We need to figure out the X, Y coordinates of the corners
-			dC1 = fmaxf(floorf((dX / dOutputWidth) * dInputWidth), 0.);	// Which will be 'real' pixels in the input raster buffer
-			dC2 = 
-				fminf(ceilf((dX / dOutputWidth) * dInputWidth), dInputWidth - 1.F);
-			dR1 = fmaxf(floorf((dY / dNewHeight) * dOriginalHeight), 0.);
-			dR2 = 
-				fminf(ceilf((dY / dNewHeight) * dOriginalHeight), dOriginalHeight - 1.F);
-    
-			nQ11 = (UINT32)fmaxf((floorf(((dR1 * dInputWidth) + dC1) /	// Now we need to know what those corner points are
-				dColorChannels) * dColorChannels) + (float)nColorChannel, 0.);
-			nQ12 = (UINT32)fmaxf((floorf(((dR1 * dInputWidth) + dC2) /
-				dColorChannels) * dColorChannels) + (float)nColorChannel, 0.);
-			nQ21 = (UINT32)fmaxf((floorf(((dR2 * dInputWidth) + dC1) /
-				dColorChannels) * dColorChannels) + (float)nColorChannel, 0.);
-			nQ22 = (UINT32)fmaxf((floorf(((dR2 * dInputWidth) + dC2) /
-				dColorChannels) * dColorChannels) + (float)nColorChannel, 0.);
-    
-			dX /= dOutputWidth;											// Translate our actual position in the input raster buffer
-			dY /= dNewHeight;											// We need to know both our location height and width
-																		//  which will most likely be between real rows and columns
-			dX1 = dC1 / dInputWidth;									// Now zero in to our location inside the 4 nearest neighbors
-			dX2 = dC2 / dInputWidth;
-			dY1 = dR1 / dOriginalHeight;
-			dY2 = dR2 / dOriginalHeight;
+		_ResampleRow(&Source, &CurrentParams->RowPlan, &CurrentParams->ColumnPlan, cy,	// Scale pass: the whole row up
+			(UINT32)dInputImageWidth, dMaxPixVal,						//  front, so white runs can be seen before the
+			CurrentParams->pResampleRow[tlop][nColorChannel], pScaledRow);	//  diffusion pass reaches them (see Resampler)
+		for (nCol = CurrentParams->ColumnPlan.nOutputs; nCol < dBufferWidth; nCol++)
+			pScaledRow[nCol] = 0.F;										// Padding to the byte block, no ink
     
-			if (CurrentParams->nImageBitDepth == 8 && 					// Input raster buffer is 8-bit, so pInputRasterBuffer is UINT8
-				!CurrentParams->bInputImageIsRGB) {						// RGB input images are always converted to 16-bit CMYK!
+		while (nColMax >= 0 && nColMax < dBufferWidth) {				// Scan between column 0 and last column, forward or reverse
+			if (CurrentParams->bZeroPixelIsBlank && pScaledRow[nColMax] == 0.F &&	// White run ahead, see _ScaledWhiteRun()
+				(nRun = _ScaledWhiteRun(pScaledRow, nColMax, nStep, dBufferWidth)) >= ED_WHITE_RUN_MIN) {
+				UINT32 nRunFirst = (nStep > 0) ? nColMax : nColMax + 1 - nRun;	// Leftmost column of the run
+				UINT8 nBlankPreview = (UINT8)fminf(floorf(dTIFFDotLevelPct[0] * 255.F), 255.F);
 				
-				nR1C1 = (UINT16)((UINT8*)pInputRasterBuffer)[nQ11] * (UINT16)nscl;
-				nR1C2 = (UINT16)((UINT8*)pInputRasterBuffer)[nQ12] * (UINT16)nscl;
-				nR2C1 = (UINT16)((UINT8*)pInputRasterBuffer)[nQ21] * (UINT16)nscl;
-				nR2C2 = (UINT16)((UINT8*)pInputRasterBuffer)[nQ22] * (UINT16)nscl;
+				memset(pRTLData[CurrentParams->nInkOrder[nColorChannel]] + nRTLWidth + nRunFirst, 0, nRun);
+				for (nCol = nRunFirst; nCol < nRunFirst + nRun; nCol++)
+					pOutputRasterBuffer[nIndexWidth + nCol * (UINT8)dColorChannels +
+						nPreviewTIFFColorChannelOrder[nColorChannel]] = nBlankPreview;
+				for (lpa = 1; lpa < nKernelRows; lpa++)					// Zero pixels drop their error and scatter none,
+					memcpy(CurrentParams->pFloatErrorBuffer[tlop][lpa - 1][nColorChannel] + nRunFirst,	//  so the error rows
+						CurrentParams->pFloatErrorBuffer[tlop][lpa][nColorChannel] + nRunFirst,		//  just move up
+						nRun * sizeof(float));
+				memset(CurrentParams->pFloatErrorBuffer[tlop][nKernelRows - 1][nColorChannel] + nRunFirst, 0,
+					nRun * sizeof(float));
+				nDotVol[0] += nRun;
+				dAvgPixValue = ldexpf(dAvgPixValue, -(INT32)min(nRun, (UINT32)255));	// Halved once per pixel
+				nColMax += (UINT32)((INT32)nStep * (INT32)nRun);		// Jump to the next inked column
+				continue;
 			}
-			else {														// Input raster buffer is 16-bit, so pInputRasterBuffer is UINT16
-				nR1C1 = ((UINT16*)pInputRasterBuffer)[nQ11];			// We will always force the scaled raster to 16-bit
-				nR1C2 = ((UINT16*)pInputRasterBuffer)[nQ12];			//  for improved gradient reproduction and optimum dynamic range
-				nR2C1 = ((UINT16*)pInputRasterBuffer)[nQ21];
-				nR2C2 = ((UINT16*)pInputRasterBuffer)[nQ22];
-			}
-			dX2X = fabsf(dX2 - dX);										// Figure out the location of the interpolated pixel
-			dY2Y = fabsf(dY2 - dY);										// It will be somewhere between the 4 corners
-			dX2X1 = fmaxf(fabsf(dX2 - dX1), 0.0001F);					// Just make sure it's not a zero value
-			dY2Y1 = fmaxf(fabsf(dY2 - dY1), 0.0001F);					//  in case of an edge condition
-    
-			dX2X2X1 = (dX2X / dX2X1);									// Triangulate to find location relative to corners
-			dY2Y2Y1 = (dY2Y / dY2Y1);									// Next four lines will weight the corners based on proximity
-    
-			dX1Y1 = clamp((float)nR1C1 - (dX2X2X1 * ((float)nR1C1 - (float)nR1C2)), 0.F, dMaxPixVal);
-			dX2Y1 = clamp((float)nR2C1 - (dX2X2X1 * ((float)nR2C1 - (float)nR2C2)), 0.F, dMaxPixVal);
-			dX1Y2 = clamp((float)nR1C1 - (dY2Y2Y1 * ((float)nR1C1 - (float)nR2C1)), 0.F, dMaxPixVal);
-			dX2Y2 = clamp((float)nR1C2 - (dY2Y2Y1 * ((float)nR1C2 - (float)nR2C2)), 0.F, dMaxPixVal);
-    
+			nRTLIndex = nRTLWidth + nColMax;							// The RTL data width is not the same as the input raster width
+			nPixelIndex = nIndexWidth + (nColMax * (UINT8)dColorChannels);	// Output pixel index, for the preview
 			nPixelValue = 0;											// Initialize the pixel value, variable gets reused
-			dOrgPixVal = 												// This is the interpolated pixel value, clamped 0. - 65535.
-				clamp((dX1Y1 + dX2Y1 + dX1Y2 + dX2Y2) / 4.F, 0.F, dMaxPixVal);
+			dOrgPixVal = pScaledRow[nColMax];							// This is the interpolated pixel value, clamped 0. - 65535.
 			
 			dQErr = 													// Accumulated Q error to be applied to the current pixel
 				CurrentParams->pFloatErrorBuffer[tlop][0][nColorChannel][nColMax];
@@ -502,7 +1247,7 @@ INT16 HalftoneRasterRow(
 						nrf) * dQAvg), 0, (INT32)dMaxPixVal);			// High frequency image data does not show artifacts
 				}														// Noise in high freq data degrades quality
 			}															// If dOrgPixVal == 0 there is no color, so don't add error
-			nDotOut = CurrentParams->pDotLUT[nPixelValue * 3];			// nPixelValue is the index to the dot LUT, nDotOut is the dot value
+			nDotOut = pDotLUT[nPixelValue * 3];							// nPixelValue is the index to the dot LUT, nDotOut is the dot value
 			nDotLUTIndex = nPixelValue * CurrentParams->nEDKernelSize;	// The index into the start of the error lookup table
 			lpc = 0;													// The error offset in the error lookup table
     
@@ -514,7 +1259,7 @@ INT16 HalftoneRasterRow(
 						nDotLUTCount < (INT32)dBufferWidth)				// Don't care about errors that extend beyond the image width
 																		// Be sure to accumulate excesss errors
 						CurrentParams->pFloatErrorBuffer[tlop][lpa][nColorChannel][nDotLUTCount] +=
-							CurrentParams->pFloatErrorLUT[nDotLUTIndex + lpc];
+							pErrorLUT[nDotLUTIndex + lpc];
     
 					nDotLUTCount += nStep;								// Used for counting dots, for reporting ink usage
 					lpc++;												// Step to the next column in the error buffer
@@ -0,0 +1,275 @@
+// Dot/error LUT builder, from measured dot densities
+// A press is calibrated by printing and measuring each dot size of each ink: the density (0 = bare paper, 1 = solid) of a
+//  patch of every dot level, the same measurement dTIFFDotLevelPct stands in for in the preview. From those densities the
+//  builder works out, for every diffusion level (65,536 at 16 bits), which dot prints and how much error is left over,
+//  spread over the taps of the error kernel, and writes the tables for every ink into a LUT cache file (see LUT_Cache.cpp)
+// The (ink, value range) blocks are built in parallel, and each block 4 levels at a time with SSE2, so recalibrating an
+//  8 ink press at 16 bits is memory bound (tens of MB of error LUT) rather than compute bound
+//
+// Calibration file (text): one line per ink, in color channel order, holding the measured density of every dot level,
+//  level 0 (no dot) first, e.g. "0.0 0.31 0.62 1.0" for paper, S, M and L dots; blank lines and # comments are skipped
+
+#define INT8	signed __int8
+#define INT16	signed __int16
+#define INT32	signed __int32
+#define UINT8 	unsigned __int8
+#define UINT16	unsigned __int16
+#define UINT32	unsigned __int32
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#define LUT_BUILD_BLOCK			4096										// Levels per parallel block
+
+// Error kernel weights, laid out like the error LUT: kernel rows x 7 columns, the current pixel in column 3 of row 0
+//  (only the columns after it are used on that row); each kernel is divided by nKernelDivisor (Atkinson spreads 6/8)
+static const UINT8
+	nKernelWeights[17][28] = {
+		{ 0, 0, 0, 0, 2, 0, 0,   0, 0, 1, 1, 0, 0, 0 },						//  0 a_3x2, Sierra Lite
+		{ 0, 0, 0, 0, 7, 0, 0,   0, 0, 3, 5, 1, 0, 0 },						//  1 b_3x2, Floyd-Steinberg
+		{ 0, 0, 0, 0, 4, 0, 0,   0, 0, 0, 3, 2, 0, 0,   0, 0, 0, 2, 1, 0, 0 },		//  2 a_2x3
+		{ 0, 0, 0, 0, 4, 0, 0,   0, 0, 1, 3, 1, 0, 0,   0, 0, 0, 1, 0, 0, 0 },		//  3 a_3x3
+		{ 0, 0, 0, 0, 4, 0, 0,   0, 0, 2, 3, 2, 0, 0,   0, 0, 1, 2, 1, 0, 0 },		//  4 b_3x3
+		{ 0, 0, 0, 0, 8, 4, 0,   0, 2, 4, 8, 4, 2, 0 },						//  5 a_5x2, Burkes
+		{ 0, 0, 0, 0, 4, 3, 0,   0, 1, 2, 3, 2, 1, 0 },						//  6 b_5x2, two row Sierra
+		{ 0, 0, 0, 0, 5, 3, 0,   0, 1, 2, 4, 2, 1, 0 },						//  7 c_5x2
+		{ 0, 0, 0, 0, 7, 2, 0,   0, 1, 2, 4, 2, 0, 0 },						//  8 d_5x2
+		{ 0, 0, 0, 0, 7, 5, 0,   0, 3, 5, 7, 5, 3, 0,   0, 1, 3, 5, 3, 1, 0 },		//  9 a_5x3, Jarvis-Judice-Ninke
+		{ 0, 0, 0, 0, 8, 4, 0,   0, 2, 4, 8, 4, 2, 0,   0, 1, 2, 4, 2, 1, 0 },		// 10 b_5x3, Stucki
+		{ 0, 0, 0, 0, 5, 3, 0,   0, 2, 4, 5, 4, 2, 0,   0, 0, 2, 3, 2, 0, 0 },		// 11 c_5x3, Sierra
+		{ 0, 0, 0, 0, 4, 3, 0,   0, 1, 3, 5, 3, 1, 0,   0, 0, 1, 2, 1, 0, 0 },		// 12 d_5x3
+		{ 0, 0, 0, 0, 1, 1, 0,   0, 0, 1, 1, 1, 0, 0,   0, 0, 0, 1, 0, 0, 0 },		// 13 e_5x3, Atkinson
+		{ 0, 0, 0, 0, 8, 4, 2,   1, 2, 4, 8, 4, 2, 1,   0, 1, 2, 4, 2, 1, 0,   0, 0, 1, 2, 1, 0, 0 },	// 14 a_7x4
+		{ 0, 0, 0, 0, 8, 4, 2,   1, 2, 4, 8, 4, 2, 1,   1, 1, 2, 4, 2, 1, 1,   0, 0, 1, 2, 1, 0, 0 },	// 15 b_7x4
+		{ 0, 0, 0, 0, 8, 0, 0,   0, 0, 2, 4, 2, 0, 0 } },					// 16 c_3x2
+	nKernelDivisor[17] = { 4, 16, 12, 10, 15, 32, 16, 18, 18, 48, 42, 32, 24, 8, 50, 52, 16 };
+
+typedef struct LUTCalibrationData {
+	UINT8 nInks						= 0;									// Lines (color channels) in the calibration
+	UINT8 nDotLevels				= 0;									// Densities per line, including level 0
+	float dDotDensity[16][16]		= {};									// [ink][dot level], 0. - 1.
+	INT16 nErrorCode				= 0;									// Return error code
+	TCHAR sRetErrDescription[128];											// Return error message
+} LUTCalibration;
+
+// *********************************************************************************************************************************
+// _SetCalibrationError() records a calibration error (always EC(-95)) and returns its code
+//
+static INT16 _SetCalibrationError(LUTCalibration* pCalibration, const char* sReason, unsigned nLine) {
+	pCalibration->nErrorCode = (-95);
+	swprintf_s(pCalibration->sRetErrDescription,
+		_countof(pCalibration->sRetErrDescription),
+		_T("EC(-95) Invalid dot calibration, %hs (line %u)!"), sReason, nLine);
+	return pCalibration->nErrorCode;
+}
+
+// *********************************************************************************************************************************
+// _AddCalibrationInk() adds one ink's measured densities; every ink must have the same number of levels, each between 0 and 1
+//  and no lighter than the dot level before it
+//
+INT16 _AddCalibrationInk(LUTCalibration* pCalibration, const float* dDensity, UINT8 nLevels, unsigned nLine) {
+	if (pCalibration->nInks == 16)
+		return _SetCalibrationError(pCalibration, "more than 16 inks", nLine);
+	if (nLevels < 2 || nLevels > 16 || (pCalibration->nDotLevels != 0 && nLevels != pCalibration->nDotLevels))
+		return _SetCalibrationError(pCalibration, "every ink needs the same dot levels", nLine);
+
+	for (UINT8 dlp = 0; dlp < nLevels; dlp++) {
+		if (!(dDensity[dlp] >= 0.F && dDensity[dlp] <= 1.F) || (dlp > 0 && dDensity[dlp] < dDensity[dlp - 1]))
+			return _SetCalibrationError(pCalibration, "densities must rise from 0 to 1", nLine);
+		pCalibration->dDotDensity[pCalibration->nInks][dlp] = dDensity[dlp];
+	}
+	pCalibration->nDotLevels = nLevels;
+	pCalibration->nInks++;
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _ReadLUTCalibration() reads the measured dot densities from a calibration file, one ink per line
+//
+INT16 _ReadLUTCalibration(LUTCalibration* pCalibration, const char* sPath) {
+	FILE* pFile = fopen(sPath, "r");
+	char sLine[1024];
+	unsigned nLine = 0;
+
+	pCalibration->nInks = 0;
+	pCalibration->nDotLevels = 0;
+	pCalibration->nErrorCode = 0;
+	if (pFile == NULL)
+		return _SetCalibrationError(pCalibration, "file not found", 0);
+
+	while (fgets(sLine, sizeof(sLine), pFile) != NULL) {
+		float dDensity[17];
+		char* pNext = sLine;
+		UINT8 nLevels = 0;
+
+		nLine++;
+		while (*pNext == ' ' || *pNext == '\t')
+			pNext++;
+		if (*pNext == '#' || *pNext == '\n' || *pNext == '\r' || *pNext == 0)
+			continue;
+		for (char* pEnd; nLevels < 17; nLevels++, pNext = pEnd) {			// Densities, level 0 first
+			dDensity[nLevels] = strtof(pNext, &pEnd);
+			if (pEnd == pNext)
+				break;
+		}
+		if (_AddCalibrationInk(pCalibration, dDensity, nLevels, nLine) != 0)
+			break;
+	}
+	fclose(pFile);
+	if (pCalibration->nErrorCode == 0 && pCalibration->nInks == 0)
+		_SetCalibrationError(pCalibration, "no inks", nLine);
+	return pCalibration->nErrorCode;
+}
+
+// *********************************************************************************************************************************
+// _BuildInkLUTBlock() fills levels nFirst .. nFirst + nCount - 1 of one ink's dot and error LUTs
+// A level prints the dot whose measured density is nearest (the thresholds are the midpoints between dot levels), and the
+//  error is the level minus what that dot prints, times each kernel weight; the printed level is built up from the
+//  threshold masks (level 0 plus each step passed), which is what lets 4 levels be done at once without a table lookup
+//
+static void _BuildInkLUTBlock(const EDParams* CurrentParams, const float* dPrinted, const float* dThreshold,
+	const float* dWeights, UINT8* pDotLUT, float* pErrorLUT, UINT32 nFirst, UINT32 nCount) {
+
+	UINT8 nKernelSize = CurrentParams->nEDKernelSize;
+	UINT8 nDotLevels = CurrentParams->nDotLevels;
+	UINT32 nLevel = nFirst, nEnd = nFirst + nCount;
+
+#ifdef ED_USE_SSE2
+	__m128 vWeights[7];														// Up to 28 taps, 4 at a time
+	__m128 vStep[16], vThreshold[16];
+
+	for (UINT8 klp = 0; klp + 4 <= nKernelSize; klp += 4)
+		vWeights[klp / 4] = _mm_loadu_ps(dWeights + klp);
+	for (UINT8 dlp = 1; dlp < nDotLevels; dlp++) {
+		vStep[dlp] = _mm_set1_ps(dPrinted[dlp] - dPrinted[dlp - 1]);
+		vThreshold[dlp] = _mm_set1_ps(dThreshold[dlp]);
+	}
+	for (; nLevel + 4 <= nEnd; nLevel += 4) {
+		__m128 vLevel = _mm_cvtepi32_ps(_mm_setr_epi32((int)nLevel, (int)nLevel + 1, (int)nLevel + 2, (int)nLevel + 3));
+		__m128 vPrinted = _mm_set1_ps(dPrinted[0]);
+		__m128i vDot = _mm_setzero_si128();
+		alignas(16) INT32 nDot[4];
+		alignas(16) float dError[4];
+
+		for (UINT8 dlp = 1; dlp < nDotLevels; dlp++) {						// Count the thresholds passed (mask = -1)
+			__m128 vPassed = _mm_cmpge_ps(vLevel, vThreshold[dlp]);
+			vDot = _mm_sub_epi32(vDot, _mm_castps_si128(vPassed));
+			vPrinted = _mm_add_ps(vPrinted, _mm_and_ps(vPassed, vStep[dlp]));
+		}
+		_mm_store_si128((__m128i*)nDot, vDot);
+		_mm_store_ps(dError, _mm_sub_ps(vLevel, vPrinted));
+
+		for (UINT8 vlp = 0; vlp < 4; vlp++) {
+			float* pTaps = pErrorLUT + (size_t)(nLevel + vlp) * nKernelSize;
+			__m128 vError = _mm_set1_ps(dError[vlp]);
+			UINT8 klp = 0;
+
+			pDotLUT[(nLevel + vlp) * 3] = (UINT8)nDot[vlp];
+			pDotLUT[(nLevel + vlp) * 3 + 1] = 0;
+			pDotLUT[(nLevel + vlp) * 3 + 2] = 0;
+			for (; klp + 4 <= nKernelSize; klp += 4)
+				_mm_storeu_ps(pTaps + klp, _mm_mul_ps(vError, vWeights[klp / 4]));
+			for (; klp < nKernelSize; klp++)
+				pTaps[klp] = dError[vlp] * dWeights[klp];
+		}
+	}
+#endif
+	for (; nLevel < nEnd; nLevel++) {										// Same sums, one level at a time
+		float dLevel = (float)nLevel, dPrintedLevel = dPrinted[0];
+		UINT8 nDot = 0;
+
+		for (UINT8 dlp = 1; dlp < nDotLevels; dlp++) {
+			if (dLevel >= dThreshold[dlp]) {
+				nDot++;
+				dPrintedLevel += dPrinted[dlp] - dPrinted[dlp - 1];
+			}
+		}
+		pDotLUT[nLevel * 3] = nDot;
+		pDotLUT[nLevel * 3 + 1] = 0;
+		pDotLUT[nLevel * 3 + 2] = 0;
+		for (UINT8 klp = 0; klp < nKernelSize; klp++)
+			pErrorLUT[(size_t)nLevel * nKernelSize + klp] = (dLevel - dPrintedLevel) * dWeights[klp];
+	}
+}
+
+// *********************************************************************************************************************************
+// _BuildInkLUTs() builds the dot and error LUTs of every ink in the calibration (ppDotLUT[n], ppErrorLUT[n], laid out like
+//  pDotLUT and pFloatErrorLUT) for the kernel, diffusion bit depth and dot levels of CurrentParams
+//
+INT16 _BuildInkLUTs(const EDParams* CurrentParams, LUTCalibration* pCalibration, UINT8* const* ppDotLUT,
+	float* const* ppErrorLUT, int nThreads) {
+
+	UINT32 nLUTEntries = (UINT32)1 << CurrentParams->nInputBitDepth;
+	UINT32 nBlocks = (nLUTEntries + LUT_BUILD_BLOCK - 1) / LUT_BUILD_BLOCK;
+	float dMaxPixVal = (float)(nLUTEntries - 1);
+	float dWeights[28] = {};
+	float dPrinted[16][16], dThreshold[16][16];
+
+	if (pCalibration->nDotLevels != CurrentParams->nDotLevels)
+		return _SetCalibrationError(pCalibration, "dot levels do not match the dot size", 0);
+
+	for (UINT8 klp = 0; klp < CurrentParams->nEDKernelSize; klp++)
+		dWeights[klp] = (float)nKernelWeights[CurrentParams->nEDKernelType][klp] /
+			(float)nKernelDivisor[CurrentParams->nEDKernelType];
+	for (UINT8 ilp = 0; ilp < pCalibration->nInks; ilp++) {					// Printed level of each dot, and the midpoints
+		for (UINT8 dlp = 0; dlp < CurrentParams->nDotLevels; dlp++) {
+			dPrinted[ilp][dlp] = pCalibration->dDotDensity[ilp][dlp] * dMaxPixVal;
+			if (dlp > 0)
+				dThreshold[ilp][dlp] = (dPrinted[ilp][dlp - 1] + dPrinted[ilp][dlp]) / 2.F;
+		}
+	}
+
+	int nTasks = (int)(pCalibration->nInks * nBlocks);
+#pragma omp parallel for schedule(static) num_threads(max(min(nThreads, nTasks), 1))
+	for (int tlp = 0; tlp < nTasks; tlp++) {								// Every (ink, block) on its own
+		UINT8 nInk = (UINT8)(tlp / nBlocks);
+		UINT32 nFirst = (UINT32)(tlp % nBlocks) * LUT_BUILD_BLOCK;
+
+		_BuildInkLUTBlock(CurrentParams, dPrinted[nInk], dThreshold[nInk], dWeights, ppDotLUT[nInk], ppErrorLUT[nInk],
+			nFirst, min((UINT32)LUT_BUILD_BLOCK, nLUTEntries - nFirst));
+	}
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _BuildLUTCache() builds the LUTs for a calibration and writes them to a LUT cache file, sPath or, if that is NULL, the
+//  file a job with -L<strDirectory> will look for
+//
+INT16 _BuildLUTCache(const EDParams* pParams, LUTCalibration* pCalibration, const string& strDirectory, const char* sPath,
+	int nThreads) {
+
+	EDParams CurrentParams = *pParams;
+	size_t nLUTEntries = (size_t)1 << CurrentParams.nInputBitDepth;
+	std::vector<UINT8*> DotLUTs;
+	std::vector<float*> ErrorLUTs;
+	INT16 nErrorCode = 0;
+
+	CurrentParams.nEDKernelSize = nKernelHeight[CurrentParams.nEDKernelType] * 7;
+	CurrentParams.nColorChannels = pCalibration->nInks;
+	for (UINT8 ilp = 0; ilp < pCalibration->nInks; ilp++) {
+		DotLUTs.push_back((UINT8*)malloc(nLUTEntries * 3));
+		ErrorLUTs.push_back((float*)malloc(nLUTEntries * CurrentParams.nEDKernelSize * sizeof(float)));
+		if (DotLUTs.back() == NULL || ErrorLUTs.back() == NULL)
+			nErrorCode = (-62);
+	}
+	if (nErrorCode != 0)
+		swprintf_s(pCalibration->sRetErrDescription, _countof(pCalibration->sRetErrDescription),
+			_T("EC(-62) Failed to allocate LUTs for %u inks!"), pCalibration->nInks);
+	else
+		nErrorCode = _BuildInkLUTs(&CurrentParams, pCalibration, DotLUTs.data(), ErrorLUTs.data(), nThreads);
+
+	if (nErrorCode == 0) {
+		string strPath = (sPath != NULL) ? string(sPath) :
+			_LUTCachePath(strDirectory, &CurrentParams, pCalibration->nInks);
+
+		nErrorCode = _WriteLUTCache(strPath.c_str(), &CurrentParams, pCalibration->nInks, DotLUTs.data(),
+			ErrorLUTs.data(), pCalibration->sRetErrDescription, _countof(pCalibration->sRetErrDescription));
+	}
+	for (UINT8 ilp = 0; ilp < pCalibration->nInks; ilp++) {
+		free(DotLUTs[ilp]);
+		free(ErrorLUTs[ilp]);
+	}
+	pCalibration->nErrorCode = nErrorCode;
+	return nErrorCode;
+}
@@ -0,0 +1,255 @@
+// Precompiled dot/error LUT cache
+// Building the 16-bit dot and error LUTs at job start is slow, so they are built once and stored in a binary cache file, one
+//  file per (kernel, diffusion bit depth, dot levels, inks). A job maps the file read-only (mmap / MapViewOfFile) and points
+//  the ink LUTs of its ED parameters (pInkDotLUT[], pInkErrorLUT[]) straight at it: nothing is copied or built, the first
+//  halftoned rows just fault the pages in, and every process and context using the same file shares the same page cache pages
+//
+// File layout (native byte order, version LUT_CACHE_VERSION):
+//	LUTCacheHeader										64 bytes, see below
+//	dot LUTs, one per ink								nEntries x 3 bytes each, every ink starts on a 4 KB page
+//	error LUTs, one per ink								nEntries x nEDKernelSize floats each, every ink on a 4 KB page
+// Files are written to a temporary name and renamed into place, so a reader never sees a partial file
+
+#define INT8	signed __int8
+#define INT16	signed __int16
+#define INT32	signed __int32
+#define INT64	signed __int64
+#define UINT8 	unsigned __int8
+#define UINT16	unsigned __int16
+#define UINT32	unsigned __int32
+#define UINT64	unsigned __int64
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define LUT_CACHE_MAGIC			"SPEEDLUT"									// 8 bytes, no terminator in the file
+#define LUT_CACHE_VERSION		1											// Bumped when the layout changes
+#define LUT_CACHE_PAGE			4096										// Every table starts on a page
+
+typedef struct LUTCacheFileHeader {
+	char sMagic[8];															// LUT_CACHE_MAGIC
+	UINT32 nVersion;														// LUT_CACHE_VERSION
+	UINT32 nHeaderBytes;													// sizeof(LUTCacheHeader)
+	UINT8 nEDKernelType;													// Key: kernel 0 - 16
+	UINT8 nInputBitDepth;													// Key: diffusion bit depth, 8 or 16
+	UINT8 nDotLevels;														// Key: dot sizes, including 0 (no dot)
+	UINT8 nInks;															// Key: inks (color channels) in the file
+	UINT8 nEDKernelSize;													// Error LUT floats per entry, kernel rows x 7
+	UINT8 nReserved[3];
+	UINT32 nEntries;														// 2 ^ nInputBitDepth
+	UINT64 nDotLUTOffset;													// First dot LUT, from the start of the file
+	UINT64 nDotLUTStride;													// Bytes from one ink's dot LUT to the next
+	UINT64 nErrorLUTOffset;													// First error LUT
+	UINT64 nErrorLUTStride;													// Bytes from one ink's error LUT to the next
+} LUTCacheHeader;
+
+typedef struct LUTCacheMapping {
+	const UINT8* pBase				= NULL;									// Start of the mapped file
+	UINT64 nSize					= 0;									// Bytes mapped
+#ifdef _WIN32
+	HANDLE hMapping					= NULL;
+#endif
+	const LUTCacheHeader* pHeader	= NULL;									// Same as pBase, once validated
+	INT16 nErrorCode				= 0;									// Return error code
+	TCHAR sRetErrDescription[128];											// Return error message
+} LUTCache;
+
+static inline UINT64 _LUTCachePageAlign(UINT64 nBytes) {
+	return (nBytes + LUT_CACHE_PAGE - 1) & ~(UINT64)(LUT_CACHE_PAGE - 1);
+}
+
+// *********************************************************************************************************************************
+// _LUTCacheLayout() fills in the header (and so the file layout) for a set of ED parameters and nInks inks
+//
+void _LUTCacheLayout(LUTCacheHeader* pHeader, const EDParams* CurrentParams, UINT8 nInks) {
+	UINT8 nKernelSize = nKernelHeight[CurrentParams->nEDKernelType] * 7;
+
+	memset(pHeader, 0, sizeof(LUTCacheHeader));
+	memcpy(pHeader->sMagic, LUT_CACHE_MAGIC, 8);
+	pHeader->nVersion = LUT_CACHE_VERSION;
+	pHeader->nHeaderBytes = sizeof(LUTCacheHeader);
+	pHeader->nEDKernelType = CurrentParams->nEDKernelType;
+	pHeader->nInputBitDepth = CurrentParams->nInputBitDepth;
+	pHeader->nDotLevels = CurrentParams->nDotLevels;
+	pHeader->nInks = nInks;
+	pHeader->nEDKernelSize = nKernelSize;
+	pHeader->nEntries = (UINT32)1 << CurrentParams->nInputBitDepth;
+	pHeader->nDotLUTOffset = LUT_CACHE_PAGE;
+	pHeader->nDotLUTStride = _LUTCachePageAlign((UINT64)pHeader->nEntries * 3);
+	pHeader->nErrorLUTOffset = pHeader->nDotLUTOffset + pHeader->nDotLUTStride * nInks;
+	pHeader->nErrorLUTStride = _LUTCachePageAlign((UINT64)pHeader->nEntries * nKernelSize * sizeof(float));
+}
+
+// *********************************************************************************************************************************
+// _LUTCachePath() is the file for a key, in the cache directory strDirectory
+//
+string _LUTCachePath(const string& strDirectory, const EDParams* CurrentParams, UINT8 nInks) {
+	char sName[64];
+
+	snprintf(sName, sizeof(sName), "speedlut_k%u_b%u_l%u_i%u.lut", CurrentParams->nEDKernelType,
+		CurrentParams->nInputBitDepth, CurrentParams->nDotLevels, nInks);
+	return strDirectory.empty() ? string(sName) : strDirectory + "/" + sName;
+}
+
+// *********************************************************************************************************************************
+// _UnmapLUTCache() releases the mapping; ED parameters attached to it must not be used afterwards
+//
+void _UnmapLUTCache(LUTCache* pCache) {
+	if (pCache->pBase != NULL) {
+#ifdef _WIN32
+		UnmapViewOfFile(pCache->pBase);
+		CloseHandle(pCache->hMapping);
+		pCache->hMapping = NULL;
+#else
+		munmap((void*)pCache->pBase, pCache->nSize);
+#endif
+	}
+	pCache->pBase = NULL;
+	pCache->pHeader = NULL;
+	pCache->nSize = 0;
+}
+
+// *********************************************************************************************************************************
+// _MapLUTCache() maps a cache file read-only and checks it was built for CurrentParams (kernel, bit depth, dot levels, and at
+//  least nColorChannels inks); the file is opened, checked and left to the page cache, the tables are not read here
+//
+INT16 _MapLUTCache(LUTCache* pCache, const char* sPath, const EDParams* CurrentParams) {
+	LUTCacheHeader Expected;
+
+	_UnmapLUTCache(pCache);
+	pCache->nErrorCode = 0;
+#ifdef _WIN32
+	HANDLE hFile = CreateFileA(sPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	LARGE_INTEGER nFileSize;
+
+	if (hFile != INVALID_HANDLE_VALUE && GetFileSizeEx(hFile, &nFileSize) && nFileSize.QuadPart >= sizeof(LUTCacheHeader) &&
+		(pCache->hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL)) != NULL) {
+		pCache->pBase = (const UINT8*)MapViewOfFile(pCache->hMapping, FILE_MAP_READ, 0, 0, 0);
+		pCache->nSize = (UINT64)nFileSize.QuadPart;
+		if (pCache->pBase == NULL) {
+			CloseHandle(pCache->hMapping);
+			pCache->hMapping = NULL;
+		}
+	}
+	if (hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(hFile);													// The mapping keeps the file open
+#else
+	int nFile = open(sPath, O_RDONLY | O_CLOEXEC);
+	struct stat FileStat;
+
+	if (nFile >= 0 && fstat(nFile, &FileStat) == 0 && (UINT64)FileStat.st_size >= sizeof(LUTCacheHeader)) {
+		void* pMap = mmap(NULL, (size_t)FileStat.st_size, PROT_READ, MAP_SHARED, nFile, 0);
+		if (pMap != MAP_FAILED) {
+			pCache->pBase = (const UINT8*)pMap;
+			pCache->nSize = (UINT64)FileStat.st_size;
+		}
+	}
+	if (nFile >= 0)
+		close(nFile);														// The mapping keeps the file open
+#endif
+	if (pCache->pBase == NULL) {
+		pCache->nErrorCode = (-93);
+		swprintf_s(pCache->sRetErrDescription,
+			_countof(pCache->sRetErrDescription),
+			_T("EC(-93) Failed to map LUT cache file %hs!"), sPath);
+		return pCache->nErrorCode;
+	}
+
+	const LUTCacheHeader* pHeader = (const LUTCacheHeader*)pCache->pBase;
+
+	_LUTCacheLayout(&Expected, CurrentParams, pHeader->nInks);
+	if (memcmp(pHeader, &Expected, sizeof(LUTCacheHeader)) != 0 || pHeader->nInks < CurrentParams->nColorChannels ||
+		pHeader->nErrorLUTOffset + pHeader->nErrorLUTStride * pHeader->nInks > pCache->nSize) {
+		_UnmapLUTCache(pCache);
+		pCache->nErrorCode = (-93);
+		swprintf_s(pCache->sRetErrDescription,
+			_countof(pCache->sRetErrDescription),
+			_T("EC(-93) LUT cache file %hs does not match this kernel and ink set!"), sPath);
+		return pCache->nErrorCode;
+	}
+	pCache->pHeader = pHeader;
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _AttachLUTCache() points the ink LUTs of the ED parameters at the mapped tables (ink n = color channel n)
+//
+void _AttachLUTCache(const LUTCache* pCache, EDParams* CurrentParams) {
+	const LUTCacheHeader* pHeader = pCache->pHeader;
+
+	for (UINT8 clp = 0; clp < CurrentParams->nColorChannels; clp++) {
+		CurrentParams->pInkDotLUT[clp] = pCache->pBase + pHeader->nDotLUTOffset + pHeader->nDotLUTStride * clp;
+		CurrentParams->pInkErrorLUT[clp] = (const float*)(pCache->pBase + pHeader->nErrorLUTOffset +
+			pHeader->nErrorLUTStride * clp);
+	}
+}
+
+// *********************************************************************************************************************************
+// _DetachLUTCache() puts the ED parameters back on their own (arena) LUTs
+//
+void _DetachLUTCache(EDParams* CurrentParams) {
+	for (UINT8 clp = 0; clp < 16; clp++) {
+		CurrentParams->pInkDotLUT[clp] = NULL;
+		CurrentParams->pInkErrorLUT[clp] = NULL;
+	}
+}
+
+// *********************************************************************************************************************************
+// _WriteLUTCache() writes nInks dot and error LUTs (ppDotLUT[n], ppErrorLUT[n], laid out like pDotLUT and pFloatErrorLUT) to a
+//  cache file; written beside the target under a temporary name and renamed over it, so mapped readers are never disturbed
+//
+INT16 _WriteLUTCache(const char* sPath, const EDParams* CurrentParams, UINT8 nInks, const UINT8* const* ppDotLUT,
+	const float* const* ppErrorLUT, TCHAR* sRetErrDescription, size_t nErrDescriptionSize) {
+
+	LUTCacheHeader Header;
+	char sTempPath[1024];
+	static const UINT8 nZeros[LUT_CACHE_PAGE] = {};
+	bool bWritten = true;
+
+	_LUTCacheLayout(&Header, CurrentParams, nInks);
+	snprintf(sTempPath, sizeof(sTempPath), "%s.%u.tmp", sPath, (unsigned)time(NULL) ^ (unsigned)(size_t)&Header);
+
+	FILE* pFile = fopen(sTempPath, "wb");
+	if (pFile == NULL) {
+		swprintf_s(sRetErrDescription, nErrDescriptionSize, _T("EC(-94) Failed to write LUT cache file %hs!"), sPath);
+		return (-94);
+	}
+
+	UINT64 nDotBytes = (UINT64)Header.nEntries * 3;
+	UINT64 nErrorBytes = (UINT64)Header.nEntries * Header.nEDKernelSize * sizeof(float);
+
+	bWritten = fwrite(&Header, sizeof(Header), 1, pFile) == 1 &&
+		fwrite(nZeros, LUT_CACHE_PAGE - sizeof(Header), 1, pFile) == 1;
+	for (UINT8 ilp = 0; ilp < nInks && bWritten; ilp++) {					// Tables, each padded to a whole page
+		bWritten = fwrite(ppDotLUT[ilp], (size_t)nDotBytes, 1, pFile) == 1 &&
+			(Header.nDotLUTStride == nDotBytes ||
+			fwrite(nZeros, (size_t)(Header.nDotLUTStride - nDotBytes), 1, pFile) == 1);
+	}
+	for (UINT8 ilp = 0; ilp < nInks && bWritten; ilp++) {
+		bWritten = fwrite(ppErrorLUT[ilp], (size_t)nErrorBytes, 1, pFile) == 1 &&
+			(Header.nErrorLUTStride == nErrorBytes ||
+			fwrite(nZeros, (size_t)(Header.nErrorLUTStride - nErrorBytes), 1, pFile) == 1);
+	}
+	bWritten = (fclose(pFile) == 0) && bWritten;
+#ifdef _WIN32
+	bWritten = bWritten && MoveFileExA(sTempPath, sPath, MOVEFILE_REPLACE_EXISTING);
+#else
+	bWritten = bWritten && rename(sTempPath, sPath) == 0;
+#endif
+	if (!bWritten) {
+		remove(sTempPath);
+		swprintf_s(sRetErrDescription, nErrDescriptionSize, _T("EC(-94) Failed to write LUT cache file %hs!"), sPath);
+		return (-94);
+	}
+	return 0;
+}
@@ -0,0 +1,543 @@
+// Print orientation: the image turned clockwise a quarter, a half or three quarters, and/or mirrored left to right (backlit
+//  film, printed from the back), as its bands are read, so no turned copy of the page is ever made
+// The halftoner sees the turned image, nOrientedPixelWidth x nOrientedPixelHeight in bands of nOrientedBufferRows, read with
+//  _ReadOrientedImageBand() in place of _ReadInputImageBand(). Printed pixel (x, y) of a W x H image is stored pixel
+//	0 turns											(x, y)						mirrored (W - 1 - x, y)
+//	1 turn (90)										(y, H - 1 - x)				mirrored (y, x)
+//	2 turns (180)									(W - 1 - x, H - 1 - y)		mirrored (x, H - 1 - y)
+//	3 turns (270)									(W - 1 - y, x)				mirrored (W - 1 - y, H - 1 - x)
+// No turn or a half turn keeps rows as rows: each printed band is one stored band (read bottom up for a half turn), its rows
+//  copied forwards or backwards, 16 bytes at a time (SSE2). A quarter turn makes printed rows of stored columns, from every
+//  stored row: the stored bands are read in order and each is transposed, in 16 x 16 pixel blocks that stay in cache (4 x 4
+//  and 2 x 2 pixels per SSE2 step for 32 and 64-bit pixels), into a window of printed rows that bands are then copied from.
+//  Only one stored band and the window are resident; the window is as many bands as ORIENT_WINDOW_BYTES allows (the whole
+//  page, for most). Each window of a tiled image decodes only the tiles of its stored columns, turned tile by tile. A strip
+//  holds every column, and a raw stream can't be read again, so when the window is not the whole page these are read once:
+//  each stored band is turned into a slab of the rows it prints (every printed row, one band of columns, for a quarter turn)
+//  and spilled to a temporary file, from which each window then reads just its rows of every slab
+
+#define INT8	signed __int8
+#define INT16	signed __int16
+#define INT32	signed __int32
+#define UINT8 	unsigned __int8
+#define UINT16	unsigned __int16
+#define UINT32	unsigned __int32
+#define INT64	signed __int64
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ED_USE_SSE2
+#include <emmintrin.h>
+#endif
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define ORIENT_WINDOW_BYTES		((size_t)256 << 20)							// Most turned rows held at once (quarter turns)
+#define ORIENT_BLOCK			16											// Transpose block, pixels each way
+
+// *********************************************************************************************************************************
+// _OrientedPosition() is where stored pixel (nX, nY) prints: *pX, *pY in the turned (and mirrored) image
+//
+static void _OrientedPosition(const TIFFHeader* MyTIFFHeader, INT64 nX, INT64 nY, INT64* pX, INT64* pY) {
+	INT64 nWidth = MyTIFFHeader->nInputImagePixelWidth, nHeight = MyTIFFHeader->nInputImagePixelHeight;
+
+	switch (MyTIFFHeader->nQuarterTurns) {
+	case 1:		*pX = nHeight - 1 - nY;	*pY = nX;					break;
+	case 2:		*pX = nWidth - 1 - nX;	*pY = nHeight - 1 - nY;		break;
+	case 3:		*pX = nY;				*pY = nWidth - 1 - nX;		break;
+	default:	*pX = nX;				*pY = nY;
+	}
+	if (MyTIFFHeader->bMirror)
+		*pX = MyTIFFHeader->nOrientedPixelWidth - 1 - *pX;
+}
+
+// *********************************************************************************************************************************
+// _OrientedBandRect() is where a stored band (nStoredRows rows from nStoredFirstRow) prints: *pFirstRow, *pRows printed rows
+//  and *pFirstCol, *pCols printed columns
+//
+static void _OrientedBandRect(const TIFFHeader* MyTIFFHeader, UINT32 nStoredFirstRow, UINT32 nStoredRows, UINT32* pFirstRow,
+	UINT32* pRows, UINT32* pFirstCol, UINT32* pCols) {
+
+	INT64 nX0, nY0, nX1, nY1;
+
+	_OrientedPosition(MyTIFFHeader, 0, nStoredFirstRow, &nX0, &nY0);		// Opposite corners of the band
+	_OrientedPosition(MyTIFFHeader, MyTIFFHeader->nInputImagePixelWidth - 1, nStoredFirstRow + nStoredRows - 1, &nX1, &nY1);
+	*pFirstRow = (UINT32)min(nY0, nY1);
+	*pRows = (UINT32)(max(nY0, nY1) - min(nY0, nY1) + 1);
+	*pFirstCol = (UINT32)min(nX0, nX1);
+	*pCols = (UINT32)(max(nX0, nX1) - min(nX0, nX1) + 1);
+}
+
+// *********************************************************************************************************************************
+// _CopyPixel() copies one pixel of nPixelBytes (1 - 8)
+//
+static inline void _CopyPixel(UINT8* pTo, const UINT8* pFrom, UINT8 nPixelBytes) {
+	switch (nPixelBytes) {
+	case 1:		*pTo = *pFrom;						break;
+	case 2:		memcpy(pTo, pFrom, 2);				break;
+	case 4:		memcpy(pTo, pFrom, 4);				break;
+	case 8:		memcpy(pTo, pFrom, 8);				break;
+	default:	memcpy(pTo, pFrom, nPixelBytes);
+	}
+}
+
+// *********************************************************************************************************************************
+// _OrientRow() copies nPixels pixels from pFrom to pTo, or (bReverse) backwards: pixel i to pTo - i pixels (pTo is where the
+//  first pixel goes either way); 1, 2, 4 and 8-byte pixels are reversed 16 bytes at a time (SSE2)
+//
+static void _OrientRow(const UINT8* pFrom, UINT8* pTo, UINT32 nPixels, UINT8 nPixelBytes, bool bReverse) {
+	UINT32 nPixel = 0;
+
+	if (!bReverse) {
+		memcpy(pTo, pFrom, (size_t)nPixels * nPixelBytes);
+		return;
+	}
+#ifdef ED_USE_SSE2
+	if (nPixelBytes == 1 || nPixelBytes == 2 || nPixelBytes == 4 || nPixelBytes == 8) {
+		UINT32 nPerVector = 16 / nPixelBytes;
+
+		for (; nPixel + nPerVector <= nPixels; nPixel += nPerVector) {
+			__m128i vPixels = _mm_loadu_si128((const __m128i*)(pFrom + (size_t)nPixel * nPixelBytes));
+
+			if (nPixelBytes <= 2) {											// 16-bit words reversed, then the bytes of each
+				vPixels = _mm_shufflehi_epi16(_mm_shufflelo_epi16(vPixels, _MM_SHUFFLE(0, 1, 2, 3)), _MM_SHUFFLE(0, 1, 2, 3));
+				vPixels = _mm_shuffle_epi32(vPixels, _MM_SHUFFLE(1, 0, 3, 2));
+				if (nPixelBytes == 1)
+					vPixels = _mm_or_si128(_mm_slli_epi16(vPixels, 8), _mm_srli_epi16(vPixels, 8));
+			}
+			else if (nPixelBytes == 4)
+				vPixels = _mm_shuffle_epi32(vPixels, _MM_SHUFFLE(0, 1, 2, 3));
+			else
+				vPixels = _mm_shuffle_epi32(vPixels, _MM_SHUFFLE(1, 0, 3, 2));
+			_mm_storeu_si128((__m128i*)(pTo - (size_t)(nPixel + nPerVector - 1) * nPixelBytes), vPixels);
+		}
+	}
+#endif
+	for (; nPixel < nPixels; nPixel++)
+		_CopyPixel(pTo - (size_t)nPixel * nPixelBytes, pFrom + (size_t)nPixel * nPixelBytes, nPixelBytes);
+}
+
+// *********************************************************************************************************************************
+// _TransposeBlock() copies nRows x nCols pixels (nFromPitch bytes from row to row) to pTo, where each next column goes
+//  nColStep bytes on and each next row nRowStep (one pixel, either way): printed rows of stored columns
+// Done in ORIENT_BLOCK square blocks, so the rows read and the rows written both stay in cache; 32-bit pixels go 4 x 4 and
+//  64-bit pixels 2 x 2 at a time (SSE2), reversed in register when the rows run backwards
+//
+static void _TransposeBlock(const UINT8* pFrom, size_t nFromPitch, UINT32 nCols, UINT32 nRows, UINT8* pTo, ptrdiff_t nColStep,
+	ptrdiff_t nRowStep, UINT8 nPixelBytes) {
+
+	UINT32 nGroup = 1;														// Rows moved together
+
+#ifdef ED_USE_SSE2
+	if (nPixelBytes == 4 || nPixelBytes == 8)
+		nGroup = 16 / nPixelBytes;
+#endif
+	for (UINT32 nBlockRow = 0; nBlockRow < nRows; nBlockRow += ORIENT_BLOCK) {
+		UINT32 nBlockRows = min((UINT32)ORIENT_BLOCK, nRows - nBlockRow);
+
+		for (UINT32 nBlockCol = 0; nBlockCol < nCols; nBlockCol += ORIENT_BLOCK) {
+			UINT32 nBlockCols = min((UINT32)ORIENT_BLOCK, nCols - nBlockCol);
+
+			for (UINT32 rlp = nBlockRow; rlp < nBlockRow + nBlockRows; ) {
+				const UINT8* pIn = pFrom + rlp * nFromPitch;
+				UINT8* pOut = pTo + (ptrdiff_t)rlp * nRowStep;
+				UINT32 clp = nBlockCol;
+
+				if (nGroup == 1 || rlp + nGroup > nBlockRow + nBlockRows) {	// One row, a pixel at a time
+					for (; clp < nBlockCol + nBlockCols; clp++)
+						_CopyPixel(pOut + (ptrdiff_t)clp * nColStep, pIn + (size_t)clp * nPixelBytes, nPixelBytes);
+					rlp++;
+					continue;
+				}
+#ifdef ED_USE_SSE2
+				for (; clp + nGroup <= nBlockCol + nBlockCols; clp += nGroup) {
+					const UINT8* pPixels = pIn + (size_t)clp * nPixelBytes;
+					__m128i vCol[4];
+
+					if (nPixelBytes == 4) {									// 4 rows of 4 pixels to 4 columns
+						__m128i vRow0 = _mm_loadu_si128((const __m128i*)pPixels);
+						__m128i vRow1 = _mm_loadu_si128((const __m128i*)(pPixels + nFromPitch));
+						__m128i vRow2 = _mm_loadu_si128((const __m128i*)(pPixels + 2 * nFromPitch));
+						__m128i vRow3 = _mm_loadu_si128((const __m128i*)(pPixels + 3 * nFromPitch));
+						__m128i vLow01 = _mm_unpacklo_epi32(vRow0, vRow1), vLow23 = _mm_unpacklo_epi32(vRow2, vRow3);
+						__m128i vHigh01 = _mm_unpackhi_epi32(vRow0, vRow1), vHigh23 = _mm_unpackhi_epi32(vRow2, vRow3);
+
+						vCol[0] = _mm_unpacklo_epi64(vLow01, vLow23);
+						vCol[1] = _mm_unpackhi_epi64(vLow01, vLow23);
+						vCol[2] = _mm_unpacklo_epi64(vHigh01, vHigh23);
+						vCol[3] = _mm_unpackhi_epi64(vHigh01, vHigh23);
+					}
+					else {													// 2 rows of 2 pixels to 2 columns
+						__m128i vRow0 = _mm_loadu_si128((const __m128i*)pPixels);
+						__m128i vRow1 = _mm_loadu_si128((const __m128i*)(pPixels + nFromPitch));
+
+						vCol[0] = _mm_unpacklo_epi64(vRow0, vRow1);
+						vCol[1] = _mm_unpackhi_epi64(vRow0, vRow1);
+					}
+					for (UINT32 glp = 0; glp < nGroup; glp++) {
+						UINT8* pColumn = pOut + (ptrdiff_t)(clp + glp) * nColStep;
+
+						if (nRowStep > 0)
+							_mm_storeu_si128((__m128i*)pColumn, vCol[glp]);
+						else if (nPixelBytes == 4)									// Rows run backwards
+							_mm_storeu_si128((__m128i*)(pColumn - 12), _mm_shuffle_epi32(vCol[glp], _MM_SHUFFLE(0, 1, 2, 3)));
+						else
+							_mm_storeu_si128((__m128i*)(pColumn - 8), _mm_shuffle_epi32(vCol[glp], _MM_SHUFFLE(1, 0, 3, 2)));
+					}
+				}
+#endif
+				for (; clp < nBlockCol + nBlockCols; clp++) {				// Columns left over, for each row of the group
+					for (UINT32 glp = 0; glp < nGroup; glp++)
+						_CopyPixel(pOut + (ptrdiff_t)glp * nRowStep + (ptrdiff_t)clp * nColStep,
+							pIn + glp * nFromPitch + (size_t)clp * nPixelBytes, nPixelBytes);
+				}
+				rlp += nGroup;
+			}
+		}
+	}
+}
+
+// *********************************************************************************************************************************
+// _OrientStoredBlock() turns the part of one plane of a stored block (nFromCols x nFromRows pixels from column nFromFirstCol,
+//  row nFromFirstRow, nFromPitch bytes from row to row) that prints in rows nToFirstRow .. nToFirstRow + nToRows - 1 into
+//  pTo, which holds that plane's printed rows from nToFirstRow on, nToPitch bytes apart, from printed column nToFirstCol on
+//
+static void _OrientStoredBlock(const TIFFHeader* MyTIFFHeader, const UINT8* pFrom, size_t nFromPitch, UINT32 nFromFirstCol,
+	UINT32 nFromCols, UINT32 nFromFirstRow, UINT32 nFromRows, UINT8* pTo, size_t nToPitch, UINT32 nToFirstCol,
+	UINT32 nToFirstRow, UINT32 nToRows) {
+
+	INT64 nWidth = MyTIFFHeader->nInputImagePixelWidth, nHeight = MyTIFFHeader->nInputImagePixelHeight;
+	UINT8 nPixelBytes = (UINT8)((MyTIFFHeader->bInputPlanar ? 1 : MyTIFFHeader->nInputColorChannels) *
+		(MyTIFFHeader->nImageBitDepth / 8));
+	INT64 nLow = nToFirstRow, nHigh = (INT64)nToFirstRow + nToRows;		// Printed rows wanted, as stored rows or columns
+	INT64 nX0 = nFromFirstCol, nX1 = (INT64)nFromFirstCol + nFromCols, nY0 = nFromFirstRow, nY1 = (INT64)nFromFirstRow + nFromRows;
+	INT64 nX, nY, nColX, nColY, nRowX, nRowY;
+
+	switch (MyTIFFHeader->nQuarterTurns) {
+	case 1:		nX0 = max(nX0, nLow);				nX1 = min(nX1, nHigh);				break;
+	case 2:		nY0 = max(nY0, nHeight - nHigh);	nY1 = min(nY1, nHeight - nLow);		break;
+	case 3:		nX0 = max(nX0, nWidth - nHigh);		nX1 = min(nX1, nWidth - nLow);		break;
+	default:	nY0 = max(nY0, nLow);				nY1 = min(nY1, nHigh);
+	}
+	if (nX0 >= nX1 || nY0 >= nY1)
+		return;
+
+	_OrientedPosition(MyTIFFHeader, nX0, nY0, &nX, &nY);					// Where the first pixel goes, and the steps to
+	_OrientedPosition(MyTIFFHeader, nX0 + 1, nY0, &nColX, &nColY);			//  the next column and the next row
+	_OrientedPosition(MyTIFFHeader, nX0, nY0 + 1, &nRowX, &nRowY);
+	ptrdiff_t nColStep = (ptrdiff_t)((nColY - nY) * (INT64)nToPitch + (nColX - nX) * nPixelBytes);
+	ptrdiff_t nRowStep = (ptrdiff_t)((nRowY - nY) * (INT64)nToPitch + (nRowX - nX) * nPixelBytes);
+	const UINT8* pIn = pFrom + (size_t)(nY0 - nFromFirstRow) * nFromPitch + (size_t)(nX0 - nFromFirstCol) * nPixelBytes;
+	UINT8* pOut = pTo + (size_t)(nY - nToFirstRow) * nToPitch + (size_t)(nX - nToFirstCol) * nPixelBytes;
+
+	if (nColStep == nPixelBytes || nColStep == -(ptrdiff_t)nPixelBytes) {	// Rows stay rows
+		for (INT64 rlp = 0; rlp < nY1 - nY0; rlp++)
+			_OrientRow(pIn + (size_t)rlp * nFromPitch, pOut + (ptrdiff_t)rlp * nRowStep, (UINT32)(nX1 - nX0),
+				nPixelBytes, nColStep < 0);
+	}
+	else
+		_TransposeBlock(pIn, nFromPitch, (UINT32)(nX1 - nX0), (UINT32)(nY1 - nY0), pOut, nColStep, nRowStep, nPixelBytes);
+}
+
+// *********************************************************************************************************************************
+// _OrientStoredBand() turns the part of a stored band (nFromRows rows from nFromFirstRow, as _ReadInputImageBand() left it)
+//  that prints in rows nToFirstRow .. nToFirstRow + nToRows - 1 into pTo, which holds printed rows from nToFirstRow on,
+//  nToPlaneRows of them per plane when the image is planar
+//
+static void _OrientStoredBand(const TIFFHeader* MyTIFFHeader, const UINT8* pFrom, UINT32 nFromFirstRow, UINT32 nFromRows,
+	UINT8* pTo, UINT32 nToFirstRow, UINT32 nToRows, UINT32 nToPlaneRows) {
+
+	UINT16 nPlanes = MyTIFFHeader->bInputPlanar ? MyTIFFHeader->nInputColorChannels : 1;
+	size_t nPixelBytes = (size_t)(MyTIFFHeader->bInputPlanar ? 1 : MyTIFFHeader->nInputColorChannels) *
+		(MyTIFFHeader->nImageBitDepth / 8);
+	size_t nFromPitch = MyTIFFHeader->nInputImagePixelWidth * nPixelBytes;
+	size_t nToPitch = MyTIFFHeader->nOrientedPixelWidth * nPixelBytes;
+
+	for (UINT16 plp = 0; plp < nPlanes; plp++)
+		_OrientStoredBlock(MyTIFFHeader, pFrom + (size_t)plp * nFromRows * nFromPitch, nFromPitch, 0,
+			MyTIFFHeader->nInputImagePixelWidth, nFromFirstRow, nFromRows, pTo + (size_t)plp * nToPlaneRows * nToPitch,
+			nToPitch, 0, nToFirstRow, nToRows);
+}
+
+// *********************************************************************************************************************************
+// _OpenOrientedImage() sets the turned image's geometry once the image is open, sets up the stored band (and, for a quarter
+//  turn or a raw stream that is not read top down, the window) it is turned from, and starts reading the first band needed
+//
+INT16 _OpenOrientedImage(TIFFHeader* MyTIFFHeader) {
+	bool bOnSide = (MyTIFFHeader->nQuarterTurns % 2 == 1);
+	size_t nPixelBytes = (size_t)MyTIFFHeader->nInputColorChannels * (MyTIFFHeader->nImageBitDepth / 8);
+	UINT32 nStoredBandFirstRow = 0;											// The first band read
+
+	MyTIFFHeader->nOrientedPixelWidth = bOnSide ? MyTIFFHeader->nInputImagePixelHeight : MyTIFFHeader->nInputImagePixelWidth;
+	MyTIFFHeader->nOrientedPixelHeight = bOnSide ? MyTIFFHeader->nInputImagePixelWidth : MyTIFFHeader->nInputImagePixelHeight;
+	MyTIFFHeader->nOrientedBufferRows = bOnSide ? 255 : MyTIFFHeader->nInputImageBufferRows;
+	MyTIFFHeader->nOrientWindowRows = 0;
+	MyTIFFHeader->nOrientWindowFirstRow = -1;
+
+	if (MyTIFFHeader->nQuarterTurns != 0 || MyTIFFHeader->bMirror) {
+		if (bOnSide || (MyTIFFHeader->nQuarterTurns == 2 && MyTIFFHeader->bRawStreamInput)) {
+			size_t nRowBytes = (size_t)MyTIFFHeader->nOrientedPixelWidth * nPixelBytes;
+			size_t nBands = max(ORIENT_WINDOW_BYTES / (nRowBytes * MyTIFFHeader->nOrientedBufferRows), (size_t)1);
+
+			MyTIFFHeader->nOrientWindowRows = (UINT32)min((size_t)MyTIFFHeader->nOrientedPixelHeight,
+				nBands * MyTIFFHeader->nOrientedBufferRows);					// Less than the page is spilled, see below
+			MyTIFFHeader->pOrientWindow = (UINT8*)malloc(MyTIFFHeader->nOrientWindowRows * nRowBytes);
+		}
+		else if (MyTIFFHeader->nQuarterTurns == 2)							// Bottom up, last band first
+			nStoredBandFirstRow = (MyTIFFHeader->nInputImagePixelHeight - 1) / MyTIFFHeader->nInputImageBufferRows *
+				MyTIFFHeader->nInputImageBufferRows;
+		MyTIFFHeader->pOrientScratch = (UINT8*)malloc((size_t)MyTIFFHeader->nInputImageBufferRows *
+			MyTIFFHeader->nInputImagePixelWidth * nPixelBytes);
+
+		if (MyTIFFHeader->pOrientScratch == NULL || (MyTIFFHeader->nOrientWindowRows > 0 && MyTIFFHeader->pOrientWindow == NULL)) {
+			MyTIFFHeader->nErrorCode = (-76);
+			swprintf_s(MyTIFFHeader->sRetErrDescription,
+				_countof(MyTIFFHeader->sRetErrDescription),
+				_T("EC(-76) Failed to allocate the orientation buffers!"));
+			return MyTIFFHeader->nErrorCode;
+		}
+	}
+	if (MyTIFFHeader->bRawStreamInput)
+		return 0;
+	return _PrefetchInputImageBand(MyTIFFHeader, nStoredBandFirstRow);		// Start reading the first band early
+}
+
+// *********************************************************************************************************************************
+// _FillOrientWindowFromTiles() decodes only the tiles of the stored columns that print in rows nFirstRow .. nFirstRow + nRows
+//  - 1 (a quarter turn), and turns each straight from its scratch tile into the window; tiles are decoded in parallel, each
+//  thread with its own TIFF handle and scratch tile, as in _FillTileRowCache()
+//
+static INT16 _FillOrientWindowFromTiles(TIFFHeader* MyTIFFHeader, UINT32 nFirstRow, UINT32 nRows) {
+	UINT16 nPlanes = MyTIFFHeader->bInputPlanar ? MyTIFFHeader->nInputColorChannels : 1;
+	size_t nPixelBytes = (size_t)(MyTIFFHeader->bInputPlanar ? 1 : MyTIFFHeader->nInputColorChannels) *
+		(MyTIFFHeader->nImageBitDepth / 8);
+	size_t nToPlaneBytes = (size_t)MyTIFFHeader->nOrientWindowRows * MyTIFFHeader->nOrientedPixelWidth * nPixelBytes;
+	UINT32 nFirstCol = (MyTIFFHeader->nQuarterTurns == 1) ? nFirstRow :	// Stored columns that print in these rows
+		(UINT32)MyTIFFHeader->nInputImagePixelWidth - nFirstRow - nRows;
+	UINT32 nFirstTileCol = nFirstCol / MyTIFFHeader->nTileWidth;
+	INT32 nTileCols = (INT32)((nFirstCol + nRows - 1) / MyTIFFHeader->nTileWidth - nFirstTileCol + 1);
+	INT32 nTilesDown = (INT32)((MyTIFFHeader->nInputImagePixelHeight + MyTIFFHeader->nTileLength - 1) / MyTIFFHeader->nTileLength);
+	INT32 nTilesPerPlane = nTileCols * nTilesDown;
+	INT32 nFailedTiles = 0;
+
+#pragma omp parallel for num_threads(MyTIFFHeader->nTileReaders) reduction(+:nFailedTiles)
+	for (INT32 tlp = 0; tlp < nTilesPerPlane * (INT32)nPlanes; tlp++) {
+		int nReader = omp_get_thread_num();
+		UINT16 nPlane = (UINT16)(tlp / nTilesPerPlane);
+		UINT32 nTileX = (nFirstTileCol + (UINT32)(tlp % nTilesPerPlane % nTileCols)) * MyTIFFHeader->nTileWidth;
+		UINT32 nTileY = (UINT32)(tlp % nTilesPerPlane / nTileCols) * MyTIFFHeader->nTileLength;
+		TIFF* tileTIFF = MyTIFFHeader->pTileReaderTIFF[nReader];
+
+		if (TIFFReadEncodedTile(tileTIFF, TIFFComputeTile(tileTIFF, nTileX, nTileY, 0, nPlane),
+			MyTIFFHeader->pTileScratch[nReader], (tmsize_t)(-1)) < 0) {
+			nFailedTiles++;
+			continue;
+		}
+		if (MyTIFFHeader->bInvertSamples)
+			_InvertBandSamples(MyTIFFHeader->pTileScratch[nReader], (size_t)MyTIFFHeader->nTileWidth * MyTIFFHeader->nTileLength,
+				MyTIFFHeader->nImageBitDepth);
+		_OrientStoredBlock(MyTIFFHeader, MyTIFFHeader->pTileScratch[nReader], MyTIFFHeader->nTileWidth * nPixelBytes, nTileX,
+			min(MyTIFFHeader->nTileWidth, (UINT32)MyTIFFHeader->nInputImagePixelWidth - nTileX), nTileY,
+			min(MyTIFFHeader->nTileLength, (UINT32)MyTIFFHeader->nInputImagePixelHeight - nTileY),
+			MyTIFFHeader->pOrientWindow + nPlane * nToPlaneBytes, MyTIFFHeader->nOrientedPixelWidth * nPixelBytes, 0,
+			nFirstRow, nRows);
+	}
+	if (nFailedTiles > 0) {
+		MyTIFFHeader->nErrorCode = (-77);
+		swprintf_s(MyTIFFHeader->sRetErrDescription,
+			_countof(MyTIFFHeader->sRetErrDescription),
+			_T("EC(-77) Failed to decode %d tile(s) turning rows from %u!"), nFailedTiles, nFirstRow);
+		return MyTIFFHeader->nErrorCode;
+	}
+	MyTIFFHeader->nOrientWindowFirstRow = (INT32)nFirstRow;
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _SeekOrientSpill() moves to byte nOffset of the spill file, which can be bigger than 2 GB
+//
+static int _SeekOrientSpill(FILE* pSpill, UINT64 nOffset) {
+#ifdef _WIN32
+	return _fseeki64(pSpill, (__int64)nOffset, SEEK_SET);
+#else
+	return fseeko(pSpill, (off_t)nOffset, SEEK_SET);
+#endif
+}
+
+// *********************************************************************************************************************************
+// _SpillOrientedImage() reads every stored band once and writes it, turned, to a temporary file: band after band, plane
+//  after plane, a slab of the printed rows the band covers (every printed row and a band of columns for a quarter turn, a
+//  band of rows for a half turn), each slab the same size whether the band is full or not, so it is found by band number
+//
+static INT16 _SpillOrientedImage(TIFFHeader* MyTIFFHeader) {
+	bool bOnSide = (MyTIFFHeader->nQuarterTurns % 2 == 1);
+	UINT16 nPlanes = MyTIFFHeader->bInputPlanar ? MyTIFFHeader->nInputColorChannels : 1;
+	size_t nPixelBytes = (size_t)(MyTIFFHeader->bInputPlanar ? 1 : MyTIFFHeader->nInputColorChannels) *
+		(MyTIFFHeader->nImageBitDepth / 8);
+	size_t nFromPitch = MyTIFFHeader->nInputImagePixelWidth * nPixelBytes;
+	UINT32 nSlabRows = bOnSide ? MyTIFFHeader->nOrientedPixelHeight : MyTIFFHeader->nInputImageBufferRows;
+	size_t nSlabPitch = (bOnSide ? MyTIFFHeader->nInputImageBufferRows : MyTIFFHeader->nOrientedPixelWidth) * nPixelBytes;
+	UINT32 nChunkRows = min(nSlabRows, MyTIFFHeader->nOrientWindowRows);	// Slab rows turned and written at a time
+	UINT8 nStoredRows = 0;
+
+	MyTIFFHeader->pOrientSpill = tmpfile();
+	MyTIFFHeader->pOrientSlab = (UINT8*)malloc(nChunkRows * nSlabPitch);
+	if (MyTIFFHeader->pOrientSpill == NULL || MyTIFFHeader->pOrientSlab == NULL) {
+		MyTIFFHeader->nErrorCode = (-76);
+		swprintf_s(MyTIFFHeader->sRetErrDescription,
+			_countof(MyTIFFHeader->sRetErrDescription),
+			_T("EC(-76) Failed to set up the orientation spill file!"));
+		return MyTIFFHeader->nErrorCode;
+	}
+	for (UINT32 nStoredRow = 0; nStoredRow < MyTIFFHeader->nInputImagePixelHeight; nStoredRow += nStoredRows) {
+		UINT32 nFirstRow, nRows, nFirstCol, nCols;
+
+		if (_ReadInputImageBand(MyTIFFHeader, MyTIFFHeader->pOrientScratch, nStoredRow, &nStoredRows) != 0)
+			return MyTIFFHeader->nErrorCode;
+		_OrientedBandRect(MyTIFFHeader, nStoredRow, nStoredRows, &nFirstRow, &nRows, &nFirstCol, &nCols);
+
+		for (UINT16 plp = 0; plp < nPlanes; plp++) {
+			for (UINT32 nChunk = 0; nChunk < nSlabRows; nChunk += nChunkRows) {
+				UINT32 nWrite = min(nChunkRows, nSlabRows - nChunk);
+
+				_OrientStoredBlock(MyTIFFHeader, MyTIFFHeader->pOrientScratch + (size_t)plp * nStoredRows * nFromPitch,
+					nFromPitch, 0, MyTIFFHeader->nInputImagePixelWidth, nStoredRow, nStoredRows, MyTIFFHeader->pOrientSlab,
+					nSlabPitch, nFirstCol, nFirstRow + nChunk, nWrite);
+				if (fwrite(MyTIFFHeader->pOrientSlab, nSlabPitch, nWrite, MyTIFFHeader->pOrientSpill) != nWrite) {
+					MyTIFFHeader->nErrorCode = (-76);
+					swprintf_s(MyTIFFHeader->sRetErrDescription,
+						_countof(MyTIFFHeader->sRetErrDescription),
+						_T("EC(-76) Failed to write the orientation spill file at row %u!"), nStoredRow);
+					return MyTIFFHeader->nErrorCode;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _FillOrientWindowFromSpill() copies the printed rows nFirstRow .. nFirstRow + nRows - 1 into the window from the slabs
+//  _SpillOrientedImage() wrote: one read of the rows wanted from each slab that has any
+//
+static INT16 _FillOrientWindowFromSpill(TIFFHeader* MyTIFFHeader, UINT32 nFirstRow, UINT32 nRows) {
+	bool bOnSide = (MyTIFFHeader->nQuarterTurns % 2 == 1);
+	UINT16 nPlanes = MyTIFFHeader->bInputPlanar ? MyTIFFHeader->nInputColorChannels : 1;
+	size_t nPixelBytes = (size_t)(MyTIFFHeader->bInputPlanar ? 1 : MyTIFFHeader->nInputColorChannels) *
+		(MyTIFFHeader->nImageBitDepth / 8);
+	size_t nToPitch = (size_t)MyTIFFHeader->nOrientedPixelWidth * nPixelBytes;
+	UINT32 nSlabRows = bOnSide ? MyTIFFHeader->nOrientedPixelHeight : MyTIFFHeader->nInputImageBufferRows;
+	size_t nSlabPitch = (bOnSide ? MyTIFFHeader->nInputImageBufferRows : MyTIFFHeader->nOrientedPixelWidth) * nPixelBytes;
+
+	for (UINT32 nStoredRow = 0, nBand = 0; nStoredRow < MyTIFFHeader->nInputImagePixelHeight;
+		nStoredRow += MyTIFFHeader->nInputImageBufferRows, nBand++) {
+		UINT32 nBandFirstRow, nBandRows, nBandFirstCol, nBandCols;
+
+		_OrientedBandRect(MyTIFFHeader, nStoredRow, min((UINT32)MyTIFFHeader->nInputImageBufferRows,
+			(UINT32)MyTIFFHeader->nInputImagePixelHeight - nStoredRow), &nBandFirstRow, &nBandRows, &nBandFirstCol, &nBandCols);
+		UINT32 nFrom = max(nBandFirstRow, nFirstRow), nTo = min(nBandFirstRow + nBandRows, nFirstRow + nRows);
+		if (nFrom >= nTo)
+			continue;														// Prints outside the window
+
+		for (UINT16 plp = 0; plp < nPlanes; plp++) {
+			UINT64 nOffset = (((UINT64)nBand * nPlanes + plp) * nSlabRows + nFrom - nBandFirstRow) * nSlabPitch;
+			UINT8* pTo = MyTIFFHeader->pOrientWindow + ((size_t)plp * MyTIFFHeader->nOrientWindowRows + nFrom - nFirstRow) *
+				nToPitch + (size_t)nBandFirstCol * nPixelBytes;
+
+			if (_SeekOrientSpill(MyTIFFHeader->pOrientSpill, nOffset) != 0 ||
+				fread(MyTIFFHeader->pOrientSlab, nSlabPitch, nTo - nFrom, MyTIFFHeader->pOrientSpill) != nTo - nFrom) {
+				MyTIFFHeader->nErrorCode = (-78);
+				swprintf_s(MyTIFFHeader->sRetErrDescription,
+					_countof(MyTIFFHeader->sRetErrDescription),
+					_T("EC(-78) Failed to read the orientation spill file at row %u!"), nFrom);
+				return MyTIFFHeader->nErrorCode;
+			}
+			for (UINT32 rlp = 0; rlp < nTo - nFrom; rlp++)
+				memcpy(pTo + rlp * nToPitch, MyTIFFHeader->pOrientSlab + rlp * nSlabPitch, nBandCols * nPixelBytes);
+		}
+	}
+	MyTIFFHeader->nOrientWindowFirstRow = (INT32)nFirstRow;
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _FillOrientWindow() turns the printed rows nFirstRow .. nFirstRow + nOrientWindowRows - 1 into the window: a tiled image
+//  decodes just the tiles they come from; others are read once, a stored band at a time, straight into the window when it
+//  holds the whole page, otherwise into the spill file that every window is then copied from
+//
+static INT16 _FillOrientWindow(TIFFHeader* MyTIFFHeader, UINT32 nFirstRow) {
+	UINT32 nRows = min(MyTIFFHeader->nOrientWindowRows, (UINT32)MyTIFFHeader->nOrientedPixelHeight - nFirstRow);
+	UINT8 nStoredRows = 0;
+
+	MyTIFFHeader->nOrientWindowFirstRow = -1;
+	if (MyTIFFHeader->bInputTileRead && MyTIFFHeader->nQuarterTurns % 2 == 1)
+		return _FillOrientWindowFromTiles(MyTIFFHeader, nFirstRow, nRows);
+
+	if (MyTIFFHeader->nOrientWindowRows < MyTIFFHeader->nOrientedPixelHeight) {
+		if (MyTIFFHeader->pOrientSpill == NULL && _SpillOrientedImage(MyTIFFHeader) != 0)
+			return MyTIFFHeader->nErrorCode;
+		return _FillOrientWindowFromSpill(MyTIFFHeader, nFirstRow, nRows);
+	}
+
+	for (UINT32 nStoredRow = 0; nStoredRow < MyTIFFHeader->nInputImagePixelHeight; nStoredRow += nStoredRows) {
+		if (_ReadInputImageBand(MyTIFFHeader, MyTIFFHeader->pOrientScratch, nStoredRow, &nStoredRows) != 0)
+			return MyTIFFHeader->nErrorCode;
+		_OrientStoredBand(MyTIFFHeader, MyTIFFHeader->pOrientScratch, nStoredRow, nStoredRows, MyTIFFHeader->pOrientWindow,
+			nFirstRow, nRows, MyTIFFHeader->nOrientWindowRows);
+	}
+	MyTIFFHeader->nOrientWindowFirstRow = (INT32)nFirstRow;
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _ReadOrientedImageBand() reads the next band of the image as printed (turned and mirrored) into pInputRasterBuffer, in the
+//  same layout as _ReadInputImageBand() (pixel order or planar), which it is with no turn and no mirror
+// nBandFirstRow should advance by *nBandRows each call; a half turn's first band is the image's last, so it may be short
+//
+INT16 _ReadOrientedImageBand(
+	TIFFHeader* MyTIFFHeader,												// Pointer to structure holding the image header
+	void* pInputRasterBuffer,												// Band buffer, nOrientedBufferRows x turned width x channels
+	UINT32 nBandFirstRow,													// First printed row of the band
+	UINT8* nBandRows) {														// Returns the number of rows read into the band
+
+	UINT16 nPlanes = MyTIFFHeader->bInputPlanar ? MyTIFFHeader->nInputColorChannels : 1;
+	size_t nRowBytes = (size_t)MyTIFFHeader->nOrientedPixelWidth *		// One printed row (of one plane)
+		(MyTIFFHeader->bInputPlanar ? 1 : MyTIFFHeader->nInputColorChannels) * (MyTIFFHeader->nImageBitDepth / 8);
+	UINT32 nRows = min((UINT32)MyTIFFHeader->nOrientedBufferRows,
+		(UINT32)MyTIFFHeader->nOrientedPixelHeight - nBandFirstRow);
+	UINT32 nStoredFirstRow = nBandFirstRow;
+
+	if (MyTIFFHeader->nQuarterTurns == 0 && !MyTIFFHeader->bMirror)
+		return _ReadInputImageBand(MyTIFFHeader, pInputRasterBuffer, nBandFirstRow, nBandRows);
+
+	*nBandRows = 0;
+	if (nBandFirstRow >= MyTIFFHeader->nOrientedPixelHeight)				// Nothing left to read
+		return 0;
+
+	if (MyTIFFHeader->nOrientWindowRows > 0) {								// Copied out of the window, filled when the band
+		if (MyTIFFHeader->nOrientWindowFirstRow < 0 ||						//  is not in it
+			nBandFirstRow < (UINT32)MyTIFFHeader->nOrientWindowFirstRow ||
+			nBandFirstRow + nRows > (UINT32)MyTIFFHeader->nOrientWindowFirstRow + MyTIFFHeader->nOrientWindowRows) {
+			if (_FillOrientWindow(MyTIFFHeader, nBandFirstRow) != 0)
+				return MyTIFFHeader->nErrorCode;
+		}
+		for (UINT16 plp = 0; plp < nPlanes; plp++)
+			memcpy((UINT8*)pInputRasterBuffer + (size_t)plp * nRows * nRowBytes, MyTIFFHeader->pOrientWindow +
+				((size_t)plp * MyTIFFHeader->nOrientWindowRows + nBandFirstRow - MyTIFFHeader->nOrientWindowFirstRow) *
+				nRowBytes, nRows * nRowBytes);
+		*nBandRows = (UINT8)nRows;
+		return 0;
+	}
+
+	if (MyTIFFHeader->nQuarterTurns == 2)									// The stored band these rows come from
+		nStoredFirstRow = (MyTIFFHeader->nInputImagePixelHeight - nBandFirstRow - 1) / MyTIFFHeader->nInputImageBufferRows *
+			MyTIFFHeader->nInputImageBufferRows;
+	if (_ReadInputImageBand(MyTIFFHeader, MyTIFFHeader->pOrientScratch, nStoredFirstRow, nBandRows) != 0)
+		return MyTIFFHeader->nErrorCode;
+	_OrientStoredBand(MyTIFFHeader, MyTIFFHeader->pOrientScratch, nStoredFirstRow, *nBandRows, (UINT8*)pInputRasterBuffer,
+		nBandFirstRow, *nBandRows, *nBandRows);
+
+	if (MyTIFFHeader->nQuarterTurns == 2 && nStoredFirstRow > 0 && !MyTIFFHeader->bRawStreamInput)
+		return _PrefetchInputImageBand(MyTIFFHeader, nStoredFirstRow - MyTIFFHeader->nInputImageBufferRows);
+	return 0;
+}
@@ -0,0 +1,184 @@
+// PCL/RTL raster compression for packed dot rows (ESC*b#M)
+//  Method 0 = unencoded, 1 = run-length, 2 = TIFF PackBits, 3 = delta row (against the seed row, the previous row of the plane)
+//  RTL_COMPRESS_ADAPTIVE encodes each row with methods 1, 2 and 3 and sends whichever is smallest
+// Rows of wide media are mostly empty or repeat the row above, so the encoders are built around fast run detection:
+//  _RTLRepeatRun(), _RTLMatchRun() and _RTLTrimmedLength() compare 16 bytes at a time with SSE2 where it is available
+
+#define INT8	signed __int8
+#define INT16	signed __int16
+#define INT32	signed __int32
+#define UINT8 	unsigned __int8
+#define UINT16	unsigned __int16
+#define UINT32	unsigned __int32
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RTL_USE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+static inline UINT32 _RTLCountTrailingZeros(UINT32 nMask) { unsigned long nBit; _BitScanForward(&nBit, nMask); return nBit; }
+static inline UINT32 _RTLCountLeadingZeros(UINT32 nMask) { unsigned long nBit; _BitScanReverse(&nBit, nMask); return 31 - nBit; }
+#else
+static inline UINT32 _RTLCountTrailingZeros(UINT32 nMask) { return (UINT32)__builtin_ctz(nMask); }
+static inline UINT32 _RTLCountLeadingZeros(UINT32 nMask) { return (UINT32)__builtin_clz(nMask); }
+#endif
+#endif
+
+#define RTL_COMPRESS_NONE		0											// ESC*b0M, unencoded
+#define RTL_COMPRESS_RLE		1											// ESC*b1M, run-length (count - 1, byte)
+#define RTL_COMPRESS_PACKBITS	2											// ESC*b2M, TIFF PackBits
+#define RTL_COMPRESS_DELTA		3											// ESC*b3M, delta row (seed row)
+#define RTL_COMPRESS_ADAPTIVE	255											// Smallest of 1, 2 and 3, chosen per row
+
+// *********************************************************************************************************************************
+// _RTLRepeatRun() returns how many bytes from pData[0] on (up to nBytes) equal pData[0]; for a zero byte, that is the zero run
+//
+UINT32 _RTLRepeatRun(const UINT8* pData, UINT32 nBytes) {
+	UINT32 nRun = 1;
+
+	if (nBytes == 0)
+		return 0;
+#ifdef RTL_USE_SSE2
+	__m128i vByte = _mm_set1_epi8((char)pData[0]);
+
+	while (nRun + 16 <= nBytes) {											// 16 bytes per compare
+		UINT32 nMask = (UINT32)_mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i*)(pData + nRun)), vByte)) ^ 0xFFFF;
+		if (nMask != 0)
+			return nRun + _RTLCountTrailingZeros(nMask);					// First byte that differs
+		nRun += 16;
+	}
+#endif
+	while (nRun < nBytes && pData[nRun] == pData[0])
+		nRun++;
+	return nRun;
+}
+
+// *********************************************************************************************************************************
+// _RTLMatchRun() returns how many leading bytes of pRow equal the seed row (delta row skips these)
+//
+UINT32 _RTLMatchRun(const UINT8* pRow, const UINT8* pSeed, UINT32 nBytes) {
+	UINT32 nRun = 0;
+#ifdef RTL_USE_SSE2
+	while (nRun + 16 <= nBytes) {
+		UINT32 nMask = (UINT32)_mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i*)(pRow + nRun)),
+			_mm_loadu_si128((const __m128i*)(pSeed + nRun)))) ^ 0xFFFF;
+		if (nMask != 0)
+			return nRun + _RTLCountTrailingZeros(nMask);
+		nRun += 16;
+	}
+#endif
+	while (nRun < nBytes && pRow[nRun] == pSeed[nRun])
+		nRun++;
+	return nRun;
+}
+
+// *********************************************************************************************************************************
+// _RTLTrimmedLength() returns the row length without its trailing zero bytes; the printer zero fills short rows
+//  (methods 0, 1 and 2), so a blank row costs nothing but its ESC*b0W
+//
+UINT32 _RTLTrimmedLength(const UINT8* pRow, UINT32 nBytes) {
+#ifdef RTL_USE_SSE2
+	__m128i vZero = _mm_setzero_si128();
+
+	while (nBytes >= 16) {													// Scan backwards, 16 bytes at a time
+		UINT32 nMask = (UINT32)_mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i*)(pRow + nBytes - 16)), vZero)) ^ 0xFFFF;
+		if (nMask != 0)
+			return nBytes - 16 + (32 - _RTLCountLeadingZeros(nMask));		// Last non-zero byte, plus one
+		nBytes -= 16;
+	}
+#endif
+	while (nBytes > 0 && pRow[nBytes - 1] == 0)
+		nBytes--;
+	return nBytes;
+}
+
+// *********************************************************************************************************************************
+// _RTLEncodeRLE() method 1: (repeat count - 1, byte) pairs, up to 256 repeats per pair; output <= 2 x nBytes
+//
+UINT32 _RTLEncodeRLE(UINT8* pOut, const UINT8* pRow, UINT32 nBytes) {
+	UINT32 nOut = 0, nPos = 0;
+
+	nBytes = _RTLTrimmedLength(pRow, nBytes);
+	while (nPos < nBytes) {
+		UINT32 nRun = _RTLRepeatRun(pRow + nPos, min(nBytes - nPos, (UINT32)256));
+
+		pOut[nOut++] = (UINT8)(nRun - 1);
+		pOut[nOut++] = pRow[nPos];
+		nPos += nRun;
+	}
+	return nOut;
+}
+
+// *********************************************************************************************************************************
+// _RTLEncodePackBits() method 2: TIFF PackBits; 0 .. 127 = copy the next n + 1 bytes, -1 .. -127 = repeat the next byte 1 - n times
+// Output <= nBytes + nBytes / 128 + 1
+//
+UINT32 _RTLEncodePackBits(UINT8* pOut, const UINT8* pRow, UINT32 nBytes) {
+	UINT32 nOut = 0, nPos = 0;
+
+	nBytes = _RTLTrimmedLength(pRow, nBytes);
+	while (nPos < nBytes) {
+		UINT32 nRun = _RTLRepeatRun(pRow + nPos, min(nBytes - nPos, (UINT32)128));
+
+		if (nRun >= 2) {													// Repeat run
+			pOut[nOut++] = (UINT8)(INT8)(1 - (INT32)nRun);
+			pOut[nOut++] = pRow[nPos];
+			nPos += nRun;
+			continue;
+		}
+		UINT32 nStart = nPos++;												// Literal run, ends where a run of 3 starts
+
+		while (nPos < nBytes && nPos - nStart < 128 &&
+			!(nPos + 2 < nBytes && pRow[nPos] == pRow[nPos + 1] && pRow[nPos] == pRow[nPos + 2]))
+			nPos++;
+
+		pOut[nOut++] = (UINT8)(nPos - nStart - 1);
+		memcpy(pOut + nOut, pRow + nStart, nPos - nStart);
+		nOut += nPos - nStart;
+	}
+	return nOut;
+}
+
+// *********************************************************************************************************************************
+// _RTLEncodeDeltaRow() method 3: only the bytes that differ from the seed row; each command byte is (count - 1) << 5 | offset,
+//  1 .. 8 replacement bytes, offset counted from the end of the previous replacement (31 = more offset bytes follow)
+// A row identical to its seed encodes to nothing; output <= nBytes + nBytes / 8 + offset bytes
+//
+UINT32 _RTLEncodeDeltaRow(UINT8* pOut, const UINT8* pRow, const UINT8* pSeed, UINT32 nBytes) {
+	UINT32 nOut = 0, nPos = 0, nLast = 0;
+
+	for (;;) {
+		nPos += _RTLMatchRun(pRow + nPos, pSeed + nPos, nBytes - nPos);		// Skip bytes the printer already has
+		if (nPos >= nBytes)
+			break;
+
+		UINT32 nCount = 1, nOffset = nPos - nLast;
+
+		while (nCount < 8 && nPos + nCount < nBytes && pRow[nPos + nCount] != pSeed[nPos + nCount])
+			nCount++;
+
+		pOut[nOut++] = (UINT8)(((nCount - 1) << 5) | min(nOffset, (UINT32)31));
+		if (nOffset >= 31) {												// Long offsets continue in 255 steps
+			for (nOffset -= 31; nOffset >= 255; nOffset -= 255)
+				pOut[nOut++] = 255;
+			pOut[nOut++] = (UINT8)nOffset;
+		}
+		memcpy(pOut + nOut, pRow + nPos, nCount);
+		nOut += nCount;
+		nPos += nCount;
+		nLast = nPos;
+	}
+	return nOut;
+}
+
+// *********************************************************************************************************************************
+// _RTLEncodedBufferSize() worst case output of any method for an nBytes row, used to size the encode buffers
+//
+UINT32 _RTLEncodedBufferSize(UINT32 nBytes) {
+	return 2 * nBytes + 64;													// Method 1 is the worst, two bytes per input byte
+}
@@ -0,0 +1,490 @@
+// Printer data (PCL/RTL raster) writer stage
+// Halftoned bands are packed (nBitsPerDot bits per dot), written row by row with one raster plane per ink in printer ink order,
+//  and streamed to stdout, a named pipe, a file, or an inherited file descriptor; nothing is spooled to a page file first
+// Output goes through one large, page-aligned staging buffer (or the io_uring band buffer pool), so the OS only ever sees
+//  big writes, and the printer backend can start on the first band while the rest of the page is still being halftoned
+// Each ink row is compressed (RTL_Compression) with a fixed method, or adaptively with the smallest method per row
+// Rows with no ink in any plane are not sent at all; a run of them becomes one vertical move (ESC*b#Y)
+// The page's raster format is set by a short form Configure Image Data (ESC*v6W): device CMY, indexed by plane, one index
+//  bit per plane (so the bits per index are the plane count), nBitsPerDot bits per primary; each plane of a row is one ink's
+//  dot sizes, nBitsPerDot bits per dot packed MSB first, and the planes of a row go out in printer ink order with ESC*b#V,
+//  the last with ESC*b#W
+
+#define INT8	signed __int8
+#define INT16	signed __int16
+#define INT32	signed __int32
+#define INT64	signed __int64
+#define UINT8 	unsigned __int8
+#define UINT16	unsigned __int16
+#define UINT32	unsigned __int32
+#define UINT64	unsigned __int64
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#include <malloc.h>
+#define RTL_WRITE(fd, p, n)		_write(fd, p, (unsigned int)(n))
+#define RTL_OPEN(path)			_open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE)
+#define RTL_CLOSE(fd)			_close(fd)
+#else
+#include <unistd.h>
+#define RTL_WRITE(fd, p, n)		write(fd, p, n)
+#define RTL_OPEN(path)			open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)
+#define RTL_CLOSE(fd)			close(fd)
+#endif
+
+#define RTL_BUFFER_SIZE			(1 << 20)									// Staging buffer, 1 MB (blocking writes)
+#define RTL_BUFFER_ALIGNMENT	4096										// One page
+#define RTL_ESC					'\x1B'
+
+typedef struct RTLOutputWriter {
+	int nFileDescriptor				= -1;									// Output: stdout, a pipe, a file, or an inherited fd
+	bool bCloseOnFinish				= false;								// We opened the file, so we close it
+	bool bSeekable					= false;								// Regular file, so queued writes can use explicit offsets
+	AsyncIO* pAsyncIO				= NULL;									// Optional io_uring backend, NULL = blocking writes
+	INT16 nAsyncBuf					= -1;									// Pool buffer being filled (io_uring)
+	INT16 nPrevAsyncBuf				= -1;									// Last pool buffer queued, pipes need writes in order
+	UINT8* pWriteBuffer				= NULL;									// Staging buffer (own, or the current pool buffer)
+	UINT32 nBufferSize				= 0;									// Size of the staging buffer
+	UINT32 nBufferUsed				= 0;									// Bytes waiting in the staging buffer
+	UINT64 nFileOffset				= 0;									// Bytes handed to the OS so far
+	UINT8* pPackedRow				= NULL;									// One ink row, packed nBitsPerDot bits per dot
+	UINT32 nPackedRowBytes			= 0;									// Size of pPackedRow
+	UINT8 nBitsPerDot				= 2;									// 1 = fixed dot size, 2 = variable dot (S, M, L)
+	UINT8 nPlanes					= 4;									// Ink planes per raster row
+	UINT32 nRowsWritten				= 0;									// Raster rows written on the current page
+	UINT8 nCompressionMode			= RTL_COMPRESS_ADAPTIVE;				// RTL_COMPRESS_NONE .. RTL_COMPRESS_DELTA, or adaptive
+	UINT8 nActiveMethod				= RTL_COMPRESS_NONE;					// Method the printer is in (last ESC*b#M sent)
+	UINT8* pSeedRows				= NULL;									// Last row sent per plane, the delta row seed
+	UINT8* pEncodedRow[3]			= { NULL, NULL, NULL };					// Encode buffers for methods 1, 2 and 3
+	UINT64 nRawBytes				= 0;									// Packed ink bytes before compression (this page)
+	UINT64 nEncodedBytes			= 0;									// Ink bytes actually sent (this page)
+	UINT32 nPendingSkipRows			= 0;									// Blank rows not yet sent as ESC*b#Y
+	UINT32 nRowsSkipped				= 0;									// Blank rows on the current page
+	INT16 nErrorCode				= 0;									// Return error code
+	TCHAR sRetErrDescription[128];											// Return error message
+} RTLWriter;
+
+// *********************************************************************************************************************************
+// _RTLAlignedAlloc() / _RTLAlignedFree() page-aligned buffers, portably
+//
+void* _RTLAlignedAlloc(size_t nSize) {
+#ifdef _WIN32
+	return _aligned_malloc(nSize, RTL_BUFFER_ALIGNMENT);
+#else
+	void* pData = NULL;
+	return (posix_memalign(&pData, RTL_BUFFER_ALIGNMENT, nSize) == 0) ? pData : NULL;
+#endif
+}
+
+void _RTLAlignedFree(void* pData) {
+#ifdef _WIN32
+	_aligned_free(pData);
+#else
+	free(pData);
+#endif
+}
+
+// *********************************************************************************************************************************
+// _OpenRTLOutput() opens the printer data stream: strOutput "-" (or empty) = stdout, a path = file or named pipe,
+//  or, with strOutput empty and nFileDescriptor >= 0, a descriptor the caller already holds (e.g. from a printer backend)
+//
+INT16 _OpenRTLOutput(RTLWriter* pWriter, const string& strOutput, int nFileDescriptor, AsyncIO* pAsyncIO) {
+	struct stat outputStat;
+
+	if (nFileDescriptor >= 0)
+		pWriter->nFileDescriptor = nFileDescriptor;
+	else if (strOutput.empty() || strOutput == "-") {
+		pWriter->nFileDescriptor = 1;										// stdout
+#ifdef _WIN32
+		_setmode(1, _O_BINARY);												// Don't let the C runtime translate LF
+#endif
+	}
+	else {
+		if ((pWriter->nFileDescriptor = RTL_OPEN(strOutput.c_str())) < 0) {
+			pWriter->nErrorCode = (-90);
+			swprintf_s(pWriter->sRetErrDescription,
+				_countof(pWriter->sRetErrDescription),
+				_T("EC(-90) Failed to open printer data output, %hs!"), strOutput.c_str());
+			return pWriter->nErrorCode;
+		}
+		pWriter->bCloseOnFinish = true;
+	}
+	pWriter->bSeekable = (fstat(pWriter->nFileDescriptor, &outputStat) == 0 &&
+		(outputStat.st_mode & S_IFMT) == S_IFREG);							// Pipes and terminals are written in order, at the end
+
+	if (pAsyncIO != NULL && pAsyncIO->bEnabled) {							// Stage straight into registered pool buffers
+		pWriter->pAsyncIO = pAsyncIO;
+		pWriter->nAsyncBuf = _AsyncIOGetBuffer(pAsyncIO);
+	}
+	if (pWriter->nAsyncBuf >= 0) {
+		pWriter->pWriteBuffer = pAsyncIO->Buffers[pWriter->nAsyncBuf].pData;
+		pWriter->nBufferSize = pAsyncIO->nBufferSize;
+	}
+	else {
+		pWriter->pAsyncIO = NULL;
+		pWriter->nBufferSize = RTL_BUFFER_SIZE;
+		if ((pWriter->pWriteBuffer = (UINT8*)_RTLAlignedAlloc(RTL_BUFFER_SIZE)) == NULL) {
+			pWriter->nErrorCode = (-91);
+			swprintf_s(pWriter->sRetErrDescription,
+				_countof(pWriter->sRetErrDescription),
+				_T("EC(-91) Failed to allocate printer data buffer!"));
+			return pWriter->nErrorCode;
+		}
+	}
+	pWriter->nBufferUsed = 0;
+	pWriter->nFileOffset = 0;
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _FlushRTLOutput() hands the staging buffer to the OS; blocking writes loop until everything is written,
+//  io_uring writes are queued and a fresh pool buffer becomes the staging buffer
+//
+INT16 _FlushRTLOutput(RTLWriter* pWriter) {
+	if (pWriter->nBufferUsed == 0)
+		return 0;
+
+	if (pWriter->pAsyncIO != NULL) {
+		AsyncIO* pAsyncIO = pWriter->pAsyncIO;
+
+		if (!pWriter->bSeekable && pWriter->nPrevAsyncBuf >= 0 &&			// A pipe has no offsets, so keep one write in flight
+			_AsyncIOWait(pAsyncIO, pWriter->nPrevAsyncBuf) != 0) {
+			pWriter->nErrorCode = pAsyncIO->nErrorCode;
+			swprintf_s(pWriter->sRetErrDescription,
+				_countof(pWriter->sRetErrDescription), _T("%ls"), pAsyncIO->sRetErrDescription);
+			return pWriter->nErrorCode;
+		}
+		INT16 nRet = _AsyncIOSubmit(pAsyncIO, true, pWriter->nFileDescriptor, (UINT8)pWriter->nAsyncBuf,
+			pWriter->bSeekable ? pWriter->nFileOffset : (UINT64)(-1), pWriter->nBufferUsed);
+
+		if (nRet == 0) {													// The queued buffer belongs to the ring now
+			pWriter->nPrevAsyncBuf = pWriter->nAsyncBuf;
+			pWriter->nAsyncBuf = _AsyncIOGetBuffer(pAsyncIO);
+		}
+		if (nRet != 0 || pWriter->nAsyncBuf < 0) {
+			pWriter->nErrorCode = (-92);
+			swprintf_s(pWriter->sRetErrDescription,
+				_countof(pWriter->sRetErrDescription),
+				_T("EC(-92) Failed to queue printer data write!"));
+			return pWriter->nErrorCode;
+		}
+		pWriter->pWriteBuffer = pAsyncIO->Buffers[pWriter->nAsyncBuf].pData;
+	}
+	else {
+		UINT32 nDone = 0;
+
+		while (nDone < pWriter->nBufferUsed) {
+			INT64 nWritten = (INT64)RTL_WRITE(pWriter->nFileDescriptor, pWriter->pWriteBuffer + nDone,
+				pWriter->nBufferUsed - nDone);
+			if (nWritten <= 0) {
+				pWriter->nErrorCode = (-92);
+				swprintf_s(pWriter->sRetErrDescription,
+					_countof(pWriter->sRetErrDescription),
+					_T("EC(-92) Failed to write printer data!"));
+				return pWriter->nErrorCode;
+			}
+			nDone += (UINT32)nWritten;
+		}
+	}
+	pWriter->nFileOffset += pWriter->nBufferUsed;
+	pWriter->nBufferUsed = 0;
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _RTLAppend() copies nSize bytes into the staging buffer, flushing whenever it fills
+//
+INT16 _RTLAppend(RTLWriter* pWriter, const void* pData, UINT32 nSize) {
+	const UINT8* pBytes = (const UINT8*)pData;
+
+	while (nSize > 0) {
+		UINT32 nChunk = min(nSize, pWriter->nBufferSize - pWriter->nBufferUsed);
+
+		memcpy(pWriter->pWriteBuffer + pWriter->nBufferUsed, pBytes, nChunk);
+		pWriter->nBufferUsed += nChunk;
+		pBytes += nChunk;
+		nSize -= nChunk;
+
+		if (pWriter->nBufferUsed == pWriter->nBufferSize && _FlushRTLOutput(pWriter) != 0)
+			return pWriter->nErrorCode;
+	}
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _RTLCommand() appends one escape sequence, ESC <group> <value> <terminator>, e.g. ESC * b 120 W
+//
+INT16 _RTLCommand(RTLWriter* pWriter, const char* sGroup, INT32 nValue, char cTerminator) {
+	char sCommand[32];
+	int nLength = snprintf(sCommand, sizeof(sCommand), "%c%s%d%c", RTL_ESC, sGroup, nValue, cTerminator);
+
+	return _RTLAppend(pWriter, sCommand, (UINT32)nLength);
+}
+
+// *********************************************************************************************************************************
+// _BeginRTLPage() resets the printer, sets resolution, raster format (Configure Image Data) and size, and starts raster graphics
+//
+INT16 _BeginRTLPage(
+	RTLWriter* pWriter,														// Pointer to the printer data writer
+	UINT32 nRasterWidthPixels,												// Width of a raster row in dots (byte block padded)
+	UINT32 nRasterHeight,													// Number of raster rows on the page
+	UINT16 nHorizontalDPI,													// Print resolution
+	UINT16 nVerticalDPI,
+	UINT8 nColorChannels,													// Ink planes per raster row
+	UINT8 nBitsPerDot) {													// 1 = fixed dot size, 2 = variable dot (S, M, L)
+
+	char sReset[2] = { RTL_ESC, 'E' };
+	char sConfigureImageData[6] = { 1, 0, (char)nColorChannels,			// Device CMY, indexed by plane, one plane per ink,
+		(char)nBitsPerDot, (char)nBitsPerDot, (char)nBitsPerDot };			//  bits per primary (C, M, Y): the dot sizes
+
+	pWriter->nBitsPerDot = nBitsPerDot;
+	pWriter->nPlanes = nColorChannels;
+	pWriter->nRowsWritten = 0;
+	pWriter->nPackedRowBytes = (nRasterWidthPixels * nBitsPerDot + 7) / 8;
+
+	pWriter->nActiveMethod = (pWriter->nCompressionMode == RTL_COMPRESS_ADAPTIVE) ?
+		RTL_COMPRESS_PACKBITS : pWriter->nCompressionMode;					// Adaptive starts in PackBits, switches when it pays
+	pWriter->nRawBytes = 0;
+	pWriter->nEncodedBytes = 0;
+	pWriter->nPendingSkipRows = 0;
+	pWriter->nRowsSkipped = 0;
+
+	_RTLAlignedFree(pWriter->pPackedRow);
+	_RTLAlignedFree(pWriter->pSeedRows);
+	for (UINT8 mlp = 0; mlp < 3; mlp++) {
+		_RTLAlignedFree(pWriter->pEncodedRow[mlp]);
+		pWriter->pEncodedRow[mlp] = (UINT8*)_RTLAlignedAlloc(_RTLEncodedBufferSize(pWriter->nPackedRowBytes));
+	}
+	pWriter->pPackedRow = (UINT8*)_RTLAlignedAlloc(pWriter->nPackedRowBytes + 64);
+	pWriter->pSeedRows = (UINT8*)_RTLAlignedAlloc((size_t)nColorChannels * pWriter->nPackedRowBytes + 64);
+	if (pWriter->pPackedRow == NULL || pWriter->pSeedRows == NULL || pWriter->pEncodedRow[0] == NULL ||
+		pWriter->pEncodedRow[1] == NULL || pWriter->pEncodedRow[2] == NULL) {
+		pWriter->nErrorCode = (-91);
+		swprintf_s(pWriter->sRetErrDescription,
+			_countof(pWriter->sRetErrDescription),
+			_T("EC(-91) Failed to allocate printer data buffer!"));
+		return pWriter->nErrorCode;
+	}
+	memset(pWriter->pSeedRows, 0, (size_t)nColorChannels * pWriter->nPackedRowBytes);	// Start raster graphics zeroes the seed rows
+	if (_RTLAppend(pWriter, sReset, 2) != 0 ||								// ESC E, printer reset
+		_RTLCommand(pWriter, "*t", nHorizontalDPI, 'R') != 0 ||				// Raster resolution
+		(nVerticalDPI != nHorizontalDPI &&
+			_RTLCommand(pWriter, "*t", nVerticalDPI, 'Y') != 0) ||			// Vertical resolution, if it differs
+		_RTLCommand(pWriter, "*v", sizeof(sConfigureImageData), 'W') != 0 ||	// Configure Image Data, short form,
+		_RTLAppend(pWriter, sConfigureImageData, sizeof(sConfigureImageData)) != 0 ||	//  the 6 bytes after it
+		_RTLCommand(pWriter, "*r", (INT32)nRasterWidthPixels, 'S') != 0 ||	// Source raster width
+		_RTLCommand(pWriter, "*r", (INT32)nRasterHeight, 'T') != 0 ||		// Source raster height
+		_RTLCommand(pWriter, "*b", pWriter->nActiveMethod, 'M') != 0 ||	// Compression method
+		_RTLCommand(pWriter, "*r", 1, 'A') != 0)							// Start raster graphics at current position
+		return pWriter->nErrorCode;
+
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _PackRTLRow() packs one row of dot values (one byte per dot, 0 .. nDotLevels - 1) into nBitsPerDot bits per dot, MSB first
+//
+void _PackRTLRow(UINT8* pPacked, const UINT8* pDots, UINT32 nDots, UINT8 nBitsPerDot) {
+	if (nBitsPerDot == 2) {
+		UINT32 nWhole = nDots / 4, blp;
+
+		for (blp = 0; blp < nWhole; blp++, pDots += 4)
+			pPacked[blp] = (UINT8)(((pDots[0] & 3) << 6) | ((pDots[1] & 3) << 4) | ((pDots[2] & 3) << 2) | (pDots[3] & 3));
+		if (nDots % 4) {
+			UINT8 nByte = 0;
+			for (UINT32 dlp = 0; dlp < nDots % 4; dlp++)
+				nByte |= (UINT8)((pDots[dlp] & 3) << (6 - 2 * dlp));
+			pPacked[blp] = nByte;
+		}
+	}
+	else {
+		UINT32 nWhole = nDots / 8, blp;
+
+		for (blp = 0; blp < nWhole; blp++, pDots += 8) {
+			UINT8 nByte = 0;
+			for (UINT8 dlp = 0; dlp < 8; dlp++)
+				nByte |= (UINT8)((pDots[dlp] != 0) << (7 - dlp));
+			pPacked[blp] = nByte;
+		}
+		if (nDots % 8) {
+			UINT8 nByte = 0;
+			for (UINT32 dlp = 0; dlp < nDots % 8; dlp++)
+				nByte |= (UINT8)((pDots[dlp] != 0) << (7 - dlp));
+			pPacked[blp] = nByte;
+		}
+	}
+}
+
+// *********************************************************************************************************************************
+// _EncodeRTLRow() compresses one packed ink row against its plane's seed row and returns the method to send it with;
+//  *ppData / *pnSize point at the encoded bytes. Adaptive mode counts a method change (ESC*b#M, 5 bytes) against the new method
+//
+UINT8 _EncodeRTLRow(RTLWriter* pWriter, UINT8* pSeed, const UINT8** ppData, UINT32* pnSize) {
+	const UINT8* pRow = pWriter->pPackedRow;
+	UINT32 nBytes = pWriter->nPackedRowBytes;
+	UINT8 nMethod = pWriter->nCompressionMode;
+
+	if (nMethod == RTL_COMPRESS_ADAPTIVE) {
+		UINT32 nSize[3], nBest = pWriter->nActiveMethod;
+
+		if (_RTLMatchRun(pRow, pSeed, nBytes) == nBytes && nBest == RTL_COMPRESS_DELTA)
+			nSize[2] = 0;													// Repeats the row above, nothing to send
+		else {
+			nSize[0] = _RTLEncodeRLE(pWriter->pEncodedRow[0], pRow, nBytes);
+			nSize[1] = _RTLEncodePackBits(pWriter->pEncodedRow[1], pRow, nBytes);
+			nSize[2] = _RTLEncodeDeltaRow(pWriter->pEncodedRow[2], pRow, pSeed, nBytes);
+
+			for (UINT8 mlp = RTL_COMPRESS_RLE; mlp <= RTL_COMPRESS_DELTA; mlp++) {
+				if (nSize[mlp - 1] + (mlp == pWriter->nActiveMethod ? 0 : 5) <
+					nSize[nBest - 1] + (nBest == pWriter->nActiveMethod ? 0 : 5))
+					nBest = mlp;
+			}
+		}
+		nMethod = (UINT8)nBest;
+		*ppData = pWriter->pEncodedRow[nMethod - 1];
+		*pnSize = nSize[nMethod - 1];
+	}
+	else if (nMethod == RTL_COMPRESS_RLE) {
+		*ppData = pWriter->pEncodedRow[0];
+		*pnSize = _RTLEncodeRLE(pWriter->pEncodedRow[0], pRow, nBytes);
+	}
+	else if (nMethod == RTL_COMPRESS_PACKBITS) {
+		*ppData = pWriter->pEncodedRow[1];
+		*pnSize = _RTLEncodePackBits(pWriter->pEncodedRow[1], pRow, nBytes);
+	}
+	else if (nMethod == RTL_COMPRESS_DELTA) {
+		*ppData = pWriter->pEncodedRow[2];
+		*pnSize = _RTLEncodeDeltaRow(pWriter->pEncodedRow[2], pRow, pSeed, nBytes);
+	}
+	else {
+		*ppData = pRow;
+		*pnSize = _RTLTrimmedLength(pRow, nBytes);							// Unencoded rows are zero filled too
+	}
+	memcpy(pSeed, pRow, nBytes);											// Every method leaves this row as the seed
+	return nMethod;
+}
+
+// *********************************************************************************************************************************
+// _FlushRTLSkip() sends the pending blank rows as one vertical move, ESC*b#Y, which also zeroes the seed rows
+//
+INT16 _FlushRTLSkip(RTLWriter* pWriter) {
+	if (pWriter->nPendingSkipRows == 0)
+		return 0;
+
+	if (_RTLCommand(pWriter, "*b", (INT32)pWriter->nPendingSkipRows, 'Y') != 0)
+		return pWriter->nErrorCode;
+
+	memset(pWriter->pSeedRows, 0, (size_t)pWriter->nPlanes * pWriter->nPackedRowBytes);
+	pWriter->nPendingSkipRows = 0;
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _WriteRTLBand() writes nRows halftoned rows from pRTLData[] (one buffer per ink, already in printer ink order)
+// Each raster row is sent as one plane per ink: ESC*b#V for every plane but the last, ESC*b#W for the last
+// Planes are compressed one by one (each has its own seed row); a method change is sent just before the plane that needs it
+// Blank rows (no dot in any plane, found with the SIMD zero scan) are counted and sent as a vertical move before the next inked row
+//
+INT16 _WriteRTLBand(
+	RTLWriter* pWriter,														// Pointer to the printer data writer
+	UINT8* pRTLData[16],													// RTL data buffer (dot data, one byte per dot)
+	UINT16 nRows,															// Number of rows in the band
+	UINT32 nRasterWidthPixels) {											// Width of a raster row in dots
+
+	for (UINT16 rlp = 0; rlp < nRows; rlp++) {
+		bool bBlankRow = true;
+
+		for (UINT8 plp = 0; plp < pWriter->nPlanes && bBlankRow; plp++)
+			bBlankRow = (_RTLTrimmedLength(pRTLData[plp] + (size_t)rlp * nRasterWidthPixels, nRasterWidthPixels) == 0);
+
+		if (bBlankRow) {
+			pWriter->nPendingSkipRows++;
+			pWriter->nRowsSkipped++;
+			pWriter->nRowsWritten++;
+			pWriter->nRawBytes += (UINT64)pWriter->nPlanes * pWriter->nPackedRowBytes;
+			continue;
+		}
+		if (_FlushRTLSkip(pWriter) != 0)
+			return pWriter->nErrorCode;
+
+		for (UINT8 plp = 0; plp < pWriter->nPlanes; plp++) {
+			const UINT8* pEncoded;
+			UINT32 nEncodedSize;
+
+			_PackRTLRow(pWriter->pPackedRow, pRTLData[plp] + (size_t)rlp * nRasterWidthPixels,
+				nRasterWidthPixels, pWriter->nBitsPerDot);
+
+			UINT8 nMethod = _EncodeRTLRow(pWriter, pWriter->pSeedRows + (size_t)plp * pWriter->nPackedRowBytes,
+				&pEncoded, &nEncodedSize);
+
+			if (nMethod != pWriter->nActiveMethod) {						// ESC*b#M, adaptive mode switching methods
+				if (_RTLCommand(pWriter, "*b", nMethod, 'M') != 0)
+					return pWriter->nErrorCode;
+				pWriter->nActiveMethod = nMethod;
+			}
+			if (_RTLCommand(pWriter, "*b", (INT32)nEncodedSize,
+				(plp == pWriter->nPlanes - 1) ? 'W' : 'V') != 0 ||
+				_RTLAppend(pWriter, pEncoded, nEncodedSize) != 0)
+				return pWriter->nErrorCode;
+
+			pWriter->nRawBytes += pWriter->nPackedRowBytes;
+			pWriter->nEncodedBytes += nEncodedSize;
+		}
+		pWriter->nRowsWritten++;
+	}
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _EndRTLPage() ends raster graphics, resets the printer and pushes everything out, so the backend sees the whole page
+//
+INT16 _EndRTLPage(RTLWriter* pWriter) {
+	char sReset[2] = { RTL_ESC, 'E' };
+
+	if (_FlushRTLSkip(pWriter) != 0 ||										// Blank rows at the foot of the page
+		_RTLCommand(pWriter, "*r", 0, 'C') != 0 ||							// ESC*rC, end raster graphics
+		_RTLAppend(pWriter, sReset, 2) != 0 ||
+		_FlushRTLOutput(pWriter) != 0)
+		return pWriter->nErrorCode;
+
+	if (pWriter->pAsyncIO != NULL && _AsyncIOWait(pWriter->pAsyncIO, -1) != 0) {
+		pWriter->nErrorCode = pWriter->pAsyncIO->nErrorCode;
+		swprintf_s(pWriter->sRetErrDescription,
+			_countof(pWriter->sRetErrDescription), _T("%ls"), pWriter->pAsyncIO->sRetErrDescription);
+		return pWriter->nErrorCode;
+	}
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _CloseRTLOutput() releases the writer's buffers, and closes the output if _OpenRTLOutput() opened it
+//
+void _CloseRTLOutput(RTLWriter* pWriter) {
+	if (pWriter->pAsyncIO != NULL) {
+		_AsyncIOWait(pWriter->pAsyncIO, -1);
+		if (pWriter->nAsyncBuf >= 0)										// Return the unused staging buffer to the pool
+			pWriter->pAsyncIO->Buffers[pWriter->nAsyncBuf].nState = ASYNC_IO_FREE;
+	}
+	else
+		_RTLAlignedFree(pWriter->pWriteBuffer);
+
+	_RTLAlignedFree(pWriter->pPackedRow);
+	_RTLAlignedFree(pWriter->pSeedRows);
+	for (UINT8 mlp = 0; mlp < 3; mlp++) {
+		_RTLAlignedFree(pWriter->pEncodedRow[mlp]);
+		pWriter->pEncodedRow[mlp] = NULL;
+	}
+	pWriter->pWriteBuffer = NULL;
+	pWriter->pPackedRow = NULL;
+	pWriter->pSeedRows = NULL;
+	pWriter->nAsyncBuf = -1;
+	pWriter->nPrevAsyncBuf = -1;
+
+	if (pWriter->bCloseOnFinish && pWriter->nFileDescriptor >= 0)
+		RTL_CLOSE(pWriter->nFileDescriptor);
+	pWriter->nFileDescriptor = -1;
+	pWriter->bCloseOnFinish = false;
+}
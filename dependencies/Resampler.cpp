@@ -0,0 +1,650 @@
+// Separable polyphase resampling, the scaler between the input band (converted to inks if need be) and the diffusion
+// Each axis is scaled by a plan worked out up front: for every output pixel (or row), the first input pixel it reads and
+//  one weight per tap, so the inner loops are multiply-adds over contiguous samples with no coordinate math per pixel.
+//  A scaled row (_ResampleRow()) is made in two passes: the row plan's input rows are summed down the columns into one
+//  float row (ink values, read through the transfer LUT), then the column plan filters that row across. The column plan
+//  is built once per page; the row plan once per band, in page rows: taps above the band read the rows kept from the bands
+//  before it (ResampleSource history), and rows with taps below it wait for the next band (_ResampleOutputsReady()), so
+//  only the image's top and bottom edges are folded and band boundaries leave no seam
+//	RESAMPLE_BOX									area average, each output pixel is the mean of the input it covers
+//	RESAMPLE_BILINEAR								triangle filter, widened to the input footprint when reducing
+//	RESAMPLE_LANCZOS3								windowed sinc, 3 lobes each side (widened the same way), overshoot clamped
+//	RESAMPLE_AUTO									bilinear on an axis that is enlarged, box on an axis that is reduced
+// Widening the filter when reducing (-s25, 600 dpi art printed at 150 dpi) averages every input pixel into the result, where
+//  point sampling would skip most of them and alias. Output pixel x covers input pixels x x nIn / nOut to (x + 1) x nIn / nOut
+// An axis enlarged by a whole factor (300 dpi art at 300, 600 or 1200 dpi) repeats the same few weights every input pixel;
+//  the plan marks the outputs away from the edges that do, and the horizontal pass makes those without reading the plan:
+//  copies of one input pixel (1:1, box enlargement), or the 2x, 3x and 4x bilinear phases, 4 outputs at a time with shuffles
+
+#define INT8	signed __int8
+#define INT16	signed __int16
+#define INT32	signed __int32
+#define UINT8 	unsigned __int8
+#define UINT16	unsigned __int16
+#define UINT32	unsigned __int32
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ED_USE_SSE2
+#include <emmintrin.h>
+#endif
+#include <math.h>
+
+#define RESAMPLE_BOX			0											// Area average
+#define RESAMPLE_BILINEAR		1											// Triangle
+#define RESAMPLE_LANCZOS3		2											// Windowed sinc, 3 lobes
+#define RESAMPLE_AUTO			3											// Bilinear to enlarge, box to reduce
+
+#define RESAMPLE_PHASES_MAX		4											// Largest enlargement with fixed two-tap weights
+
+typedef struct ResamplePlanData {
+	UINT32 nOutputs					= 0;									// Output pixels (or rows) the plan makes
+	UINT16 nTaps					= 0;									// Input pixels read per output, the same for all
+	INT32* pFirst					= NULL;									// First input pixel of each output
+	float* pWeight					= NULL;									// Weights, tap major: [tap x nOutputs + output]
+	UINT32 nInputs					= 0;									// Input pixels (or rows) the plan reads
+	UINT16 nFactor					= 0;									// Outputs per input pixel in the span, 0 = no span
+	bool bReplicate					= false;								// Span outputs are copies of their input pixel
+	UINT32 nSpanFirst				= 0;									// Span: outputs nSpanFirst to nSpanEnd - 1, whole
+	UINT32 nSpanEnd					= 0;									//  input pixels that all repeat the same weights
+	INT32 nSpanInput				= 0;									// Input pixel of output nSpanFirst
+	float dPhaseWeight[2][RESAMPLE_PHASES_MAX] = {};						// Span weights by phase, on the pixel the phase starts
+} ResamplePlan;																//  at (_ResamplePhaseOffset()) and the one after
+
+typedef struct ResampleSourceData {
+	const void* pSamples			= NULL;									// The channel's first sample in the band
+	UINT8 nBitDepth					= 8;									// 8 or 16-bit samples
+	UINT8 nStride					= 1;									// Samples from one pixel to the next, 1 = planar
+	size_t nRowPitch				= 0;									// Samples from one row to the next
+	const UINT16* pTransferLUT		= NULL;									// Sample to ink value, NULL = sample x dScale
+	float dScale					= 1.F;									// Promotion when there is no LUT, 257 or 1
+	const void* pHistory			= NULL;									// Rows kept from the bands before, same layout,
+	UINT32 nHistoryRows				= 0;									//  ahead of the band: rows 0 - nHistoryRows - 1
+} ResampleSource;
+
+// *********************************************************************************************************************************
+// _ResampleFilterFor() is the filter an axis scaled from nIn to nOut pixels uses (RESAMPLE_AUTO picks by direction)
+//
+UINT8 _ResampleFilterFor(UINT8 nFilter, UINT32 nIn, UINT32 nOut) {
+	if (nFilter <= RESAMPLE_LANCZOS3)
+		return nFilter;
+	return (nOut >= nIn) ? RESAMPLE_BILINEAR : RESAMPLE_BOX;
+}
+
+// *********************************************************************************************************************************
+// _ResampleTaps() is the most input pixels one output pixel reads, scaling nIn to nOut (the plan's nTaps, before clamping)
+//
+UINT16 _ResampleTaps(UINT8 nFilter, UINT32 nIn, UINT32 nOut) {
+	double dRatio = (double)nIn / (double)max(nOut, (UINT32)1);				// Input pixels per output pixel
+	double dWidth = max(dRatio, 1.);										// Filter scale, widened when reducing
+
+	switch (_ResampleFilterFor(nFilter, nIn, nOut)) {
+	case RESAMPLE_BOX:		return (UINT16)min(ceil(dRatio) + 1., 65535.);
+	case RESAMPLE_BILINEAR:	return (UINT16)min(ceil(2. * dWidth) + 1., 65535.);
+	default:				return (UINT16)min(ceil(6. * dWidth) + 1., 65535.);
+	}
+}
+
+// *********************************************************************************************************************************
+// _ResampleKernel() is the bilinear or Lanczos3 weight at dX input pixels from the centre (in filter units)
+//
+static inline double _ResampleKernel(UINT8 nFilter, double dX) {
+	const double dPi = 3.14159265358979323846;
+
+	dX = fabs(dX);
+	if (nFilter == RESAMPLE_BILINEAR)
+		return max(1. - dX, 0.);
+	if (fabs(dX - floor(dX + 0.5)) < 1e-9)								// Exactly 1 at the centre, 0 at the other
+		return (dX < 0.5) ? 1. : 0.;									//  whole pixels (sin() is not, quite)
+	if (dX >= 3.)
+		return 0.;
+	return 3. * sin(dPi * dX) * sin(dPi * dX / 3.) / (dPi * dPi * dX * dX);
+}
+
+// *********************************************************************************************************************************
+// _ResamplePhaseOffset() is the input pixel, from the one it falls in, that output nPhase of an nFactor enlargement's two taps
+//  start at: the pixel before for the outputs left of the pixel's centre, the pixel itself for the rest
+//
+static inline INT32 _ResamplePhaseOffset(UINT32 nPhase, UINT32 nFactor) {
+	return (2 * nPhase + 1 < nFactor) ? -1 : 0;
+}
+
+// *********************************************************************************************************************************
+// _ResampleWeightAt() is the weight output nOutput of pPlan gives input pixel nInput (0 outside its taps)
+//
+static float _ResampleWeightAt(const ResamplePlan* pPlan, UINT32 nOutput, INT32 nInput) {
+	INT32 nTap = nInput - pPlan->pFirst[nOutput];
+
+	return (nTap >= 0 && nTap < (INT32)pPlan->nTaps) ? pPlan->pWeight[(size_t)nTap * pPlan->nOutputs + nOutput] : 0.F;
+}
+
+// *********************************************************************************************************************************
+// _ResampleMatches() is true if output nOutput of pPlan is exactly dWeight0 x input nInput + dWeight1 x input nInput + 1, with
+//  no other tap weighted and every pixel the fast paths read there in the plan's inputs (just nInput, if bOneTap)
+//
+static bool _ResampleMatches(const ResamplePlan* pPlan, UINT32 nOutput, INT32 nInput, float dWeight0, float dWeight1,
+	bool bOneTap) {
+
+	if (nInput < 0 || nInput + (bOneTap ? 0 : 1) >= (INT32)pPlan->nInputs)
+		return false;
+	if (_ResampleWeightAt(pPlan, nOutput, nInput) != dWeight0 || _ResampleWeightAt(pPlan, nOutput, nInput + 1) != dWeight1)
+		return false;
+
+	for (UINT16 tlp = 0; tlp < pPlan->nTaps; tlp++) {
+		INT32 nAt = pPlan->pFirst[nOutput] + tlp;
+
+		if (nAt != nInput && nAt != nInput + 1 && pPlan->pWeight[(size_t)tlp * pPlan->nOutputs + nOutput] != 0.F)
+			return false;
+	}
+	return true;
+}
+
+// *********************************************************************************************************************************
+// _FindResampleSpan() sets pPlan's span: when nIn to nOut is a whole enlargement, the run of whole input pixels whose outputs
+//  are copies of it, or (2x to 4x) the same two-tap weights as the pixels in the middle of the plan. Edge pixels, with taps
+//  folded, are left to the general path, as is everything else (reductions, Lanczos, 1.5x)
+//
+static void _FindResampleSpan(ResamplePlan* pPlan, UINT32 nIn, UINT32 nOut, UINT32 nFirstOutput, UINT32 nFirstInput) {
+	UINT32 nFactor = (nIn > 0 && nOut % nIn == 0) ? nOut / nIn : 0;
+	UINT32 nAlign, nMiddle;
+	bool bReplicate = true, bInSpan = false;
+
+	pPlan->nFactor = 0;
+	pPlan->nSpanFirst = pPlan->nSpanEnd = 0;
+	if (nFactor == 0 || nFactor > 65535)
+		return;
+	nAlign = (nFactor - nFirstOutput % nFactor) % nFactor;					// First output that starts an input pixel
+	if (nAlign + nFactor > pPlan->nOutputs)
+		return;
+	nMiddle = nAlign + (pPlan->nOutputs - nAlign) / nFactor / 2 * nFactor;	// and one in the middle, clear of the edges
+
+	for (UINT32 plp = 0; plp < nFactor && bReplicate; plp++)
+		bReplicate = _ResampleMatches(pPlan, nMiddle + plp,
+			(INT32)((nFirstOutput + nMiddle) / nFactor) - (INT32)nFirstInput, 1.F, 0.F, true);
+	if (!bReplicate) {
+		if (nFactor > RESAMPLE_PHASES_MAX)
+			return;
+		for (UINT32 plp = 0; plp < nFactor; plp++) {
+			INT32 nInput = (INT32)((nFirstOutput + nMiddle) / nFactor) - (INT32)nFirstInput + _ResamplePhaseOffset(plp, nFactor);
+
+			pPlan->dPhaseWeight[0][plp] = _ResampleWeightAt(pPlan, nMiddle + plp, nInput);
+			pPlan->dPhaseWeight[1][plp] = _ResampleWeightAt(pPlan, nMiddle + plp, nInput + 1);
+		}
+	}
+
+	for (UINT32 olp = nAlign; olp + nFactor <= pPlan->nOutputs; olp += nFactor) {
+		INT32 nPixel = (INT32)((nFirstOutput + olp) / nFactor) - (INT32)nFirstInput;
+		bool bMatch = true;
+
+		for (UINT32 plp = 0; plp < nFactor && bMatch; plp++)
+			bMatch = bReplicate ? _ResampleMatches(pPlan, olp + plp, nPixel, 1.F, 0.F, true) :
+				_ResampleMatches(pPlan, olp + plp, nPixel + _ResamplePhaseOffset(plp, nFactor),
+					pPlan->dPhaseWeight[0][plp], pPlan->dPhaseWeight[1][plp], false);
+		if (bMatch) {
+			if (!bInSpan) {
+				pPlan->nSpanFirst = olp;
+				pPlan->nSpanInput = nPixel;
+				bInSpan = true;
+			}
+			pPlan->nSpanEnd = olp + nFactor;
+		}
+		else if (bInSpan)
+			break;
+	}
+	if (bInSpan) {
+		pPlan->nFactor = (UINT16)nFactor;
+		pPlan->bReplicate = bReplicate;
+	}
+}
+
+// *********************************************************************************************************************************
+// _BuildResamplePlan() fills pPlan (pFirst and pWeight already pointing at room for nOutputs x _ResampleTaps() entries) for
+//  outputs nFirstOutput on of an axis scaled from nIn to nOut pixels, reading only the nInputs pixels from nFirstInput on;
+//  taps that fall outside them are folded onto the nearest one, and each output's weights add up to 1
+//
+typedef struct ResampleFootprintData {
+	UINT8 nKernel					= RESAMPLE_BOX;							// Filter the axis uses, see _ResampleFilterFor()
+	UINT32 nFactor					= 0;									// Whole enlargement, outputs per input pixel
+	double dRatio					= 1.;									// Input pixels per output pixel
+	double dWidth					= 1.;									// Filter scale, widened when reducing
+	double dRadius					= 1.;									// Kernel reach, in input pixels
+	INT32 nOrigin					= 0;									// Input pixel the footprint is measured from
+	double dLeft					= 0.;									// Footprint, in input pixel edges, and its
+	double dCentre					= 0.;									//  centre, in input pixel centres, from nOrigin
+	INT32 nLow						= 0;									// First and last input pixels the kernel
+	INT32 nHigh						= 0;									//  reaches (some may weigh nothing)
+} ResampleFootprint;
+
+// *********************************************************************************************************************************
+// _ResampleAxis() sets up pFoot for an axis scaled from nIn to nOut pixels with nFilter, ready for _ResampleFootprintOf()
+//
+static void _ResampleAxis(ResampleFootprint* pFoot, UINT8 nFilter, UINT32 nIn, UINT32 nOut) {
+	pFoot->nKernel = _ResampleFilterFor(nFilter, nIn, nOut);
+	pFoot->nFactor = (nIn > 0 && nOut % nIn == 0) ? nOut / nIn : 0;
+	pFoot->dRatio = (double)nIn / (double)max(nOut, (UINT32)1);
+	pFoot->dWidth = max(pFoot->dRatio, 1.);
+	pFoot->dRadius = (pFoot->nKernel == RESAMPLE_BILINEAR) ? pFoot->dWidth : 3. * pFoot->dWidth;
+}
+
+// *********************************************************************************************************************************
+// _ResampleFootprintOf() sets the input pixels output nOutput of pFoot's axis reaches; whole enlargements measure from the input
+//  pixel the output is in, so that every pixel gets the same weights, bit for bit
+//
+static void _ResampleFootprintOf(ResampleFootprint* pFoot, UINT32 nOutput) {
+	pFoot->nOrigin = (pFoot->nFactor > 0) ? (INT32)(nOutput / pFoot->nFactor) : 0;
+	pFoot->dLeft = (double)((pFoot->nFactor > 0) ? nOutput % pFoot->nFactor : nOutput) * pFoot->dRatio;
+	pFoot->dCentre = pFoot->dLeft + 0.5 * pFoot->dRatio - 0.5;
+
+	if (pFoot->nKernel == RESAMPLE_BOX) {
+		pFoot->nLow = pFoot->nOrigin + (INT32)floor(pFoot->dLeft);
+		pFoot->nHigh = pFoot->nOrigin + (INT32)ceil(pFoot->dLeft + pFoot->dRatio) - 1;
+	}
+	else {
+		pFoot->nLow = pFoot->nOrigin + (INT32)ceil(pFoot->dCentre - pFoot->dRadius);
+		pFoot->nHigh = pFoot->nOrigin + (INT32)floor(pFoot->dCentre + pFoot->dRadius);
+	}
+}
+
+// *********************************************************************************************************************************
+// _ResampleFootprintWeight() is the (unnormalized) weight input pixel nInput has in pFoot's current output, 0 = not read
+//
+static double _ResampleFootprintWeight(const ResampleFootprint* pFoot, INT32 nInput) {
+	double dAt = (double)(nInput - pFoot->nOrigin);
+	double dWeight = (pFoot->nKernel == RESAMPLE_BOX) ?						// Overlap, or the kernel at this pixel
+		min(pFoot->dLeft + pFoot->dRatio, dAt + 1.) - max(pFoot->dLeft, dAt) :
+		_ResampleKernel(pFoot->nKernel, (dAt - pFoot->dCentre) / pFoot->dWidth);
+
+	return (pFoot->nKernel == RESAMPLE_BOX && dWeight < 1e-9) ? 0. : dWeight;	// Box edges rounded past a pixel boundary
+}
+
+// *********************************************************************************************************************************
+// _BuildResamplePlan() fills pPlan (pFirst and pWeight already pointing at room for nOutputs x _ResampleTaps() entries) for
+//  outputs nFirstOutput on of an axis scaled from nIn to nOut pixels, reading only the nInputs pixels from nFirstInput on;
+//  taps that fall outside them are folded onto the nearest one, and each output's weights add up to 1
+//
+void _BuildResamplePlan(ResamplePlan* pPlan, UINT8 nFilter, UINT32 nIn, UINT32 nOut, UINT32 nFirstOutput, UINT32 nOutputs,
+	UINT32 nFirstInput, UINT32 nInputs) {
+
+	ResampleFootprint Foot;
+
+	_ResampleAxis(&Foot, nFilter, nIn, nOut);
+	pPlan->nOutputs = nOutputs;
+	pPlan->nTaps = (UINT16)min((UINT32)_ResampleTaps(nFilter, nIn, nOut), max(nInputs, (UINT32)1));
+
+	for (UINT32 olp = 0; olp < nOutputs; olp++) {
+		_ResampleFootprintOf(&Foot, nFirstOutput + olp);
+
+		INT32 nStart = min(max(Foot.nLow - (INT32)nFirstInput, 0), (INT32)nInputs - (INT32)pPlan->nTaps);
+		double dSum = 0.;
+
+		pPlan->pFirst[olp] = max(nStart, 0);
+		for (UINT16 tlp = 0; tlp < pPlan->nTaps; tlp++)
+			pPlan->pWeight[(size_t)tlp * nOutputs + olp] = 0.F;
+
+		for (INT32 ilp = Foot.nLow; ilp <= Foot.nHigh; ilp++) {
+			double dWeight = _ResampleFootprintWeight(&Foot, ilp);
+			INT32 nTap = min(max(ilp - (INT32)nFirstInput, 0), (INT32)nInputs - 1) - pPlan->pFirst[olp];
+
+			if (dWeight == 0.)
+				continue;
+			nTap = min(max(nTap, 0), (INT32)pPlan->nTaps - 1);			// Edge pixels take the taps beyond them
+			pPlan->pWeight[(size_t)nTap * nOutputs + olp] += (float)dWeight;
+			dSum += dWeight;
+		}
+		if (dSum > 0.) {
+			for (UINT16 tlp = 0; tlp < pPlan->nTaps; tlp++)
+				pPlan->pWeight[(size_t)tlp * nOutputs + olp] = (float)(pPlan->pWeight[(size_t)tlp * nOutputs + olp] / dSum);
+		}
+		else																// Lanczos zero crossings only, take the nearest
+			pPlan->pWeight[(size_t)min(max(Foot.nOrigin + (INT32)lround(Foot.dCentre) - (INT32)nFirstInput - pPlan->pFirst[olp],
+				0), (INT32)pPlan->nTaps - 1) * nOutputs + olp] = 1.F;
+	}
+	pPlan->nInputs = nInputs;
+	_FindResampleSpan(pPlan, nIn, nOut, nFirstOutput, nFirstInput);
+}
+
+// *********************************************************************************************************************************
+// _ResampleOutputsReady() is how many outputs, from the first, of an axis scaled from nIn to nOut pixels read nothing from
+//  input pixel nInputEnd on (all of them once nInputEnd reaches nIn, the edge folds the rest)
+// The kernel's reach only ever moves forward, so the outputs that stop short of nInputEnd are found by a binary
+//  search; past those, outputs that reach it with a weight of 0 (Lanczos on a whole pixel, a kernel's end) are ready too
+//
+UINT32 _ResampleOutputsReady(UINT8 nFilter, UINT32 nIn, UINT32 nOut, UINT32 nInputEnd) {
+	ResampleFootprint Foot;
+	UINT32 nReady = 0, nPast = nOut;										// Outputs below nReady reach no further
+
+	if (nInputEnd >= nIn)
+		return nOut;
+	_ResampleAxis(&Foot, nFilter, nIn, nOut);
+	while (nReady < nPast) {
+		UINT32 nOutput = nReady + (nPast - nReady) / 2;
+
+		_ResampleFootprintOf(&Foot, nOutput);
+		if (Foot.nHigh < (INT32)nInputEnd)
+			nReady = nOutput + 1;
+		else
+			nPast = nOutput;
+	}
+	for (; nReady < nOut; nReady++) {										// Up to the first that weighs a pixel past it
+		_ResampleFootprintOf(&Foot, nReady);
+		for (INT32 ilp = (INT32)nInputEnd; ilp <= Foot.nHigh; ilp++) {
+			if (_ResampleFootprintWeight(&Foot, ilp) != 0.)
+				return nReady;
+		}
+	}
+	return nReady;
+}
+
+// *********************************************************************************************************************************
+// _SourceRowSamples() is the first sample of row nRow of the source, a history row or, past those, a row of the band
+//
+static inline const void* _SourceRowSamples(const ResampleSource* pSource, INT32 nRow) {
+	size_t nRowBytes = pSource->nRowPitch * (pSource->nBitDepth / 8);
+
+	if (nRow < (INT32)pSource->nHistoryRows)
+		return (const UINT8*)pSource->pHistory + (size_t)nRow * nRowBytes;
+	return (const UINT8*)pSource->pSamples + (size_t)(nRow - (INT32)pSource->nHistoryRows) * nRowBytes;
+}
+
+// *********************************************************************************************************************************
+// _AddSourceRow() adds dWeight x row nRow of the source to pRow (or sets pRow, if bFirst), nWidth pixels
+// With no transfer LUT, planar and 4-sample pixel order rows go 4 pixels at a time (SSE2); a LUT is one lookup per sample
+//
+static void _AddSourceRow(const ResampleSource* pSource, INT32 nRow, float dWeight, UINT32 nWidth, bool bFirst, float* pRow) {
+	size_t nStride = pSource->nStride;
+	UINT32 nPixel = 0;
+
+	if (pSource->pTransferLUT != NULL) {
+		const UINT16* pLUT = pSource->pTransferLUT;
+
+		if (pSource->nBitDepth == 8) {
+			const UINT8* pSample = (const UINT8*)_SourceRowSamples(pSource, nRow);
+			for (; nPixel < nWidth; nPixel++)
+				pRow[nPixel] = (bFirst ? 0.F : pRow[nPixel]) + dWeight * (float)pLUT[pSample[nPixel * nStride]];
+		}
+		else {
+			const UINT16* pSample = (const UINT16*)_SourceRowSamples(pSource, nRow);
+			for (; nPixel < nWidth; nPixel++)
+				pRow[nPixel] = (bFirst ? 0.F : pRow[nPixel]) + dWeight * (float)pLUT[pSample[nPixel * nStride]];
+		}
+		return;
+	}
+	float dScaledWeight = dWeight * pSource->dScale;
+
+	if (pSource->nBitDepth == 8) {
+		const UINT8* pSample = (const UINT8*)_SourceRowSamples(pSource, nRow);
+#ifdef ED_USE_SSE2
+		__m128 vWeight = _mm_set1_ps(dScaledWeight);
+		__m128i vZero = _mm_setzero_si128();
+
+		if (nStride == 1 || nStride == 4) {									// Never reads past the row's last sample
+			for (; nPixel + 4 < nWidth; nPixel += 4) {
+				__m128i vSamples = (nStride == 1) ?
+					_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int*)(pSample + nPixel)), vZero), vZero) :
+					_mm_and_si128(_mm_loadu_si128((const __m128i*)(pSample + nPixel * 4)), _mm_set1_epi32(0xFF));
+				__m128 vSum = _mm_mul_ps(_mm_cvtepi32_ps(vSamples), vWeight);
+
+				_mm_storeu_ps(pRow + nPixel, bFirst ? vSum : _mm_add_ps(_mm_loadu_ps(pRow + nPixel), vSum));
+			}
+		}
+#endif
+		for (; nPixel < nWidth; nPixel++)
+			pRow[nPixel] = (bFirst ? 0.F : pRow[nPixel]) + dScaledWeight * (float)pSample[nPixel * nStride];
+	}
+	else {
+		const UINT16* pSample = (const UINT16*)_SourceRowSamples(pSource, nRow);
+#ifdef ED_USE_SSE2
+		__m128 vWeight = _mm_set1_ps(dScaledWeight);
+		__m128i vZero = _mm_setzero_si128();
+
+		if (nStride == 1 || nStride == 4) {
+			for (; nPixel + 4 < nWidth; nPixel += 4) {
+				__m128i vSamples;
+
+				if (nStride == 1)
+					vSamples = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(pSample + nPixel)), vZero);
+				else {														// Sample 0 of each 64-bit pixel
+					__m128i vMask = _mm_set_epi32(0, 0xFFFF, 0, 0xFFFF);
+					__m128i vLow = _mm_and_si128(_mm_loadu_si128((const __m128i*)(pSample + nPixel * 4)), vMask);
+					__m128i vHigh = _mm_and_si128(_mm_loadu_si128((const __m128i*)(pSample + nPixel * 4 + 8)), vMask);
+					vSamples = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(vLow), _mm_castsi128_ps(vHigh),
+						_MM_SHUFFLE(2, 0, 2, 0)));
+				}
+				__m128 vSum = _mm_mul_ps(_mm_cvtepi32_ps(vSamples), vWeight);
+
+				_mm_storeu_ps(pRow + nPixel, bFirst ? vSum : _mm_add_ps(_mm_loadu_ps(pRow + nPixel), vSum));
+			}
+		}
+#endif
+		for (; nPixel < nWidth; nPixel++)
+			pRow[nPixel] = (bFirst ? 0.F : pRow[nPixel]) + dScaledWeight * (float)pSample[nPixel * nStride];
+	}
+}
+
+// *********************************************************************************************************************************
+// _ResampleColumns() is the vertical pass: output row nRow of pRows, summed down the columns of the source into pRow
+//  (nWidth input pixels wide, ink values); rows the plan copies (1:1, box enlargement) are converted with no tap loop
+//
+void _ResampleColumns(const ResampleSource* pSource, const ResamplePlan* pRows, UINT32 nRow, UINT32 nWidth, float* pRow) {
+	bool bFirst = true;
+
+	if (pRows->nFactor != 0 && pRows->bReplicate && nRow >= pRows->nSpanFirst && nRow < pRows->nSpanEnd) {
+		_AddSourceRow(pSource, pRows->nSpanInput + (INT32)((nRow - pRows->nSpanFirst) / pRows->nFactor), 1.F, nWidth,
+			true, pRow);													// A copied row, no filter: just converted
+		return;
+	}
+	for (UINT16 tlp = 0; tlp < pRows->nTaps; tlp++) {
+		float dWeight = pRows->pWeight[(size_t)tlp * pRows->nOutputs + nRow];
+
+		if (dWeight != 0.F) {												// Reductions have taps that miss
+			_AddSourceRow(pSource, pRows->pFirst[nRow] + tlp, dWeight, nWidth, bFirst, pRow);
+			bFirst = false;
+		}
+	}
+	if (bFirst)
+		memset(pRow, 0, nWidth * sizeof(float));
+}
+
+// *********************************************************************************************************************************
+// _ResampleAcrossPlan() is the general horizontal pass, outputs nFrom to nTo - 1: each a weighted sum of its taps, read from
+//  the plan, clamped to 0 - dMaxPixVal
+//
+static void _ResampleAcrossPlan(const ResamplePlan* pColumns, const float* pRow, float dMaxPixVal, float* pScaledRow,
+	UINT32 nFrom, UINT32 nTo) {
+
+	UINT32 nOutputs = pColumns->nOutputs, nPixel = nFrom;
+	const INT32* pFirst = pColumns->pFirst;
+	const float* pWeight = pColumns->pWeight;
+
+#ifdef ED_USE_SSE2
+	__m128 vMax = _mm_set1_ps(dMaxPixVal);
+
+	for (; nPixel + 4 <= nTo; nPixel += 4) {								// 4 outputs, one tap at a time
+		const float* pIn0 = pRow + pFirst[nPixel];
+		const float* pIn1 = pRow + pFirst[nPixel + 1];
+		const float* pIn2 = pRow + pFirst[nPixel + 2];
+		const float* pIn3 = pRow + pFirst[nPixel + 3];
+		__m128 vSum = _mm_setzero_ps();
+
+		for (UINT16 tlp = 0; tlp < pColumns->nTaps; tlp++)
+			vSum = _mm_add_ps(vSum, _mm_mul_ps(_mm_loadu_ps(pWeight + (size_t)tlp * nOutputs + nPixel),
+				_mm_set_ps(pIn3[tlp], pIn2[tlp], pIn1[tlp], pIn0[tlp])));
+		_mm_storeu_ps(pScaledRow + nPixel, _mm_min_ps(_mm_max_ps(vSum, _mm_setzero_ps()), vMax));
+	}
+#endif
+	for (; nPixel < nTo; nPixel++) {
+		float dSum = 0.F;
+
+		for (UINT16 tlp = 0; tlp < pColumns->nTaps; tlp++)
+			dSum += pWeight[(size_t)tlp * nOutputs + nPixel] * pRow[pFirst[nPixel] + tlp];
+		pScaledRow[nPixel] = fminf(fmaxf(dSum, 0.F), dMaxPixVal);
+	}
+}
+
+// *********************************************************************************************************************************
+// _ResampleAcrossReplicate() makes the span of a replicating plan: each input pixel, clamped, nFactor times
+//
+static void _ResampleAcrossReplicate(const ResamplePlan* pColumns, const float* pRow, float dMaxPixVal, float* pScaledRow) {
+	UINT32 nFactor = pColumns->nFactor, nPixels = (pColumns->nSpanEnd - pColumns->nSpanFirst) / nFactor, nPixel = 0;
+	const float* pIn = pRow + pColumns->nSpanInput;
+	float* pOut = pScaledRow + pColumns->nSpanFirst;
+
+#ifdef ED_USE_SSE2
+	__m128 vMax = _mm_set1_ps(dMaxPixVal), vZero = _mm_setzero_ps();
+
+	if (nFactor <= 2 || nFactor == 4) {
+		for (; nPixel + 4 <= nPixels; nPixel += 4) {						// 4 input pixels to 4, 8 or 16 outputs
+			__m128 vIn = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(pIn + nPixel), vZero), vMax);
+			float* pTo = pOut + (size_t)nPixel * nFactor;
+
+			if (nFactor == 1)
+				_mm_storeu_ps(pTo, vIn);
+			else if (nFactor == 2) {
+				_mm_storeu_ps(pTo, _mm_unpacklo_ps(vIn, vIn));
+				_mm_storeu_ps(pTo + 4, _mm_unpackhi_ps(vIn, vIn));
+			}
+			else {
+				_mm_storeu_ps(pTo, _mm_shuffle_ps(vIn, vIn, _MM_SHUFFLE(0, 0, 0, 0)));
+				_mm_storeu_ps(pTo + 4, _mm_shuffle_ps(vIn, vIn, _MM_SHUFFLE(1, 1, 1, 1)));
+				_mm_storeu_ps(pTo + 8, _mm_shuffle_ps(vIn, vIn, _MM_SHUFFLE(2, 2, 2, 2)));
+				_mm_storeu_ps(pTo + 12, _mm_shuffle_ps(vIn, vIn, _MM_SHUFFLE(3, 3, 3, 3)));
+			}
+		}
+	}
+#endif
+	for (; nPixel < nPixels; nPixel++) {
+		float dValue = fminf(fmaxf(pIn[nPixel], 0.F), dMaxPixVal);
+		float* pTo = pOut + (size_t)nPixel * nFactor;
+		UINT32 nCopy = 0;
+
+#ifdef ED_USE_SSE2
+		for (; nCopy + 4 <= nFactor; nCopy += 4)
+			_mm_storeu_ps(pTo + nCopy, _mm_set1_ps(dValue));
+#endif
+		for (; nCopy < nFactor; nCopy++)
+			pTo[nCopy] = dValue;
+	}
+}
+
+// *********************************************************************************************************************************
+// _ResampleAcrossPhases() makes the span of a 2x, 3x or 4x two-tap plan: output phase p of input pixel x is dPhaseWeight[0][p]
+//  x pixel x + _ResamplePhaseOffset(p) + dPhaseWeight[1][p] x the pixel after, the same sum the general path does
+// With SSE2 one load covers the pixels 4 outputs read, shuffled into place, and the weights stay in registers
+//
+static void _ResampleAcrossPhases(const ResamplePlan* pColumns, const float* pRow, float dMaxPixVal, float* pScaledRow) {
+	UINT32 nFactor = pColumns->nFactor, nPixels = (pColumns->nSpanEnd - pColumns->nSpanFirst) / nFactor, nPixel = 0;
+	const float* pIn = pRow + pColumns->nSpanInput;							// The span reads pIn[-1] to pIn[nPixels]
+	const float* pWeight0 = pColumns->dPhaseWeight[0];
+	const float* pWeight1 = pColumns->dPhaseWeight[1];
+	float* pOut = pScaledRow + pColumns->nSpanFirst;
+
+#ifdef ED_USE_SSE2
+	__m128 vMax = _mm_set1_ps(dMaxPixVal), vZero = _mm_setzero_ps();
+
+	if (nFactor == 2) {
+		__m128 vWeight0 = _mm_set_ps(pWeight0[1], pWeight0[0], pWeight0[1], pWeight0[0]);
+		__m128 vWeight1 = _mm_set_ps(pWeight1[1], pWeight1[0], pWeight1[1], pWeight1[0]);
+
+		for (; nPixel + 2 <= nPixels; nPixel += 2) {						// Pixels x and x + 1, from x - 1 to x + 2
+			__m128 vIn = _mm_loadu_ps(pIn + nPixel - 1);
+			__m128 vSum = _mm_add_ps(_mm_mul_ps(vWeight0, _mm_shuffle_ps(vIn, vIn, _MM_SHUFFLE(2, 1, 1, 0))),
+				_mm_mul_ps(vWeight1, _mm_shuffle_ps(vIn, vIn, _MM_SHUFFLE(3, 2, 2, 1))));
+
+			_mm_storeu_ps(pOut + (size_t)nPixel * 2, _mm_min_ps(_mm_max_ps(vSum, vZero), vMax));
+		}
+	}
+	else if (nFactor == 3) {
+		__m128 vWeight0[3] = { _mm_set_ps(pWeight0[0], pWeight0[2], pWeight0[1], pWeight0[0]),
+			_mm_set_ps(pWeight0[1], pWeight0[0], pWeight0[2], pWeight0[1]),
+			_mm_set_ps(pWeight0[2], pWeight0[1], pWeight0[0], pWeight0[2]) };
+		__m128 vWeight1[3] = { _mm_set_ps(pWeight1[0], pWeight1[2], pWeight1[1], pWeight1[0]),
+			_mm_set_ps(pWeight1[1], pWeight1[0], pWeight1[2], pWeight1[1]),
+			_mm_set_ps(pWeight1[2], pWeight1[1], pWeight1[0], pWeight1[2]) };
+
+		for (; nPixel + 4 <= nPixels; nPixel += 4) {						// Pixels x to x + 3, from x - 1 to x + 4
+			__m128 vLow = _mm_loadu_ps(pIn + nPixel - 1);
+			__m128 vHigh = _mm_loadu_ps(pIn + nPixel + 1);
+			__m128 vSum[3] = {
+				_mm_add_ps(_mm_mul_ps(vWeight0[0], _mm_shuffle_ps(vLow, vLow, _MM_SHUFFLE(1, 1, 1, 0))),
+					_mm_mul_ps(vWeight1[0], _mm_shuffle_ps(vLow, vLow, _MM_SHUFFLE(2, 2, 2, 1)))),
+				_mm_add_ps(_mm_mul_ps(vWeight0[1], _mm_shuffle_ps(vLow, vLow, _MM_SHUFFLE(3, 2, 2, 2))),
+					_mm_mul_ps(vWeight1[1], _mm_shuffle_ps(vHigh, vHigh, _MM_SHUFFLE(2, 1, 1, 1)))),
+				_mm_add_ps(_mm_mul_ps(vWeight0[2], _mm_shuffle_ps(vHigh, vHigh, _MM_SHUFFLE(2, 2, 1, 1))),
+					_mm_mul_ps(vWeight1[2], _mm_shuffle_ps(vHigh, vHigh, _MM_SHUFFLE(3, 3, 2, 2)))) };
+
+			for (UINT32 vlp = 0; vlp < 3; vlp++)
+				_mm_storeu_ps(pOut + (size_t)nPixel * 3 + vlp * 4, _mm_min_ps(_mm_max_ps(vSum[vlp], vZero), vMax));
+		}
+	}
+	else if (nFactor == 4) {
+		__m128 vWeight0 = _mm_loadu_ps(pWeight0);
+		__m128 vWeight1 = _mm_loadu_ps(pWeight1);
+
+		for (; nPixel + 2 <= nPixels; nPixel++) {							// Pixel x, from x - 1 to x + 2 (x + 2 read, unused)
+			__m128 vIn = _mm_loadu_ps(pIn + nPixel - 1);
+			__m128 vSum = _mm_add_ps(_mm_mul_ps(vWeight0, _mm_shuffle_ps(vIn, vIn, _MM_SHUFFLE(1, 1, 0, 0))),
+				_mm_mul_ps(vWeight1, _mm_shuffle_ps(vIn, vIn, _MM_SHUFFLE(2, 2, 1, 1))));
+
+			_mm_storeu_ps(pOut + (size_t)nPixel * 4, _mm_min_ps(_mm_max_ps(vSum, vZero), vMax));
+		}
+	}
+#endif
+	for (; nPixel < nPixels; nPixel++) {
+		for (UINT32 plp = 0; plp < nFactor; plp++) {
+			const float* pAt = pIn + nPixel + _ResamplePhaseOffset(plp, nFactor);
+
+			pOut[(size_t)nPixel * nFactor + plp] = fminf(fmaxf(pWeight0[plp] * pAt[0] + pWeight1[plp] * pAt[1], 0.F),
+				dMaxPixVal);
+		}
+	}
+}
+
+// *********************************************************************************************************************************
+// _ResampleAcross() is the horizontal pass: pRow (the vertical pass's row) filtered by pColumns into pScaledRow, clamped to
+//  0 - dMaxPixVal (Lanczos rings past the input's range). The plan's span, if it has one, takes the fast path
+//
+void _ResampleAcross(const ResamplePlan* pColumns, const float* pRow, float dMaxPixVal, float* pScaledRow) {
+	if (pColumns->nFactor == 0) {
+		_ResampleAcrossPlan(pColumns, pRow, dMaxPixVal, pScaledRow, 0, pColumns->nOutputs);
+		return;
+	}
+	_ResampleAcrossPlan(pColumns, pRow, dMaxPixVal, pScaledRow, 0, pColumns->nSpanFirst);
+	if (pColumns->bReplicate)
+		_ResampleAcrossReplicate(pColumns, pRow, dMaxPixVal, pScaledRow);
+	else
+		_ResampleAcrossPhases(pColumns, pRow, dMaxPixVal, pScaledRow);
+	_ResampleAcrossPlan(pColumns, pRow, dMaxPixVal, pScaledRow, pColumns->nSpanEnd, pColumns->nOutputs);
+}
+
+// *********************************************************************************************************************************
+// _ResampleClamp() clamps pRow, nWidth pixels, to 0 - dMaxPixVal in place
+//
+static void _ResampleClamp(float* pRow, UINT32 nWidth, float dMaxPixVal) {
+	UINT32 nPixel = 0;
+
+#ifdef ED_USE_SSE2
+	__m128 vMax = _mm_set1_ps(dMaxPixVal), vZero = _mm_setzero_ps();
+
+	for (; nPixel + 4 <= nWidth; nPixel += 4)
+		_mm_storeu_ps(pRow + nPixel, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(pRow + nPixel), vZero), vMax));
+#endif
+	for (; nPixel < nWidth; nPixel++)
+		pRow[nPixel] = fminf(fmaxf(pRow[nPixel], 0.F), dMaxPixVal);
+}
+
+// *********************************************************************************************************************************
+// _ResampleRow() makes scaled row nRow of the band, the two axes scaled independently: the vertical pass by pRows into
+//  pColumnRow (nWidth input pixels), then the horizontal pass by pColumns into pScaledRow. An axis at 1:1 is not filtered;
+//  a copied row is only converted (see _ResampleColumns()), and when every column is copied (same horizontal DPI as the
+//  art) the vertical pass writes pScaledRow itself and there is no horizontal pass, just the clamp it would have made
+//
+void _ResampleRow(const ResampleSource* pSource, const ResamplePlan* pRows, const ResamplePlan* pColumns, UINT32 nRow,
+	UINT32 nWidth, float dMaxPixVal, float* pColumnRow, float* pScaledRow) {
+
+	if (pColumns->nFactor == 1 && pColumns->nSpanFirst == 0 && pColumns->nSpanEnd == pColumns->nOutputs) {
+		_ResampleColumns(pSource, pRows, nRow, nWidth, pScaledRow);
+		_ResampleClamp(pScaledRow, pColumns->nOutputs, dMaxPixVal);
+		return;
+	}
+	_ResampleColumns(pSource, pRows, nRow, nWidth, pColumnRow);
+	_ResampleAcross(pColumns, pColumnRow, dMaxPixVal, pScaledRow);
+}
@@ -0,0 +1,584 @@
+// One print job: the command line (or a spool job descriptor, which uses the same switches) parsed into a SPEEDJob,
+//  then opened, halftoned and written by _RunSPEEDJob()
+// Jobs can borrow a warm halftoning context from a HalftoneContextPool instead of setting one up: contexts are kept
+//  per (kernel, diffusion bit depth, ink channels, DPI, huge pages), so a job that matches an idle context skips the
+//  LUT and buffer setup entirely; the daemon (SpoolDaemon) keeps one pool for its whole life
+
+#define INT8	signed __int8
+#define INT16	signed __int16
+#define INT32	signed __int32
+#define UINT8 	unsigned __int8
+#define UINT16	unsigned __int16
+#define UINT32	unsigned __int32
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#define SPEED_POOL_MAX_IDLE		8											// Idle contexts kept, least recently used go first
+
+typedef struct SPEEDJobSettings {
+	TIFFHeader MyTIFFHeader;												// Input image and print resolution
+	EDParams MyEDParams;													// Kernel and ink setup, channels come from the image
+	int nMaxCores					= 0;									// -p, 0 = every core (the core budget for a daemon)
+	bool bAsyncIO					= false;								// -u, io_uring for input and output (Linux)
+	UINT8 nHugePageMode				= ED_HUGE_PAGES_OFF;					// -l, -lh
+	UINT8 nCompressionMode			= RTL_COMPRESS_ADAPTIVE;				// -m
+	string strLUTDirectory;													// -L, prebuilt LUT cache files (see LUT_Cache)
+	string strCalibrationPath;												// -C, build the LUT cache file from this dot calibration
+	string strColorProfilePath;												// -P, convert the input through this profile (see ColorLUT)
+	string strTransferCurvePath;											// -X, per ink transfer curves (see TransferCurves)
+	string strOutputPath;													// -o, empty or "-" = stdout
+	int nOutputFileDescriptor		= -1;									// -f
+	bool bWriteOutput				= false;								// -o or -f given
+	string strSpoolDirectory;												// -D, run as a daemon watching this directory
+	string strSocketPath;													// -S, run as a daemon listening on this Unix socket
+	int nConcurrentJobs				= 0;									// -j, jobs run at once (daemon, batch), 0 = default
+	string strManifestPath;													// -B, run every job listed in this manifest
+	INT16 nErrorCode				= 0;									// Return error code
+	TCHAR sRetErrDescription[128];											// Return error message
+} SPEEDJob;
+
+typedef struct PooledHalftoneContext {
+	UINT8 nEDKernelType				= 0;									// Key: what the context's LUTs were built for
+	UINT8 nInputBitDepth			= 0;
+	UINT8 nColorChannels			= 0;
+	UINT16 nHorizontalDPI			= 0;
+	UINT16 nVerticalDPI				= 0;
+	UINT8 nHugePageMode				= ED_HUGE_PAGES_OFF;
+	string strLUTDirectory;													// LUT cache the LUTs are mapped from, empty = none
+	bool bInUse						= false;								// Lent to a job
+	UINT32 nLastUsed				= 0;									// Pool clock when last released, for eviction
+	HalftoneContext Context;												// LUTs and buffers, kept warm
+	LUTCache LUTs;															// Mapped LUT cache file, if any
+} PooledContext;
+
+typedef struct HalftoneContextPool {
+	std::mutex Lock;														// Jobs acquire and release from several threads
+	std::vector<PooledContext*> Contexts;									// Every context, idle or lent
+	UINT32 nClock					= 0;									// Ticks once per release
+	UINT32 nWarmStarts				= 0;									// Jobs that got an idle context
+	UINT32 nColdStarts				= 0;									// Jobs that had to set one up
+} ContextPool;
+
+// *********************************************************************************************************************************
+// _SplitJobLine() splits a job descriptor line into switches, like a shell would for simple quoting ("..." or '...')
+//
+void _SplitJobLine(const string& strLine, std::vector<string>& Arguments) {
+	string strArgument;
+	bool bInArgument = false;
+	char cQuote = 0;
+
+	for (char c : strLine) {
+		if (cQuote != 0) {
+			if (c == cQuote)
+				cQuote = 0;
+			else
+				strArgument += c;
+		}
+		else if (c == '"' || c == '\'') {
+			cQuote = c;
+			bInArgument = true;
+		}
+		else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+			if (bInArgument)
+				Arguments.push_back(strArgument);
+			strArgument.clear();
+			bInArgument = false;
+		}
+		else {
+			strArgument += c;
+			bInArgument = true;
+		}
+	}
+	if (bInArgument)
+		Arguments.push_back(strArgument);
+}
+
+// *********************************************************************************************************************************
+// _SwitchValueIn() is the number after a switch, thrown out (std::invalid_argument, see _ParseJobArguments()) if it is not
+//  nLowest to nHighest; for the raw geometry, where a value out of range would be narrowed, not clamped
+//
+int _SwitchValueIn(const string& strArg, int nLowest, int nHighest) {
+	int nValue = stoi(strArg.substr(2));
+
+	if (nValue < nLowest || nValue > nHighest)
+		throw std::invalid_argument(strArg);
+	return nValue;
+}
+
+// *********************************************************************************************************************************
+// _ParseJobArguments() reads the switches of a command line or job descriptor into pJob; unknown switches are ignored
+//
+INT16 _ParseJobArguments(SPEEDJob* pJob, const std::vector<string>& Arguments) {
+	TIFFHeader* MyTIFFHeader = &pJob->MyTIFFHeader;
+
+	for (size_t i = 0; i < Arguments.size(); i++) {
+		const string& strArg = Arguments[i];
+		string strSwitch = strArg.substr(0, 2);
+
+		try {
+			if (strSwitch == "-v") {								// updates Verbose mode
+				MyTIFFHeader->bVerbose = true;
+			}
+			else if (strSwitch == "-x") {							// check constraints and change Horizontal Resolution
+				MyTIFFHeader->nHorizontalDPI = (UINT16)std::clamp(stoi(strArg.substr(2)), 50, 3200);
+			}
+			else if (strSwitch == "-y") {							// check constraints and change Vertical Resolution
+				MyTIFFHeader->nVerticalDPI = (UINT16)std::clamp(stoi(strArg.substr(2)), 50, 3200);
+			}
+			else if (strSwitch == "-s") {							// check constraints and change Page Scaling Percentage
+				MyTIFFHeader->nPageScalingPer = (UINT16)std::clamp(stoi(strArg.substr(2)), 25, 400);
+			}
+			else if (strSwitch == "-O") {							// orientation: turned clockwise -O90, -O180, -O270, m mirrors (-Om, -O90m)
+				string strTurn = strArg.substr(2);
+				MyTIFFHeader->bMirror = (!strTurn.empty() && strTurn.back() == 'm');
+				if (MyTIFFHeader->bMirror)
+					strTurn.pop_back();
+				size_t nDigits = 0;
+				int nDegrees = strTurn.empty() ? 0 : stoi(strTurn, &nDigits);
+				if (nDigits != strTurn.size() || nDegrees < 0 || nDegrees > 270 || nDegrees % 90 != 0)
+					throw std::invalid_argument(strArg);
+				MyTIFFHeader->nQuarterTurns = (UINT8)(nDegrees / 90);
+			}
+			else if (strSwitch == "-p") {							// check constraints and change Max Cores
+				pJob->nMaxCores = std::clamp(stoi(strArg.substr(2)), 1, 512);
+			}
+			else if (strSwitch == "-i") {							// updates filepath for the TIFF file
+				MyTIFFHeader->strInputFile = strArg.substr(2);
+			}
+			else if (strSwitch == "-u") {							// use the io_uring backend for input and output (Linux)
+				pJob->bAsyncIO = true;
+			}
+			else if (strSwitch == "-l") {							// large (2 MB) pages for the halftoning buffers, -l THP, -lh hugetlbfs
+				pJob->nHugePageMode = (strArg.substr(2) == "h") ? ED_HUGE_PAGES_HUGETLB : ED_HUGE_PAGES_THP;
+			}
+			else if (strSwitch == "-r") {							// raw pixel rows from stdin, or from the file/pipe given
+				MyTIFFHeader->bRawStreamInput = true;
+				if (strArg.size() > 2) {
+					MyTIFFHeader->strInputFile = strArg.substr(2);
+				}
+			}
+			else if (strSwitch == "-w") {							// raw input width in pixels (no stream header)
+				MyTIFFHeader->nInputImagePixelWidth = (UINT16)_SwitchValueIn(strArg, 1, 65535);
+				MyTIFFHeader->bRawStreamHeader = false;
+			}
+			else if (strSwitch == "-h") {							// raw input height in pixels
+				MyTIFFHeader->nInputImagePixelHeight = (UINT16)_SwitchValueIn(strArg, 1, 65535);
+				MyTIFFHeader->bRawStreamHeader = false;
+			}
+			else if (strSwitch == "-b") {							// raw input bit depth, 8 or 16
+				MyTIFFHeader->nImageBitDepth = (UINT8)_SwitchValueIn(strArg, 1, 16);
+			}
+			else if (strSwitch == "-c") {							// raw input color channels, 1, 3 or 4
+				MyTIFFHeader->nInputColorChannels = (UINT8)_SwitchValueIn(strArg, 1, 16);
+			}
+			else if (strSwitch == "-d") {							// raw input resolution in DPI
+				MyTIFFHeader->nRawInputDPI = (UINT16)_SwitchValueIn(strArg, 1, 65535);
+			}
+			else if (strSwitch == "-o") {							// stream printer data to stdout (-o or -o-), a file or a pipe
+				pJob->strOutputPath = strArg.substr(2);
+				pJob->bWriteOutput = true;
+			}
+			else if (strSwitch == "-f") {							// stream printer data to an open file descriptor
+				pJob->nOutputFileDescriptor = stoi(strArg.substr(2));
+				pJob->bWriteOutput = true;
+			}
+			else if (strSwitch == "-m") {							// raster compression method 0 .. 3, or -ma adaptive (default)
+				if (strArg.substr(2) == "a") {
+					pJob->nCompressionMode = RTL_COMPRESS_ADAPTIVE;
+				}
+				else {
+					pJob->nCompressionMode = (UINT8)std::clamp(stoi(strArg.substr(2)), 0, 3);
+				}
+			}
+			else if (strSwitch == "-L") {							// map the dot and error LUTs from the LUT cache in this directory
+				pJob->strLUTDirectory = strArg.substr(2);
+			}
+			else if (strSwitch == "-C") {							// build the -L LUT cache file from measured dot densities (see LUT_Builder)
+				pJob->strCalibrationPath = strArg.substr(2);
+			}
+			else if (strSwitch == "-P") {							// color profile: convert the input to its inks through its LUT
+				pJob->strColorProfilePath = strArg.substr(2);
+			}
+			else if (strSwitch == "-X") {							// per ink linearization / limit curves, applied as the input is scaled
+				pJob->strTransferCurvePath = strArg.substr(2);
+			}
+			else if (strSwitch == "-G") {							// RGB input: gray component replacement, 0 .. 100%
+				pJob->MyEDParams.Separation.dGCR = std::clamp(stoi(strArg.substr(2)), 0, 100) / 100.F;
+			}
+			else if (strSwitch == "-U") {							// RGB input: under color removal, 0 .. 100%
+				pJob->MyEDParams.Separation.dUCR = std::clamp(stoi(strArg.substr(2)), 0, 100) / 100.F;
+			}
+			else if (strSwitch == "-T") {							// RGB input: total ink limit, 100 .. 400%
+				pJob->MyEDParams.Separation.dInkLimit = std::clamp(stoi(strArg.substr(2)), 100, 400) / 100.F;
+			}
+			else if (strSwitch == "-R") {							// scaling filter: 0 box, 1 bilinear, 2 Lanczos3, or -Ra auto (default)
+				if (strArg.substr(2) == "a") {
+					pJob->MyEDParams.nResampleFilter = RESAMPLE_AUTO;
+				}
+				else {
+					pJob->MyEDParams.nResampleFilter = (UINT8)std::clamp(stoi(strArg.substr(2)), 0, 2);
+				}
+			}
+			else if (strSwitch == "-k") {							// error diffusion kernel, 0 .. 16
+				pJob->MyEDParams.nEDKernelType = (UINT8)std::clamp(stoi(strArg.substr(2)), 0, 16);
+			}
+			else if (strSwitch == "-D") {							// daemon: watch this spool directory for *.job descriptors
+				pJob->strSpoolDirectory = strArg.substr(2);
+			}
+			else if (strSwitch == "-S") {							// daemon: accept job descriptors on this Unix socket
+				pJob->strSocketPath = strArg.substr(2);
+			}
+			else if (strSwitch == "-j") {							// daemon or batch: jobs run at once, sharing the -p core budget
+				pJob->nConcurrentJobs = std::clamp(stoi(strArg.substr(2)), 1, 512);
+			}
+			else if (strSwitch == "-B") {							// batch: run every job (one per line) in this manifest, "-" = stdin
+				pJob->strManifestPath = strArg.substr(2);
+			}
+		}
+		catch (const std::exception&) {								// stoi() on a switch with no (or a bad) number
+			pJob->nErrorCode = (-89);
+			swprintf_s(pJob->sRetErrDescription,
+				_countof(pJob->sRetErrDescription),
+				_T("EC(-89) Invalid value for switch %hs!"), strArg.c_str());
+			return pJob->nErrorCode;
+		}
+	}
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _IsProcessStreamPath() is true for a path that names one of this process's own descriptors (/dev/stdout, /dev/fd/3 ...)
+//
+static bool _IsProcessStreamPath(const string& strPath) {
+	return strPath.rfind("/dev/std", 0) == 0 || strPath.rfind("/dev/fd/", 0) == 0 || strPath.rfind("/proc/self/fd/", 0) == 0;
+}
+
+// *********************************************************************************************************************************
+// _CheckJobStreams() refuses a spool or batch job that would use one of the process's own descriptors: stdin (raw input,
+//  -r with no path), stdout (-o, -o-), or any descriptor given with -f. Those are shared by every job of the process (in the
+//  daemon also its listen socket, inotify, LUT mappings and client connections), so such a job reads and writes named files
+//
+INT16 _CheckJobStreams(SPEEDJob* pJob, const char* sJobKind) {
+	const string& strInput = pJob->MyTIFFHeader.strInputFile;
+	const char* sRefused = NULL;
+
+	if ((pJob->MyTIFFHeader.bRawStreamInput && strInput.empty()) || _IsProcessStreamPath(strInput))
+		sRefused = "stdin, give -r a path";
+	else if (pJob->nOutputFileDescriptor >= 0)
+		sRefused = "-f, give -o a path";
+	else if (pJob->bWriteOutput && (pJob->strOutputPath.empty() || pJob->strOutputPath == "-" ||
+		_IsProcessStreamPath(pJob->strOutputPath)))
+		sRefused = "stdout, give -o a path";
+
+	if (sRefused != NULL) {
+		pJob->nErrorCode = (-88);
+		swprintf_s(pJob->sRetErrDescription,
+			_countof(pJob->sRetErrDescription),
+			_T("EC(-88) %hs jobs cannot use %hs!"), sJobKind, sRefused);
+		return pJob->nErrorCode;
+	}
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _MapJobLUTs() maps the LUT cache file for the context's kernel, bit depth, dot levels and inks, and points its ink LUTs at it
+//
+INT16 _MapJobLUTs(HalftoneContext* pContext, LUTCache* pLUTs, const string& strLUTDirectory, TCHAR* sRetErrDescription,
+	size_t nErrDescriptionSize) {
+
+	string strPath = _LUTCachePath(strLUTDirectory, &pContext->Params, pContext->Params.nColorChannels);
+
+	if (_MapLUTCache(pLUTs, strPath.c_str(), &pContext->Params) != 0) {
+		swprintf_s(sRetErrDescription, nErrDescriptionSize, _T("%ls"), pLUTs->sRetErrDescription);
+		return pLUTs->nErrorCode;
+	}
+	_AttachLUTCache(pLUTs, &pContext->Params);
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _AcquireHalftoneContext() lends out an idle context set up for the same key, or sets up a new one (outside the lock)
+// On failure, the error is copied to sRetErrDescription and NULL is returned in *ppContext
+//
+INT16 _AcquireHalftoneContext(
+	ContextPool* pPool,														// Pool shared by every job of the process
+	const EDParams* pParams,												// ED parameters of the job (kernel, channels ...)
+	UINT16 nHorizontalDPI,													// Print resolution of the job
+	UINT16 nVerticalDPI,
+	UINT8 nHugePageMode,													// ED_HUGE_PAGES_...
+	const string& strLUTDirectory,											// LUT cache directory, empty = LUTs in the context
+	int nThreads,															// Cores the job may use
+	HalftoneContext** ppContext,											// Context lent to the job
+	TCHAR* sRetErrDescription,												// Error message, if no context could be set up
+	size_t nErrDescriptionSize) {
+
+	PooledContext* pPooled = NULL;
+
+	*ppContext = NULL;
+	{
+		std::lock_guard<std::mutex> PoolLock(pPool->Lock);
+
+		for (PooledContext* pCandidate : pPool->Contexts) {
+			if (!pCandidate->bInUse && pCandidate->nEDKernelType == pParams->nEDKernelType &&
+				pCandidate->nInputBitDepth == pParams->nInputBitDepth &&
+				pCandidate->nColorChannels == pParams->nColorChannels &&
+				pCandidate->nHorizontalDPI == nHorizontalDPI && pCandidate->nVerticalDPI == nVerticalDPI &&
+				pCandidate->nHugePageMode == nHugePageMode && pCandidate->strLUTDirectory == strLUTDirectory) {
+				pCandidate->bInUse = true;
+				pCandidate->Context.nThreads = max(nThreads, 1);
+				pCandidate->Context.Params.bInputImageIsRGB = pParams->bInputImageIsRGB;	// per job, not part of the key
+				pCandidate->Context.Params.Separation = pParams->Separation;
+				pCandidate->Context.Params.Decode = pParams->Decode;
+				pCandidate->Context.Params.nResampleFilter = pParams->nResampleFilter;
+				pCandidate->Context.Params.pColorLUT = pParams->pColorLUT;
+				pCandidate->Context.Params.pTransferCurves = pParams->pTransferCurves;
+				memcpy(pCandidate->Context.Params.nInkOrder, pParams->nInkOrder, sizeof(pParams->nInkOrder));
+				pPool->nWarmStarts++;
+				*ppContext = &pCandidate->Context;
+				return 0;
+			}
+		}
+		pPooled = new PooledContext;										// Cold start, reserved before it is set up
+		pPooled->nEDKernelType = pParams->nEDKernelType;
+		pPooled->nInputBitDepth = pParams->nInputBitDepth;
+		pPooled->nColorChannels = pParams->nColorChannels;
+		pPooled->nHorizontalDPI = nHorizontalDPI;
+		pPooled->nVerticalDPI = nVerticalDPI;
+		pPooled->nHugePageMode = nHugePageMode;
+		pPooled->strLUTDirectory = strLUTDirectory;
+		pPooled->bInUse = true;
+		pPooled->Context.Arena.nHugePageMode = nHugePageMode;
+		pPool->Contexts.push_back(pPooled);
+		pPool->nColdStarts++;
+	}
+	INT16 nErrorCode = _InitHalftoneContext(&pPooled->Context, pParams, nThreads);
+
+	if (nErrorCode != 0)
+		swprintf_s(sRetErrDescription, nErrDescriptionSize, _T("%ls"), pPooled->Context.Params.sRetErrDescription);
+	else if (!strLUTDirectory.empty())
+		nErrorCode = _MapJobLUTs(&pPooled->Context, &pPooled->LUTs, strLUTDirectory, sRetErrDescription, nErrDescriptionSize);
+	if (nErrorCode != 0) {
+		std::lock_guard<std::mutex> PoolLock(pPool->Lock);
+
+		pPool->Contexts.erase(std::find(pPool->Contexts.begin(), pPool->Contexts.end(), pPooled));
+		_FreeHalftoneContext(&pPooled->Context);
+		_UnmapLUTCache(&pPooled->LUTs);
+		delete pPooled;
+		return nErrorCode;
+	}
+	*ppContext = &pPooled->Context;
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _ReleaseHalftoneContext() hands a context back; beyond SPEED_POOL_MAX_IDLE idle contexts, the least recently used is freed
+// The pointers the job lent the context (profile LUT, transfer curves, and the page's transfer LUTs) are dropped with it,
+//  so an idle context never points at a job's freed data
+//
+void _ReleaseHalftoneContext(ContextPool* pPool, HalftoneContext* pContext) {
+	std::lock_guard<std::mutex> PoolLock(pPool->Lock);
+	PooledContext* pOldest = NULL;
+	UINT32 nIdle = 0;
+
+	pContext->Params.pColorLUT = NULL;									// Per job, see _AcquireHalftoneContext()
+	pContext->Params.pTransferCurves = NULL;
+	memset(pContext->Params.pTransferLUT, 0, sizeof(pContext->Params.pTransferLUT));
+	for (PooledContext* pPooled : pPool->Contexts) {
+		if (&pPooled->Context == pContext) {
+			pPooled->bInUse = false;
+			pPooled->nLastUsed = ++pPool->nClock;
+		}
+	}
+	for (PooledContext* pPooled : pPool->Contexts) {
+		if (!pPooled->bInUse) {
+			nIdle++;
+			if (pOldest == NULL || pPooled->nLastUsed < pOldest->nLastUsed)
+				pOldest = pPooled;
+		}
+	}
+	if (nIdle > SPEED_POOL_MAX_IDLE) {
+		pPool->Contexts.erase(std::find(pPool->Contexts.begin(), pPool->Contexts.end(), pOldest));
+		_FreeHalftoneContext(&pOldest->Context);
+		_UnmapLUTCache(&pOldest->LUTs);
+		delete pOldest;
+	}
+}
+
+// *********************************************************************************************************************************
+// _FreeContextPool() frees every context; none may still be lent out
+//
+void _FreeContextPool(ContextPool* pPool) {
+	std::lock_guard<std::mutex> PoolLock(pPool->Lock);
+
+	for (PooledContext* pPooled : pPool->Contexts) {
+		_FreeHalftoneContext(&pPooled->Context);
+		_UnmapLUTCache(&pPooled->LUTs);
+		delete pPooled;
+	}
+	pPool->Contexts.clear();
+}
+
+// *********************************************************************************************************************************
+// _RunSPEEDJob() opens the input, halftones it and writes the printer data; pPool = NULL sets up a context just for this job
+// Errors are returned, and described in pJob->sRetErrDescription; verbose statistics go to stderr
+//
+INT16 _RunSPEEDJob(SPEEDJob* pJob, ContextPool* pPool) {
+	TIFFHeader* MyTIFFHeader = &pJob->MyTIFFHeader;
+	EDParams* MyEDParams = &pJob->MyEDParams;
+	AsyncIO MyAsyncIO;
+	AsyncIO MyWriterAsyncIO;
+	RTLWriter MyRTLWriter;
+	HalftoneContext LocalContext;
+	HalftoneContext* pContext = &LocalContext;
+	LUTCache LocalLUTs;
+	ColorLUT JobColorLUT;
+	TransferCurves JobTransferCurves;
+
+	if (pJob->nMaxCores == 0) {												// -p not given, so use every core
+		pJob->nMaxCores = omp_get_max_threads();
+	}
+	MyTIFFHeader->nMaxThreads = pJob->nMaxCores;							// tiles are decoded within the same budget
+	if (pJob->bAsyncIO) {
+		if (_AsyncIOInit(&MyAsyncIO, 16, 4 << 20) == 0) {					// 16 x 4 MB band buffer pool, for the reader
+			MyTIFFHeader->pAsyncIO = &MyAsyncIO;
+		}
+		else {																// not fatal, stay on blocking I/O, but -u
+			std::wcerr << MyAsyncIO.sRetErrDescription << " -u falls back to blocking I/O" << std::endl;	//  asked for it, say so
+		}
+	}
+	MyRTLWriter.nCompressionMode = pJob->nCompressionMode;
+
+	INT16 getImageDimensions = MyTIFFHeader->bRawStreamInput ?				// raw stream, or open TIFF file and get the dimensions
+		_OpenRawInputStream(MyTIFFHeader) : _GetInputImageDimensions(MyTIFFHeader);
+
+	if (getImageDimensions != 0) {
+		pJob->nErrorCode = getImageDimensions;
+		swprintf_s(pJob->sRetErrDescription, _countof(pJob->sRetErrDescription), _T("%ls"),
+			MyTIFFHeader->sRetErrDescription);
+		_CloseInputImage(MyTIFFHeader);
+		_AsyncIOClose(&MyAsyncIO);
+		return pJob->nErrorCode;
+	}
+
+	MyEDParams->bInputImageIsRGB = MyTIFFHeader->bInputImageIsRGB;		// separated to CMYK band by band, see ColorSeparation
+	MyEDParams->Decode = ColorDecode();
+	if (!MyTIFFHeader->bInputImageIsRGB) {
+		MyEDParams->nColorChannels = MyTIFFHeader->nInputColorChannels;
+	}
+	else {																	// Lab and YCbCr are decoded to RGB on the way
+		MyEDParams->nColorChannels = 4;										//  and separated to CMYK
+		_SetColorDecode(&MyEDParams->Decode, MyTIFFHeader->nPhotometric, MyTIFFHeader->dYCbCrCoefficients,
+			MyTIFFHeader->dReferenceBlackWhite);
+	}
+	if (!pJob->strColorProfilePath.empty()) {								// the profile's inks are printed, compiled once per profile
+		if (_OpenColorLUT(&JobColorLUT, pJob->strColorProfilePath.c_str(), pJob->strLUTDirectory) != 0) {
+			pJob->nErrorCode = JobColorLUT.nErrorCode;
+			swprintf_s(pJob->sRetErrDescription, _countof(pJob->sRetErrDescription), _T("%ls"),
+				JobColorLUT.sRetErrDescription);
+			_CloseInputImage(MyTIFFHeader);
+			_AsyncIOClose(&MyAsyncIO);
+			return pJob->nErrorCode;
+		}
+		MyEDParams->pColorLUT = &JobColorLUT;
+		MyEDParams->nColorChannels = JobColorLUT.nOutputs;
+	}
+	_DefaultInkOrder(MyEDParams);											// KCMY planes, gray input prints on the K plane alone
+	if (!pJob->strTransferCurvePath.empty()) {								// one curve per printed ink, built into LUTs per page
+		if (_ReadTransferCurves(&JobTransferCurves, pJob->strTransferCurvePath.c_str()) != 0) {
+			pJob->nErrorCode = JobTransferCurves.nErrorCode;
+			swprintf_s(pJob->sRetErrDescription, _countof(pJob->sRetErrDescription), _T("%ls"),
+				JobTransferCurves.sRetErrDescription);
+			MyEDParams->pColorLUT = NULL;
+			_UnmapColorLUT(&JobColorLUT);
+			_CloseInputImage(MyTIFFHeader);
+			_AsyncIOClose(&MyAsyncIO);
+			return pJob->nErrorCode;
+		}
+		MyEDParams->pTransferCurves = &JobTransferCurves;
+	}
+
+	if (pPool != NULL)														// a warm context if one matches, LUTs and buffers ready
+		pJob->nErrorCode = _AcquireHalftoneContext(pPool, MyEDParams, MyTIFFHeader->nHorizontalDPI,
+			MyTIFFHeader->nVerticalDPI, pJob->nHugePageMode, pJob->strLUTDirectory, pJob->nMaxCores, &pContext,
+			pJob->sRetErrDescription, _countof(pJob->sRetErrDescription));
+	else {
+		LocalContext.Arena.nHugePageMode = pJob->nHugePageMode;
+		pJob->nErrorCode = _InitHalftoneContext(&LocalContext, MyEDParams, pJob->nMaxCores);
+		if (pJob->nErrorCode != 0)
+			swprintf_s(pJob->sRetErrDescription, _countof(pJob->sRetErrDescription), _T("%ls"),
+				LocalContext.Params.sRetErrDescription);
+		else if (!pJob->strLUTDirectory.empty())							// LUTs straight from the page cache
+			pJob->nErrorCode = _MapJobLUTs(&LocalContext, &LocalLUTs, pJob->strLUTDirectory,
+				pJob->sRetErrDescription, _countof(pJob->sRetErrDescription));
+	}
+	if (pJob->nErrorCode != 0) {
+		_FreeHalftoneContext(&LocalContext);
+		_UnmapLUTCache(&LocalLUTs);
+		MyEDParams->pColorLUT = NULL;
+		MyEDParams->pTransferCurves = NULL;
+		_UnmapColorLUT(&JobColorLUT);
+		_CloseInputImage(MyTIFFHeader);
+		_AsyncIOClose(&MyAsyncIO);
+		return pJob->nErrorCode;
+	}
+
+	if (pJob->bWriteOutput && MyTIFFHeader->pAsyncIO != NULL) {			// the writer thread gets a ring of its own (8 x 4 MB),
+		if (_AsyncIOInit(&MyWriterAsyncIO, 8, 4 << 20) != 0 && MyTIFFHeader->bVerbose)	//  a ring is never driven from two threads
+			std::wcerr << MyWriterAsyncIO.sRetErrDescription << std::endl;
+	}
+	if (pJob->bWriteOutput &&
+		_OpenRTLOutput(&MyRTLWriter, pJob->strOutputPath, pJob->nOutputFileDescriptor, &MyWriterAsyncIO) != 0) {
+		pJob->nErrorCode = MyRTLWriter.nErrorCode;
+		swprintf_s(pJob->sRetErrDescription, _countof(pJob->sRetErrDescription), _T("%ls"),
+			MyRTLWriter.sRetErrDescription);
+	}
+	else {
+		pJob->nErrorCode = GenerateRTLData(pContext, MyTIFFHeader, pJob->bWriteOutput ? &MyRTLWriter : NULL);
+
+		if (pJob->bWriteOutput && MyRTLWriter.nErrorCode != 0) {			// the writer stage failed
+			pJob->nErrorCode = MyRTLWriter.nErrorCode;
+			swprintf_s(pJob->sRetErrDescription, _countof(pJob->sRetErrDescription), _T("%ls"),
+				MyRTLWriter.sRetErrDescription);
+		}
+		else if (pJob->nErrorCode != 0 && MyTIFFHeader->nErrorCode != 0) {	// the band reader failed
+			swprintf_s(pJob->sRetErrDescription, _countof(pJob->sRetErrDescription), _T("%ls"),
+				MyTIFFHeader->sRetErrDescription);
+		}
+		else if (pJob->nErrorCode != 0) {									// the halftoner's own reason
+			swprintf_s(pJob->sRetErrDescription, _countof(pJob->sRetErrDescription), _T("%ls"),
+				pContext->Params.sRetErrDescription);
+		}
+		else if (pJob->bWriteOutput && MyTIFFHeader->bVerbose && MyRTLWriter.nRawBytes > 0) {	// compression achieved
+			std::wcerr << "Raster data " << MyRTLWriter.nEncodedBytes << " of " << MyRTLWriter.nRawBytes << " bytes ("
+				<< (100 * MyRTLWriter.nEncodedBytes / MyRTLWriter.nRawBytes) << "%), " << MyRTLWriter.nRowsSkipped
+				<< " blank rows skipped" << std::endl;
+		}
+	}
+
+	if (MyTIFFHeader->bVerbose && pContext->ConversionStats.nPixels > 0) {	// how much of the color conversion was repeats
+		const SeparationStats* pStats = &pContext->ConversionStats;
+		std::wcerr << "Color conversion " << pStats->nPixels << " pixels, " << (100 * pStats->nRunHits / pStats->nPixels)
+			<< "% runs, " << (100 * pStats->nCacheHits / pStats->nPixels) << "% cache hits" << std::endl;
+	}
+	if (MyTIFFHeader->bVerbose && pContext->Arena.nHugePageMode != ED_HUGE_PAGES_OFF) {	// did the huge page backing take effect?
+		std::wcerr << "Huge pages " << (_HalftoneArenaHugePageBytes(&pContext->Arena) >> 20) << " of "
+			<< (pContext->Arena.nSlabSize >> 20) << " MB" << (pContext->Arena.nHugePageBacking == ED_HUGE_PAGES_HUGETLB ?
+			" (hugetlbfs)" : pContext->Arena.nHugePageBacking == ED_HUGE_PAGES_THP ? " (THP)" : " (not available)") << std::endl;
+	}
+	if (pContext != &LocalContext)
+		_ReleaseHalftoneContext(pPool, pContext);
+	_FreeHalftoneContext(&LocalContext);
+	_UnmapLUTCache(&LocalLUTs);
+	MyEDParams->pColorLUT = NULL;
+	MyEDParams->pTransferCurves = NULL;
+	_UnmapColorLUT(&JobColorLUT);
+	_CloseRTLOutput(&MyRTLWriter);
+	_AsyncIOClose(&MyWriterAsyncIO);
+	_CloseInputImage(MyTIFFHeader);
+	_AsyncIOClose(&MyAsyncIO);
+
+	return pJob->nErrorCode;
+}
@@ -0,0 +1,426 @@
+// Spool daemon: one long-running SPEEDLib process that takes print jobs from a spool directory and/or a Unix domain socket
+// A job descriptor is one line of the usual command line switches (e.g. -i/spool/in/label.tif -o/spool/out/label.prn -x600)
+//  - spool directory (-D): each *.job file holds one descriptor; it is claimed by renaming it to *.job.work, and renamed to
+//    *.job.done or *.job.failed when the job finishes, with the result line appended
+//    Writers must create the file under another name (label.job.tmp, or elsewhere on the same filesystem) and rename() it
+//    to *.job once it is complete: a *.job name means a finished descriptor, the daemon claims it as soon as it sees it
+//  - Unix socket (-S): a client writes one descriptor per line and reads back one result line per job, in completion
+//    order: "0 <job line>" or "EC(-nn) <description>"
+// Up to nConcurrentJobs jobs run at once, each with an equal share of the -p core budget (or less, if its own -p says so)
+// Jobs borrow warm halftoning contexts from the daemon's ContextPool, so a job that matches an earlier one sets up nothing
+// Jobs read and write paths only (-i, -r<path>, -o<path>): job lines that read stdin, write stdout (-o, -o-) or write an
+//  inherited descriptor (-f) are refused, in the daemon those are its own streams, sockets and mappings
+// SIGINT or SIGTERM stops the daemon after the running jobs finish: client sockets are shut down for reading, so no new jobs
+//  come in, their reader threads joined, and the jobs already queued still answer
+
+#define INT8	signed __int8
+#define INT16	signed __int16
+#define INT32	signed __int32
+#define UINT8 	unsigned __int8
+#define UINT16	unsigned __int16
+#define UINT32	unsigned __int32
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <signal.h>
+#include <thread>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#endif
+
+#define SPOOL_RESCAN_MS			1000										// Spool directory rescan, where there is no inotify
+#define SPOOL_MAX_LINE			4096										// Longest job descriptor accepted
+
+typedef struct SpoolConnection {											// One socket client, closed when its last job is done
+	int nSocket						= -1;
+	std::mutex WriteLock;													// Workers reply on the same socket
+	std::atomic<bool> bReaderDone	= false;								// The client closed its end, or sent junk
+	~SpoolConnection() {
+#ifndef _WIN32
+		if (nSocket >= 0)
+			close(nSocket);
+#endif
+	}
+} SpoolConn;
+
+typedef struct SpoolClientEntry {
+	std::shared_ptr<SpoolConn> pConnection;									// Shut down for reading when the daemon stops
+	std::thread Reader;														// Its _SpoolConnectionReader(), joined when done
+} SpoolClient;
+
+typedef struct SpoolJobEntry {
+	string strJobLine;														// Switches of the job
+	string strJobFile;														// Claimed *.job.work file, spool directory jobs only
+	std::shared_ptr<SpoolConn> pConnection;									// Client to answer, socket jobs only
+} SpoolJob;
+
+typedef struct SpoolDaemonState {
+	string strSpoolDirectory;												// -D, empty = no spool directory
+	string strSocketPath;													// -S, empty = no socket
+	int nCoreBudget					= 1;									// Cores shared by all running jobs (-p)
+	int nConcurrentJobs				= 1;									// Jobs run at once (-j)
+	bool bVerbose					= false;								// Log every job to stderr
+	ContextPool Pool;														// Warm halftoning contexts
+	std::mutex QueueLock;
+	std::condition_variable QueueReady;
+	std::deque<SpoolJob> Queue;												// Jobs waiting for a worker
+	int nListenSocket				= -1;
+	UINT32 nJobsDone				= 0;
+	UINT32 nJobsFailed				= 0;
+	INT16 nErrorCode				= 0;									// Return error code
+	TCHAR sRetErrDescription[128];											// Return error message
+} SpoolDaemon;
+
+static volatile sig_atomic_t bSpoolStop = 0;								// Set by SIGINT / SIGTERM
+
+#ifndef _WIN32
+
+static void _SpoolSignal(int /* nSignal */) {
+	bSpoolStop = 1;
+}
+
+// *********************************************************************************************************************************
+// _QueueSpoolJob() hands a job to the workers
+//
+void _QueueSpoolJob(SpoolDaemon* pDaemon, SpoolJob&& Job) {
+	{
+		std::lock_guard<std::mutex> QueueLock(pDaemon->QueueLock);
+		pDaemon->Queue.push_back(std::move(Job));
+	}
+	pDaemon->QueueReady.notify_one();
+}
+
+// *********************************************************************************************************************************
+// _ReportSpoolJob() answers a socket client, or renames the claimed job file to *.done / *.failed with the result appended
+//
+void _ReportSpoolJob(SpoolDaemon* pDaemon, SpoolJob* pJob, INT16 nErrorCode, const TCHAR* sDescription) {
+	char sResult[SPOOL_MAX_LINE + 160];
+
+	if (nErrorCode == 0)
+		snprintf(sResult, sizeof(sResult), "0 %s\n", pJob->strJobLine.c_str());
+	else
+		snprintf(sResult, sizeof(sResult), "%ls\n", sDescription);
+
+	if (pJob->pConnection != NULL) {
+		std::lock_guard<std::mutex> WriteLock(pJob->pConnection->WriteLock);
+		size_t nWritten = 0, nLength = strlen(sResult);
+
+		while (nWritten < nLength) {										// A client that went away just loses the answer
+			ssize_t nResult = send(pJob->pConnection->nSocket, sResult + nWritten, nLength - nWritten, MSG_NOSIGNAL);
+			if (nResult <= 0)
+				break;
+			nWritten += (size_t)nResult;
+		}
+	}
+	if (!pJob->strJobFile.empty()) {
+		string strFinished = pJob->strJobFile.substr(0, pJob->strJobFile.size() - 5) + (nErrorCode == 0 ? ".done" : ".failed");
+		FILE* pFile = fopen(pJob->strJobFile.c_str(), "a");
+
+		if (pFile != NULL) {
+			fputs(sResult, pFile);
+			fclose(pFile);
+		}
+		rename(pJob->strJobFile.c_str(), strFinished.c_str());
+	}
+	if (pDaemon->bVerbose)
+		std::wcerr << (nErrorCode == 0 ? "Done: " : "Failed: ") << sResult;
+}
+
+// *********************************************************************************************************************************
+// _SpoolWorker() runs queued jobs until the daemon stops and the queue is empty
+//
+void _SpoolWorker(SpoolDaemon* pDaemon) {
+	int nJobCores = max(pDaemon->nCoreBudget / pDaemon->nConcurrentJobs, 1);
+
+	for (;;) {
+		SpoolJob Job;
+		{
+			std::unique_lock<std::mutex> QueueLock(pDaemon->QueueLock);
+			pDaemon->QueueReady.wait(QueueLock, [pDaemon] { return !pDaemon->Queue.empty() || bSpoolStop; });
+			if (pDaemon->Queue.empty())
+				return;
+			Job = std::move(pDaemon->Queue.front());
+			pDaemon->Queue.pop_front();
+		}
+		std::unique_ptr<SPEEDJob> pJob(new SPEEDJob);
+		std::vector<string> Arguments;
+
+		_SplitJobLine(Job.strJobLine, Arguments);
+		if (_ParseJobArguments(pJob.get(), Arguments) == 0 && _CheckJobStreams(pJob.get(), "Spool") == 0) {
+			pJob->nMaxCores = (pJob->nMaxCores > 0) ? min(pJob->nMaxCores, nJobCores) : nJobCores;
+			_RunSPEEDJob(pJob.get(), &pDaemon->Pool);
+		}
+		_ReportSpoolJob(pDaemon, &Job, pJob->nErrorCode, pJob->sRetErrDescription);
+		{
+			std::lock_guard<std::mutex> QueueLock(pDaemon->QueueLock);
+			if (pJob->nErrorCode == 0)
+				pDaemon->nJobsDone++;
+			else
+				pDaemon->nJobsFailed++;
+		}
+	}
+}
+
+// *********************************************************************************************************************************
+// _ClaimSpoolFile() claims one *.job file of the spool directory and queues its job (rename is atomic, so two daemons never
+//  share a job); names that do not end in .job are ignored, that is where writers keep the files they are still writing
+//
+void _ClaimSpoolFile(SpoolDaemon* pDaemon, const string& strName) {
+	if (strName.size() <= 4 || strName.compare(strName.size() - 4, 4, ".job") != 0)
+		return;
+
+	string strJobFile = pDaemon->strSpoolDirectory + "/" + strName;
+	string strWorkFile = strJobFile + ".work";
+
+	if (rename(strJobFile.c_str(), strWorkFile.c_str()) != 0)
+		return;																// Another daemon got it first
+
+	SpoolJob Job;
+	char sLine[SPOOL_MAX_LINE] = "";
+	FILE* pFile = fopen(strWorkFile.c_str(), "r");
+
+	if (pFile != NULL) {
+		if (fgets(sLine, sizeof(sLine), pFile) == NULL)
+			sLine[0] = 0;
+		fclose(pFile);
+	}
+	Job.strJobLine = sLine;
+	while (!Job.strJobLine.empty() && (Job.strJobLine.back() == '\n' || Job.strJobLine.back() == '\r'))
+		Job.strJobLine.pop_back();
+	Job.strJobFile = strWorkFile;
+	_QueueSpoolJob(pDaemon, std::move(Job));
+}
+
+// *********************************************************************************************************************************
+// _ScanSpoolDirectory() claims every *.job file in the spool directory: at startup, after an inotify queue overflow, and
+//  on every rescan where there is no inotify
+//
+void _ScanSpoolDirectory(SpoolDaemon* pDaemon) {
+	DIR* pDirectory = opendir(pDaemon->strSpoolDirectory.c_str());
+	struct dirent* pEntry;
+
+	if (pDirectory == NULL)
+		return;
+	while ((pEntry = readdir(pDirectory)) != NULL)
+		_ClaimSpoolFile(pDaemon, pEntry->d_name);
+	closedir(pDirectory);
+}
+
+// *********************************************************************************************************************************
+// _SpoolConnectionReader() queues every line a socket client sends, until it closes its end (or the daemon shuts it down)
+//
+void _SpoolConnectionReader(SpoolDaemon* pDaemon, std::shared_ptr<SpoolConn> pConnection) {
+	string strPending;
+	char sBuffer[4096];
+	ssize_t nRead;
+
+	while ((nRead = recv(pConnection->nSocket, sBuffer, sizeof(sBuffer), 0)) > 0) {
+		strPending.append(sBuffer, (size_t)nRead);
+
+		size_t nEnd;
+		while ((nEnd = strPending.find('\n')) != string::npos) {
+			SpoolJob Job;
+
+			Job.strJobLine = strPending.substr(0, nEnd);
+			strPending.erase(0, nEnd + 1);
+			if (!Job.strJobLine.empty() && Job.strJobLine.back() == '\r')
+				Job.strJobLine.pop_back();
+			if (Job.strJobLine.empty())
+				continue;
+			Job.pConnection = pConnection;
+			_QueueSpoolJob(pDaemon, std::move(Job));
+		}
+		if (strPending.size() > SPOOL_MAX_LINE)								// No newline in sight, not a job descriptor
+			break;
+	}
+	shutdown(pConnection->nSocket, SHUT_RD);
+	pConnection->bReaderDone = true;
+}
+
+// *********************************************************************************************************************************
+// _OpenSpoolSocket() binds and listens on the Unix socket (a stale socket file from an earlier run is replaced); the socket
+//  is created mode 0600, so only the daemon's own user (and root) may connect and have jobs run with the daemon's rights
+//
+INT16 _OpenSpoolSocket(SpoolDaemon* pDaemon) {
+	struct sockaddr_un Address = {};
+
+	if (pDaemon->strSocketPath.size() >= sizeof(Address.sun_path) ||
+		(pDaemon->nListenSocket = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		pDaemon->nErrorCode = (-88);
+		swprintf_s(pDaemon->sRetErrDescription,
+			_countof(pDaemon->sRetErrDescription),
+			_T("EC(-88) Failed to create spool socket %hs!"), pDaemon->strSocketPath.c_str());
+		return pDaemon->nErrorCode;
+	}
+	Address.sun_family = AF_UNIX;
+	memcpy(Address.sun_path, pDaemon->strSocketPath.c_str(), pDaemon->strSocketPath.size());
+	unlink(pDaemon->strSocketPath.c_str());
+
+	mode_t nMask = umask(0177);												// No window where others can connect
+	int nBound = bind(pDaemon->nListenSocket, (struct sockaddr*)&Address, sizeof(Address));
+	umask(nMask);
+
+	if (nBound != 0 || chmod(pDaemon->strSocketPath.c_str(), 0600) != 0 ||
+		listen(pDaemon->nListenSocket, 64) != 0) {
+		close(pDaemon->nListenSocket);
+		pDaemon->nListenSocket = -1;
+		pDaemon->nErrorCode = (-88);
+		swprintf_s(pDaemon->sRetErrDescription,
+			_countof(pDaemon->sRetErrDescription),
+			_T("EC(-88) Failed to listen on spool socket %hs!"), pDaemon->strSocketPath.c_str());
+		return pDaemon->nErrorCode;
+	}
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _RunSpoolDaemon() runs until SIGINT / SIGTERM: waits on the socket and the spool directory (inotify on Linux, plus a
+//  periodic rescan) and feeds the workers; returns once the queue has drained and every context is freed
+//
+INT16 _RunSpoolDaemon(SpoolDaemon* pDaemon) {
+	std::vector<std::thread> Workers;
+	std::vector<SpoolClient> Clients;										// Socket clients, until their reader is done
+	int nNotify = -1;
+
+	if (!pDaemon->strSpoolDirectory.empty()) {
+		DIR* pDirectory = opendir(pDaemon->strSpoolDirectory.c_str());
+		if (pDirectory == NULL) {
+			pDaemon->nErrorCode = (-88);
+			swprintf_s(pDaemon->sRetErrDescription,
+				_countof(pDaemon->sRetErrDescription),
+				_T("EC(-88) Failed to open spool directory %hs!"), pDaemon->strSpoolDirectory.c_str());
+			return pDaemon->nErrorCode;
+		}
+		closedir(pDirectory);
+#ifdef __linux__
+		nNotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);					// Wake up as soon as a job file is renamed in
+		if (nNotify >= 0 && inotify_add_watch(nNotify, pDaemon->strSpoolDirectory.c_str(), IN_MOVED_TO) < 0) {
+			close(nNotify);
+			nNotify = -1;
+		}
+#endif
+	}
+	if (!pDaemon->strSocketPath.empty() && _OpenSpoolSocket(pDaemon) != 0) {
+		if (nNotify >= 0)
+			close(nNotify);
+		return pDaemon->nErrorCode;
+	}
+	signal(SIGINT, _SpoolSignal);
+	signal(SIGTERM, _SpoolSignal);
+	signal(SIGPIPE, SIG_IGN);
+
+	for (int wlp = 0; wlp < pDaemon->nConcurrentJobs; wlp++)
+		Workers.emplace_back(_SpoolWorker, pDaemon);
+
+	if (pDaemon->bVerbose)
+		std::wcerr << "Spool daemon: " << pDaemon->nConcurrentJobs << " jobs x "
+			<< max(pDaemon->nCoreBudget / pDaemon->nConcurrentJobs, 1) << " cores" << std::endl;
+
+	if (!pDaemon->strSpoolDirectory.empty())								// Jobs left over from before we started
+		_ScanSpoolDirectory(pDaemon);
+
+	while (!bSpoolStop) {
+		struct pollfd Waits[2];
+		nfds_t nWaits = 0;
+
+		if (pDaemon->nListenSocket >= 0)
+			Waits[nWaits++] = { pDaemon->nListenSocket, POLLIN, 0 };
+		if (nNotify >= 0)
+			Waits[nWaits++] = { nNotify, POLLIN, 0 };
+
+		int nReady = poll(Waits, nWaits, SPOOL_RESCAN_MS);
+		if (nReady < 0)
+			continue;														// EINTR, the signal has set bSpoolStop
+
+		bool bScan = (nNotify < 0);											// No inotify to tell us, rescan each time
+		for (nfds_t wlp = 0; wlp < nWaits; wlp++) {
+			if (!(Waits[wlp].revents & POLLIN))
+				continue;
+			if (Waits[wlp].fd == nNotify) {
+#ifdef __linux__
+				alignas(struct inotify_event) char sEvents[4096];
+				ssize_t nRead;
+
+				while ((nRead = read(nNotify, sEvents, sizeof(sEvents))) > 0) {
+					for (ssize_t nOffset = 0; nOffset < nRead; ) {
+						const struct inotify_event* pEvent = (const struct inotify_event*)(sEvents + nOffset);
+
+						if (pEvent->mask & IN_Q_OVERFLOW)
+							bScan = true;									// Events were lost, look at everything
+						else if (pEvent->len > 0)
+							_ClaimSpoolFile(pDaemon, pEvent->name);			// Only names renamed into place
+						nOffset += sizeof(struct inotify_event) + pEvent->len;
+					}
+				}
+#endif
+			}
+			else {
+				int nClient = accept(pDaemon->nListenSocket, NULL, NULL);
+				if (nClient >= 0) {
+					SpoolClient Client;
+
+					Client.pConnection = std::make_shared<SpoolConn>();
+					Client.pConnection->nSocket = nClient;
+					Client.Reader = std::thread(_SpoolConnectionReader, pDaemon, Client.pConnection);
+					Clients.push_back(std::move(Client));
+				}
+			}
+		}
+		if (bScan && !pDaemon->strSpoolDirectory.empty())
+			_ScanSpoolDirectory(pDaemon);
+
+		for (size_t clp = 0; clp < Clients.size(); ) {						// Join the readers of clients that are gone
+			if (Clients[clp].pConnection->bReaderDone) {
+				Clients[clp].Reader.join();
+				Clients.erase(Clients.begin() + clp);
+			}
+			else
+				clp++;
+		}
+	}
+
+	for (SpoolClient& Client : Clients)										// No more jobs in: wake every reader up, the
+		shutdown(Client.pConnection->nSocket, SHUT_RD);						//  sockets stay open for the answers
+	for (SpoolClient& Client : Clients)
+		Client.Reader.join();
+	Clients.clear();														// Queued jobs keep their connection alive
+
+	pDaemon->QueueReady.notify_all();										// Workers finish the queue, then return
+	for (std::thread& Worker : Workers)
+		Worker.join();
+
+	if (pDaemon->nListenSocket >= 0) {
+		close(pDaemon->nListenSocket);
+		unlink(pDaemon->strSocketPath.c_str());
+	}
+	if (nNotify >= 0)
+		close(nNotify);
+	if (pDaemon->bVerbose)
+		std::wcerr << "Spool daemon: " << pDaemon->nJobsDone << " jobs done, " << pDaemon->nJobsFailed << " failed, "
+			<< pDaemon->Pool.nWarmStarts << " warm starts, " << pDaemon->Pool.nColdStarts << " cold" << std::endl;
+	_FreeContextPool(&pDaemon->Pool);
+	return 0;
+}
+
+#else
+
+INT16 _RunSpoolDaemon(SpoolDaemon* pDaemon) {
+	pDaemon->nErrorCode = (-88);
+	swprintf_s(pDaemon->sRetErrDescription,
+		_countof(pDaemon->sRetErrDescription),
+		_T("EC(-88) The spool daemon needs a POSIX system!"));
+	return pDaemon->nErrorCode;
+}
+
+#endif
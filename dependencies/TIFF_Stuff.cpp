@@ -51,18 +51,43 @@
 
 #include "../../LibTiff_Win32/source_4.1/tiff.h"							// Header files for LibTIFF
 #include "../../LibTiff_Win32/source_4.1/tiffio.h"
+#include <cmath>															// ceilf(), floorf() for the output geometry
+#include <omp.h>
+#include <stdio.h>
+#include <utility>
+#ifdef _WIN32
+#include <io.h>																// _setmode(), so stdin is read as binary
+#include <fcntl.h>
+#endif
 
 typedef struct TIFFileHeader {
 	bool bVerbose 					= false;								// Enable verbose mode for console app
-	bool bInputImageIsRGB 			= false;								// Input image is RGB (need to convert to CMYK if true)
+	bool bInputImageIsRGB 			= false;								// Input image is RGB, Lab or YCbCr (need to convert to CMYK if true)
+	UINT16 nPhotometric				= PHOTOMETRIC_SEPARATED;				// TIFF photometric model, RGB for JPEG decoded YCbCr
+	float dYCbCrCoefficients[3]		= { 0.299F, 0.587F, 0.114F };			// YCbCr luma coefficients (TIFFTAG_YCBCRCOEFFICIENTS)
+	float dReferenceBlackWhite[6]	= {};									// YCbCr black / white codes, all 0 = not in the image
 	bool bInputFileIsGrayscaleK		= false;								// Grayscale, so print K only, C=M=Y=0
+	bool bInvertSamples				= false;								// Gray with 0 = black, inverted to ink coverage as read
 	bool bInputStripRead			= true;									// Read strips (true) or single raster bands
+	bool bInputPlanar				= false;								// PLANARCONFIG_SEPARATE, bands are read one plane per channel
 	UINT8 nImageBitDepth 			= 8;									// Input raster image bit depth, 8 or 16 bits/color
 	UINT8 nInputColorChannels		= 4;									// This should be 4 for CMYK
 	UINT16 nInputImagePixelWidth;											// Input image width in pixels
 	UINT16 nInputImagePixelHeight;											// Input image height in pixels
 	UINT16 nHorizontalDPI;													// Horizontal print DPI (dots per inch)
 	UINT16 nVerticalDPI;													// Vertical print DPI
+	UINT16 nPageScalingPer			= 100;									// Printed size, percent of the image's own (25 - 400)
+	UINT8 nQuarterTurns				= 0;									// Printed turned clockwise 0 - 3 quarter turns (see Orientation)
+	bool bMirror					= false;								//  and then mirrored left to right (backlit film)
+	UINT16 nOrientedPixelWidth		= 0;									// The image as printed, after any turn: width & height
+	UINT16 nOrientedPixelHeight		= 0;									//  in pixels, and rows per band read
+	UINT8 nOrientedBufferRows		= 0;
+	UINT8* pOrientScratch			= NULL;									// One band of the image as stored, before it is turned
+	UINT8* pOrientWindow			= NULL;									// Turned rows, filled from every band (quarter turns)
+	UINT32 nOrientWindowRows		= 0;									// Rows the window holds, 0 = bands are turned one by one
+	INT32 nOrientWindowFirstRow		= -1;									// First turned row in the window, -1 = empty
+	FILE* pOrientSpill				= NULL;									// Every stored band turned, when the window is not the page
+	UINT8* pOrientSlab				= NULL;									// Turned rows of one band, on their way to or from the spill
 	UINT8 nInputStripSize			= 1;									// TIFF strip size = n number of rows
 	UINT8 nStripReadLoopSize		= 1;									// Number of strips to read per image band
 	UINT8 nInputImageBufferRows		= 255;									// Number of rows in (height of) input image band
@@ -70,6 +95,23 @@ typedef struct TIFFileHeader {
 	float dPrintedMediaHeight;												// Printed image height in inches
 	UINT32 nOutputPixelWidth;												// Printed image width in pixels
 	UINT32 nOutputPixelHeight;												// Printed image height in pixels
+	bool bInputTileRead				= false;								// Input image is tiled (true), so read tile rows, not strips
+	UINT32 nTileWidth				= 0;									// TIFF tile width in pixels (tiled images only)
+	UINT32 nTileLength				= 0;									// TIFF tile height in rows (tiled images only)
+	UINT32 nTilesAcross				= 0;									// Number of tiles in one tile row
+	UINT32 nTileCacheRows			= 0;									// Height of the tile-row cache, band height or one tile row
+	INT32 nTileCacheFirstRow		= -1;									// First image row held in the tile-row cache, -1 = empty
+	UINT8* pTileRowCache			= NULL;									// Decoded tile rows, nTileCacheRows tall x full image width
+	int nMaxThreads					= 0;									// Cores the job may use (-p), 0 = every core
+	UINT8 nTileReaders				= 1;									// Number of threads decoding tiles, one TIFF handle each
+	TIFF* pTileReaderTIFF[16]		= {};									// LibTIFF handles are not thread safe, so one per thread
+	UINT8* pTileScratch[16]			= {};									// One decoded tile per thread, copied into the cache
+	TIFF* pInputTIFF				= NULL;									// Input image, kept open for band reads
+	AsyncIO* pAsyncIO				= NULL;									// Optional io_uring backend, NULL = blocking reads
+	bool bRawStreamInput			= false;								// Raw interleaved rows from stdin or a pipe, not a TIFF
+	bool bRawStreamHeader			= true;									// Raw stream starts with a header line, false = CLI flags
+	UINT16 nRawInputDPI				= 0;									// Resolution of the raw input image (both axes)
+	FILE* pRawInputStream			= NULL;									// Raw input stream, stdin unless a file or pipe is named
 	string strInputFile;													// Filename and path of TIFF file to be printed
 	INT16 nErrorCode 				= 0;									// Return error code (for allocation function)
 	TCHAR sRetErrDescription[128];											// Return error message
@@ -77,6 +119,12 @@ typedef struct TIFFileHeader {
 
 TIFFHeader MyTIFFHeader;
 
+INT16 _OpenTileReaders(TIFFHeader* MyTIFFHeader);
+INT16 _OpenRawInputStream(TIFFHeader* MyTIFFHeader);
+INT16 _FillTileRowCache(TIFFHeader* MyTIFFHeader, UINT32 nFirstRow);
+INT16 _PrefetchInputImageBand(TIFFHeader* MyTIFFHeader, UINT32 nBandFirstRow);
+INT16 _OpenOrientedImage(TIFFHeader* MyTIFFHeader);
+
 INT16 _GetInputImageDimensions(TIFFHeader* MyTIFFHeader) {
 	const char* sInFile = MyTIFFHeader->strInputFile.c_str();				// This is the name of the TIFF file we want to print
 	TIFF* inputTIFF;														// This is the pointer to the TIFF buffer
@@ -89,7 +137,12 @@ INT16 _GetInputImageDimensions(TIFFHeader* MyTIFFHeader) {
 		TIFFSetErrorHandlerExt(NULL);
 	}
 
-	if ((inputTIFF = TIFFOpen(sInFile, "r")) == NULL) {						// Attempt to open the TIFF file from disk
+	if (MyTIFFHeader->pAsyncIO != NULL && MyTIFFHeader->pAsyncIO->bEnabled)	// Reads are served from the io_uring buffer pool
+		inputTIFF = _AsyncIOOpenTIFF(MyTIFFHeader->pAsyncIO, sInFile);
+	else
+		inputTIFF = TIFFOpen(sInFile, "r");
+
+	if (inputTIFF == NULL) {												// Attempt to open the TIFF file from disk
 		MyTIFFHeader->nErrorCode = (-72);									// If NULL is returned, something went wrong
 		swprintf_s(MyTIFFHeader->sRetErrDescription,
 			_countof(MyTIFFHeader->sRetErrDescription),
@@ -100,11 +153,12 @@ INT16 _GetInputImageDimensions(TIFFHeader* MyTIFFHeader) {
 	UINT16 _inImageCols;
 	UINT16 _imageChn;
 	UINT16 _bitsPerSample;
-	UINT16 _photometric;
+	UINT16 _photometric = 0xFFFF;
 	UINT16 _resUnit;
 	float _xRes;
 	float _yRes;
 	UINT16 _RowsPerStrip;
+	UINT16 _planarConfig = PLANARCONFIG_CONTIG;
 
 	TIFFGetField(inputTIFF, TIFFTAG_IMAGELENGTH, &_inImageRows);			// Get image length (pixel rows)
 	TIFFGetField(inputTIFF, TIFFTAG_IMAGEWIDTH, &_inImageCols);				// Get image width (pixels columns)
@@ -115,20 +169,71 @@ INT16 _GetInputImageDimensions(TIFFHeader* MyTIFFHeader) {
 	TIFFGetField(inputTIFF, TIFFTAG_XRESOLUTION, &_xRes);					// Get resolution in X direction
 	TIFFGetField(inputTIFF, TIFFTAG_YRESOLUTION, &_yRes);					// Get resolution in Y direction
 	TIFFGetField(inputTIFF, TIFFTAG_ROWSPERSTRIP, &_RowsPerStrip);			// Get rows per strip, default = 1
+	TIFFGetField(inputTIFF, TIFFTAG_PLANARCONFIG, &_planarConfig);			// Get sample layout, chunky (default) or planar
+	MyTIFFHeader->pInputTIFF = inputTIFF;									// Keep the image open, bands are read from it later
 
 	MyTIFFHeader->nInputImagePixelWidth = _inImageCols;						// Input image width & height in pixels
 	MyTIFFHeader->nInputImagePixelHeight = _inImageRows;
 
 	dImageWidth = (float)_inImageCols / _xRes;								// Physical width & height
 	dImageHeight = (float)_inImageRows / _yRes;
+	if (MyTIFFHeader->nQuarterTurns % 2 == 1)								// Printed on its side
+		std::swap(dImageWidth, dImageHeight);
 
-	MyTIFFHeader->dPrintedMediaWidth = dImageWidth;							// Printed image physical width & height
-	MyTIFFHeader->dPrintedMediaHeight = dImageHeight;
+	MyTIFFHeader->dPrintedMediaWidth = dImageWidth *						// Printed image physical width & height, page
+		(float)MyTIFFHeader->nPageScalingPer / 100.F;						//  scaling included: the resampler goes from the
+	MyTIFFHeader->dPrintedMediaHeight = dImageHeight *						//  image straight to these, in one plan per axis
+		(float)MyTIFFHeader->nPageScalingPer / 100.F;
 
-	if (_imageChn == 3)														// Is the image RGB or CMYK.?
-		MyTIFFHeader->bInputImageIsRGB = true;
-	else
+	if (_photometric == 0xFFFF)												// No photometric tag, go by the channels
+		_photometric = (_imageChn == 1) ? PHOTOMETRIC_MINISBLACK : (_imageChn == 3) ? PHOTOMETRIC_RGB : PHOTOMETRIC_SEPARATED;
+	if (_photometric == PHOTOMETRIC_YCBCR) {
+		UINT16 _compression = COMPRESSION_NONE, _subsampleX = 1, _subsampleY = 1;
+		float* _coefficients = NULL;
+		float* _referenceBlackWhite = NULL;
+
+		TIFFGetField(inputTIFF, TIFFTAG_COMPRESSION, &_compression);
+		TIFFGetFieldDefaulted(inputTIFF, TIFFTAG_YCBCRSUBSAMPLING, &_subsampleX, &_subsampleY);
+		if (_compression == COMPRESSION_JPEG &&								// The JPEG codec upsamples and converts to RGB
+			TIFFSetField(inputTIFF, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB) == 1)
+			_photometric = PHOTOMETRIC_RGB;
+		else if (_subsampleX != 1 || _subsampleY != 1) {					// Subsampled chroma is only read through JPEG
+			MyTIFFHeader->nErrorCode = (-74);
+			swprintf_s(MyTIFFHeader->sRetErrDescription,
+				_countof(MyTIFFHeader->sRetErrDescription),
+				_T("EC(-74) Unsupported YCbCr chroma subsampling: %d x %d!"), _subsampleX, _subsampleY);
+			return MyTIFFHeader->nErrorCode;
+		}
+		if (TIFFGetFieldDefaulted(inputTIFF, TIFFTAG_YCBCRCOEFFICIENTS, &_coefficients) == 1 && _coefficients != NULL)
+			for (UINT8 clp = 0; clp < 3; clp++)
+				MyTIFFHeader->dYCbCrCoefficients[clp] = _coefficients[clp];
+		if (TIFFGetField(inputTIFF, TIFFTAG_REFERENCEBLACKWHITE, &_referenceBlackWhite) == 1 && _referenceBlackWhite != NULL)
+			for (UINT8 rlp = 0; rlp < 6; rlp++)								// Not defaulted, LibTIFF's default is 8-bit only
+				MyTIFFHeader->dReferenceBlackWhite[rlp] = _referenceBlackWhite[rlp];
+	}
+	MyTIFFHeader->nPhotometric = _photometric;
+
+	switch (_photometric) {													// Is the image RGB (or Lab, YCbCr) or CMYK.?
+	case PHOTOMETRIC_MINISWHITE:											// Gray, 0 = white is already ink coverage, 0 = black
+	case PHOTOMETRIC_MINISBLACK:											//  is inverted as bands are read (bInvertSamples)
+	case PHOTOMETRIC_SEPARATED:												// Inks as they are, 3 channels are CMY
 		MyTIFFHeader->bInputImageIsRGB = false;
+		break;
+	case PHOTOMETRIC_RGB:
+	case PHOTOMETRIC_CIELAB:
+	case PHOTOMETRIC_ICCLAB:
+	case PHOTOMETRIC_YCBCR:
+		MyTIFFHeader->bInputImageIsRGB = true;
+		if (_imageChn == 3)
+			break;
+		[[fallthrough]];													// Color with alpha or extra samples is not printed
+	default:
+		MyTIFFHeader->nErrorCode = (-74);									// Palette, alpha, LogLuv ... no CMYK from these
+		swprintf_s(MyTIFFHeader->sRetErrDescription,
+			_countof(MyTIFFHeader->sRetErrDescription),
+			_T("EC(-74) Unsupported photometric model %d with %d color channels!"), _photometric, _imageChn);
+		return MyTIFFHeader->nErrorCode;
+	}
 
 	if (_bitsPerSample == 8 || _bitsPerSample == 16)						// Only accept 8 or 16-bit images
 		MyTIFFHeader->nImageBitDepth = _bitsPerSample;
@@ -144,6 +249,7 @@ INT16 _GetInputImageDimensions(TIFFHeader* MyTIFFHeader) {
 		MyTIFFHeader->bInputFileIsGrayscaleK = true;
 	else
 		MyTIFFHeader->bInputFileIsGrayscaleK = false;
+	MyTIFFHeader->bInvertSamples = MyTIFFHeader->bInputFileIsGrayscaleK && _photometric == PHOTOMETRIC_MINISBLACK;
 
 	if (_imageChn == 1 || _imageChn == 3 || _imageChn == 4)					// Image is neither gray, RGB, or CMYK, so report an error
 		MyTIFFHeader->nInputColorChannels = (UINT8)_imageChn;
@@ -155,12 +261,20 @@ INT16 _GetInputImageDimensions(TIFFHeader* MyTIFFHeader) {
 		return MyTIFFHeader->nErrorCode;
 	}
 
-	MyTIFFHeader->nOutputPixelWidth = (UINT32)ceilf(dImageWidth *			// Output image width & height in pixels
-		(float)MyJobHeader->nHorizontalDPI);
-	MyTIFFHeader->nOutputPixelHeight = (UINT32)ceilf(dImageHeight *
-		(float)MyJobHeader->nVerticalDPI);
+	MyTIFFHeader->nOutputPixelWidth = (UINT32)ceilf(MyTIFFHeader->dPrintedMediaWidth *	// Output image width & height
+		(float)MyTIFFHeader->nHorizontalDPI);								//  in pixels
+	MyTIFFHeader->nOutputPixelHeight = (UINT32)ceilf(MyTIFFHeader->dPrintedMediaHeight *
+		(float)MyTIFFHeader->nVerticalDPI);
+
+	MyTIFFHeader->bInputPlanar =											// Planar images are read straight into channel planes
+		(_planarConfig == PLANARCONFIG_SEPARATE && _imageChn > 1);
 
-	if (_RowsPerStrip < 256) {
+	if (TIFFIsTiled(inputTIFF)) {											// Tiled images are decoded a row of tiles at a time
+		INT16 nTileError = _OpenTileReaders(MyTIFFHeader);
+		if (nTileError != 0)
+			return nTileError;
+	}
+	else if (_RowsPerStrip < 256) {
 		MyTIFFHeader->bInputStripRead = true;								// Read strips (true) or single raster bands
 		MyTIFFHeader->nStripReadLoopSize =									// Number of strips to read per image band
 			(UINT8)floorf(255.F / (float)_RowsPerStrip);
@@ -177,10 +291,442 @@ INT16 _GetInputImageDimensions(TIFFHeader* MyTIFFHeader) {
 	
 	// The image is open now, and you have your image size and band size
 	// Figure out how many bands you need, based on image band height vs. image height
-	// ** Now you can start halftoning the image **
+	// ** Now you can start halftoning the image, one _ReadOrientedImageBand() call per band **
 
+	return _OpenOrientedImage(MyTIFFHeader);								// Turned band geometry, and start reading the first band
+}
 
-	
-	TIFFClose(inputTIFF);													// Close the TIFF image file one you are done
-	return 0;																// No errors, so return zero
+// *********************************************************************************************************************************
+// _OpenRawInputStream() is the raw streaming alternative to _GetInputImageDimensions(), for an upstream RIP that already
+//  renders interleaved pixels (CMYKCMYK.., native byte order for 16-bit); rows are read from stdin, or from strInputFile
+//  if one was given (a file or a named pipe), one band at a time, so halftoning starts as soon as the first band arrives
+// Width, height, bit depth, channels and DPI come from the command line, or (bRawStreamHeader) from a one-line header:
+//  "SPEEDRAW <width> <height> <bits> <channels> <dpi>\n", immediately followed by the pixel rows
+//
+INT16 _OpenRawInputStream(TIFFHeader* MyTIFFHeader) {
+	if (MyTIFFHeader->strInputFile.empty()) {
+		MyTIFFHeader->pRawInputStream = stdin;
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);								// Don't let the C runtime translate CR/LF
+#endif
+	}
+	else if ((MyTIFFHeader->pRawInputStream = fopen(MyTIFFHeader->strInputFile.c_str(), "rb")) == NULL) {
+		MyTIFFHeader->nErrorCode = (-72);
+		swprintf_s(MyTIFFHeader->sRetErrDescription,
+			_countof(MyTIFFHeader->sRetErrDescription),
+			_T("EC(-72) Failed to read input image file, %hs!"), MyTIFFHeader->strInputFile.c_str());
+		return MyTIFFHeader->nErrorCode;
+	}
+	MyTIFFHeader->bRawStreamInput = true;
+
+	if (MyTIFFHeader->bRawStreamHeader) {									// Dimensions come from the stream itself
+		char sHeader[128];
+		unsigned int _width = 0, _height = 0, _bits = 0, _chn = 0, _dpi = 0;
+
+		if (fgets(sHeader, sizeof(sHeader), MyTIFFHeader->pRawInputStream) == NULL ||
+			sscanf(sHeader, "SPEEDRAW %u %u %u %u %u", &_width, &_height, &_bits, &_chn, &_dpi) != 5) {
+			MyTIFFHeader->nErrorCode = (-79);
+			swprintf_s(MyTIFFHeader->sRetErrDescription,
+				_countof(MyTIFFHeader->sRetErrDescription),
+				_T("EC(-79) Invalid raw input stream header!"));
+			return MyTIFFHeader->nErrorCode;
+		}
+		if (_width > 65535 || _height > 65535 || _bits > 16 || _chn > 16 || _dpi > 65535) {	// Checked before they are
+			MyTIFFHeader->nErrorCode = (-79);								//  narrowed, so 65544 is not read as 8
+			swprintf_s(MyTIFFHeader->sRetErrDescription,
+				_countof(MyTIFFHeader->sRetErrDescription),
+				_T("EC(-79) Raw input header out of range: %u x %u, %u bits, %u channels, %u DPI!"),
+				_width, _height, _bits, _chn, _dpi);
+			return MyTIFFHeader->nErrorCode;
+		}
+		MyTIFFHeader->nInputImagePixelWidth = (UINT16)_width;
+		MyTIFFHeader->nInputImagePixelHeight = (UINT16)_height;
+		MyTIFFHeader->nImageBitDepth = (UINT8)_bits;
+		MyTIFFHeader->nInputColorChannels = (UINT8)_chn;
+		MyTIFFHeader->nRawInputDPI = (UINT16)_dpi;
+	}
+	if (MyTIFFHeader->nInputImagePixelWidth == 0 || MyTIFFHeader->nInputImagePixelHeight == 0 ||
+		MyTIFFHeader->nRawInputDPI == 0) {
+		MyTIFFHeader->nErrorCode = (-79);
+		swprintf_s(MyTIFFHeader->sRetErrDescription,
+			_countof(MyTIFFHeader->sRetErrDescription),
+			_T("EC(-79) Raw input needs width, height and DPI!"));
+		return MyTIFFHeader->nErrorCode;
+	}
+	if (MyTIFFHeader->nImageBitDepth != 8 && MyTIFFHeader->nImageBitDepth != 16) {
+		MyTIFFHeader->nErrorCode = (-73);									// Only accept 8 or 16-bit images
+		swprintf_s(MyTIFFHeader->sRetErrDescription,
+			_countof(MyTIFFHeader->sRetErrDescription),
+			_T("EC(-73) Invalid image pixel bit depth: %d!"), MyTIFFHeader->nImageBitDepth);
+		return MyTIFFHeader->nErrorCode;
+	}
+	if (MyTIFFHeader->nInputColorChannels != 1 && MyTIFFHeader->nInputColorChannels != 3 &&
+		MyTIFFHeader->nInputColorChannels != 4) {
+		MyTIFFHeader->nErrorCode = (-74);									// Neither gray, RGB, or CMYK
+		swprintf_s(MyTIFFHeader->sRetErrDescription,
+			_countof(MyTIFFHeader->sRetErrDescription),
+			_T("EC(-74) Invalid number of input color channels: %d!"), MyTIFFHeader->nInputColorChannels);
+		return MyTIFFHeader->nErrorCode;
+	}
+	MyTIFFHeader->bInputImageIsRGB = (MyTIFFHeader->nInputColorChannels == 3);
+	MyTIFFHeader->nPhotometric = MyTIFFHeader->bInputImageIsRGB ? PHOTOMETRIC_RGB :
+		(MyTIFFHeader->nInputColorChannels == 1) ? PHOTOMETRIC_MINISBLACK : PHOTOMETRIC_SEPARATED;
+	MyTIFFHeader->bInputFileIsGrayscaleK = (MyTIFFHeader->nInputColorChannels == 1);
+	MyTIFFHeader->bInvertSamples = MyTIFFHeader->bInputFileIsGrayscaleK;			// Raw gray is 0 = black, like MINISBLACK
+	MyTIFFHeader->bInputPlanar = false;										// Raw streams are always pixel order
+
+	MyTIFFHeader->dPrintedMediaWidth =										// Printed image physical width & height
+		(float)MyTIFFHeader->nInputImagePixelWidth / (float)MyTIFFHeader->nRawInputDPI *
+		(float)MyTIFFHeader->nPageScalingPer / 100.F;
+	MyTIFFHeader->dPrintedMediaHeight =
+		(float)MyTIFFHeader->nInputImagePixelHeight / (float)MyTIFFHeader->nRawInputDPI *
+		(float)MyTIFFHeader->nPageScalingPer / 100.F;
+	if (MyTIFFHeader->nQuarterTurns % 2 == 1)								// Printed on its side
+		std::swap(MyTIFFHeader->dPrintedMediaWidth, MyTIFFHeader->dPrintedMediaHeight);
+	MyTIFFHeader->nOutputPixelWidth = (UINT32)ceilf(MyTIFFHeader->dPrintedMediaWidth *
+		(float)MyTIFFHeader->nHorizontalDPI);
+	MyTIFFHeader->nOutputPixelHeight = (UINT32)ceilf(MyTIFFHeader->dPrintedMediaHeight *
+		(float)MyTIFFHeader->nVerticalDPI);
+
+	MyTIFFHeader->bInputStripRead = false;									// No strips, a band is just the next 255 rows
+	MyTIFFHeader->nStripReadLoopSize = 255;
+	MyTIFFHeader->nInputImageBufferRows = 255;
+	MyTIFFHeader->nInputStripSize = 1;
+	return _OpenOrientedImage(MyTIFFHeader);
+}
+
+// *********************************************************************************************************************************
+// _OpenTileReaders() sets up the tile-row cache for a tiled TIFF; one TIFF handle and one tile buffer per decode thread
+// If tiles are 255 rows or less, the band is a whole number of tile rows and the cache is exactly one band tall
+// Taller tiles (256 x 256 is common) keep one tile row in the cache, and 255-row bands are copied out of it
+//
+INT16 _OpenTileReaders(TIFFHeader* MyTIFFHeader) {
+	TIFF* inputTIFF = MyTIFFHeader->pInputTIFF;
+	UINT32 _tileWidth = 0, _tileLength = 0;
+	int _jpegColorMode = JPEGCOLORMODE_RAW;
+	bool bJPEGColorMode = (TIFFGetField(inputTIFF, TIFFTAG_JPEGCOLORMODE, &_jpegColorMode) == 1 &&
+		_jpegColorMode == JPEGCOLORMODE_RGB);
+
+	TIFFGetField(inputTIFF, TIFFTAG_TILEWIDTH, &_tileWidth);				// Tile dimensions, always multiples of 16
+	TIFFGetField(inputTIFF, TIFFTAG_TILELENGTH, &_tileLength);
+
+	if (_tileWidth == 0 || _tileLength == 0) {
+		MyTIFFHeader->nErrorCode = (-75);
+		swprintf_s(MyTIFFHeader->sRetErrDescription,
+			_countof(MyTIFFHeader->sRetErrDescription),
+			_T("EC(-75) Invalid tile size: %u x %u!"), _tileWidth, _tileLength);
+		return MyTIFFHeader->nErrorCode;
+	}
+	MyTIFFHeader->bInputTileRead = true;
+	MyTIFFHeader->bInputStripRead = false;
+	MyTIFFHeader->nTileWidth = _tileWidth;
+	MyTIFFHeader->nTileLength = _tileLength;
+	MyTIFFHeader->nTilesAcross = 
+		(MyTIFFHeader->nInputImagePixelWidth + _tileWidth - 1) / _tileWidth;
+
+	if (_tileLength < 256) {												// Band = whole number of tile rows
+		MyTIFFHeader->nStripReadLoopSize = (UINT8)(255 / _tileLength);		// Tile rows per band
+		MyTIFFHeader->nInputImageBufferRows = 
+			(UINT8)(MyTIFFHeader->nStripReadLoopSize * _tileLength);
+		MyTIFFHeader->nTileCacheRows = MyTIFFHeader->nInputImageBufferRows;
+	}
+	else {																	// One tile row spans more than one band
+		MyTIFFHeader->nStripReadLoopSize = 1;
+		MyTIFFHeader->nInputImageBufferRows = 255;
+		MyTIFFHeader->nTileCacheRows = _tileLength;
+	}
+	MyTIFFHeader->nInputStripSize = 1;
+
+	size_t nBytesPerPixel = (size_t)MyTIFFHeader->nInputColorChannels *
+		(MyTIFFHeader->nImageBitDepth / 8);
+	UINT32 nTilesPerCache = MyTIFFHeader->nTilesAcross *					// Number of tiles decoded per cache fill
+		(MyTIFFHeader->nTileCacheRows / _tileLength) * 
+		(MyTIFFHeader->bInputPlanar ? MyTIFFHeader->nInputColorChannels : 1);
+
+	int nMaxThreads = (MyTIFFHeader->nMaxThreads > 0) ? MyTIFFHeader->nMaxThreads : omp_get_max_threads();
+
+	MyTIFFHeader->nTileReaders = (UINT8)min(min(nMaxThreads, 16), (int)nTilesPerCache);	// Within the job's core budget
+	MyTIFFHeader->pTileReaderTIFF[0] = inputTIFF;							// Thread 0 shares the main handle
+
+	for (UINT8 rlp = 1; rlp < MyTIFFHeader->nTileReaders; rlp++) {
+		if ((MyTIFFHeader->pTileReaderTIFF[rlp] = 
+			TIFFOpen(MyTIFFHeader->strInputFile.c_str(), "r")) == NULL) {
+			MyTIFFHeader->nTileReaders = rlp;								// Not fatal, decode with fewer threads
+			break;
+		}
+		if (bJPEGColorMode)													// JPEG YCbCr, every handle decodes to RGB
+			TIFFSetField(MyTIFFHeader->pTileReaderTIFF[rlp], TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+	}
+	for (UINT8 rlp = 0; rlp < MyTIFFHeader->nTileReaders; rlp++) {
+		if ((MyTIFFHeader->pTileScratch[rlp] = 
+			(UINT8*)malloc((size_t)TIFFTileSize(inputTIFF))) == NULL) {
+			MyTIFFHeader->nErrorCode = (-76);
+			swprintf_s(MyTIFFHeader->sRetErrDescription,
+				_countof(MyTIFFHeader->sRetErrDescription),
+				_T("EC(-76) Failed to allocate tile decode buffer!"));
+			return MyTIFFHeader->nErrorCode;
+		}
+	}
+	if ((MyTIFFHeader->pTileRowCache = (UINT8*)malloc((size_t)MyTIFFHeader->nTileCacheRows *
+		MyTIFFHeader->nInputImagePixelWidth * nBytesPerPixel)) == NULL) {
+		MyTIFFHeader->nErrorCode = (-76);
+		swprintf_s(MyTIFFHeader->sRetErrDescription,
+			_countof(MyTIFFHeader->sRetErrDescription),
+			_T("EC(-76) Failed to allocate tile row cache!"));
+		return MyTIFFHeader->nErrorCode;
+	}
+	MyTIFFHeader->nTileCacheFirstRow = -1;									// Cache is empty until the first band read
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _FillTileRowCache() decodes every tile covering image rows nFirstRow .. nFirstRow + nTileCacheRows - 1
+// Tiles are independent, so they are decoded in parallel, each thread using its own TIFF handle and scratch tile
+// Planar images have one set of tiles per sample plane, and the cache holds one plane after the other
+//
+INT16 _FillTileRowCache(TIFFHeader* MyTIFFHeader, UINT32 nFirstRow) {
+	UINT32 nPlanes = MyTIFFHeader->bInputPlanar ? MyTIFFHeader->nInputColorChannels : 1;
+	UINT32 nBytesPerPixel = (MyTIFFHeader->bInputPlanar ? 1 :				// Bytes per pixel within one plane
+		(UINT32)MyTIFFHeader->nInputColorChannels) * (MyTIFFHeader->nImageBitDepth / 8);
+	UINT32 nCacheRowBytes = MyTIFFHeader->nInputImagePixelWidth * nBytesPerPixel;
+	size_t nCachePlaneBytes = (size_t)nCacheRowBytes * MyTIFFHeader->nTileCacheRows;
+	UINT32 nTileRowBytes = MyTIFFHeader->nTileWidth * nBytesPerPixel;
+	INT32 nTilesPerPlane = (INT32)(MyTIFFHeader->nTilesAcross *
+		(MyTIFFHeader->nTileCacheRows / MyTIFFHeader->nTileLength));
+	INT32 nTiles = nTilesPerPlane * (INT32)nPlanes;
+	INT32 nFailedTiles = 0;
+
+#pragma omp parallel for num_threads(MyTIFFHeader->nTileReaders) reduction(+:nFailedTiles)
+	for (INT32 tlp = 0; tlp < nTiles; tlp++) {
+		int nReader = omp_get_thread_num();									// Each thread owns one handle and one scratch tile
+		UINT16 nPlane = (UINT16)(tlp / nTilesPerPlane);
+		INT32 nPlaneTile = tlp % nTilesPerPlane;
+		UINT32 nTileX = (nPlaneTile % MyTIFFHeader->nTilesAcross) * MyTIFFHeader->nTileWidth;
+		UINT32 nTileY = nFirstRow + (nPlaneTile / MyTIFFHeader->nTilesAcross) * MyTIFFHeader->nTileLength;
+
+		if (nTileY >= MyTIFFHeader->nInputImagePixelHeight)					// Past the bottom of the image
+			continue;
+
+		TIFF* tileTIFF = MyTIFFHeader->pTileReaderTIFF[nReader];
+		if (TIFFReadEncodedTile(tileTIFF, TIFFComputeTile(tileTIFF, nTileX, nTileY, 0, nPlane),
+			MyTIFFHeader->pTileScratch[nReader], (tmsize_t)(-1)) < 0) {
+			nFailedTiles++;
+			continue;
+		}
+		UINT32 nCopyCols = min(MyTIFFHeader->nTileWidth,					// Edge tiles are padded, only copy the image part
+			(UINT32)MyTIFFHeader->nInputImagePixelWidth - nTileX);
+		UINT32 nCopyRows = min(MyTIFFHeader->nTileLength,
+			(UINT32)MyTIFFHeader->nInputImagePixelHeight - nTileY);
+		UINT8* pCachePlane = MyTIFFHeader->pTileRowCache + nPlane * nCachePlaneBytes;
+
+		for (UINT32 rlp = 0; rlp < nCopyRows; rlp++)
+			memcpy(pCachePlane + (size_t)(nTileY - nFirstRow + rlp) * nCacheRowBytes + 
+				(size_t)nTileX * nBytesPerPixel, MyTIFFHeader->pTileScratch[nReader] + 
+				(size_t)rlp * nTileRowBytes, (size_t)nCopyCols * nBytesPerPixel);
+	}
+	if (nFailedTiles > 0) {
+		MyTIFFHeader->nTileCacheFirstRow = -1;
+		MyTIFFHeader->nErrorCode = (-77);
+		swprintf_s(MyTIFFHeader->sRetErrDescription,
+			_countof(MyTIFFHeader->sRetErrDescription),
+			_T("EC(-77) Failed to decode %d tile(s) at row %u!"), nFailedTiles, nFirstRow);
+		return MyTIFFHeader->nErrorCode;
+	}
+	MyTIFFHeader->nTileCacheFirstRow = (INT32)nFirstRow;
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _InvertBandSamples() turns nSamples gray samples (0 = black) into ink coverage (0 = no ink), in place
+//
+void _InvertBandSamples(void* pSamples, size_t nSamples, UINT8 nImageBitDepth) {
+	if (nImageBitDepth == 16) {
+		UINT16* pSample = (UINT16*)pSamples;
+
+		for (size_t slp = 0; slp < nSamples; slp++)
+			pSample[slp] = (UINT16)~pSample[slp];
+	}
+	else {
+		UINT8* pSample = (UINT8*)pSamples;
+
+		for (size_t slp = 0; slp < nSamples; slp++)
+			pSample[slp] = (UINT8)~pSample[slp];
+	}
 }
+
+// *********************************************************************************************************************************
+// _ReadInputImageBand() reads the next band of up to nInputImageBufferRows rows into pInputRasterBuffer
+// Chunky images fill the band in pixel order (CMYKCMYK..); planar images (bInputPlanar) fill it one contiguous plane per
+//  channel (CC..MM..YY..KK..), each plane *nBandRows x width samples, so the band buffer size is the same either way
+// Striped images read nStripReadLoopSize strips, tiled images copy rows out of the tile-row cache, others read one row at a time
+// nBandFirstRow should advance by nInputImageBufferRows each call; *nBandRows returns the number of rows actually read
+//
+INT16 _ReadInputImageBand(
+	TIFFHeader* MyTIFFHeader,												// Pointer to structure holding the image header
+	void* pInputRasterBuffer,												// Band buffer, nInputImageBufferRows x width x channels
+	UINT32 nBandFirstRow,													// First image row of the band
+	UINT8* nBandRows) {														// Returns the number of rows read into the band
+
+	TIFF* inputTIFF = MyTIFFHeader->pInputTIFF;
+	UINT16 nPlanes = MyTIFFHeader->bInputPlanar ? MyTIFFHeader->nInputColorChannels : 1;
+	UINT32 nRowBytes = (UINT32)MyTIFFHeader->nInputImagePixelWidth *		// Size of one image row (of one plane) in bytes
+		(MyTIFFHeader->bInputPlanar ? 1 : MyTIFFHeader->nInputColorChannels) * (MyTIFFHeader->nImageBitDepth / 8);
+	UINT32 nRows = min((UINT32)MyTIFFHeader->nInputImageBufferRows,		// The last band is usually short
+		(UINT32)MyTIFFHeader->nInputImagePixelHeight - nBandFirstRow);
+
+	*nBandRows = 0;
+	if (nBandFirstRow >= MyTIFFHeader->nInputImagePixelHeight)				// Nothing left to read
+		return 0;
+
+	if (MyTIFFHeader->bRawStreamInput) {									// Blocks until upstream has rendered the band
+		size_t nRead = fread(pInputRasterBuffer, nRowBytes, nRows, MyTIFFHeader->pRawInputStream);
+
+		if (nRead != nRows) {
+			MyTIFFHeader->nErrorCode = (-78);
+			swprintf_s(MyTIFFHeader->sRetErrDescription,
+				_countof(MyTIFFHeader->sRetErrDescription),
+				_T("EC(-78) Raw input stream ended at row %u!"), nBandFirstRow + (UINT32)nRead);
+			return MyTIFFHeader->nErrorCode;
+		}
+		if (MyTIFFHeader->bInvertSamples)
+			_InvertBandSamples(pInputRasterBuffer, (size_t)nRows * MyTIFFHeader->nInputImagePixelWidth,
+				MyTIFFHeader->nImageBitDepth);
+		*nBandRows = (UINT8)nRows;
+		return 0;
+	}
+
+	if (MyTIFFHeader->bInputTileRead) {
+		for (UINT32 rlp = 0; rlp < nRows; ) {							// Tile rows in turn, every plane copied from each
+			UINT32 nRow = nBandFirstRow + rlp;
+
+			if (MyTIFFHeader->nTileCacheFirstRow < 0 ||						// Row is not in the cache, so decode its tile row
+				nRow < (UINT32)MyTIFFHeader->nTileCacheFirstRow ||
+				nRow >= (UINT32)MyTIFFHeader->nTileCacheFirstRow + MyTIFFHeader->nTileCacheRows) {
+				INT16 nCacheError = _FillTileRowCache(MyTIFFHeader, 
+					(nRow / MyTIFFHeader->nTileLength) * MyTIFFHeader->nTileLength);
+				if (nCacheError != 0)
+					return nCacheError;
+			}
+			UINT32 nCachedRows = min(nRows - rlp,							// Rows of the band this cache fill holds
+				(UINT32)MyTIFFHeader->nTileCacheFirstRow + MyTIFFHeader->nTileCacheRows - nRow);
+
+			for (UINT16 plp = 0; plp < nPlanes; plp++)
+				memcpy((UINT8*)pInputRasterBuffer + ((size_t)plp * nRows + rlp) * nRowBytes, MyTIFFHeader->pTileRowCache +
+					((size_t)plp * MyTIFFHeader->nTileCacheRows + nRow - MyTIFFHeader->nTileCacheFirstRow) * nRowBytes,
+					(size_t)nCachedRows * nRowBytes);
+			rlp += nCachedRows;
+		}
+	}
+	else {
+		for (UINT16 plp = 0; plp < nPlanes; plp++) {						// Chunky images have a single 'plane'
+			UINT8* pBand = (UINT8*)pInputRasterBuffer + (size_t)plp * nRows * nRowBytes;
+
+			if (MyTIFFHeader->bInputStripRead) {						// Bands always start on a strip boundary
+				for (UINT32 rlp = 0; rlp < nRows; rlp += MyTIFFHeader->nInputStripSize) {
+					UINT32 nStrip = TIFFComputeStrip(inputTIFF, nBandFirstRow + rlp, plp);
+
+					if (TIFFReadEncodedStrip(inputTIFF, nStrip, pBand + (size_t)rlp * nRowBytes, (tmsize_t)(-1)) < 0) {
+						MyTIFFHeader->nErrorCode = (-78);
+						swprintf_s(MyTIFFHeader->sRetErrDescription,
+							_countof(MyTIFFHeader->sRetErrDescription),
+							_T("EC(-78) Failed to read input image strip %u!"), nStrip);
+						return MyTIFFHeader->nErrorCode;
+					}
+				}
+			}
+			else {
+				for (UINT32 rlp = 0; rlp < nRows; rlp++) {
+					if (TIFFReadScanline(inputTIFF, pBand + (size_t)rlp * nRowBytes, nBandFirstRow + rlp, plp) < 0) {
+						MyTIFFHeader->nErrorCode = (-78);
+						swprintf_s(MyTIFFHeader->sRetErrDescription,
+							_countof(MyTIFFHeader->sRetErrDescription),
+							_T("EC(-78) Failed to read input image row %u!"), nBandFirstRow + rlp);
+						return MyTIFFHeader->nErrorCode;
+					}
+				}
+			}
+		}
+	}
+	if (MyTIFFHeader->bInvertSamples)										// Gray is one channel, so one plane either way
+		_InvertBandSamples(pInputRasterBuffer, (size_t)nRows * MyTIFFHeader->nInputImagePixelWidth,
+			MyTIFFHeader->nImageBitDepth);
+	*nBandRows = (UINT8)nRows;
+	if (MyTIFFHeader->nQuarterTurns == 2 && MyTIFFHeader->nOrientWindowRows == 0)
+		return 0;															// Read bottom up, Orientation prefetches the band above
+	return _PrefetchInputImageBand(MyTIFFHeader, nBandFirstRow + nRows);	// Overlap the next band's I/O with halftoning
+}
+
+// *********************************************************************************************************************************
+// _PrefetchInputImageBand() queues io_uring reads for every strip of the band starting at nBandFirstRow (all planes)
+// Strips of a band are normally contiguous in the file, so this is one or two large reads; does nothing without pAsyncIO
+//
+INT16 _PrefetchInputImageBand(TIFFHeader* MyTIFFHeader, UINT32 nBandFirstRow) {
+	AsyncIO* pAsyncIO = MyTIFFHeader->pAsyncIO;
+	TIFF* inputTIFF = MyTIFFHeader->pInputTIFF;
+
+	if (pAsyncIO == NULL || !pAsyncIO->bEnabled || MyTIFFHeader->bInputTileRead)
+		return 0;															// Tile readers use their own (blocking) handles
+
+	_AsyncIOReleaseReads(pAsyncIO);											// The previous band has been decoded by now
+	if (nBandFirstRow >= MyTIFFHeader->nInputImagePixelHeight)
+		return 0;
+
+	UINT32 nLastRow = min(nBandFirstRow + MyTIFFHeader->nInputImageBufferRows,
+		(UINT32)MyTIFFHeader->nInputImagePixelHeight) - 1;
+	UINT16 nPlanes = MyTIFFHeader->bInputPlanar ? MyTIFFHeader->nInputColorChannels : 1;
+	UINT64 nRangeStart = (UINT64)(-1), nRangeEnd = 0;
+
+	for (UINT16 plp = 0; plp < nPlanes; plp++) {
+		for (UINT32 nStrip = TIFFComputeStrip(inputTIFF, nBandFirstRow, plp);
+			nStrip <= TIFFComputeStrip(inputTIFF, nLastRow, plp); nStrip++) {
+			UINT64 nOffset = TIFFGetStrileOffset(inputTIFF, nStrip);
+
+			nRangeStart = min(nRangeStart, nOffset);
+			nRangeEnd = max(nRangeEnd, nOffset + TIFFGetStrileByteCount(inputTIFF, nStrip));
+		}
+	}
+	if (nRangeEnd <= nRangeStart)
+		return 0;
+
+	if (_AsyncIOPrefetch(pAsyncIO, inputTIFF, nRangeStart, nRangeEnd - nRangeStart) != 0) {
+		MyTIFFHeader->nErrorCode = pAsyncIO->nErrorCode;
+		swprintf_s(MyTIFFHeader->sRetErrDescription,
+			_countof(MyTIFFHeader->sRetErrDescription), _T("%ls"), pAsyncIO->sRetErrDescription);
+		return MyTIFFHeader->nErrorCode;
+	}
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _CloseInputImage() closes the input image (or raw stream) and releases the tile readers and the tile-row cache
+//
+void _CloseInputImage(TIFFHeader* MyTIFFHeader) {
+	for (UINT8 rlp = 0; rlp < 16; rlp++) {
+		if (rlp > 0 && MyTIFFHeader->pTileReaderTIFF[rlp] != NULL)			// Handle 0 is pInputTIFF, closed below
+			TIFFClose(MyTIFFHeader->pTileReaderTIFF[rlp]);
+		free(MyTIFFHeader->pTileScratch[rlp]);
+		MyTIFFHeader->pTileReaderTIFF[rlp] = NULL;
+		MyTIFFHeader->pTileScratch[rlp] = NULL;
+	}
+	free(MyTIFFHeader->pTileRowCache);
+	MyTIFFHeader->pTileRowCache = NULL;
+	MyTIFFHeader->nTileCacheFirstRow = -1;
+	free(MyTIFFHeader->pOrientScratch);
+	free(MyTIFFHeader->pOrientWindow);
+	free(MyTIFFHeader->pOrientSlab);
+	MyTIFFHeader->pOrientScratch = NULL;
+	MyTIFFHeader->pOrientWindow = NULL;
+	MyTIFFHeader->pOrientSlab = NULL;
+	MyTIFFHeader->nOrientWindowFirstRow = -1;
+	if (MyTIFFHeader->pOrientSpill != NULL)
+		fclose(MyTIFFHeader->pOrientSpill);									// A tmpfile(), removed as it is closed
+	MyTIFFHeader->pOrientSpill = NULL;
+
+	if (MyTIFFHeader->pInputTIFF != NULL)
+		TIFFClose(MyTIFFHeader->pInputTIFF);								// Close the TIFF image file once you are done
+	MyTIFFHeader->pInputTIFF = NULL;
+
+	if (MyTIFFHeader->pRawInputStream != NULL && MyTIFFHeader->pRawInputStream != stdin)
+		fclose(MyTIFFHeader->pRawInputStream);
+	MyTIFFHeader->pRawInputStream = NULL;
+}
\ No newline at end of file
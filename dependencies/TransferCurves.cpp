@@ -0,0 +1,118 @@
+// Per ink transfer curves: linearization, dot gain compensation and ink limits, folded into one lookup in the scaler
+// With curves, the scaler reads every input sample through a per ink transfer LUT (256 entries for 8-bit samples, 65,536
+//  for 16-bit), built for each page from the ink's curve and the diffusion bit depth, so the 8 to 16-bit promotion, the
+//  press linearization and a per ink limit (a curve that stops short of 1) all cost one table read, with no extra pass
+//  over the band. With no curves, the resampler promotes 8-bit samples with a multiply (x 257 for 16-bit diffusion) and
+//  reads 16-bit samples as they are. Curves apply to the inks the scaler sees, after any RGB or color LUT conversion
+//
+// Curve file (text): one line per ink, in color channel order, holding the ink level (0. - 1.) printed for evenly spaced
+//  input levels from 0 to full, e.g. "0.0 0.18 0.42 0.7 0.92" (5 points); every ink has the same number of points, 2 -
+//  TRANSFER_CURVE_POINTS, and the LUT is interpolated linearly between them; blank lines and # comments are skipped
+
+#define INT8	signed __int8
+#define INT16	signed __int16
+#define INT32	signed __int32
+#define UINT8 	unsigned __int8
+#define UINT16	unsigned __int16
+#define UINT32	unsigned __int32
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TRANSFER_CURVE_POINTS	256											// Most points per curve
+
+typedef struct TransferCurveData {
+	UINT8 nInks						= 0;									// Curves (color channels), 0 = none
+	UINT16 nPoints					= 0;									// Points per curve, evenly spaced over the input
+	float dLevel[16][TRANSFER_CURVE_POINTS] = {};							// [ink][point], 0. - 1.
+	INT16 nErrorCode				= 0;									// Return error code
+	TCHAR sRetErrDescription[128];											// Return error message
+} TransferCurves;
+
+// *********************************************************************************************************************************
+// _SetTransferCurveError() records a curve error (always EC(-97)) and returns its code
+//
+static INT16 _SetTransferCurveError(TransferCurves* pCurves, const char* sReason, unsigned nLine) {
+	pCurves->nErrorCode = (-97);
+	swprintf_s(pCurves->sRetErrDescription,
+		_countof(pCurves->sRetErrDescription),
+		_T("EC(-97) Invalid transfer curves, %hs (line %u)!"), sReason, nLine);
+	return pCurves->nErrorCode;
+}
+
+// *********************************************************************************************************************************
+// _AddTransferCurve() adds one ink's curve; every ink must have the same number of points, each between 0 and 1
+//
+INT16 _AddTransferCurve(TransferCurves* pCurves, const float* dLevel, UINT16 nPoints, unsigned nLine) {
+	if (pCurves->nInks == 16)
+		return _SetTransferCurveError(pCurves, "more than 16 inks", nLine);
+	if (nPoints < 2 || nPoints > TRANSFER_CURVE_POINTS || (pCurves->nPoints != 0 && nPoints != pCurves->nPoints))
+		return _SetTransferCurveError(pCurves, "every ink needs the same 2 - 256 points", nLine);
+
+	for (UINT16 plp = 0; plp < nPoints; plp++) {
+		if (!(dLevel[plp] >= 0.F && dLevel[plp] <= 1.F))
+			return _SetTransferCurveError(pCurves, "levels must be 0 - 1", nLine);
+		pCurves->dLevel[pCurves->nInks][plp] = dLevel[plp];
+	}
+	pCurves->nPoints = nPoints;
+	pCurves->nInks++;
+	return 0;
+}
+
+// *********************************************************************************************************************************
+// _ReadTransferCurves() reads the per ink curves from a curve file, one ink per line
+//
+INT16 _ReadTransferCurves(TransferCurves* pCurves, const char* sPath) {
+	FILE* pFile = fopen(sPath, "r");
+	char sLine[8192];
+	unsigned nLine = 0;
+
+	pCurves->nInks = 0;
+	pCurves->nPoints = 0;
+	pCurves->nErrorCode = 0;
+	if (pFile == NULL)
+		return _SetTransferCurveError(pCurves, "file not found", 0);
+
+	while (fgets(sLine, sizeof(sLine), pFile) != NULL) {
+		float dLevel[TRANSFER_CURVE_POINTS + 1];
+		char* pNext = sLine;
+		UINT16 nPoints = 0;
+
+		nLine++;
+		while (*pNext == ' ' || *pNext == '\t')
+			pNext++;
+		if (*pNext == '#' || *pNext == '\n' || *pNext == '\r' || *pNext == 0)
+			continue;
+		for (char* pEnd; nPoints < TRANSFER_CURVE_POINTS + 1; nPoints++, pNext = pEnd) {	// Levels, input 0 first
+			dLevel[nPoints] = strtof(pNext, &pEnd);
+			if (pEnd == pNext)
+				break;
+		}
+		if (_AddTransferCurve(pCurves, dLevel, nPoints, nLine) != 0)
+			break;
+	}
+	fclose(pFile);
+	if (pCurves->nErrorCode == 0 && pCurves->nInks == 0)
+		_SetTransferCurveError(pCurves, "no inks", nLine);
+	return pCurves->nErrorCode;
+}
+
+// *********************************************************************************************************************************
+// _BuildTransferLUT() fills one ink's transfer LUT: every input sample (2 ^ nImageBitDepth of them) to the value the scaler
+//  interpolates, 0 - nMaxPixVal (the diffusion range)
+//
+void _BuildTransferLUT(const TransferCurves* pCurves, UINT8 nInk, UINT8 nImageBitDepth, UINT16 nMaxPixVal, UINT16* pLUT) {
+	UINT32 nEntries = (UINT32)1 << nImageBitDepth;
+	const float* dLevel = pCurves->dLevel[nInk];
+	float dStep = (float)(pCurves->nPoints - 1) / (float)(nEntries - 1);	// Curve points per input level
+
+	for (UINT32 elp = 0; elp < nEntries; elp++) {
+		float dPoint = (float)elp * dStep;
+		UINT16 nPoint = (UINT16)min((UINT32)dPoint, (UINT32)pCurves->nPoints - 2);	// Segment holding the level
+		float dFraction = dPoint - (float)nPoint;
+		float dOut = dLevel[nPoint] + dFraction * (dLevel[nPoint + 1] - dLevel[nPoint]);
+
+		pLUT[elp] = (UINT16)lrintf(fminf(fmaxf(dOut, 0.F), 1.F) * (float)nMaxPixVal);
+	}
+}
@@ -0,0 +1,142 @@
+// ColorLUT tests: profiles (3D RGB and 4D CMYK) are compiled, mapped and applied to whole bands; pixels on grid nodes come
+//  out as the node exactly, inks that are linear in the inputs stay linear between nodes (simplex interpolation reproduces
+//  a plane), and the per-thread color cache changes nothing
+
+// *********************************************************************************************************************************
+// _TestProfileInk() is ink nOutput at grid node nIndex[] (0 .. nGridPoints - 1 per input), 0 - 65535: ink 0 is the first
+//  input, ink 1 a mix of the second and last, both linear; the others are scrambled, so every node differs
+//
+static UINT16 _TestProfileInk(const UINT32* nIndex, UINT8 nInputs, UINT8 nGridPoints, UINT8 nOutput) {
+	UINT32 nStep = 65535 / (nGridPoints - 1), nScramble = 0;
+
+	if (nOutput == 0)
+		return (UINT16)(nStep * nIndex[0]);
+	if (nOutput == 1)
+		return (UINT16)lrintf((float)nStep * (0.3F * (float)nIndex[1] + 0.7F * (float)nIndex[nInputs - 1]));
+	for (UINT8 ilp = 0; ilp < nInputs; ilp++)
+		nScramble = nScramble * 2654435761u + nIndex[ilp] + 1;
+	return (UINT16)((nScramble * 40503u + nOutput * 977u) >> 16);
+}
+
+// *********************************************************************************************************************************
+// _WriteTestProfile() writes a profile of _TestProfileInk() nodes, first input slowest
+//
+static bool _WriteTestProfile(const char* sPath, UINT8 nGridPoints, UINT8 nInputs, UINT8 nOutputs) {
+	FILE* pFile = fopen(sPath, "w");
+	UINT32 nEntries = 1;
+
+	if (pFile == NULL)
+		return false;
+	fprintf(pFile, "# SPEEDLib test profile\nGRID_POINTS %u\nINPUT_CHANNELS %u\nOUTPUT_CHANNELS %u\n", nGridPoints, nInputs,
+		nOutputs);
+	for (UINT8 ilp = 0; ilp < nInputs; ilp++)
+		nEntries *= nGridPoints;
+	for (UINT32 elp = 0; elp < nEntries; elp++) {
+		UINT32 nIndex[4];
+
+		for (UINT32 ilp = nInputs, nRest = elp; ilp-- > 0; nRest /= nGridPoints)	// Last input fastest
+			nIndex[ilp] = nRest % nGridPoints;
+		for (UINT8 olp = 0; olp < nOutputs; olp++)
+			fprintf(pFile, "%.9f ", (double)_TestProfileInk(nIndex, nInputs, nGridPoints, olp) / 65535.);
+		fputc('\n', pFile);
+	}
+	fclose(pFile);
+	return true;
+}
+
+// *********************************************************************************************************************************
+// _TestColorLUTProfile() one profile at 8 and 16 bits: a band of every grid node, and a band of random colors (in runs, so
+//  the cache is used) checked for the linear inks and against the same row converted without a cache
+//
+static void _TestColorLUTProfile(UINT8 nGridPoints, UINT8 nInputs, UINT8 nOutputs) {
+	const char* sProfile = "SPEEDLib_Test_Profile.txt";
+	ColorLUT LUT;
+	UINT64 nHash = 0;
+	UINT32 nState = 0xC01012, nEntries = 1;
+
+	SPEED_CHECK(_WriteTestProfile(sProfile, nGridPoints, nInputs, nOutputs));
+	SPEED_CHECK(_OpenColorLUT(&LUT, sProfile, "") == 0);
+	SPEED_CHECK(_HashColorProfile(sProfile, &nHash) == 0);
+	if (LUT.pHeader == NULL) {
+		remove(sProfile);
+		return;
+	}
+	SPEED_CHECK(LUT.nInputs == nInputs && LUT.nOutputs == nOutputs);
+	for (UINT8 ilp = 0; ilp < nInputs; ilp++)
+		nEntries *= nGridPoints;
+
+	for (UINT8 nBitDepth : { 8, 16 }) {
+		UINT32 nFullScale = (nBitDepth == 8) ? 255 : 65535, nNodeStep = nFullScale / (nGridPoints - 1);
+		std::vector<UINT16> Samples((size_t)nEntries * nInputs), Inks((size_t)nEntries * nOutputs);
+		std::vector<UINT8> Bytes(Samples.size());
+		const void* pBand = (nBitDepth == 8) ? (const void*)Bytes.data() : (const void*)Samples.data();
+		UINT32 nBadNodes = 0;
+
+		for (UINT32 elp = 0; elp < nEntries; elp++)							// Every node, one pixel each, in a single row
+			for (UINT32 ilp = 0, nRest = elp; ilp < nInputs; ilp++, nRest /= nGridPoints)
+				Samples[(size_t)elp * nInputs + ilp] = (UINT16)((nRest % nGridPoints) * nNodeStep);
+		for (size_t slp = 0; slp < Samples.size(); slp++)
+			Bytes[slp] = (UINT8)Samples[slp];
+		_ApplyColorLUTBand(&LUT, NULL, pBand, nBitDepth, false, (UINT16)nEntries, 1, Inks.data(), 4, NULL);
+		for (UINT32 elp = 0; elp < nEntries; elp++) {
+			UINT32 nIndex[4];
+
+			for (UINT8 ilp = 0; ilp < nInputs; ilp++)
+				nIndex[ilp] = Samples[(size_t)elp * nInputs + ilp] / nNodeStep;
+			for (UINT8 olp = 0; olp < nOutputs; olp++)
+				if (Inks[(size_t)olp * nEntries + elp] != _TestProfileInk(nIndex, nInputs, nGridPoints, olp))
+					nBadNodes++;
+		}
+		SPEED_CHECK(nBadNodes == 0);
+
+		const UINT16 nWidth = 500, nRows = 6;
+		std::vector<UINT16> Random((size_t)nWidth * nRows * nInputs), Band((size_t)nWidth * nRows * nOutputs), Row(Band.size());
+		std::vector<UINT8> RandomBytes(Random.size());
+		float dScale = (float)(nGridPoints - 1) / (float)nFullScale, dStep = 65535.F / (float)(nGridPoints - 1), dWorst = 0.F;
+
+		for (size_t plp = 0; plp < Random.size(); plp += nInputs) {			// Runs of 1 - 8 pixels of a color
+			UINT32 nRun = 1 + _TestRandom(&nState) % 8;
+
+			for (UINT8 ilp = 0; ilp < nInputs; ilp++)
+				Random[plp + ilp] = (UINT16)(_TestRandom(&nState) % (nFullScale + 1));
+			for (UINT32 rlp = 1; rlp < nRun && plp + nInputs < Random.size(); rlp++, plp += nInputs)
+				std::copy(Random.begin() + plp, Random.begin() + plp + nInputs, Random.begin() + plp + nInputs);
+		}
+		for (size_t slp = 0; slp < Random.size(); slp++)
+			RandomBytes[slp] = (UINT8)Random[slp];
+		pBand = (nBitDepth == 8) ? (const void*)RandomBytes.data() : (const void*)Random.data();
+		_ApplyColorLUTBand(&LUT, NULL, pBand, nBitDepth, false, nWidth, nRows, Band.data(), 4, NULL);
+
+		for (UINT16 rlp = 0; rlp < nRows; rlp++) {							// Same rows, no cache
+			const void* pInput[4];
+
+			for (UINT8 ilp = 0; ilp < nInputs; ilp++)
+				pInput[ilp] = (const UINT8*)pBand + (nBitDepth / 8) * ((size_t)rlp * nWidth * nInputs + ilp);
+			_ApplyColorLUTRow(&LUT, pInput, nBitDepth, nInputs, nWidth, 0, Row.data() + (size_t)rlp * nWidth,
+				(size_t)nRows * nWidth, NULL);
+		}
+		SPEED_CHECK(Band == Row);
+
+		for (size_t plp = 0; plp < (size_t)nWidth * nRows; plp++) {			// Inks 0 and 1 are planes through the nodes
+			const UINT16* pPixel = Random.data() + plp * nInputs;
+			float dInk0 = dStep * dScale * pPixel[0];
+			float dInk1 = dStep * dScale * (0.3F * pPixel[1] + 0.7F * pPixel[nInputs - 1]);
+
+			dWorst = max(dWorst, fabsf((float)Band[plp] - dInk0));
+			dWorst = max(dWorst, fabsf((float)Band[(size_t)nWidth * nRows + plp] - dInk1));
+		}
+		SPEED_CHECK(dWorst <= 1.5F);
+	}
+	_UnmapColorLUT(&LUT);
+	remove(_ColorLUTCachePath("", sProfile, nHash).c_str());
+	remove(sProfile);
+}
+
+// *********************************************************************************************************************************
+// _TestColorLUT() a 16 point RGB profile to 10 inks (two 8 ink passes) and a 6 point CMYK profile to 4 inks; grid nodes fall
+//  on whole 8 and 16-bit samples at both (255 and 65535 divide by 15 and by 5)
+//
+static void _TestColorLUT() {
+	_TestColorLUTProfile(16, 3, 10);
+	_TestColorLUTProfile(6, 4, 4);
+}
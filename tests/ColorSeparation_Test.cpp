@@ -0,0 +1,98 @@
+// ColorSeparation tests: whole RGB bands (8 and 16-bit, planar and pixel order, 4 and 6 inks) separated on every core, SSE2
+//  and color cache included, give exactly what the scalar _SeparatePixel() gives each pixel, for GCR, UCR and ink limit
+//  settings from none to heavy; and the scalar sums themselves hold to the rules at the top of ColorSeparation.cpp
+
+// *********************************************************************************************************************************
+// _TestSeparationBand() separates a band of random colors (in runs, so the cache is used, and with gray, white and black in
+//  it) and checks every pixel against _SeparatePixel(), and that inks past K are left at 0
+//
+static void _TestSeparationBand(const SeparationParams* pSeparation, UINT8 nBitDepth, bool bPlanar, UINT8 nColorChannels,
+	UINT32* pState) {
+
+	const UINT16 nWidth = 301, nRows = 5;										// Odd width, so the scalar tail runs too
+	UINT32 nFullScale = (nBitDepth == 8) ? 255 : 65535;
+	float dScale = 1.F / (float)nFullScale;										// Samples to 0. - 1., as the band is
+	std::vector<UINT16> RGB((size_t)nWidth * nRows * 3), CMYK((size_t)nWidth * nRows * nColorChannels, 0xFFFF);
+	std::vector<UINT8> RGBBytes(RGB.size());
+	SeparationStats Stats;
+	UINT32 nBadPixels = 0;
+
+	for (size_t plp = 0; plp < (size_t)nWidth * nRows; ) {				// Runs of 1 - 6 pixels of a color
+		UINT32 nRun = 1 + _TestRandom(pState) % 6, nKind = _TestRandom(pState) % 8;
+		UINT16 nColor[3];
+
+		for (UINT8 clp = 0; clp < 3; clp++)
+			nColor[clp] = (UINT16)(_TestRandom(pState) % (nFullScale + 1));
+		if (nKind == 0)														// Gray, white, black
+			nColor[1] = nColor[2] = nColor[0];
+		else if (nKind == 1)
+			nColor[0] = nColor[1] = nColor[2] = (UINT16)nFullScale;
+		else if (nKind == 2)
+			nColor[0] = nColor[1] = nColor[2] = 0;
+		for (UINT32 rlp = 0; rlp < nRun && plp < (size_t)nWidth * nRows; rlp++, plp++) {
+			for (UINT8 clp = 0; clp < 3; clp++) {
+				size_t nAt = bPlanar ? (size_t)clp * nWidth * nRows + plp : plp * 3 + clp;		// Rows are back to back
+				RGB[nAt] = nColor[clp];
+				RGBBytes[nAt] = (UINT8)nColor[clp];
+			}
+		}
+	}
+	_SeparateRGBBand(pSeparation, NULL, (nBitDepth == 8) ? (const void*)RGBBytes.data() : (const void*)RGB.data(), nBitDepth,
+		bPlanar, nWidth, nRows, nColorChannels, CMYK.data(), 3, &Stats);
+	SPEED_CHECK(Stats.nPixels == (UINT64)nWidth * nRows && Stats.nRunHits + Stats.nCacheHits > 0);
+
+	for (size_t plp = 0; plp < (size_t)nWidth * nRows; plp++) {
+		float dRGB[3];
+		UINT16 nExpected[4];
+		const UINT16* pPixel = CMYK.data() + plp * nColorChannels;
+
+		for (UINT8 clp = 0; clp < 3; clp++)
+			dRGB[clp] = dScale * (float)RGB[bPlanar ? (size_t)clp * nWidth * nRows + plp : plp * 3 + clp];
+		_SeparatePixel(pSeparation, dRGB[0], dRGB[1], dRGB[2], nExpected);
+		if (memcmp(pPixel, nExpected, sizeof(nExpected)) != 0)
+			nBadPixels++;
+		for (UINT8 clp = 4; clp < nColorChannels; clp++)
+			if (pPixel[clp] != 0)
+				nBadPixels++;
+	}
+	SPEED_CHECK(nBadPixels == 0);
+}
+
+// *********************************************************************************************************************************
+// _TestSeparation() every band layout at each setting; then the scalar sums: K is dGCR of the least of C, M and Y, dUCR of it
+//  comes off C, M and Y, and the total stays under the ink limit with K untouched
+//
+static void _TestSeparation() {
+	const float dSettings[][3] = {												// GCR, UCR, ink limit
+		{ 1.F, 1.F, 4.F }, { 0.F, 0.F, 4.F }, { 1.F, 0.F, 3.F }, { 0.5F, 0.8F, 2.6F }, { 0.7F, 1.F, 1.5F }, { 1.F, 1.F, 1.F } };
+	UINT32 nState = 0x5E9A;
+
+	for (const float* pSetting : dSettings) {
+		SeparationParams Separation;
+
+		Separation.dGCR = pSetting[0];
+		Separation.dUCR = pSetting[1];
+		Separation.dInkLimit = pSetting[2];
+		for (UINT8 nBitDepth : { 8, 16 })
+			for (bool bPlanar : { false, true })
+				for (UINT8 nColorChannels : { 4, 6 })
+					_TestSeparationBand(&Separation, nBitDepth, bPlanar, nColorChannels, &nState);
+
+		UINT32 nBadPixels = 0;
+		for (UINT32 plp = 0; plp < 20000; plp++) {
+			float dR = (float)(_TestRandom(&nState) % 1001) / 1000.F, dG = (float)(_TestRandom(&nState) % 1001) / 1000.F;
+			float dB = (float)(_TestRandom(&nState) % 1001) / 1000.F;
+			float dK = Separation.dGCR * (1.F - max(max(dR, dG), dB)), dRemove = Separation.dUCR * dK;
+			float dC = 1.F - dR - dRemove, dM = 1.F - dG - dRemove, dY = 1.F - dB - dRemove;
+			float dThin = min(1.F, max(Separation.dInkLimit - dK, 0.F) / max(dC + dM + dY, 1e-6F));
+			UINT16 nCMYK[4];
+
+			_SeparatePixel(&Separation, dR, dG, dB, nCMYK);
+			if (fabsf(nCMYK[3] - dK * 65535.F) > 1.F || fabsf(nCMYK[0] - dC * dThin * 65535.F) > 2.F ||
+				fabsf(nCMYK[1] - dM * dThin * 65535.F) > 2.F || fabsf(nCMYK[2] - dY * dThin * 65535.F) > 2.F ||
+				nCMYK[0] + nCMYK[1] + nCMYK[2] + nCMYK[3] > Separation.dInkLimit * 65535.F + 4.F)
+				nBadPixels++;
+		}
+		SPEED_CHECK(nBadPixels == 0);
+	}
+}
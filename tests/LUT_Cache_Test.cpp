@@ -0,0 +1,147 @@
+// LUT_Cache tests: a cache built from a calibration maps back with every ink's dot and error LUT as the calibration says
+//  (nearest measured dot, the rest of the level spread over the kernel), and files built for another kernel, dot size or
+//  version, with a different header size, a bad magic, too few inks or cut short are refused with EC(-93)
+
+// *********************************************************************************************************************************
+// _CopyTestLUTCache() copies the cache file sFrom to sTo, with nBytes bytes at nOffset replaced by pPatch and the file cut to
+//  nKeepBytes (0 = all of it)
+//
+static bool _CopyTestLUTCache(const char* sFrom, const char* sTo, size_t nOffset, const void* pPatch, size_t nBytes,
+	size_t nKeepBytes) {
+
+	FILE* pFrom = fopen(sFrom, "rb");
+	std::vector<UINT8> File;
+	int nByte;
+
+	if (pFrom == NULL)
+		return false;
+	while ((nByte = fgetc(pFrom)) != EOF)
+		File.push_back((UINT8)nByte);
+	fclose(pFrom);
+	if (nBytes > 0)
+		memcpy(File.data() + nOffset, pPatch, nBytes);
+	if (nKeepBytes > 0)
+		File.resize(nKeepBytes);
+
+	FILE* pTo = fopen(sTo, "wb");
+	if (pTo == NULL)
+		return false;
+	fwrite(File.data(), 1, File.size(), pTo);
+	fclose(pTo);
+	return true;
+}
+
+// *********************************************************************************************************************************
+// _TestLUTCacheBuild() builds a 2 ink, 4 dot level Floyd-Steinberg cache at 8 and 16 bits, maps and attaches it, and checks
+//  every entry against the nearest measured dot (ties go to the bigger dot) and the level left over, times each weight
+//
+static void _TestLUTCacheBuild() {
+	const float dDensity[2][4] = { { 0.F, 0.3F, 0.6F, 1.F }, { 0.F, 0.25F, 0.5F, 1.F } };
+	const char* sPath = "SPEEDLib_Test_LUTCache.lut";
+
+	for (UINT8 nBitDepth : { 8, 16 }) {
+		LUTCalibration Calibration;
+		EDParams Params;
+		LUTCache Cache;
+		float dMaxPixVal = (float)((1 << nBitDepth) - 1), dWorst = 0.F;
+		UINT32 nBadDots = 0;
+
+		SPEED_CHECK(_AddCalibrationInk(&Calibration, dDensity[0], 4, 1) == 0);
+		SPEED_CHECK(_AddCalibrationInk(&Calibration, dDensity[1], 4, 2) == 0);
+		Params.nEDKernelType = 1;
+		Params.nInputBitDepth = nBitDepth;
+		Params.nDotLevels = 4;
+		Params.nColorChannels = 2;
+		SPEED_CHECK(_BuildLUTCache(&Params, &Calibration, "", sPath, 4) == 0);
+		SPEED_CHECK(_MapLUTCache(&Cache, sPath, &Params) == 0);
+		if (Cache.pHeader == NULL)
+			continue;
+		SPEED_CHECK(Cache.pHeader->nEDKernelSize == 14 && Cache.pHeader->nEntries == (UINT32)1 << nBitDepth);
+		_AttachLUTCache(&Cache, &Params);
+
+		for (UINT8 ilp = 0; ilp < 2; ilp++) {
+			for (UINT32 vlp = 0; vlp <= (UINT32)dMaxPixVal; vlp++) {
+				const UINT8* pDot = Params.pInkDotLUT[ilp] + (size_t)vlp * 3;
+				const float* pTaps = Params.pInkErrorLUT[ilp] + (size_t)vlp * 14;
+				UINT8 nDot = 0;
+
+				for (UINT8 dlp = 1; dlp < 4; dlp++)								// Nearest dot, the bigger one on a tie
+					if (fabsf((float)vlp - dDensity[ilp][dlp] * dMaxPixVal) <=
+						fabsf((float)vlp - dDensity[ilp][nDot] * dMaxPixVal))
+						nDot = dlp;
+				if (pDot[0] != nDot || pDot[1] != 0 || pDot[2] != 0)
+					nBadDots++;
+
+				float dError = (float)vlp - dDensity[ilp][nDot] * dMaxPixVal;
+				for (UINT8 klp = 0; klp < 14; klp++) {							// 7/16 right, 3/16, 5/16 and 1/16 below
+					float dWeight = (klp == 4) ? 7.F : (klp == 9) ? 3.F : (klp == 10) ? 5.F : (klp == 11) ? 1.F : 0.F;
+					dWorst = max(dWorst, fabsf(pTaps[klp] - dError * dWeight / 16.F));
+				}
+			}
+		}
+		SPEED_CHECK(nBadDots == 0);
+		SPEED_CHECK(dWorst < 0.02F);
+
+		Params.nColorChannels = 1;												// Fewer inks than the file is fine
+		SPEED_CHECK(_MapLUTCache(&Cache, sPath, &Params) == 0);
+		_DetachLUTCache(&Params);
+		SPEED_CHECK(Params.pInkDotLUT[0] == NULL && Params.pInkErrorLUT[0] == NULL);
+		_UnmapLUTCache(&Cache);
+		SPEED_CHECK(Cache.pBase == NULL);
+	}
+	remove(sPath);
+}
+
+// *********************************************************************************************************************************
+// _TestLUTCacheMismatch() every file that was not built for the job, or not by this version, is refused rather than mapped
+//
+static void _TestLUTCacheMismatch() {
+	const float dDensity[3] = { 0.F, 0.5F, 1.F };
+	const char* sPath = "SPEEDLib_Test_LUTCache.lut";
+	const char* sBadPath = "SPEEDLib_Test_LUTCacheBad.lut";
+	LUTCalibration Calibration;
+	EDParams Params, Other;
+	LUTCache Cache;
+	UINT32 nVersion = LUT_CACHE_VERSION + 1, nHeaderBytes = sizeof(LUTCacheHeader) + 8;
+
+	SPEED_CHECK(_AddCalibrationInk(&Calibration, dDensity, 3, 1) == 0);
+	SPEED_CHECK(_AddCalibrationInk(&Calibration, dDensity, 3, 2) == 0);
+	Params.nEDKernelType = 9;
+	Params.nInputBitDepth = 8;
+	Params.nDotLevels = 3;
+	Params.nColorChannels = 2;
+	SPEED_CHECK(_BuildLUTCache(&Params, &Calibration, "", sPath, 1) == 0);
+	SPEED_CHECK(_MapLUTCache(&Cache, sPath, &Params) == 0);
+
+	Other = Params;
+	Other.nEDKernelType = 10;
+	SPEED_CHECK(_MapLUTCache(&Cache, sPath, &Other) == (-93) && Cache.pBase == NULL);
+	Other = Params;
+	Other.nInputBitDepth = 16;
+	SPEED_CHECK(_MapLUTCache(&Cache, sPath, &Other) == (-93));
+	Other = Params;
+	Other.nDotLevels = 4;
+	SPEED_CHECK(_MapLUTCache(&Cache, sPath, &Other) == (-93));
+	Other = Params;
+	Other.nColorChannels = 3;
+	SPEED_CHECK(_MapLUTCache(&Cache, sPath, &Other) == (-93));
+	SPEED_CHECK(_MapLUTCache(&Cache, "SPEEDLib_Test_NoSuchFile.lut", &Params) == (-93));
+
+	SPEED_CHECK(_CopyTestLUTCache(sPath, sBadPath, 8, &nVersion, 4, 0));
+	SPEED_CHECK(_MapLUTCache(&Cache, sBadPath, &Params) == (-93));
+	SPEED_CHECK(_CopyTestLUTCache(sPath, sBadPath, 12, &nHeaderBytes, 4, 0));
+	SPEED_CHECK(_MapLUTCache(&Cache, sBadPath, &Params) == (-93));
+	SPEED_CHECK(_CopyTestLUTCache(sPath, sBadPath, 0, "SPEEDLUX", 8, 0));
+	SPEED_CHECK(_MapLUTCache(&Cache, sBadPath, &Params) == (-93));
+	SPEED_CHECK(_CopyTestLUTCache(sPath, sBadPath, 0, NULL, 0, LUT_CACHE_PAGE * 3));		// Error LUTs cut off
+	SPEED_CHECK(_MapLUTCache(&Cache, sBadPath, &Params) == (-93));
+	SPEED_CHECK(_CopyTestLUTCache(sPath, sBadPath, 0, NULL, 0, 0));						// A plain copy still maps
+	SPEED_CHECK(_MapLUTCache(&Cache, sBadPath, &Params) == 0);
+	_UnmapLUTCache(&Cache);
+
+	Params.nDotLevels = 4;													// Calibration measured 3 dot levels
+	SPEED_CHECK(_BuildLUTCache(&Params, &Calibration, "", sBadPath, 1) == (-95));
+	SPEED_CHECK(_AddCalibrationInk(&Calibration, dDensity + 1, 2, 3) == (-95));			// Fewer levels than the others
+	remove(sPath);
+	remove(sBadPath);
+}
@@ -0,0 +1,197 @@
+// Orientation tests: every one of the 8 transforms (0 to 3 quarter turns, each mirrored or not) of a raw stream, a striped
+//  planar TIFF and a tiled TIFF, read band by band with _ReadOrientedImageBand(), puts every stored pixel where the table
+//  at the top of Orientation.cpp says; each is read again with a window of one band, so windows are refilled (and striped
+//  and raw images go through the spill file)
+
+// *********************************************************************************************************************************
+// _TestOrientSample() is the stored sample of channel nChannel at (nX, nY), different for every pixel and channel nearby
+//
+static UINT16 _TestOrientSample(UINT32 nX, UINT32 nY, UINT32 nChannel, UINT8 nBitDepth) {
+	UINT32 nSample = nX * 7 + nY * 13 + nChannel * 50 + (nX * nY) % 11;
+
+	return (UINT16)((nBitDepth == 16) ? (nSample * 257 + nY) & 0xFFFF : nSample & 0xFF);
+}
+
+// *********************************************************************************************************************************
+// _TestStoredPixel() is the stored pixel printed at (nX, nY) of a W x H image turned nQuarterTurns and (bMirror) mirrored
+//
+static void _TestStoredPixel(UINT32 nX, UINT32 nY, UINT32 nWidth, UINT32 nHeight, UINT8 nQuarterTurns, bool bMirror,
+	UINT32* pX, UINT32* pY) {
+
+	switch (nQuarterTurns * 2 + (bMirror ? 1 : 0)) {
+	case 0:		*pX = nX;					*pY = nY;					break;
+	case 1:		*pX = nWidth - 1 - nX;		*pY = nY;					break;
+	case 2:		*pX = nY;					*pY = nHeight - 1 - nX;		break;
+	case 3:		*pX = nY;					*pY = nX;					break;
+	case 4:		*pX = nWidth - 1 - nX;		*pY = nHeight - 1 - nY;		break;
+	case 5:		*pX = nX;					*pY = nHeight - 1 - nY;		break;
+	case 6:		*pX = nWidth - 1 - nY;		*pY = nX;					break;
+	default:	*pX = nWidth - 1 - nY;		*pY = nHeight - 1 - nX;
+	}
+}
+
+// *********************************************************************************************************************************
+// _WriteTestRaw() writes a raw stream, with its SPEEDRAW header, of W x H pixel order pixels
+//
+static bool _WriteTestRaw(const char* sPath, UINT32 nWidth, UINT32 nHeight, UINT8 nBitDepth, UINT8 nChannels) {
+	FILE* pFile = fopen(sPath, "wb");
+
+	if (pFile == NULL)
+		return false;
+	fprintf(pFile, "SPEEDRAW %u %u %u %u 300\n", nWidth, nHeight, nBitDepth, nChannels);
+	for (UINT32 rlp = 0; rlp < nHeight; rlp++) {
+		for (UINT32 clp = 0; clp < nWidth; clp++) {
+			for (UINT8 chn = 0; chn < nChannels; chn++) {
+				UINT16 nSample = _TestOrientSample(clp, rlp, chn, nBitDepth);
+
+				if (nBitDepth == 16)
+					fwrite(&nSample, 2, 1, pFile);
+				else
+					fputc((UINT8)nSample, pFile);
+			}
+		}
+	}
+	fclose(pFile);
+	return true;
+}
+
+// *********************************************************************************************************************************
+// _WriteTestTIFF() writes an uncompressed 8-bit CMYK TIFF of W x H pixels: planar in 16-row strips, or chunky 64 x 64 tiles
+//
+static bool _WriteTestTIFF(const char* sPath, UINT32 nWidth, UINT32 nHeight, bool bTiled) {
+	TIFF* pTIFF = TIFFOpen(sPath, "w");
+
+	if (pTIFF == NULL)
+		return false;
+	TIFFSetField(pTIFF, TIFFTAG_IMAGEWIDTH, nWidth);
+	TIFFSetField(pTIFF, TIFFTAG_IMAGELENGTH, nHeight);
+	TIFFSetField(pTIFF, TIFFTAG_SAMPLESPERPIXEL, 4);
+	TIFFSetField(pTIFF, TIFFTAG_BITSPERSAMPLE, 8);
+	TIFFSetField(pTIFF, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_SEPARATED);
+	TIFFSetField(pTIFF, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+	TIFFSetField(pTIFF, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
+	TIFFSetField(pTIFF, TIFFTAG_XRESOLUTION, 300.F);
+	TIFFSetField(pTIFF, TIFFTAG_YRESOLUTION, 300.F);
+
+	if (bTiled) {
+		std::vector<UINT8> Tile(64 * 64 * 4);
+
+		TIFFSetField(pTIFF, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+		TIFFSetField(pTIFF, TIFFTAG_TILEWIDTH, 64);
+		TIFFSetField(pTIFF, TIFFTAG_TILELENGTH, 64);
+		for (UINT32 nTileY = 0; nTileY < nHeight; nTileY += 64) {
+			for (UINT32 nTileX = 0; nTileX < nWidth; nTileX += 64) {
+				for (UINT32 rlp = 0; rlp < 64; rlp++)
+					for (UINT32 clp = 0; clp < 64; clp++)
+						for (UINT8 chn = 0; chn < 4; chn++)
+							Tile[(rlp * 64 + clp) * 4 + chn] = (UINT8)_TestOrientSample(nTileX + clp, nTileY + rlp, chn, 8);
+				TIFFWriteEncodedTile(pTIFF, TIFFComputeTile(pTIFF, nTileX, nTileY, 0, 0), Tile.data(), (tmsize_t)Tile.size());
+			}
+		}
+	}
+	else {
+		std::vector<UINT8> Strip((size_t)16 * nWidth);
+
+		TIFFSetField(pTIFF, TIFFTAG_PLANARCONFIG, PLANARCONFIG_SEPARATE);
+		TIFFSetField(pTIFF, TIFFTAG_ROWSPERSTRIP, 16);
+		for (UINT16 plp = 0; plp < 4; plp++) {
+			for (UINT32 nStripY = 0; nStripY < nHeight; nStripY += 16) {
+				UINT32 nRows = min(16u, nHeight - nStripY);
+
+				for (UINT32 rlp = 0; rlp < nRows; rlp++)
+					for (UINT32 clp = 0; clp < nWidth; clp++)
+						Strip[(size_t)rlp * nWidth + clp] = (UINT8)_TestOrientSample(clp, nStripY + rlp, plp, 8);
+				TIFFWriteEncodedStrip(pTIFF, TIFFComputeStrip(pTIFF, nStripY, plp), Strip.data(), (tmsize_t)nRows * nWidth);
+			}
+		}
+	}
+	TIFFClose(pTIFF);
+	return true;
+}
+
+// *********************************************************************************************************************************
+// _CheckOrientedImage() opens sPath (raw or TIFF) turned and mirrored as asked, reads every printed band and checks every
+//  sample; bOneBandWindow shrinks the window to one band once it is open, so it is refilled for every band
+//
+static void _CheckOrientedImage(const char* sPath, bool bRaw, UINT8 nQuarterTurns, bool bMirror, bool bOneBandWindow) {
+	std::unique_ptr<TIFFHeader> pHeader(new TIFFHeader);
+	TIFFHeader* MyHeader = pHeader.get();
+	INT16 nOpened;
+
+	MyHeader->strInputFile = sPath;
+	MyHeader->nHorizontalDPI = MyHeader->nVerticalDPI = 300;
+	MyHeader->nQuarterTurns = nQuarterTurns;
+	MyHeader->bMirror = bMirror;
+	nOpened = bRaw ? _OpenRawInputStream(MyHeader) : _GetInputImageDimensions(MyHeader);
+	SPEED_CHECK(nOpened == 0);
+	if (nOpened != 0) {
+		_CloseInputImage(MyHeader);
+		return;
+	}
+	if (bOneBandWindow && MyHeader->nOrientWindowRows > MyHeader->nOrientedBufferRows)
+		MyHeader->nOrientWindowRows = MyHeader->nOrientedBufferRows;		// The window buffer is only ever bigger
+
+	UINT32 nWidth = MyHeader->nInputImagePixelWidth, nHeight = MyHeader->nInputImagePixelHeight;
+	UINT32 nPrintedWidth = MyHeader->nOrientedPixelWidth, nPrintedHeight = MyHeader->nOrientedPixelHeight;
+	UINT8 nChannels = MyHeader->nInputColorChannels, nBitDepth = MyHeader->nImageBitDepth;
+	std::vector<UINT8> Band((size_t)MyHeader->nOrientedBufferRows * nPrintedWidth * nChannels * (nBitDepth / 8));
+	UINT32 nBadSamples = 0, nRowsRead = 0;
+	UINT8 nBandRows = 0;
+
+	SPEED_CHECK(nPrintedWidth == ((nQuarterTurns % 2 == 1) ? nHeight : nWidth));
+	for (UINT32 nRow = 0; nRow < nPrintedHeight; nRow += nBandRows) {
+		if (_ReadOrientedImageBand(MyHeader, Band.data(), nRow, &nBandRows) != 0 || nBandRows == 0) {
+			nBadSamples++;
+			break;
+		}
+		for (UINT32 rlp = 0; rlp < nBandRows; rlp++) {
+			for (UINT32 clp = 0; clp < nPrintedWidth; clp++) {
+				UINT32 nX, nY;
+
+				_TestStoredPixel(clp, nRow + rlp, nWidth, nHeight, nQuarterTurns, bMirror, &nX, &nY);
+				for (UINT8 chn = 0; chn < nChannels; chn++) {
+					size_t nAt = MyHeader->bInputPlanar ? ((size_t)chn * nBandRows + rlp) * nPrintedWidth + clp :
+						((size_t)rlp * nPrintedWidth + clp) * nChannels + chn;
+					UINT16 nSample = (nBitDepth == 16) ? ((const UINT16*)Band.data())[nAt] : Band[nAt];
+
+					if (nSample != _TestOrientSample(nX, nY, chn, nBitDepth))
+						nBadSamples++;
+				}
+			}
+		}
+		nRowsRead += nBandRows;
+	}
+	SPEED_CHECK(nBadSamples == 0);
+	SPEED_CHECK(nRowsRead == nPrintedHeight);
+	_CloseInputImage(MyHeader);
+}
+
+// *********************************************************************************************************************************
+// _TestOrientation() the 8 transforms of each test image, with the window it gets and with a one band window
+//
+static void _TestOrientation() {
+	const char* sRaw8 = "SPEEDLib_Test_Orient8.raw";
+	const char* sRaw16 = "SPEEDLib_Test_Orient16.raw";
+	const char* sStriped = "SPEEDLib_Test_OrientStriped.tif";
+	const char* sTiled = "SPEEDLib_Test_OrientTiled.tif";
+
+	SPEED_CHECK(_WriteTestRaw(sRaw8, 300, 600, 8, 4));
+	SPEED_CHECK(_WriteTestRaw(sRaw16, 130, 520, 16, 3));
+	SPEED_CHECK(_WriteTestTIFF(sStriped, 290, 500, false));
+	SPEED_CHECK(_WriteTestTIFF(sTiled, 300, 330, true));
+
+	for (UINT8 nQuarterTurns = 0; nQuarterTurns < 4; nQuarterTurns++) {
+		for (bool bMirror : { false, true }) {
+			for (bool bOneBandWindow : { false, true }) {
+				_CheckOrientedImage(sRaw8, true, nQuarterTurns, bMirror, bOneBandWindow);
+				_CheckOrientedImage(sRaw16, true, nQuarterTurns, bMirror, bOneBandWindow);
+				_CheckOrientedImage(sStriped, false, nQuarterTurns, bMirror, bOneBandWindow);
+				_CheckOrientedImage(sTiled, false, nQuarterTurns, bMirror, bOneBandWindow);
+			}
+		}
+	}
+	remove(sRaw8);
+	remove(sRaw16);
+	remove(sStriped);
+	remove(sTiled);
+}
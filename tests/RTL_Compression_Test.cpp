@@ -0,0 +1,145 @@
+// RTL_Compression tests: each encoder's output is decoded the way the printer does (PCL ESC*b1M, 2M and 3M) and must give
+//  back the row; rows are random bytes, long runs (past the 256 and 128 run limits), zero tails and all zero
+
+// *********************************************************************************************************************************
+// _DecodeRTLRunLength() method 1: (repeat count - 1, byte) pairs; the rest of the nBytes row is zero filled
+//
+static std::vector<UINT8> _DecodeRTLRunLength(const UINT8* pIn, UINT32 nIn, UINT32 nBytes) {
+	std::vector<UINT8> Row;
+
+	for (UINT32 nPos = 0; nPos + 1 < nIn; nPos += 2)
+		Row.insert(Row.end(), (size_t)pIn[nPos] + 1, pIn[nPos + 1]);
+	Row.resize(max((size_t)nBytes, Row.size()), 0);
+	return Row;
+}
+
+// *********************************************************************************************************************************
+// _DecodeRTLPackBits() method 2: 0 .. 127 = copy the next n + 1 bytes, -1 .. -127 = repeat the next byte 1 - n times,
+//  -128 = no operation; the rest of the nBytes row is zero filled
+//
+static std::vector<UINT8> _DecodeRTLPackBits(const UINT8* pIn, UINT32 nIn, UINT32 nBytes) {
+	std::vector<UINT8> Row;
+
+	for (UINT32 nPos = 0; nPos < nIn; ) {
+		INT8 nControl = (INT8)pIn[nPos++];
+
+		if (nControl >= 0) {
+			Row.insert(Row.end(), pIn + nPos, pIn + min(nIn, nPos + nControl + 1));
+			nPos += nControl + 1;
+		}
+		else if (nControl != -128 && nPos < nIn)
+			Row.insert(Row.end(), (size_t)(1 - nControl), pIn[nPos++]);
+	}
+	Row.resize(max((size_t)nBytes, Row.size()), 0);
+	return Row;
+}
+
+// *********************************************************************************************************************************
+// _DecodeRTLDeltaRow() method 3: replaces bytes of the seed row; command byte (count - 1) << 5 | offset, an offset of 31
+//  continues in the next bytes for as long as they are 255
+//
+static std::vector<UINT8> _DecodeRTLDeltaRow(const UINT8* pIn, UINT32 nIn, const std::vector<UINT8>& Seed) {
+	std::vector<UINT8> Row = Seed;
+	size_t nAt = 0;
+
+	for (UINT32 nPos = 0; nPos < nIn; ) {
+		UINT32 nCount = (pIn[nPos] >> 5) + 1, nOffset = pIn[nPos] & 31;
+
+		nPos++;
+		if (nOffset == 31) {
+			do
+				nOffset += pIn[nPos];
+			while (pIn[nPos++] == 255 && nPos < nIn);
+		}
+		nAt += nOffset;
+		for (UINT32 clp = 0; clp < nCount && nPos < nIn; clp++, nAt++, nPos++) {
+			if (nAt < Row.size())
+				Row[nAt] = pIn[nPos];
+		}
+	}
+	return Row;
+}
+
+// *********************************************************************************************************************************
+// _TestRTLRows() the rows every encoder is tried on: random, runs of up to 600 bytes, a zero tail and all zero
+//
+static std::vector<std::vector<UINT8>> _TestRTLRows() {
+	std::vector<std::vector<UINT8>> Rows;
+	UINT32 nState = 0x5EED;
+
+	for (UINT32 nBytes : { 1u, 2u, 3u, 15u, 16u, 17u, 127u, 128u, 129u, 255u, 256u, 257u, 1000u }) {
+		std::vector<UINT8> Random(nBytes), Runs, Tail(nBytes, 0), Zero(nBytes, 0);
+
+		for (UINT8& nByte : Random)
+			nByte = (UINT8)_TestRandom(&nState);
+		while (Runs.size() < nBytes) {										// Runs of 1 .. 600, some of them zero
+			UINT32 nRun = 1 + _TestRandom(&nState) % 600;
+			UINT8 nByte = (_TestRandom(&nState) % 3 == 0) ? 0 : (UINT8)_TestRandom(&nState);
+
+			Runs.insert(Runs.end(), min(nRun, nBytes - (UINT32)Runs.size()), nByte);
+		}
+		for (UINT32 blp = 0; blp < nBytes / 2; blp++)
+			Tail[blp] = (UINT8)(_TestRandom(&nState) | 1);
+		Rows.push_back(Random);
+		Rows.push_back(Runs);
+		Rows.push_back(Tail);
+		Rows.push_back(Zero);
+	}
+	return Rows;
+}
+
+// *********************************************************************************************************************************
+// _TestRTLRunLength() method 1 gives back every row, within its worst case size
+//
+static void _TestRTLRunLength() {
+	for (const std::vector<UINT8>& Row : _TestRTLRows()) {
+		std::vector<UINT8> Out(_RTLEncodedBufferSize((UINT32)Row.size()));
+		UINT32 nOut = _RTLEncodeRLE(Out.data(), Row.data(), (UINT32)Row.size());
+
+		SPEED_CHECK(nOut <= 2 * Row.size());
+		SPEED_CHECK(_DecodeRTLRunLength(Out.data(), nOut, (UINT32)Row.size()) == Row);
+	}
+}
+
+// *********************************************************************************************************************************
+// _TestRTLPackBits() method 2 gives back every row, within its worst case size
+//
+static void _TestRTLPackBits() {
+	for (const std::vector<UINT8>& Row : _TestRTLRows()) {
+		std::vector<UINT8> Out(_RTLEncodedBufferSize((UINT32)Row.size()));
+		UINT32 nOut = _RTLEncodePackBits(Out.data(), Row.data(), (UINT32)Row.size());
+
+		SPEED_CHECK(nOut <= Row.size() + Row.size() / 128 + 1);
+		SPEED_CHECK(_DecodeRTLPackBits(Out.data(), nOut, (UINT32)Row.size()) == Row);
+	}
+}
+
+// *********************************************************************************************************************************
+// _TestRTLDeltaRow() method 3 gives back every row against a random seed, an identical row encodes to nothing, and single
+//  changes at offsets either side of the 31 and 31 + 255 escapes land where they should
+//
+static void _TestRTLDeltaRow() {
+	std::vector<std::vector<UINT8>> Rows = _TestRTLRows();
+	UINT32 nState = 0xDE17A;
+
+	for (const std::vector<UINT8>& Row : Rows) {
+		std::vector<UINT8> Seed(Row), Out(_RTLEncodedBufferSize((UINT32)Row.size()));
+
+		for (size_t blp = 0; blp < Seed.size(); blp++)						// About one byte in four differs
+			if (_TestRandom(&nState) % 4 == 0)
+				Seed[blp] = (UINT8)_TestRandom(&nState);
+		UINT32 nOut = _RTLEncodeDeltaRow(Out.data(), Row.data(), Seed.data(), (UINT32)Row.size());
+		SPEED_CHECK(nOut <= _RTLEncodedBufferSize((UINT32)Row.size()));
+		SPEED_CHECK(_DecodeRTLDeltaRow(Out.data(), nOut, Seed) == Row);
+		SPEED_CHECK(_RTLEncodeDeltaRow(Out.data(), Row.data(), Row.data(), (UINT32)Row.size()) == 0);
+	}
+	for (UINT32 nOffset : { 0u, 1u, 30u, 31u, 32u, 285u, 286u, 287u, 540u, 541u, 542u, 900u }) {
+		std::vector<UINT8> Seed(2000, 0x55), Row(Seed), Out(_RTLEncodedBufferSize(2000));
+
+		Row[nOffset] = 0xAA;												// One change, then a second one as far on again
+		Row[2 * nOffset + 1] = 0xAB;
+		UINT32 nOut = _RTLEncodeDeltaRow(Out.data(), Row.data(), Seed.data(), 2000);
+		SPEED_CHECK(_DecodeRTLDeltaRow(Out.data(), nOut, Seed) == Row);
+		SPEED_CHECK((Out[0] & 31) == min(nOffset, 31u));
+	}
+}
@@ -0,0 +1,172 @@
+// Resampler tests: plans for box, bilinear and Lanczos3, enlarging and reducing, keep flat input flat and ramps straight;
+//  the horizontal fast paths match the plan they stand in for; and a page scaled band by band, with the row history the
+//  halftoner keeps, comes out bit for bit the same as the page scaled in one go, so band boundaries leave no seam
+
+static const UINT8 nTestFilters[] = { RESAMPLE_BOX, RESAMPLE_BILINEAR, RESAMPLE_LANCZOS3 };
+
+typedef struct TestResamplePlanData {
+	ResamplePlan Plan;
+	std::vector<INT32> First;
+	std::vector<float> Weight;
+} TestResamplePlan;
+
+// *********************************************************************************************************************************
+// _BuildTestPlan() sizes pTest's arrays and builds its plan, as _BuildResamplePlan() takes it
+//
+static void _BuildTestPlan(TestResamplePlan* pTest, UINT8 nFilter, UINT32 nIn, UINT32 nOut, UINT32 nFirstOutput,
+	UINT32 nOutputs, UINT32 nFirstInput, UINT32 nInputs) {
+
+	pTest->First.assign(max(nOutputs, (UINT32)1), 0);
+	pTest->Weight.assign((size_t)max(nOutputs, (UINT32)1) * _ResampleTaps(nFilter, nIn, nOut), 0.F);
+	pTest->Plan.pFirst = pTest->First.data();
+	pTest->Plan.pWeight = pTest->Weight.data();
+	_BuildResamplePlan(&pTest->Plan, nFilter, nIn, nOut, nFirstOutput, nOutputs, nFirstInput, nInputs);
+}
+
+// *********************************************************************************************************************************
+// _TestResamplePlans() every output's weights add up to 1 and read only input pixels; flat rows stay flat, 1:1 is a copy,
+//  a 4:1 box reduction is the mean of each 4 pixels and a 2x bilinear enlargement keeps a ramp straight
+//
+static void _TestResamplePlans() {
+	const UINT32 nSizes[][2] = { { 40, 100 }, { 100, 40 }, { 50, 150 }, { 64, 256 }, { 300, 299 }, { 7, 3 }, { 33, 33 } };
+
+	for (UINT8 nFilter : nTestFilters) {
+		for (const UINT32* pSize : nSizes) {
+			TestResamplePlan Test;
+			std::vector<float> Flat(pSize[0], 200.F), Ramp(pSize[0]), Out(pSize[1]);
+			float dWorst = 0.F;
+
+			_BuildTestPlan(&Test, nFilter, pSize[0], pSize[1], 0, pSize[1], 0, pSize[0]);
+			for (UINT32 olp = 0; olp < pSize[1]; olp++) {
+				double dSum = 0.;
+
+				for (UINT16 tlp = 0; tlp < Test.Plan.nTaps; tlp++)
+					dSum += Test.Weight[(size_t)tlp * pSize[1] + olp];
+				dWorst = max(dWorst, (float)fabs(dSum - 1.));
+				SPEED_CHECK(Test.First[olp] >= 0 && Test.First[olp] + Test.Plan.nTaps <= (INT32)pSize[0]);
+			}
+			SPEED_CHECK(dWorst < 1e-5F);
+
+			_ResampleAcross(&Test.Plan, Flat.data(), 255.F, Out.data());
+			for (float dOut : Out)
+				SPEED_CHECK(fabsf(dOut - 200.F) < 1e-3F);
+
+			for (UINT32 ilp = 0; ilp < pSize[0]; ilp++)
+				Ramp[ilp] = 10.F + 0.5F * (float)ilp;
+			_ResampleAcross(&Test.Plan, Ramp.data(), 255.F, Out.data());
+			if (pSize[0] == pSize[1]) {
+				for (UINT32 olp = 0; olp < pSize[1]; olp++)
+					SPEED_CHECK(Out[olp] == Ramp[olp]);
+			}
+		}
+	}
+
+	TestResamplePlan Box, Bilinear;
+	std::vector<float> Ramp(64), Out(256);
+
+	for (UINT32 ilp = 0; ilp < 64; ilp++)
+		Ramp[ilp] = 10.F + 3.F * (float)ilp;
+	_BuildTestPlan(&Box, RESAMPLE_BOX, 64, 16, 0, 16, 0, 64);
+	_ResampleAcross(&Box.Plan, Ramp.data(), 255.F, Out.data());
+	for (UINT32 olp = 0; olp < 16; olp++)									// Mean of 4 x, 4 x + 1, 4 x + 2, 4 x + 3
+		SPEED_CHECK(fabsf(Out[olp] - (10.F + 3.F * (4.F * olp + 1.5F))) < 1e-3F);
+
+	_BuildTestPlan(&Bilinear, RESAMPLE_BILINEAR, 64, 128, 0, 128, 0, 64);
+	_ResampleAcross(&Bilinear.Plan, Ramp.data(), 255.F, Out.data());
+	for (UINT32 olp = 1; olp < 127; olp++) {								// Output centre at input (x + 0.5) / 2 - 0.5
+		float dAt = ((float)olp + 0.5F) / 2.F - 0.5F;
+		SPEED_CHECK(fabsf(Out[olp] - min(10.F + 3.F * dAt, 255.F)) < 1e-3F);
+	}
+}
+
+// *********************************************************************************************************************************
+// _TestResampleFastPaths() the horizontal pass, spans included (copies, and the 2x to 4x bilinear phases), gives what the
+//  plan's weights do, summed the slow way, for whole enlargements and for the scales around them
+//
+static void _TestResampleFastPaths() {
+	UINT32 nState = 0xFA57;
+	bool bSpans[2] = {};													// A replicating and a phase span were tried
+
+	for (UINT8 nFilter : nTestFilters) {
+		for (UINT32 nIn : { 9u, 61u, 250u }) {
+			for (UINT32 nFactor : { 1u, 2u, 3u, 4u, 5u }) {
+				for (UINT32 nOut : { nIn * nFactor, nIn * nFactor + 1 }) {
+					TestResamplePlan Test;
+					std::vector<float> Row(nIn), Out(nOut);
+
+					for (float& dSample : Row)
+						dSample = (float)(_TestRandom(&nState) % 256);
+					_BuildTestPlan(&Test, nFilter, nIn, nOut, 0, nOut, 0, nIn);
+					if (Test.Plan.nFactor != 0)
+						bSpans[Test.Plan.bReplicate ? 0 : 1] = true;
+					_ResampleAcross(&Test.Plan, Row.data(), 255.F, Out.data());
+
+					for (UINT32 olp = 0; olp < nOut; olp++) {
+						double dSum = 0.;
+
+						for (UINT16 tlp = 0; tlp < Test.Plan.nTaps; tlp++)
+							dSum += (double)Test.Weight[(size_t)tlp * nOut + olp] * Row[Test.First[olp] + tlp];
+						SPEED_CHECK(fabs(Out[olp] - min(max(dSum, 0.), 255.)) < 1e-2);
+					}
+				}
+			}
+		}
+	}
+	SPEED_CHECK(bSpans[0] && bSpans[1]);
+}
+
+// *********************************************************************************************************************************
+// _TestResampleBands() scales a page (planar 8-bit, one channel) in bands of nBandRows, planning each band's rows the way
+//  _HalftoneBand() does (rows wait until every tap is in, the last rows read are kept as history), and in one go; the
+//  two pages must match bit for bit
+//
+static void _TestResampleBands() {
+	const UINT32 nWidth = 23, nHeight = 97, nOutWidth = 31;
+	UINT32 nState = 0xBA2D;
+	std::vector<UINT8> Page((size_t)nWidth * nHeight);
+
+	for (UINT32 rlp = 0; rlp < nHeight; rlp++)								// Smooth, with some noise on top
+		for (UINT32 clp = 0; clp < nWidth; clp++)
+			Page[(size_t)rlp * nWidth + clp] = (UINT8)min(255u, (rlp * 2 + clp * 5) % 200 + _TestRandom(&nState) % 40);
+
+	for (UINT8 nFilter : nTestFilters) {
+		for (UINT32 nOutHeight : { 19u, 40u, 97u, 194u, 250u }) {
+			for (UINT32 nBandRows : { 1u, 7u, 16u, 255u }) {
+				TestResamplePlan Columns, Rows;
+				UINT16 nHistoryMost = _ResampleTaps(nFilter, nHeight, nOutHeight);
+				std::vector<float> Whole((size_t)nOutHeight * nOutWidth), Banded(Whole.size()), ColumnRow(nWidth);
+				std::vector<UINT8> History((size_t)nHistoryMost * nWidth);
+				ResampleSource Source;
+				UINT32 nRowsIn = 0, nRowsOut = 0, nHistoryRows = 0;
+
+				_BuildTestPlan(&Columns, nFilter, nWidth, nOutWidth, 0, nOutWidth, 0, nWidth);
+				Source.nRowPitch = nWidth;
+
+				_BuildTestPlan(&Rows, nFilter, nHeight, nOutHeight, 0, nOutHeight, 0, nHeight);
+				Source.pSamples = Page.data();
+				for (UINT32 olp = 0; olp < nOutHeight; olp++)
+					_ResampleRow(&Source, &Rows.Plan, &Columns.Plan, olp, nWidth, 255.F, ColumnRow.data(),
+						Whole.data() + (size_t)olp * nOutWidth);
+
+				while (nRowsOut < nOutHeight) {
+					UINT32 nBand = min(nBandRows, nHeight - nRowsIn);
+					UINT32 nReady = _ResampleOutputsReady(nFilter, nHeight, nOutHeight, nRowsIn + nBand);
+
+					_BuildTestPlan(&Rows, nFilter, nHeight, nOutHeight, nRowsOut, nReady - nRowsOut, nRowsIn - nHistoryRows,
+						nHistoryRows + nBand);
+					Source.pSamples = Page.data() + (size_t)nRowsIn * nWidth;
+					Source.pHistory = History.data();
+					Source.nHistoryRows = nHistoryRows;
+					for (UINT32 olp = 0; olp < nReady - nRowsOut; olp++)
+						_ResampleRow(&Source, &Rows.Plan, &Columns.Plan, olp, nWidth, 255.F, ColumnRow.data(),
+							Banded.data() + (size_t)(nRowsOut + olp) * nOutWidth);
+					nRowsIn += nBand;
+					nRowsOut = nReady;
+					nHistoryRows = min(nRowsIn, (UINT32)nHistoryMost);				// The last rows read, oldest first
+					memcpy(History.data(), Page.data() + (size_t)(nRowsIn - nHistoryRows) * nWidth, (size_t)nHistoryRows * nWidth);
+				}
+				SPEED_CHECK(Banded == Whole);
+			}
+		}
+	}
+}
@@ -0,0 +1,94 @@
+// SPEEDLib_API tests: speed_config compatibility by struct_size (a version 1 config is read only as far as it goes, whatever
+//  follows it in the caller's memory; a full config is read and checked whole; anything shorter than version 1 is refused),
+//  and a small page through a context made from a version 1 config
+
+// *********************************************************************************************************************************
+// _TestAPIConfigSize() version 1, current and too short configs, each followed by garbage where the newer fields would be
+//
+static void _TestAPIConfigSize() {
+	speed_config Config;
+	speed_context* pContext = NULL;
+	EDParams Defaults;
+
+	SPEED_CHECK(speed_api_version() == SPEEDLIB_API_VERSION && SPEEDLIB_API_VERSION == 2);
+	speed_default_config(&Config);
+	SPEED_CHECK(Config.struct_size == sizeof(speed_config));
+	SPEED_CHECK(SPEEDLIB_CONFIG_SIZE_V1 < sizeof(speed_config));
+
+	Config.threads = 2;
+	memset((UINT8*)&Config + SPEEDLIB_CONFIG_SIZE_V1, 0xEE, sizeof(speed_config) - SPEEDLIB_CONFIG_SIZE_V1);
+	Config.struct_size = SPEEDLIB_CONFIG_SIZE_V1;							// An old caller: the 0xEE is not its memory
+	SPEED_CHECK(speed_create(&Config, &pContext) == 0 && pContext != NULL);
+	if (pContext != NULL) {
+		const EDParams* pParams = &pContext->Context.Params;
+
+		SPEED_CHECK(pParams->nResampleFilter == Defaults.nResampleFilter);
+		SPEED_CHECK(pParams->Decode.nColorSpace == Defaults.Decode.nColorSpace);
+		SPEED_CHECK(pParams->Separation.dGCR == Defaults.Separation.dGCR && pParams->Separation.dUCR == Defaults.Separation.dUCR &&
+			pParams->Separation.dInkLimit == Defaults.Separation.dInkLimit);
+		SPEED_CHECK(pContext->Context.Arena.nHugePageMode == ED_HUGE_PAGES_OFF);
+		SPEED_CHECK(pParams->nEDKernelType == Config.kernel_type && pParams->nColorChannels == Config.color_channels);
+		speed_destroy(pContext);
+	}
+
+	Config.struct_size = sizeof(speed_config);								// Same bytes, but now they are fields
+	SPEED_CHECK(speed_create(&Config, &pContext) == (-85) && pContext == NULL);
+	SPEED_CHECK(strstr(speed_last_error(NULL), "EC(-85)") != NULL);
+
+	for (UINT32 nSize : { 0u, 4u, (UINT32)SPEEDLIB_CONFIG_SIZE_V1 - 1 }) {
+		Config.struct_size = nSize;
+		SPEED_CHECK(speed_create(&Config, &pContext) == (-85) && pContext == NULL);
+	}
+	SPEED_CHECK(speed_create(NULL, &pContext) == (-85) && pContext == NULL);
+
+	speed_default_config(&Config);											// The newer fields, when they are there, are used
+	Config.threads = 2;
+	Config.gcr = 0.5F;
+	Config.ink_limit = 2.8F;
+	Config.resample_filter = RESAMPLE_LANCZOS3;
+	SPEED_CHECK(speed_create(&Config, &pContext) == 0 && pContext != NULL);
+	if (pContext != NULL) {
+		SPEED_CHECK(pContext->Context.Params.Separation.dGCR == 0.5F && pContext->Context.Params.Separation.dInkLimit == 2.8F);
+		SPEED_CHECK(pContext->Context.Params.nResampleFilter == RESAMPLE_LANCZOS3);
+		speed_destroy(pContext);
+	}
+}
+
+// *********************************************************************************************************************************
+// _TestAPIPage() a context from a version 1 config halftones a 2x page in two bands: every output row comes back, once, and a
+//  band past the end of the page is refused
+//
+static void _TestAPIPage() {
+	const UINT32 nWidth = 40, nHeight = 30, nBandRows = 16;
+	speed_config Config;
+	speed_context* pContext = NULL;
+	speed_rows Rows;
+	std::vector<UINT8> Page((size_t)nWidth * nHeight * 4, 0x80);
+	UINT32 nRowsOut = 0;
+
+	speed_default_config(&Config);
+	Config.struct_size = SPEEDLIB_CONFIG_SIZE_V1;
+	Config.threads = 2;
+	SPEED_CHECK(speed_create(&Config, &pContext) == 0 && pContext != NULL);
+	if (pContext == NULL)
+		return;
+
+	size_t nDotBytes, nErrorFloats;
+	SPEED_CHECK(speed_lut_sizes(pContext, &nDotBytes, &nErrorFloats) == 0);
+	std::vector<UINT8> DotLUT(nDotBytes, 0);
+	std::vector<float> ErrorLUT(nErrorFloats, 0.F);
+	SPEED_CHECK(speed_set_luts(pContext, DotLUT.data(), ErrorLUT.data()) == 0);
+
+	SPEED_CHECK(speed_begin_page(pContext, nWidth, nHeight, nBandRows, 4, 8, 0, nWidth * 2, nHeight * 2) == 0);
+	for (UINT32 nRow = 0; nRow < nHeight; nRow += nBandRows) {
+		UINT32 nBand = min(nBandRows, nHeight - nRow);
+
+		SPEED_CHECK(speed_submit_band(pContext, Page.data() + (size_t)nRow * nWidth * 4, nBand, &Rows) == 0);
+		nRowsOut += Rows.rows;
+		SPEED_CHECK(Rows.width >= nWidth * 2 && Rows.planes[0] != NULL && Rows.planes[3] != NULL);
+	}
+	SPEED_CHECK(nRowsOut == nHeight * 2);
+	SPEED_CHECK(speed_submit_band(pContext, Page.data(), 1, &Rows) == (-87));
+	SPEED_CHECK(speed_end_page(pContext) == 0);
+	speed_destroy(pContext);
+}
@@ -0,0 +1,66 @@
+// SPEEDLib behavior tests: one program over the library and its C API, built like SPEEDLib_API.cpp (same include path,
+//  OpenMP and SSE settings); each module's tests are in their own *_Test.cpp, included below and run in order from main()
+// Returns the number of failed checks, so 0 = all passed; every failed check is reported to stderr with its file and line
+
+#include "../SPEEDLib_API.cpp"
+#include <iostream>
+#include <vector>
+
+static int nTestFailures = 0;												// Failed SPEED_CHECK()s, all tests
+
+#define SPEED_CHECK(bCondition) do { if (!(bCondition)) { nTestFailures++;											\
+	std::wcerr << __FILE__ << "(" << __LINE__ << "): " << #bCondition << std::endl; } } while (0)
+
+// *********************************************************************************************************************************
+// _TestRandom() is a small repeatable generator (xorshift32), so every run tests the same rows
+//
+static UINT32 _TestRandom(UINT32* pState) {
+	*pState ^= *pState << 13;
+	*pState ^= *pState >> 17;
+	*pState ^= *pState << 5;
+	return *pState;
+}
+
+#include "RTL_Compression_Test.cpp"
+#include "Resampler_Test.cpp"
+#include "Orientation_Test.cpp"
+#include "LUT_Cache_Test.cpp"
+#include "ColorLUT_Test.cpp"
+#include "ColorSeparation_Test.cpp"
+#include "TransferCurves_Test.cpp"
+#include "SPEEDLib_API_Test.cpp"
+
+typedef struct SPEEDTestCase {
+	const char* sName;
+	void (*pTest)();
+} SPEEDTest;
+
+static const SPEEDTest Tests[] = {
+	{ "RTL run-length round trip",				_TestRTLRunLength },
+	{ "RTL PackBits round trip",				_TestRTLPackBits },
+	{ "RTL delta row round trip",				_TestRTLDeltaRow },
+	{ "Resampler plans",						_TestResamplePlans },
+	{ "Resampler fast paths",					_TestResampleFastPaths },
+	{ "Resampler across band boundaries",		_TestResampleBands },
+	{ "Orientation, all 8 transforms",			_TestOrientation },
+	{ "LUT cache build and map",				_TestLUTCacheBuild },
+	{ "LUT cache mismatches refused",			_TestLUTCacheMismatch },
+	{ "Color LUT simplex interpolation",		_TestColorLUT },
+	{ "GCR / UCR / ink limit separation",		_TestSeparation },
+	{ "Transfer curve LUTs",					_TestTransferLUTs },
+	{ "Transfer curves in the resampler",		_TestTransferResample },
+	{ "Transfer curve files",					_TestTransferCurveFile },
+	{ "C API config struct_size",				_TestAPIConfigSize },
+	{ "C API page from a version 1 config",		_TestAPIPage },
+};
+
+int main() {
+	for (const SPEEDTest& Test : Tests) {
+		int nFailuresBefore = nTestFailures;
+
+		Test.pTest();
+		std::wcerr << (nTestFailures == nFailuresBefore ? "pass  " : "FAIL  ") << Test.sName << std::endl;
+	}
+	std::wcerr << nTestFailures << " failed check(s)" << std::endl;
+	return nTestFailures;
+}
@@ -0,0 +1,137 @@
+// TransferCurves tests: transfer LUTs hit every curve point and interpolate linearly between them, an identity curve is the
+//  plain 8 to 16-bit promotion, the resampler reads samples through the LUT in place of that promotion, and bad curve files
+//  are refused with EC(-97)
+
+// *********************************************************************************************************************************
+// _TestTransferLUTs() 2 to 256 point curves at every sample and diffusion bit depth: within 1 of the curve, linear between
+//  points, exact at the points that fall on whole samples, and stopping at an ink limit if the curve does
+//
+static void _TestTransferLUTs() {
+	const float dIdentity[2] = { 0.F, 1.F }, dGain[4] = { 0.F, 0.45F, 0.8F, 0.9F };
+	std::vector<float> dWiggle(256);
+	UINT32 nState = 0x7C0B;
+
+	for (float& dLevel : dWiggle)
+		dLevel = (float)(_TestRandom(&nState) % 10001) / 10000.F;
+
+	for (UINT8 nImageBitDepth : { 8, 16 }) {
+		for (UINT16 nMaxPixVal : { 255, 65535 }) {
+			UINT32 nEntries = (UINT32)1 << nImageBitDepth;
+			std::vector<UINT16> LUT(nEntries);
+			TransferCurves Curves;
+			float dWorst = 0.F;
+
+			if (nMaxPixVal < nEntries - 1)										// Diffusion is never shallower
+				continue;
+			SPEED_CHECK(_AddTransferCurve(&Curves, dIdentity, 2, 1) == 0);
+			SPEED_CHECK(_AddTransferCurve(&Curves, dGain, 4, 2) == (-97));		// Every ink has the same points
+			Curves = TransferCurves();
+			SPEED_CHECK(_AddTransferCurve(&Curves, dGain, 4, 1) == 0);
+			_BuildTransferLUT(&Curves, 0, nImageBitDepth, nMaxPixVal, LUT.data());
+			for (UINT32 plp = 0; plp < 4; plp++)								// 255 and 65535 are 3 steps of 85 and 21845
+				SPEED_CHECK(LUT[plp * (nEntries - 1) / 3] == (UINT16)lrintf(dGain[plp] * nMaxPixVal));
+			SPEED_CHECK(LUT[nEntries - 1] == (UINT16)lrintf(0.9F * nMaxPixVal));	// The ink limit
+			for (UINT32 elp = 1; elp < nEntries; elp++)
+				SPEED_CHECK(LUT[elp] >= LUT[elp - 1]);
+
+			Curves = TransferCurves();
+			SPEED_CHECK(_AddTransferCurve(&Curves, dIdentity, 2, 1) == 0);
+			_BuildTransferLUT(&Curves, 0, nImageBitDepth, nMaxPixVal, LUT.data());
+			for (UINT32 elp = 0; elp < nEntries; elp++)							// Same as promoting with a multiply
+				dWorst = max(dWorst, fabsf((float)LUT[elp] - (float)elp * nMaxPixVal / (float)(nEntries - 1)));
+			SPEED_CHECK(dWorst <= 0.5F);
+
+			for (UINT16 nPoints : { 2, 3, 17, 100, 256 }) {						// Linear between the points
+				Curves = TransferCurves();
+				SPEED_CHECK(_AddTransferCurve(&Curves, dWiggle.data(), nPoints, 1) == 0);
+				_BuildTransferLUT(&Curves, 0, nImageBitDepth, nMaxPixVal, LUT.data());
+				dWorst = 0.F;
+				for (UINT32 elp = 0; elp < nEntries; elp++) {
+					double dPoint = (double)elp * (nPoints - 1) / (nEntries - 1);
+					UINT32 nPoint = min((UINT32)dPoint, (UINT32)nPoints - 2);
+					double dLevel = dWiggle[nPoint] + (dPoint - nPoint) * (dWiggle[nPoint + 1] - dWiggle[nPoint]);
+
+					dWorst = max(dWorst, (float)fabs(LUT[elp] - dLevel * nMaxPixVal));
+				}
+				SPEED_CHECK(dWorst <= 1.F);
+			}
+		}
+	}
+}
+
+// *********************************************************************************************************************************
+// _TestTransferResample() a band read 1:1 through a transfer LUT gives the LUT of every sample, and through an identity LUT
+//  gives exactly what the x 257 promotion does, 8-bit pixel order CMYK into 16-bit diffusion
+//
+static void _TestTransferResample() {
+	const UINT32 nWidth = 37, nHeight = 9;
+	const float dIdentity[2] = { 0.F, 1.F }, dCurve[5] = { 0.F, 0.18F, 0.42F, 0.7F, 0.92F };
+	std::vector<UINT8> Page((size_t)nWidth * nHeight * 4);
+	std::vector<UINT16> Identity(256), Curve(256);
+	std::vector<float> ColumnRow(nWidth), Promoted(nWidth), Looked(nWidth), Curved(nWidth);
+	TestResamplePlan Columns, Rows;
+	TransferCurves Curves;
+	ResampleSource Source;
+	UINT32 nState = 0x7C0C, nBad = 0;
+
+	for (UINT8& nSample : Page)
+		nSample = (UINT8)_TestRandom(&nState);
+	SPEED_CHECK(_AddTransferCurve(&Curves, dIdentity, 2, 1) == 0);
+	_BuildTransferLUT(&Curves, 0, 8, 65535, Identity.data());
+	Curves = TransferCurves();
+	SPEED_CHECK(_AddTransferCurve(&Curves, dCurve, 5, 1) == 0);
+	_BuildTransferLUT(&Curves, 0, 8, 65535, Curve.data());
+
+	_BuildTestPlan(&Columns, RESAMPLE_BILINEAR, nWidth, nWidth, 0, nWidth, 0, nWidth);
+	_BuildTestPlan(&Rows, RESAMPLE_BILINEAR, nHeight, nHeight, 0, nHeight, 0, nHeight);
+	Source.nRowPitch = (size_t)nWidth * 4;
+	Source.nStride = 4;
+	for (UINT8 clp = 0; clp < 4; clp++) {
+		Source.pSamples = Page.data() + clp;
+		for (UINT32 rlp = 0; rlp < nHeight; rlp++) {
+			Source.pTransferLUT = NULL;
+			Source.dScale = 257.F;
+			_ResampleRow(&Source, &Rows.Plan, &Columns.Plan, rlp, nWidth, 65535.F, ColumnRow.data(), Promoted.data());
+			Source.pTransferLUT = Identity.data();
+			_ResampleRow(&Source, &Rows.Plan, &Columns.Plan, rlp, nWidth, 65535.F, ColumnRow.data(), Looked.data());
+			Source.pTransferLUT = Curve.data();
+			_ResampleRow(&Source, &Rows.Plan, &Columns.Plan, rlp, nWidth, 65535.F, ColumnRow.data(), Curved.data());
+			SPEED_CHECK(Looked == Promoted);
+			for (UINT32 plp = 0; plp < nWidth; plp++)
+				if (Curved[plp] != (float)Curve[Page[((size_t)rlp * nWidth + plp) * 4 + clp]])
+					nBad++;
+		}
+	}
+	SPEED_CHECK(nBad == 0);
+}
+
+// *********************************************************************************************************************************
+// _TestTransferCurveFile() a curve file with comments and blank lines is read ink by ink; files with a level out of range,
+//  inks of different lengths, one point or no inks at all are refused
+//
+static void _TestTransferCurveFile() {
+	const char* sPath = "SPEEDLib_Test_Curves.txt";
+	const char* sFiles[] = {
+		"# Press A\n\n0.0 0.2 0.5 1.0\n  0 0.25 0.5 0.75\n",
+		"0.0 0.2 1.2\n",
+		"0.0 0.5 1.0\n0.0 1.0\n",
+		"0.5\n",
+		"# Nothing\n\n" };
+	TransferCurves Curves;
+
+	for (UINT8 flp = 0; flp < _countof(sFiles); flp++) {
+		FILE* pFile = fopen(sPath, "w");
+
+		SPEED_CHECK(pFile != NULL);
+		if (pFile == NULL)
+			return;
+		fputs(sFiles[flp], pFile);
+		fclose(pFile);
+		SPEED_CHECK(_ReadTransferCurves(&Curves, sPath) == ((flp == 0) ? 0 : (-97)));
+		if (flp == 0)
+			SPEED_CHECK(Curves.nInks == 2 && Curves.nPoints == 4 && Curves.dLevel[0][1] == 0.2F &&
+				Curves.dLevel[1][3] == 0.75F);
+	}
+	SPEED_CHECK(_ReadTransferCurves(&Curves, "SPEEDLib_Test_NoSuchFile.txt") == (-97));
+	remove(sPath);
+}